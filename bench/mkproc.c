@@ -0,0 +1,449 @@
+/*
+ * mkproc.c -- make up a /proc tree to benchmark against.
+ *
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ *
+ * usage:  bench/mkproc [-n procs] [-c cmdline] [-t threads] [-s seed] dir
+ *
+ * Writes `procs' processes (default 1000) into dir, which must not exist
+ * yet:  each has stat, statm, status, cmdline (about `cmdline' bytes of
+ * it, default 100), environ and cgroup, and a task directory with
+ * `threads' threads (default 1;  kernel threads keep to one), each again
+ * with stat, statm, status and cgroup.  The formats are those of a 6.x kernel, as in
+ * bench/samples.  Alongside go the stat, uptime, loadavg, meminfo and
+ * vmstat that sysinfo.c reads, so that with PROCPS_ROOT=dir every tool
+ * sees this machine instead of the real one.
+ *
+ * Processes hang off a random earlier one (the first is init, the second
+ * kthreadd and the parent of the kernel threads), so `ps f' has a forest
+ * of some depth to draw.  The same seed makes the same tree.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define HZ       100
+#define UPTIME   864000		/* ten days, in seconds */
+#define BTIME    1700000000
+
+typedef struct task {
+    int pid, ppid, pgrp, session, tty, tpgid;
+    int uid, gid;
+    int kthread;
+    int nlwp;			/* threads, kernel threads having one */
+    int pod;			/* its cgroup, -1 for the root */
+    char state;
+    const char *comm;
+    unsigned long utime, stime, start;
+    unsigned long vsize, rss;	/* bytes, pages */
+} task;
+
+static const char *comms[] = {
+    "bash", "sshd", "nginx", "postgres", "python3", "java", "cron",
+    "sleep", "rsyslogd", "dbus-daemon", "node", "containerd-shim",
+    "a-name-of-15-ch",
+};
+#define COMMS  (int)(sizeof comms / sizeof *comms)
+
+static const char *kcomms[] = {
+    "kworker/0:1", "ksoftirqd/0", "rcu_sched", "migration/0", "kswapd0",
+};
+#define KCOMMS  (int)(sizeof kcomms / sizeof *kcomms)
+
+/* 1000 and up aren't in most passwd files, which name lookups should
+ * also be timed at */
+static const int uids[] = { 0, 0, 0, 1, 33, 65534, 1000, 1001, 1002 };
+#define UIDS  (int)(sizeof uids / sizeof *uids)
+
+static unsigned long long seed = 1;
+
+static unsigned rnd(unsigned n) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return n ? (unsigned)(seed >> 11) % n : 0;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static void put(const char *dir, const char *name, const char *buf, int len) {
+    char path[4096];
+    int fd;
+
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1
+     || write(fd, buf, len) != len || close(fd) == -1)
+	die(path);
+}
+
+static void dir(const char *path) {
+    if (mkdir(path, 0755) == -1)
+	die(path);
+}
+
+/*********************************************************************/
+
+static void put_stat(const char *d, const task *t, int pid, int threads) {
+    char buf[1024];
+    unsigned long code = 0x560000000000UL + (unsigned long)t->pid * 0x10000;
+    int n;
+
+    n = sprintf(buf,
+	"%d (%s) %c %d %d %d %d %d %u %lu 0 %lu 0 %lu %lu 0 0 20 0 %d 0 %lu "
+	"%lu %lu 18446744073709551615 %lu %lu %lu 0 0 0 0 0 0 1 0 0 17 %u 0 0 "
+	"0 0 0 %lu %lu %lu %lu %lu %lu %lu 0\n",
+	pid, t->comm, t->state, t->ppid, t->pgrp, t->session, t->tty,
+	t->tty ? t->tpgid : -1, t->kthread ? 0x208040u : 0x400100u,
+	100UL + t->pid % 5000, (unsigned long)t->pid % 50,
+	t->utime, t->stime, threads, t->start,
+	t->vsize, t->rss,
+	t->kthread ? 0 : code, t->kthread ? 0 : code + 0x4000,
+	t->kthread ? 0 : 0x7ffc00000000UL + (unsigned long)t->pid * 0x100,
+	rnd(8),
+	t->kthread ? 0 : code + 0x8000, t->kthread ? 0 : code + 0x9000,
+	t->kthread ? 0 : code + 0x500000,
+	t->kthread ? 0 : 0x7ffc00001000UL, t->kthread ? 0 : 0x7ffc00001100UL,
+	t->kthread ? 0 : 0x7ffc00001100UL, t->kthread ? 0 : 0x7ffc00002000UL);
+    put(d, "stat", buf, n);
+}
+
+static void put_statm(const char *d, const task *t) {
+    char buf[128];
+    int n;
+
+    n = sprintf(buf, "%lu %lu %lu 5 0 %lu 0\n", t->vsize / 4096, t->rss,
+		t->rss * 3 / 4, t->vsize / 4096 / 8);
+    put(d, "statm", buf, n);
+}
+
+static void put_status(const char *d, const task *t, int pid, int threads) {
+    static const char *states[] = { "R (running)", "S (sleeping)",
+	"D (disk sleep)", "Z (zombie)", "T (stopped)", "I (idle)" };
+    const char *state = strchr("RSDZTI", t->state)
+			? states[strchr("RSDZTI", t->state) - "RSDZTI"] : states[1];
+    char buf[4096];
+    int n;
+
+    n = sprintf(buf,
+	"Name:\t%s\n"
+	"Umask:\t0022\n"
+	"State:\t%s\n"
+	"Tgid:\t%d\n"
+	"Ngid:\t0\n"
+	"Pid:\t%d\n"
+	"PPid:\t%d\n"
+	"TracerPid:\t0\n"
+	"Uid:\t%d\t%d\t%d\t%d\n"
+	"Gid:\t%d\t%d\t%d\t%d\n"
+	"FDSize:\t64\n"
+	"Groups:\t \n"
+	"NStgid:\t%d\n"
+	"NSpid:\t%d\n"
+	"NSpgid:\t%d\n"
+	"NSsid:\t%d\n"
+	"Kthread:\t%d\n",
+	t->comm, state, t->pid, pid, t->ppid,
+	t->uid, t->uid, t->uid, t->uid, t->gid, t->gid, t->gid, t->gid,
+	t->pid, pid, t->pgrp, t->session, t->kthread);
+    if (!t->kthread)		/* kernel threads have no Vm* lines */
+	n += sprintf(buf + n,
+	    "VmPeak:\t%8lu kB\n"
+	    "VmSize:\t%8lu kB\n"
+	    "VmLck:\t       0 kB\n"
+	    "VmPin:\t       0 kB\n"
+	    "VmHWM:\t%8lu kB\n"
+	    "VmRSS:\t%8lu kB\n"
+	    "RssAnon:\t%8lu kB\n"
+	    "RssFile:\t%8lu kB\n"
+	    "RssShmem:\t       0 kB\n"
+	    "VmData:\t%8lu kB\n"
+	    "VmStk:\t     132 kB\n"
+	    "VmExe:\t      20 kB\n"
+	    "VmLib:\t    1528 kB\n"
+	    "VmPTE:\t      44 kB\n"
+	    "VmSwap:\t       0 kB\n"
+	    "HugetlbPages:\t       0 kB\n",
+	    t->vsize / 1024, t->vsize / 1024, t->rss * 4, t->rss * 4,
+	    t->rss, t->rss * 3, t->vsize / 1024 / 8);
+    n += sprintf(buf + n,
+	"CoreDumping:\t0\n"
+	"THP_enabled:\t1\n"
+	"untag_mask:\t0xffffffffffffffff\n"
+	"Threads:\t%d\n"
+	"SigQ:\t0/23961\n"
+	"SigPnd:\t0000000000000000\n"
+	"ShdPnd:\t0000000000000000\n"
+	"SigBlk:\t0000000000000000\n"
+	"SigIgn:\t%016x\n"
+	"SigCgt:\t%016x\n"
+	"CapInh:\t0000000000000000\n"
+	"CapPrm:\t000001fffeffffff\n"
+	"CapEff:\t000001fffeffffff\n"
+	"CapBnd:\t000001fffeffffff\n"
+	"CapAmb:\t0000000000000000\n"
+	"NoNewPrivs:\t0\n"
+	"Seccomp:\t0\n"
+	"Seccomp_filters:\t0\n"
+	"Speculation_Store_Bypass:\tthread vulnerable\n"
+	"SpeculationIndirectBranch:\tconditional enabled\n"
+	"Cpus_allowed:\tff\n"
+	"Cpus_allowed_list:\t0-7\n"
+	"Mems_allowed:\t00000000,00000001\n"
+	"Mems_allowed_list:\t0\n"
+	"voluntary_ctxt_switches:\t%lu\n"
+	"nonvoluntary_ctxt_switches:\t%lu\n",
+	threads, t->kthread ? 0xffffffffu : 0x1000u, t->kthread ? 0 : 0x4a03u,
+	t->utime * 7, t->stime);
+    put(d, "status", buf, n);
+}
+
+/* "/usr/bin/comm --option=... --option=..." up to about `len' bytes */
+static void put_cmdline(const char *d, const task *t, int len) {
+    char *buf = malloc(len + 64);
+    int n;
+
+    if (!buf)
+	die("malloc");
+    n = sprintf(buf, "/usr/bin/%s", t->comm) + 1;
+    while (n < len)
+	n += sprintf(buf + n, "--option-%u=%u", rnd(100), rnd(1000000)) + 1;
+    put(d, "cmdline", buf, t->kthread ? 0 : n);
+    free(buf);
+}
+
+/* cgroup v2, as on a Kubernetes node:  pods under kubepods.slice */
+static void put_cgroup(const char *d, const task *t) {
+    char buf[128];
+    int n;
+
+    if (t->pod < 0)
+	n = sprintf(buf, "0::/\n");
+    else
+	n = sprintf(buf, "0::/kubepods.slice/kubepods-pod%04d.slice/cri-containerd-%08x.scope\n",
+		    t->pod, t->pod * 2654435761u);
+    put(d, "cgroup", buf, n);
+}
+
+static void put_environ(const char *d, const task *t) {
+    static const char env[] =
+	"PATH=/usr/local/bin:/usr/bin:/bin\0HOME=/root\0TERM=xterm\0LANG=C\0";
+
+    put(d, "environ", env, t->kthread ? 0 : (int)sizeof env - 1);
+}
+
+/*********************************************************************/
+/* the machine-wide files */
+
+static void put_system(const char *root, int procs, int running) {
+    char buf[8192];
+    long cpus = sysconf(_SC_NPROCESSORS_CONF), c;
+    unsigned long tick = (unsigned long)UPTIME * HZ;
+    int n;
+
+    if (cpus < 1)
+	cpus = 1;
+    /* 10% user, 1% nice, 4% system, the rest idle */
+    n = sprintf(buf, "cpu  %lu %lu %lu %lu 1000 0 500 0 0 0\n", cpus * tick / 10,
+		cpus * tick / 100, cpus * tick / 25, cpus * tick * 85 / 100);
+    for (c = 0; c < cpus && n < (int)sizeof buf - 300; c++)
+	n += sprintf(buf + n, "cpu%ld %lu %lu %lu %lu %lu 0 %lu 0 0 0\n", c,
+		     tick / 10, tick / 100, tick / 25, tick * 85 / 100,
+		     1000 / cpus, 500 / cpus);
+    n += sprintf(buf + n,
+	"intr 123456789 0\n"
+	"ctxt 987654321\n"
+	"btime %d\n"
+	"processes %d\n"
+	"procs_running %d\n"
+	"procs_blocked 0\n"
+	"softirq 12345678 0\n", BTIME, procs * 3, running);
+    put(root, "stat", buf, n);
+
+    n = sprintf(buf, "%d.00 %lu.00\n", UPTIME, cpus * UPTIME * 85 / 100);
+    put(root, "uptime", buf, n);
+
+    n = sprintf(buf, "0.52 0.58 0.59 %d/%d %d\n", running, procs, procs * 3);
+    put(root, "loadavg", buf, n);
+
+    n = sprintf(buf,
+	"MemTotal:       16384000 kB\n"
+	"MemFree:         4096000 kB\n"
+	"MemAvailable:   10240000 kB\n"
+	"Buffers:          512000 kB\n"
+	"Cached:          6144000 kB\n"
+	"SwapCached:            0 kB\n"
+	"Active:          7168000 kB\n"
+	"Inactive:        4096000 kB\n"
+	"HighTotal:             0 kB\n"
+	"HighFree:              0 kB\n"
+	"LowTotal:       16384000 kB\n"
+	"LowFree:         4096000 kB\n"
+	"SwapTotal:       2097152 kB\n"
+	"SwapFree:        2097152 kB\n"
+	"Dirty:              1024 kB\n"
+	"Writeback:             0 kB\n"
+	"Mapped:          1024000 kB\n"
+	"Slab:             512000 kB\n"
+	"Committed_AS:    8192000 kB\n"
+	"PageTables:        65536 kB\n"
+	"VmallocTotal:   34359738367 kB\n"
+	"VmallocUsed:       65536 kB\n"
+	"VmallocChunk:          0 kB\n");
+    put(root, "meminfo", buf, n);
+
+    n = sprintf(buf,
+	"nr_dirty 256\n"
+	"nr_writeback 0\n"
+	"nr_mapped 256000\n"
+	"nr_page_table_pages 16384\n"
+	"nr_slab 128000\n"
+	"pgpgin 12345678\n"
+	"pgpgout 23456789\n"
+	"pswpin 0\n"
+	"pswpout 0\n"
+	"pgalloc 345678901\n"
+	"pgfree 345690000\n"
+	"pgactivate 1234567\n"
+	"pgdeactivate 234567\n"
+	"pgfault 456789012\n"
+	"pgmajfault 12345\n"
+	"pgrefill 0\n"
+	"pgsteal 0\n"
+	"kswapd_steal 0\n"
+	"pageoutrun 0\n"
+	"allocstall 0\n");
+    put(root, "vmstat", buf, n);
+}
+
+/*********************************************************************/
+
+int main(int argc, char *argv[]) {
+    int procs = 1000, cmdlen = 100, threads = 1, running = 0;
+    int c, i, j;
+    char path[4096], tpath[4096 + 16];
+    task *tt;
+
+    while ((c = getopt(argc, argv, "n:c:t:s:")) != -1)
+	switch (c) {
+	case 'n': procs = atoi(optarg);  break;
+	case 'c': cmdlen = atoi(optarg); break;
+	case 't': threads = atoi(optarg); break;
+	case 's': seed = strtoull(optarg, NULL, 0) | 1; break;
+	default:  goto usage;
+	}
+    if (optind != argc - 1 || procs < 2 || cmdlen < 0 || threads < 1) {
+    usage:
+	fprintf(stderr, "usage: %s [-n procs] [-c cmdline] [-t threads] [-s seed] dir\n",
+		argv[0]);
+	return 2;
+    }
+    /* never write over a real tree, such as /proc itself */
+    if (mkdir(argv[optind], 0755) == -1)
+	die(argv[optind]);
+
+    if (!(tt = calloc(procs, sizeof *tt)))
+	die("calloc");
+    for (i = 0; i < procs; i++) {
+	task *t = &tt[i];
+
+	/* each gets `threads' ids in a row, the first being its pid */
+	t->pid = 1 + i * threads;
+	if (i == 0) {
+	    t->ppid = 0;
+	    t->comm = "systemd";
+	} else if (i == 1) {
+	    t->ppid = 0;
+	    t->comm = "kthreadd";
+	    t->kthread = 1;
+	} else if (rnd(20) == 0) {
+	    t->ppid = tt[1].pid;
+	    t->comm = kcomms[rnd(KCOMMS)];
+	    t->kthread = 1;
+	} else {
+	    int up;
+	    do			/* anyone but kthreadd and its children */
+		up = rnd(i);
+	    while (tt[up].kthread);
+	    t->ppid = tt[up].pid;
+	    t->comm = comms[rnd(COMMS)];
+	}
+	if (t->kthread || i == 0) {
+	    t->uid = t->gid = 0;
+	    t->pgrp = t->session = i == 0 ? t->pid : 0;
+	} else {
+	    task *up = &tt[(t->ppid - 1) / threads];
+	    t->uid = uids[rnd(UIDS)];
+	    t->gid = t->uid;
+	    if (rnd(4)) {		/* mostly the parent's job and session */
+		t->pgrp = up->pgrp;
+		t->session = up->session;
+		t->tty = up->tty;
+		t->tpgid = up->tpgid;
+	    } else {
+		t->pgrp = t->session = t->pid;
+		if (rnd(2)) {		/* ...or a new login on a pty */
+		    t->tty = 136 << 8 | rnd(64);
+		    t->tpgid = t->pid;
+		}
+	    }
+	}
+	t->nlwp = t->kthread ? 1 : threads;
+	/* mostly the parent's pod:  worked out rather than drawn, so that
+	   rnd() makes the same tree of a seed whether or not it's used */
+	if (t->kthread || i == 0)
+	    t->pod = -1;
+	else if (i % 4 && tt[(t->ppid - 1) / threads].pod >= 0)
+	    t->pod = tt[(t->ppid - 1) / threads].pod;
+	else
+	    t->pod = (i * 2654435761u >> 8) % 40;
+	c = rnd(100);
+	t->state = c < 2 ? 'R' : c < 3 ? 'D' : c < 4 ? 'Z' : t->kthread ? 'I' : 'S';
+	running += t->state == 'R';
+	t->utime = rnd(100) < 90 ? rnd(100) : rnd(1000000);
+	t->stime = t->utime / 4 + rnd(50);
+	t->start = i < 2 ? 5 + i : 10 + (unsigned long)i * ((UPTIME - 1) * HZ / procs);
+	t->vsize = t->kthread ? 0 : 4096UL * (512 + rnd(1 << 20));
+	t->rss = t->kthread ? 0 : 64 + rnd(t->vsize / 4096 / 4);
+    }
+
+    put_system(argv[optind], procs * threads, running);
+    for (i = 0; i < procs; i++) {
+	task *t = &tt[i];
+
+	snprintf(path, sizeof path, "%s/%d", argv[optind], t->pid);
+	dir(path);
+	put_stat(path, t, t->pid, t->nlwp);
+	put_statm(path, t);
+	put_status(path, t, t->pid, t->nlwp);
+	put_cmdline(path, t, cmdlen);
+	put_environ(path, t);
+	put_cgroup(path, t);
+	snprintf(path, sizeof path, "%s/%d/task", argv[optind], t->pid);
+	dir(path);
+	for (j = 0; j < t->nlwp; j++) {
+	    snprintf(tpath, sizeof tpath, "%s/%d", path, t->pid + j);
+	    dir(tpath);
+	    put_stat(tpath, t, t->pid + j, t->nlwp);
+	    put_statm(tpath, t);
+	    put_status(tpath, t, t->pid + j, t->nlwp);
+	    put_cgroup(tpath, t);
+	}
+    }
+    free(tt);
+    return 0;
+}
@@ -0,0 +1,316 @@
+/*
+ * parse.c -- the old sscanf() parsers of /proc/#/stat, statm and status
+ * against the hand-written ones in readproc.c, on the captured samples.
+ *
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ *
+ * usage:  bench/parse [-n loops] bench/samples/...
+ *
+ * A sample is parsed as stat, statm or status according to its suffix.
+ * Each is first run through both parsers, and any field they disagree on
+ * is reported (the exit status is then 1);  then each parser is timed.
+ */
+
+/* the new parsers are static, so take them along with everything else */
+#include "../proc/readproc.c"
+#include <time.h>
+
+/*********************************************************************/
+/* The old parsers, as they were before the hand-written ones, except that
+ * old_status2proc() no longer crashes on a 15 character name.
+ */
+
+static void old_status2proc (char* S, proc_t* P, int fill) {
+    char* tmp;
+    if (fill == 1) {
+        memset(P->cmd, 0, sizeof P->cmd);
+        sscanf (S, "Name:\t%15c", P->cmd);
+        tmp = strchr(P->cmd,'\n');
+        if (tmp) *tmp='\0';
+        tmp = strstr (S,"State");
+        if (tmp) sscanf (tmp, "State:\t%c", &P->state);
+    }
+
+    tmp = strstr (S,"Pid:");
+    if(tmp) sscanf (tmp,
+        "Pid:\t%d\n"
+        "PPid:\t%d\n",
+        &P->pid,
+        &P->ppid
+    );
+    else fprintf(stderr, "Internal error!\n");
+
+    tmp = strstr (S,"Uid:");
+    if(tmp) sscanf (tmp,
+        "Uid:\t%d\t%d\t%d\t%d",
+        &P->ruid, &P->euid, &P->suid, &P->fuid
+    );
+    else fprintf(stderr, "Internal error!\n");
+
+    tmp = strstr (S,"Gid:");
+    if(tmp) sscanf (tmp,
+        "Gid:\t%d\t%d\t%d\t%d",
+        &P->rgid, &P->egid, &P->sgid, &P->fgid
+    );
+    else fprintf(stderr, "Internal error!\n");
+
+    tmp = strstr (S,"VmSize:");
+    if(tmp) sscanf (tmp,
+        "VmSize: %lu kB\n"
+        "VmLck: %lu kB\n"
+        "VmRSS: %lu kB\n"
+        "VmData: %lu kB\n"
+        "VmStk: %lu kB\n"
+        "VmExe: %lu kB\n"
+        "VmLib: %lu kB\n",
+        &P->vm_size, &P->vm_lock, &P->vm_rss, &P->vm_data,
+        &P->vm_stack, &P->vm_exe, &P->vm_lib
+    );
+    else /* looks like an annoying kernel thread */
+    {
+        P->vm_size  = 0;
+        P->vm_lock  = 0;
+        P->vm_rss   = 0;
+        P->vm_data  = 0;
+        P->vm_stack = 0;
+        P->vm_exe   = 0;
+        P->vm_lib   = 0;
+    }
+
+    tmp = strstr (S,"SigPnd:");
+    if(tmp) sscanf (tmp,
+#ifdef SIGNAL_STRING
+        "SigPnd: %s SigBlk: %s SigIgn: %s %*s %s",
+        P->signal, P->blocked, P->sigignore, P->sigcatch
+#else
+        "SigPnd: %Lx SigBlk: %Lx SigIgn: %Lx %*s %Lx",
+        &P->signal, &P->blocked, &P->sigignore, &P->sigcatch
+#endif
+    );
+    else fprintf(stderr, "Internal error!\n");
+}
+
+static void old_stat2proc(char* S, proc_t* P) {
+    char* tmp = strrchr(S, ')');	/* split into "PID (cmd" and "<rest>" */
+    if (!tmp) return;
+    *tmp = '\0';			/* replace trailing ')' with NUL */
+    /* fill in default values for older kernels */
+    P->exit_signal = SIGCHLD;
+    P->processor = 0;
+    P->rtprio = -1;
+    P->sched = -1;
+    /* parse these two strings separately, skipping the leading "(". */
+    memset(P->cmd, 0, sizeof P->cmd);	/* clear even though *P xcalloc'd ?! */
+    sscanf(S, "%d (%15c", &P->pid, P->cmd);   /* comm[16] in kernel */
+    sscanf(tmp + 2,			/* skip space after ')' too */
+       "%c "
+       "%d %d %d %d %d "
+       "%lu %lu %lu %lu %lu "
+       "%Lu %Lu %Lu %Lu "  /* utime stime cutime cstime */
+       "%ld %ld %ld %ld "
+       "%Lu "  /* start_time */
+       "%lu "
+       "%ld "
+       "%lu %lu %lu %lu %lu %lu "
+       "%*s %*s %*s %*s " /* discard, no RT signals & Linux 2.1 used hex */
+       "%lu %lu %lu "
+       "%d %d "
+       "%lu %lu",
+       &P->state,
+       &P->ppid, &P->pgrp, &P->session, &P->tty, &P->tpgid,
+       &P->flags, &P->min_flt, &P->cmin_flt, &P->maj_flt, &P->cmaj_flt,
+       &P->utime, &P->stime, &P->cutime, &P->cstime,
+       &P->priority, &P->nice, &P->timeout, &P->it_real_value,
+       &P->start_time,
+       &P->vsize,
+       &P->rss,
+       &P->rss_rlim, &P->start_code, &P->end_code, &P->start_stack, &P->kstk_esp, &P->kstk_eip,
+       &P->wchan, &P->nswap, &P->cnswap,
+       &P->exit_signal, &P->processor,
+       &P->rtprio, &P->sched
+    );
+    if (P->tty == 0)
+	P->tty = -1;  /* the old notty val, update elsewhere bef. moving to 0 */
+}
+
+static void old_statm2proc(char* s, proc_t* P) {
+    sscanf(s, "%ld %ld %ld %ld %ld %ld %ld",
+	   &P->size, &P->resident, &P->share,
+	   &P->trs, &P->lrs, &P->drs, &P->dt);
+}
+
+/*********************************************************************/
+
+enum { T_STAT, T_STATM, T_STATUS, TYPES };
+static const char *type_names[TYPES] = { "stat", "statm", "status" };
+
+typedef struct sample {
+    const char *path;
+    int type;
+    int len;
+    char text[4096];
+} sample;
+
+static void new_status(char *S, proc_t *P) { status2proc(S, P, 1, PROC_FILLSTATUS); }
+static void new_stat(char *S, proc_t *P)   { stat2proc(S, P); }
+static void new_statm(char *S, proc_t *P)  { statm2proc(S, P); }
+static void old_status(char *S, proc_t *P) { old_status2proc(S, P, 1); }
+
+static void (*const old_parse[TYPES])(char *, proc_t *) =
+    { old_stat2proc, old_statm2proc, old_status };
+static void (*const new_parse[TYPES])(char *, proc_t *) =
+    { new_stat, new_statm, new_status };
+
+static FILE *out;		/* stdout;  parse errors go to /dev/null */
+static int differ;
+
+static void report(const sample *s, const char *field, const char *o, const char *n) {
+    fprintf(out, "%s: %s differs:  old \"%s\"  new \"%s\"\n", s->path, field, o, n);
+    differ = 1;
+}
+
+#define NUM(f) do { \
+    if (o->f != n->f) { \
+	char ob[32], nb[32]; \
+	sprintf(ob, "%lld", (long long) o->f); \
+	sprintf(nb, "%lld", (long long) n->f); \
+	report(s, #f, ob, nb); \
+    } \
+} while (0)
+#define STR(f) do { \
+    if (strcmp(o->f, n->f)) report(s, #f, o->f, n->f); \
+} while (0)
+
+static void compare(const sample *s, const proc_t *o, const proc_t *n) {
+    switch (s->type) {
+    case T_STAT:
+	NUM(pid); STR(cmd); NUM(state);
+	NUM(ppid); NUM(pgrp); NUM(session); NUM(tty); NUM(tpgid);
+	NUM(flags); NUM(min_flt); NUM(cmin_flt); NUM(maj_flt); NUM(cmaj_flt);
+	NUM(utime); NUM(stime); NUM(cutime); NUM(cstime);
+	NUM(priority); NUM(nice); NUM(timeout); NUM(it_real_value);
+	NUM(start_time); NUM(vsize); NUM(rss); NUM(rss_rlim);
+	NUM(start_code); NUM(end_code); NUM(start_stack);
+	NUM(kstk_esp); NUM(kstk_eip); NUM(wchan); NUM(nswap); NUM(cnswap);
+	NUM(exit_signal); NUM(processor); NUM(rtprio); NUM(sched);
+	break;
+    case T_STATM:
+	NUM(size); NUM(resident); NUM(share); NUM(trs); NUM(lrs);
+	NUM(drs); NUM(dt);
+	break;
+    case T_STATUS:
+	STR(cmd); NUM(state); NUM(pid); NUM(ppid);
+	NUM(ruid); NUM(euid); NUM(suid); NUM(fuid);
+	NUM(rgid); NUM(egid); NUM(sgid); NUM(fgid);
+	NUM(vm_size); NUM(vm_lock);
+	/* the old format strings can't get past VmPin and ShdPnd, which
+	   newer kernels put between the lines they expect */
+	if (strstr(s->text, "VmPin:") || strstr(s->text, "ShdPnd:"))
+	    break;
+	NUM(vm_rss); NUM(vm_data); NUM(vm_stack); NUM(vm_exe); NUM(vm_lib);
+	STR(signal); STR(blocked); STR(sigignore); STR(sigcatch);
+	break;
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* average ns per parse, over `loops' passes through the samples of a type */
+static double timed(void (*parse)(char *, proc_t *), const sample *ss, int count,
+		    int type, int loops) {
+    char buf[4096];
+    proc_t p;
+    double t0;
+    int i, j, done = 0;
+
+    t0 = now();
+    for (i = 0; i < loops; i++)
+	for (j = 0; j < count; j++) {
+	    if (ss[j].type != type)
+		continue;
+	    memcpy(buf, ss[j].text, ss[j].len + 1);
+	    parse(buf, &p);
+	    done++;
+	}
+    return done ? (now() - t0) * 1e9 / done : 0;
+}
+
+static int load(sample *s, const char *path) {
+    const char *dot = strrchr(path, '.');
+    int fd, n;
+
+    s->path = path;
+    for (s->type = 0; s->type < TYPES; s->type++)
+	if (dot && !strcmp(dot + 1, type_names[s->type]))
+	    break;
+    if (s->type == TYPES) {
+	fprintf(out, "%s: not a .stat, .statm or .status sample\n", path);
+	return 0;
+    }
+    if ((fd = open(path, O_RDONLY)) == -1) {
+	perror(path);
+	return 0;
+    }
+    n = read(fd, s->text, sizeof s->text - 1);
+    close(fd);
+    s->len = n > 0 ? n : 0;
+    s->text[s->len] = '\0';
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    sample *ss;
+    int count = 0, loops = 100000, type, i;
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+	loops = atoi(argv[2]);
+	argc -= 2;
+	argv += 2;
+    }
+    if (argc < 2) {
+	fprintf(stderr, "usage: %s [-n loops] sample...\n", argv[0]);
+	return 2;
+    }
+    /* both parsers complain about missing lines on stderr -- which is
+       expected of the truncated samples, and too much of it when timed */
+    out = fdopen(dup(1), "w");
+    freopen("/dev/null", "w", stderr);
+
+    ss = xcalloc(NULL, (argc - 1) * sizeof *ss);
+    for (i = 1; i < argc; i++)
+	if (load(&ss[count], argv[i]))
+	    count++;
+
+    for (i = 0; i < count; i++) {
+	char buf[4096];
+	proc_t o, n;
+	memset(&o, 0, sizeof o);
+	memset(&n, 0, sizeof n);
+	memcpy(buf, ss[i].text, ss[i].len + 1);
+	old_parse[ss[i].type](buf, &o);
+	memcpy(buf, ss[i].text, ss[i].len + 1);
+	new_parse[ss[i].type](buf, &n);
+	compare(&ss[i], &o, &n);
+    }
+    fprintf(out, "%d samples, %s\n", count, differ ? "some DIFFER" : "all agree");
+
+    for (type = 0; type < TYPES; type++) {
+	double o = timed(old_parse[type], ss, count, type, loops);
+	double n = timed(new_parse[type], ss, count, type, loops);
+	if (o && n)
+	    fprintf(out, "%-7s old %7.1f ns   new %7.1f ns   %5.1fx\n",
+		    type_names[type], o, n, o / n);
+    }
+    fclose(out);
+    return differ;
+}
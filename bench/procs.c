@@ -0,0 +1,222 @@
+/*
+ * procs.c -- time libproc's passes over a whole /proc tree, and the tools
+ * that are built on them.
+ *
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ *
+ * usage:  bench/procs [-n loops] dir [command...]
+ *
+ * dir is a tree made by bench/mkproc (or /proc itself, for a look at the
+ * real thing).  Each pass -- listing the pids, parsing stat, status with
+ * the user and group names, cmdline, every thread, a whole table read
+ * plainly and in parallel, and a ps-style sort of it -- is run `loops'
+ * times (default 10) and the best time reported.  Then each command is
+ * run through sh with PROCPS_ROOT=dir and its output thrown away, which
+ * times what the library can't be timed alone at:  ps's forest and
+ * output, top's frame and so on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "procps.h"
+#include "readproc.h"
+#include "compare.h"
+
+static int loops = 10;
+static int tasks;		/* the last pass's count, for the ns/task */
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, double best, int n) {
+    printf("%-10s %9.2f ms", what, best * 1e3);
+    if (n)
+	printf("  %7.0f ns/task  (%d)", best * 1e9 / n, n);
+    putchar('\n');
+}
+
+/* best of `loops' runs of pass() */
+static void timed(const char *what, int (*pass)(void)) {
+    double t0, t, best = 0;
+    int i;
+
+    for (i = 0; i < loops; i++) {
+	t0 = now();
+	tasks = pass();
+	t = now() - t0;
+	if (!i || t < best)
+	    best = t;
+    }
+    report(what, best, tasks);
+}
+
+/*********************************************************************/
+
+static int pass_scan(void) {
+    pidscan_t *ps = pidscan_open(proc_root());
+    int n = 0;
+
+    if (!ps)
+	return 0;
+    while (pidscan_next(ps))
+	n++;
+    pidscan_close(ps);
+    return n;
+}
+
+/* a pass with openproc(flags) into one proc_t, for what allocates nothing */
+static int reread(int flags) {
+    PROCTAB *PT = openproc(flags);
+    proc_t p;
+    int n = 0;
+
+    if (!PT)
+	return 0;
+    memset(&p, 0, sizeof p);
+    while (readproc(PT, &p))
+	n++;
+    closeproc(PT);
+    return n;
+}
+
+static int pass_stat(void)    { return reread(PROC_FILLSTAT); }
+static int pass_status(void)  { return reread(PROC_FILLSTATUS); }
+static int pass_names(void)   { return reread(PROC_FILLSTATUS | PROC_FILLUSR | PROC_FILLGRP); }
+static int pass_threads(void) { return reread(PROC_FILLSTAT | PROC_TASKS); }
+
+static int pass_cmdline(void) {
+    PROCTAB *PT = openproc(PROC_FILLSTAT | PROC_FILLCOM);
+    proc_t *p;
+    int n = 0;
+
+    if (!PT)
+	return 0;
+    while ((p = readproc(PT, NULL))) {
+	freeproc(p);
+	n++;
+    }
+    closeproc(PT);
+    return n;
+}
+
+/* what `ps aux' asks for */
+#define TABLE_FLAGS  (PROC_FILLSTAT | PROC_FILLMEM | PROC_FILLCOM | PROC_FILLUSR)
+
+static int freetab(proc_t **tab) {
+    int n;
+
+    if (!tab)
+	return 0;
+    for (n = 0; tab[n]; n++)
+	freeproc(tab[n]);
+    free(tab);
+    return n;
+}
+
+static int pass_table(void)    { return freetab(readproctab(TABLE_FLAGS)); }
+static int pass_parallel(void) { return freetab(readproctab_parallel(TABLE_FLAGS, 0)); }
+
+/* `ps --sort=user,-utime,pid', each pass from the table as read */
+static proc_t **sorted, **unsorted;
+static int nsorted;
+
+static int pass_sort(void) {
+    memcpy(sorted, unsorted, nsorted * sizeof *sorted);
+    qsort(sorted, nsorted, sizeof *sorted,
+	  (int (*)(const void*, const void*))mult_lvl_cmp);
+    return nsorted;
+}
+
+/*********************************************************************/
+
+/* best wall time and best cpu time (user + system) apart, since top, for
+ * one, sleeps a second before its first frame */
+static void command(const char *cmd) {
+    double t0, t, c, best = 0, cpu = 0;
+    struct rusage ru;
+    int i, status, fd;
+    pid_t pid;
+
+    for (i = 0; i < loops; i++) {
+	t0 = now();
+	if ((pid = fork()) == 0) {
+	    if ((fd = open("/dev/null", O_WRONLY)) != -1) {
+		dup2(fd, 1);
+		dup2(fd, 2);
+	    }
+	    execl("/bin/sh", "sh", "-c", cmd, (char*)NULL);
+	    _exit(127);
+	}
+	if (pid == -1 || wait4(pid, &status, 0, &ru) == -1) {
+	    perror(cmd);
+	    return;
+	}
+	t = now() - t0;
+	c = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+	  + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) > 1) {
+	    printf("%s: failed (status %d)\n", cmd, status);
+	    return;
+	}
+	if (!i || t < best)
+	    best = t;
+	if (!i || c < cpu)
+	    cpu = c;
+    }
+    printf("%-10s %9.2f ms  %7.2f ms cpu  %s\n", "run", best * 1e3, cpu * 1e3, cmd);
+}
+
+int main(int argc, char *argv[]) {
+    int i;
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+	loops = atoi(argv[2]);
+	argc -= 2;
+	argv += 2;
+    }
+    if (argc < 2 || loops < 1) {
+	fprintf(stderr, "usage: %s [-n loops] dir [command...]\n", argv[0]);
+	return 2;
+    }
+    if (proc_root_set(argv[1]) == -1 || setenv("PROCPS_ROOT", proc_root(), 1) == -1) {
+	fprintf(stderr, "%s: no good as a proc root\n", argv[1]);
+	return 2;
+    }
+
+    timed("scan", pass_scan);
+    timed("stat", pass_stat);
+    timed("status", pass_status);
+    timed("names", pass_names);
+    timed("cmdline", pass_cmdline);
+    timed("threads", pass_threads);
+    timed("table", pass_table);
+    timed("parallel", pass_parallel);
+
+    unsorted = readproctab(TABLE_FLAGS);
+    for (nsorted = 0; unsorted && unsorted[nsorted]; nsorted++)
+	;
+    sorted = xcalloc(NULL, (nsorted + 1) * sizeof *sorted);
+    parse_sort_opt("u-kp");
+    timed("sort", pass_sort);
+    free(sorted);
+    freetab(unsorted);
+
+    for (i = 2; i < argc; i++)
+	command(argv[i]);
+    return 0;
+}
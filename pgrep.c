@@ -23,6 +23,7 @@
 #include <errno.h>
 
 #include "proc/readproc.h"
+#include "proc/pidsig.h"
 #include "proc/sig.h"
 #include "proc/devname.h"
 #include "proc/sysinfo.h"
@@ -45,6 +46,7 @@ static int opt_newest = 0;
 static int opt_negate = 0;
 static int opt_exact = 0;
 static int opt_signal = SIGTERM;
+static int opt_threads = 0;
 
 static const char *opt_delim = "\n";
 static union el *opt_pgrp = NULL;
@@ -65,7 +67,7 @@ static int conv_sid (const char *, union el *);
 static int conv_pgrp (const char *, union el *);
 static int conv_num (const char *, union el *);
 static int conv_str (const char *, union el *);
-static int match_numlist (long, const union el *);
+static void filter_numlist (unsigned char *, const int *, int, const union el *);
 static int match_strlist (const char *, const union el *);
 static void display_pgrep_version(void);
 
@@ -74,7 +76,7 @@ static int
 usage (int opt)
 {
 	if (i_am_pkill)
-		fprintf (stderr, "Usage: pkill [-SIGNAL] [-fvx] ");
+		fprintf (stderr, "Usage: pkill [-SIGNAL] [-fvx] [-T THREADS] ");
 	else
 		fprintf (stderr, "Usage: pgrep [-flvx] [-d DELIM] ");
 	fprintf (stderr, "[-n|-o] [-P PPIDLIST] [-g PGRPLIST] [-s SIDLIST]\n"
@@ -108,6 +110,8 @@ parse_opts (int argc, char **argv)
 				opt_signal = sig;
 			}
 		}
+		/* and this one for pkill only */
+		strcat (opts, "T:");
 	} else {
 		/* These options are for pgrep only */
 		strcat (opts, "ld:");
@@ -146,6 +150,11 @@ parse_opts (int argc, char **argv)
 		case 'd':
 			opt_delim = strdup (optarg);
 			break;
+		case 'T':
+			opt_threads = atoi (optarg);
+			if (opt_threads < 1)
+				usage (opt);
+			break;
 		case 'P':
 	  		opt_ppid = split_list (optarg, ',', conv_num);
 			if (opt_ppid == NULL)
@@ -360,20 +369,25 @@ conv_str (const char *name, union el *e)
 }
 
 
-static int
-match_numlist (long value, const union el *list)
+/* The numeric criteria are each checked against one packed column of
+   the table at a time -- see proccols_keep() -- clearing keep[] for the
+   tasks that don't match. */
+
+static void
+filter_numlist (unsigned char *keep, const int *col, int n, const union el *list)
 {
-	int found = 0;
+	int *want;
+	int i;
+
 	if (list == NULL)
-		found = 0;
-	else {
-		int i;
-		for (i = list[0].num; i > 0; i--) {
-			if (list[i].num == value)
-				found = 1;
-		}
-	}
-	return (found);
+		return;
+	want = malloc (list[0].num * sizeof (int));
+	if (want == NULL)
+		exit (3);
+	for (i = 0; i < list[0].num; i++)
+		want[i] = list[i+1].num;
+	proccols_keep (keep, col, n, want, list[0].num);
+	free (want);
 }
 
 static int
@@ -420,10 +434,8 @@ do_openproc (void)
 	PROCTAB *ptp;
 	int flags = PROC_FILLANY;
 
-	if (opt_pattern || opt_full)
-		flags |= PROC_FILLCOM;
-	if (opt_uid)
-		flags |= PROC_FILLSTATUS;
+	if (opt_uid || opt_gid)
+		flags |= PROC_FILLID;
 	if (opt_euid && !opt_negate) {
 		int num = opt_euid[0].num;
 		int i = num;
@@ -441,12 +453,315 @@ do_openproc (void)
 	return (ptp);
 }
 
+/* The first pass over the table reads just stat (and status, for -u or -G)
+   and keeps what the criteria look at, one packed column per field.  Only
+   the tasks still in the running after the numeric criteria have their tty
+   names looked up, and only those have their cmdlines read, in a second
+   pass over just their pids.  A task with no address space (a kernel
+   thread or a zombie:  vsize is 0) has an empty cmdline, so -f falls back
+   to its comm and there is nothing to read. */
+
+struct task_cols {
+	int n, size;
+	int *pid, *ppid, *pgrp, *euid, *ruid, *rgid, *session, *tty;
+	unsigned long long *start_time;
+	char (*cmd)[16];
+	unsigned char *keep, *nomm;
+};
+
+static void
+grow_cols (struct task_cols *t)
+{
+	t->size = t->size ? t->size * 2 : 1024;
+#define GROW(col) \
+	if ((t->col = realloc (t->col, t->size * sizeof (*t->col))) == NULL) \
+		exit (3)
+	GROW (pid);
+	GROW (ppid);
+	GROW (pgrp);
+	GROW (euid);
+	GROW (ruid);
+	GROW (rgid);
+	GROW (session);
+	GROW (tty);
+	GROW (start_time);
+	GROW (cmd);
+	GROW (keep);
+	GROW (nomm);
+#undef GROW
+}
+
+static void
+read_cols (struct task_cols *t)
+{
+	PROCTAB *ptp;
+	proc_t task;
+	pid_t myself = getpid();
+
+	ptp = do_openproc ();
+	memset (&task, 0, sizeof (task));
+	while (readproc (ptp, &task)) {
+		int i = t->n;
+
+		if (task.pid == myself)
+			continue;
+		if (i == t->size)
+			grow_cols (t);
+		t->pid[i] = task.pid;
+		t->ppid[i] = task.ppid;
+		t->pgrp[i] = task.pgrp;
+		t->euid[i] = task.euid;
+		t->ruid[i] = task.ruid;
+		t->rgid[i] = task.rgid;
+		t->session[i] = task.session;
+		t->tty[i] = task.tty;
+		t->start_time[i] = task.start_time;
+		memcpy (t->cmd[i], task.cmd, sizeof (t->cmd[i]));
+		t->keep[i] = 1;
+		t->nomm[i] = task.vsize == 0;
+		t->n++;
+		memset (&task, 0, sizeof (task));
+	}
+	closeproc (ptp);
+}
+
+static void
+filter_cols (struct task_cols *t)
+{
+	int i;
+
+	filter_numlist (t->keep, t->ppid, t->n, opt_ppid);
+	filter_numlist (t->keep, t->pgrp, t->n, opt_pgrp);
+	filter_numlist (t->keep, t->euid, t->n, opt_euid);
+	filter_numlist (t->keep, t->ruid, t->n, opt_uid);
+	filter_numlist (t->keep, t->rgid, t->n, opt_gid);
+	filter_numlist (t->keep, t->session, t->n, opt_sid);
+	if (opt_term) {
+		for (i = 0; i < t->n; i++) {
+			char tty[256];
+
+			if (! t->keep[i])
+				continue;
+			if (t->tty[i] == -1) {
+				t->keep[i] = 0;
+				continue;
+			}
+			dev_to_tty (tty, sizeof(tty) - 1,
+				    t->tty[i], t->pid[i], ABBREV_DEV);
+			t->keep[i] = match_strlist (tty, opt_term);
+		}
+	}
+}
+
+/* Everything that survived needs its cmdline, and so does everything else
+   when -v -l will list it anyway, except where it is known to be empty.
+   NULL if nobody needs one. */
+static PROCTAB *
+open_cmdlines (const struct task_cols *t)
+{
+	pid_t *pids;
+	int i, num = 0;
+
+	if (! opt_full || ! (opt_long || opt_pattern))
+		return NULL;
+	pids = malloc ((t->n + 1) * sizeof (pid_t));
+	if (pids == NULL)
+		exit (3);
+	for (i = 0; i < t->n; i++) {
+		if (t->nomm[i])
+			continue;
+		if (t->keep[i] || (opt_long && opt_negate))
+			pids[num++] = t->pid[i];
+	}
+	pids[num] = 0;
+	if (num == 0) {
+		free (pids);
+		return NULL;
+	}
+	return (openproc (PROC_FILLCOM | PROC_PID, pids));
+}
+
+/* Most patterns are plain words or anchored prefixes and need no regex
+   engine at all;  scan_pattern() sorts those out for do_regcomp().  Of any
+   other pattern it keeps the longest run of plain characters that every
+   match has to contain, so regexec only sees the names that have it. */
+
+enum { RE_REGEX, RE_SUBSTR, RE_PREFIX, RE_SUFFIX, RE_WHOLE };
+static int re_kind = RE_REGEX;
+static char *re_lit = NULL;	/* NULL if nothing is known to be required */
+static size_t re_len;
+
+#define RE_SPECIAL(c) ((c) && strchr (".[]()*+?{}|^$\\", (c)) != NULL)
+
+/* q is at a '[';  return where its closing ']' is (or the last char) */
+static const char *
+skip_bracket (const char *q)
+{
+	q++;
+	if (*q == '^')
+		q++;
+	if (*q == ']')
+		q++;
+	while (*q && *q != ']') {
+		if (*q == '[' && (q[1] == ':' || q[1] == '.' || q[1] == '=')) {
+			char delim = q[1];
+
+			q += 2;
+			while (*q && !(*q == delim && q[1] == ']'))
+				q++;
+			if (*q)
+				q += 2;
+			continue;
+		}
+		q++;
+	}
+	return *q ? q : q - 1;
+}
+
+/* The characters outside any group, set, or alternation, minus those a
+   quantifier lets go missing, are what every match contains. */
+static void
+required_literal (const char *q, char *cur)
+{
+	size_t run = 0;
+	int depth = 0;
+
+	re_len = 0;
+	for (; *q; q++) {
+		int c = (unsigned char) *q;
+
+		if (c == '[') {
+			q = skip_bracket (q);
+			c = -1;
+		} else if (c == '\\' && q[1]) {
+			c = (unsigned char) *++q;
+			if (! RE_SPECIAL (c))	/* \w, \<, \1 ... */
+				c = -1;
+		} else if (c == '(') {
+			depth++;
+			c = -1;
+		} else if (c == ')') {
+			if (depth)
+				depth--;
+			c = -1;
+		} else if (c == '|') {
+			if (depth == 0) {
+				re_len = 0;
+				return;
+			}
+			c = -1;
+		} else if (c == '*' || c == '?' || c == '{') {
+			if (run)	/* the one before may be absent */
+				run--;
+			if (c == '{')
+				while (q[1] && *q != '}')
+					q++;
+			c = -1;
+		} else if (RE_SPECIAL (c) || c >= 0x80) {
+			c = -1;
+		}
+		if (c == -1 || depth) {
+			if (run > re_len) {
+				memcpy (re_lit, cur, run);
+				re_len = run;
+			}
+			run = 0;
+		} else {
+			cur[run++] = c;
+		}
+	}
+	if (run > re_len) {
+		memcpy (re_lit, cur, run);
+		re_len = run;
+	}
+}
+
+/* Returns 1 if the pattern is plain, and needs no regcomp. */
+static int
+scan_pattern (const char *pat)
+{
+	size_t n = strlen (pat);
+	const char *p = pat;
+	const char *end = pat + n;
+	const char *q;
+	char *cur;
+	int start = 0, stop = 0;
+
+	re_lit = malloc (n + 1);
+	if (re_lit == NULL)
+		exit (3);
+	if (*p == '^') {
+		start = 1;
+		p++;
+	}
+	if (end > p && end[-1] == '$') {
+		/* not if it is escaped by an odd number of backslashes */
+		for (q = end - 1; q > p && q[-1] == '\\'; q--)
+			;
+		if ((end - 1 - q) % 2 == 0) {
+			stop = 1;
+			end--;
+		}
+	}
+	re_len = 0;
+	for (q = p; q < end; q++) {
+		if (*q == '\\' && q + 1 < end && RE_SPECIAL (q[1]))
+			q++;
+		else if (RE_SPECIAL (*q))
+			break;
+		re_lit[re_len++] = *q;
+	}
+	if (q == end) {
+		re_lit[re_len] = '\0';
+		if (opt_exact)
+			start = stop = 1;
+		re_kind = start ? (stop ? RE_WHOLE : RE_PREFIX)
+				: (stop ? RE_SUFFIX : RE_SUBSTR);
+		return 1;
+	}
+
+	cur = malloc (n + 1);
+	if (cur == NULL)
+		exit (3);
+	required_literal (pat, cur);
+	free (cur);
+	if (re_len == 0) {
+		free (re_lit);
+		re_lit = NULL;
+	} else {
+		re_lit[re_len] = '\0';
+	}
+	return 0;
+}
+
+static int
+match_pattern (const regex_t *preg, const char *cmd)
+{
+	size_t len;
+
+	switch (re_kind) {
+	case RE_SUBSTR:
+		return strstr (cmd, re_lit) != NULL;
+	case RE_PREFIX:
+		return strncmp (cmd, re_lit, re_len) == 0;
+	case RE_SUFFIX:
+		len = strlen (cmd);
+		return len >= re_len &&
+		       memcmp (cmd + len - re_len, re_lit, re_len) == 0;
+	case RE_WHOLE:
+		return strcmp (cmd, re_lit) == 0;
+	}
+	if (re_lit && strstr (cmd, re_lit) == NULL)
+		return 0;
+	return regexec (preg, cmd, 0, NULL, 0) == 0;
+}
+
 static regex_t *
 do_regcomp (void)
 {
 	regex_t *preg = NULL;
 
-	if (opt_pattern) {
+	if (opt_pattern && ! scan_pattern (opt_pattern)) {
 		char *re;
 		char errbuf[256];
 		int re_err;
@@ -473,6 +788,10 @@ do_regcomp (void)
 	return preg;
 }
 
+/* the start time of each pid in the list select_procs() returns, so that
+   pkill can be sure of signalling the processes it matched */
+static unsigned long long *match_start;
+
 #ifdef NOT_USED
 static time_t
 jiffies_to_time_t (long jiffies)
@@ -490,62 +809,55 @@ select_procs (void)
 {
 	PROCTAB *ptp;
 	proc_t task;
+	struct task_cols t;
 	unsigned long long saved_start_time;      // for new/old support
 	pid_t saved_pid = 0;                      // for new/old support
 	int matches = 0;
 	int size = 32;
+	int have = 0;
+	int i;
 	regex_t *preg;
-	pid_t myself = getpid();
 	union el *list;
 	char cmd[4096];
 
 	list = malloc (size * sizeof (union el));
-	if (list == NULL)
+	match_start = malloc (size * sizeof (*match_start));
+	if (list == NULL || match_start == NULL)
 		exit (3);
 
-	ptp = do_openproc ();
+	memset (&t, 0, sizeof (t));
+	read_cols (&t);
+	filter_cols (&t);
 	preg = do_regcomp ();
 
+	/* the second pass returns those tasks it still finds, in table order */
+	ptp = open_cmdlines (&t);
+	memset (&task, 0, sizeof (task));
+	if (ptp)
+		have = readproc (ptp, &task) != NULL;
+
 	if (opt_newest) saved_start_time =  0ULL;
 	if (opt_oldest) saved_start_time = ~0ULL;
 	if (opt_newest) saved_pid = 0;
 	if (opt_oldest) saved_pid = INT_MAX;
 	
-	memset (&task, 0, sizeof (task));
-	while (readproc (ptp, &task)) {
-		int match = 1;
+	for (i = 0; i < t.n; i++) {
+		int match = t.keep[i];
+		char **cmdline = NULL;
+
+		if (have && task.pid == t.pid[i]) {
+			/* unless the pid has since gone to someone else */
+			if (task.start_time == t.start_time[i])
+				cmdline = task.cmdline;
+		}
 
-		if (task.pid == myself)
-			continue;
-		else if (opt_newest && task.start_time < saved_start_time)
-			match = 0;
-		else if (opt_oldest && task.start_time > saved_start_time)
-			match = 0;
-		else if (opt_ppid && ! match_numlist (task.ppid, opt_ppid))
+		if (opt_newest && t.start_time[i] < saved_start_time)
 			match = 0;
-		else if (opt_pgrp && ! match_numlist (task.pgrp, opt_pgrp))
+		else if (opt_oldest && t.start_time[i] > saved_start_time)
 			match = 0;
-		else if (opt_euid && ! match_numlist (task.euid, opt_euid))
-			match = 0;
-		else if (opt_uid && ! match_numlist (task.ruid, opt_uid))
-			match = 0;
-		else if (opt_gid && ! match_numlist (task.rgid, opt_gid))
-			match = 0;
-		else if (opt_sid && ! match_numlist (task.session, opt_sid))
-			match = 0;
-		else if (opt_term) {
-			if (task.tty == -1) {
-				match = 0;
-			} else {
-				char tty[256];
-				dev_to_tty (tty, sizeof(tty) - 1,
-					    task.tty, task.pid, ABBREV_DEV);
-				match = match_strlist (tty, opt_term);
-			}
-		}
 		if (opt_long || (match && opt_pattern)) {
-			if (opt_full && task.cmdline) {
-				int i = 0;
+			if (opt_full && cmdline) {
+				int j = 0;
 				int bytes = sizeof (cmd) - 1;
 
 				/* make sure it is always NUL-terminated */
@@ -553,59 +865,68 @@ select_procs (void)
 				/* make room for SPC in loop below */
 				--bytes;
 
-				strncpy (cmd, task.cmdline[i], bytes);
-				bytes -= strlen (task.cmdline[i++]);
-				while (task.cmdline[i] && bytes > 0) {
+				strncpy (cmd, cmdline[j], bytes);
+				bytes -= strlen (cmdline[j++]);
+				while (cmdline[j] && bytes > 0) {
 					strncat (cmd, " ", bytes);
-					strncat (cmd, task.cmdline[i], bytes);
-					bytes -= strlen (task.cmdline[i++]) + 1;
+					strncat (cmd, cmdline[j], bytes);
+					bytes -= strlen (cmdline[j++]) + 1;
 				}
 			} else {
-				strcpy (cmd, task.cmd);
+				strcpy (cmd, t.cmd[i]);
 			}
 		}
 
+		if (have && task.pid == t.pid[i]) {
+			if (task.cmdline)
+				free ((void *) *task.cmdline);
+			memset (&task, 0, sizeof (task));
+			have = readproc (ptp, &task) != NULL;
+		}
+
 		if (match && opt_pattern) {
-			if (regexec (preg, cmd, 0, NULL, 0) != 0)
+			if (! match_pattern (preg, cmd))
 				match = 0;
 		}
 
 		if (match ^ opt_negate) {	/* Exclusive OR is neat */
 			if (opt_newest) {
-				if (saved_start_time == task.start_time &&
-				    saved_pid > task.pid)
+				if (saved_start_time == t.start_time[i] &&
+				    saved_pid > t.pid[i])
 					continue;
-				saved_start_time = task.start_time;
-				saved_pid = task.pid;
+				saved_start_time = t.start_time[i];
+				saved_pid = t.pid[i];
 				matches = 0;
 			}
 			if (opt_oldest) {
-				if (saved_start_time == task.start_time &&
-				    saved_pid < task.pid)
+				if (saved_start_time == t.start_time[i] &&
+				    saved_pid < t.pid[i])
 					continue;
-				saved_start_time = task.start_time;
-				saved_pid = task.pid;
+				saved_start_time = t.start_time[i];
+				saved_pid = t.pid[i];
 				matches = 0;
 			}
 			if (opt_long) {
 				char buff[4096];
-				sprintf (buff, "%d %s", task.pid, cmd);
+				sprintf (buff, "%d %s", t.pid[i], cmd);
 				list[++matches].str = strdup (buff);
 			} else {
-				list[++matches].num = task.pid;
+				list[++matches].num = t.pid[i];
 			}
+			match_start[matches] = t.start_time[i];
 			if (matches == size) {
 				size *= 2;
 				list = realloc (list,
 						size * sizeof (union el));
-				if (list == NULL)
+				match_start = realloc (match_start,
+						size * sizeof (*match_start));
+				if (list == NULL || match_start == NULL)
 					exit (3);
 			}
 		}
-		
-		memset (&task, 0, sizeof (task));
 	}
-	closeproc (ptp);
+	if (ptp)
+		closeproc (ptp);
 
 	list[0].num = matches;
 	return (list);
@@ -621,12 +942,34 @@ main (int argc, char **argv)
 
 	procs = select_procs ();
 	if (i_am_pkill) {
-		int i;
+		pidsig_t sigs;
+		int i, fd;
+
+		/* each matched process is pinned by a pidfd, good only if the
+		   pid still has the start time it was matched with, and then
+		   they are all signalled together */
+		memset (&sigs, 0, sizeof (sigs));
+		sigs.threads = opt_threads;
 		for (i = 1; i <= procs[0].num; i++) {
-			if (kill (procs[i].num, opt_signal) == -1)
+			fd = pidsig_open (procs[i].num, match_start[i]);
+			if (fd == -1 && errno == ESRCH) {
 				fprintf (stderr, "pkill: %ld - %s\n",
 					 procs[i].num, strerror (errno));
+				continue;
+			}
+			pidsig_add (&sigs, procs[i].num, fd);
+		}
+		pidsig_send (&sigs, opt_signal);
+		for (i = 0; i < sigs.n; i++) {
+			if (sigs.err[i])
+				fprintf (stderr, "pkill: %d - %s\n",
+					 sigs.pid[i], strerror (sigs.err[i]));
 		}
+		pidsig_clear (&sigs);
+		if (opt_threads)
+			fprintf (stderr, "pkill: %lu signalled, %lu failed, "
+				 "in %.3f ms\n", sigs.sent, sigs.failed,
+				 sigs.nsec / 1e6);
 	} else {
 		if (opt_long)
 			output_strlist (procs);
@@ -32,6 +32,8 @@
 #include <sys/file.h>
 #include <signal.h>
 #include <unistd.h>
+#include <time.h>
+#include <poll.h>
 
 #include <netinet/in_systm.h>
 #include <netinet/in.h>
@@ -44,6 +46,9 @@
 #define VERBOSE		1	/* verbose flag */
 #define QUIET		2	/* quiet flag */
 #define FLOOD		4	/* floodping flag */
+#define BULK		8	/* batched flood, see bulk() */
+#define BATCH		64	/* packets per sendmmsg() or recvmmsg() */
+#define WINDOW		(4*BATCH)	/* unanswered before bulk() waits */
 #ifndef MAXHOSTNAMELEN
 #define MAXHOSTNAMELEN	64
 #endif
@@ -60,7 +65,7 @@ struct sockaddr whereto;/* Who to ping */
 int datalen;		/* How much data */
 
 char usage[] =
-"Usage:  ping [-dfqrv] host [packetsize [count [preload]]]\n";
+"Usage:  ping [-dfFqrv] host [packetsize [count [preload]]]\n";
 
 char *hostname;
 char hnamebuf[MAXHOSTNAMELEN];
@@ -75,6 +80,8 @@ int timing = 0;
 int tmin = 999999999;
 int tmax = 0;
 int tsum = 0;			/* sum of all times, for doing average */
+long long us_min = -1, us_max, us_sum;	/* the same in microseconds, for -F */
+struct timeval started;		/* when -F began sending */
 int finish(), catcher();
 void pinger();
 char *inet_ntoa();
@@ -113,45 +120,63 @@ catcher()
 }
 
 /*
- *			I N _ C K S U M
- *
- * Checksum routine for Internet Protocol family headers (C Version)
+ *			C K S U M _ A D D
  *
+ * Add len bytes at addr into a running Internet checksum.  The sum is
+ * of 16 bit words, but one's complement addition doesn't care how they
+ * are grouped, so this takes them 32 bits at a time into a 64 bit
+ * accumulator and leaves the folding to the end (cksum_fold).  A sum can
+ * be kept for the parts of a packet that never change and the rest added
+ * in:  len must be even except for the last piece.
  */
-unsigned short
-in_cksum(unsigned short *addr, int len)
+unsigned long long
+cksum_add(unsigned long long sum, const void *addr, int len)
 {
-	int nleft = len;
-	unsigned short *w = addr;
-	unsigned short answer;
-	int sum = 0;
-
-	/*
-	 *  Our algorithm is simple, using a 32 bit accumulator (sum),
-	 *  we add sequential 16 bit words to it, and at the end, fold
-	 *  back all the carry bits from the top 16 bits into the lower
-	 *  16 bits.
-	 */
-	while( nleft > 1 )  {
-		sum += *w++;
-		nleft -= 2;
+	const unsigned char *p = addr;
+	unsigned int w;
+	unsigned short h;
+
+	while( len >= 4 )  {
+		memcpy(&w, p, 4);	/* any alignment */
+		sum += w;
+		p += 4;
+		len -= 4;
+	}
+	if( len >= 2 ) {
+		memcpy(&h, p, 2);
+		sum += h;
+		p += 2;
+		len -= 2;
 	}
-
 	/* mop up an odd byte, if necessary */
-	if( nleft == 1 ) {
+	if( len == 1 ) {
 		unsigned short u = 0;
 
-		*(unsigned char *)(&u) = *(unsigned char *)w ;
+		*(unsigned char *)(&u) = *p;
 		sum += u;
 	}
+	return (sum);
+}
 
-	/*
-	 * add back carry outs from top 16 bits to low 16 bits
-	 */
-	sum = (sum >> 16) + (sum & 0xffff);	/* add hi 16 to low 16 */
-	sum += (sum >> 16);			/* add carry */
-	answer = ~sum;				/* truncate to 16 bits */
-	return (answer);
+unsigned short
+cksum_fold(unsigned long long sum)
+{
+	/* add back the carries until it fits 16 bits */
+	while( sum >> 16 )
+		sum = (sum & 0xffff) + (sum >> 16);
+	return (~sum & 0xffff);
+}
+
+/*
+ *			I N _ C K S U M
+ *
+ * Checksum routine for Internet Protocol family headers (C Version)
+ *
+ */
+unsigned short
+in_cksum(unsigned short *addr, int len)
+{
+	return (cksum_fold(cksum_add(0, addr, len)));
 }
 
 /*
@@ -264,7 +289,7 @@ tvsub(struct timeval *out, struct timeval *in)
  * program to be run without having intermingled output (or statistics!).
  */
 void
-pr_pack(char* buf, int cc, struct sockaddr_in *from )
+pr_pack(char* buf, int cc, struct sockaddr_in *from, struct timeval *rcvd )
 {
 	struct ip *ip;
 	register struct icmp *icp;
@@ -275,7 +300,10 @@ pr_pack(char* buf, int cc, struct sockaddr_in *from )
 	int hlen, triptime;
 
 	from->sin_addr.s_addr = ntohl( from->sin_addr.s_addr );
-	gettimeofday( &tv, &tz );
+	if (rcvd)
+		tv = *rcvd;
+	else
+		gettimeofday( &tv, &tz );
 
 	ip = (struct ip *) buf;
 	hlen = ip->ip_hl << 2;
@@ -287,6 +315,8 @@ pr_pack(char* buf, int cc, struct sockaddr_in *from )
 	}
 	cc -= hlen;
 	icp = (struct icmp *)(buf + hlen);
+	if( (pingflags & BULK) && icp->icmp_type == ICMP_ECHO )
+		return;			/* our own, looped back */
 	if( (!(pingflags & QUIET)) && icp->icmp_type != ICMP_ECHOREPLY )  {
 		printf("%d bytes from %s: icmp_type=%d (%s) icmp_code=%d\n",
 		  cc, inet_ntoa(ntohl(from->sin_addr.s_addr)),
@@ -302,9 +332,17 @@ pr_pack(char* buf, int cc, struct sockaddr_in *from )
 		return;			/* 'Twas not our ECHO */
 
 	if (timing) {
+		long long us;
+
 		tp = (struct timeval *)&icp->icmp_data[0];
 		tvsub( &tv, tp );
 		triptime = tv.tv_sec*1000+(tv.tv_usec/1000);
+		us = tv.tv_sec*1000000LL + tv.tv_usec;
+		us_sum += us;
+		if( us_min < 0 || us < us_min )
+			us_min = us;
+		if( us > us_max )
+			us_max = us;
 		tsum += triptime;
 		if( triptime < tmin )
 			tmin = triptime;
@@ -312,7 +350,7 @@ pr_pack(char* buf, int cc, struct sockaddr_in *from )
 			tmax = triptime;
 	}
 
-	if(!(pingflags & QUIET)) {
+	if(!(pingflags & (QUIET|BULK))) {
 		if(pingflags != FLOOD) {
 			printf("%d bytes from %s: icmp_seq=%d", cc,
 			  inet_ntoa(from->sin_addr),
@@ -356,15 +394,171 @@ finish()
 			  ntransmitted));
 	}
 	printf("\n");
-	if (nreceived && timing)
+	if (nreceived && timing && (pingflags & BULK))
+	    printf("round-trip (ms)  min/avg/max = %.3f/%.3f/%.3f\n",
+		us_min / 1000.0,
+		us_sum / 1000.0 / nreceived,
+		us_max / 1000.0 );
+	else if (nreceived && timing)
 	    printf("round-trip (ms)  min/avg/max = %d/%d/%d\n",
 		tmin,
 		tsum / nreceived,
 		tmax );
+	if (pingflags & BULK) {
+		struct timeval now;
+		double secs;
+
+		gettimeofday( &now, &tz );
+		tvsub( &now, &started );
+		secs = now.tv_sec + now.tv_usec / 1e6;
+		if (secs > 0)
+			printf("%.3f seconds, %.0f packets/s out, %.0f in\n",
+			  secs, ntransmitted / secs, nreceived / secs);
+	}
 	fflush(stdout);
 	exit(0);
 }
 
+/*
+ *			B U L K
+ *
+ * Flood, as with -f, but BATCH packets to a sendmmsg() and as many
+ * replies as are waiting to a recvmmsg(), for the load a saturated link
+ * puts on it.  The packets are all alike but for the sequence number and
+ * the time, so their checksum is that of a template plus those two.  The
+ * time each reply came in is the kernel's (SO_TIMESTAMPNS), not the time
+ * we got around to it, so round trips stay honest with the queue backed
+ * up.  No more than WINDOW go unanswered.
+ */
+#ifndef ICMP_FILTER
+#define ICMP_FILTER	1	/* <linux/icmp.h>, which clashes with <netinet/> */
+#endif
+
+static u_char bulkout[BATCH][MAXPACKET];
+static u_char bulkin[BATCH][MAXPACKET];
+static char bulkctl[BATCH][CMSG_SPACE(sizeof(struct timespec))];
+
+void
+bulk(void)
+{
+	static u_char template[MAXPACKET];
+	struct icmp *icp = (struct icmp *) template;
+	struct mmsghdr out[BATCH], in[BATCH];
+	struct iovec outv[BATCH], inv[BATCH];
+	struct sockaddr_in from[BATCH];
+	struct pollfd pfd;
+	unsigned long long base;
+	struct timeval now;
+	unsigned int filter;
+	int cc = datalen+8, on = 1, i, n;
+
+	/* only replies and errors:  not our own requests, nor other noise */
+	filter = ~((1<<ICMP_ECHOREPLY) | (1<<ICMP_DEST_UNREACH) |
+		   (1<<ICMP_SOURCE_QUENCH) | (1<<ICMP_TIME_EXCEEDED) |
+		   (1<<ICMP_PARAMETERPROB));
+	setsockopt(s, SOL_RAW, ICMP_FILTER, &filter, sizeof(filter));
+	if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+		perror("ping: SO_TIMESTAMPNS");	/* we'll time it ourselves */
+
+	icp->icmp_type = ICMP_ECHO;
+	icp->icmp_code = 0;
+	icp->icmp_id = ident;
+	for( i=8; i<datalen; i++)	/* as pinger() fills it */
+		template[8+sizeof(struct timeval)+i-8] = i;
+	base = cksum_add(0, template, cc);	/* seq and time are 0 */
+
+	memset(out, 0, sizeof(out));
+	memset(in, 0, sizeof(in));
+	for (i = 0; i < BATCH; i++) {
+		memcpy(bulkout[i], template, cc);
+		outv[i].iov_base = bulkout[i];
+		outv[i].iov_len = cc;
+		out[i].msg_hdr.msg_name = &whereto;
+		out[i].msg_hdr.msg_namelen = sizeof(struct sockaddr);
+		out[i].msg_hdr.msg_iov = &outv[i];
+		out[i].msg_hdr.msg_iovlen = 1;
+		inv[i].iov_base = bulkin[i];
+		inv[i].iov_len = MAXPACKET;
+		in[i].msg_hdr.msg_name = &from[i];
+		in[i].msg_hdr.msg_iov = &inv[i];
+		in[i].msg_hdr.msg_iovlen = 1;
+	}
+	pfd.fd = s;
+	pfd.events = POLLIN;
+	gettimeofday( &started, &tz );
+
+	for (;;) {
+		int room = WINDOW - (ntransmitted - nreceived);
+
+		if (npackets && ntransmitted >= npackets)
+			room = 0;
+		else if (npackets && room > npackets - ntransmitted)
+			room = npackets - ntransmitted;
+		if (room > BATCH)
+			room = BATCH;
+		if (room > 0) {
+			gettimeofday( &now, &tz );
+			for (i = 0; i < room; i++) {
+				struct icmp *op = (struct icmp *) bulkout[i];
+
+				op->icmp_seq = ntransmitted + i;
+				memcpy(op->icmp_data, &now, sizeof(now));
+				op->icmp_cksum = cksum_fold(cksum_add(base +
+				  op->icmp_seq, &now, timing ? sizeof(now) : 0));
+			}
+			if (!timing)	/* too small to carry the time */
+				for (i = 0; i < room; i++)
+					memcpy(bulkout[i]+8, template+8, datalen);
+			n = sendmmsg(s, out, room, 0);
+			if (n < 0 && errno != EINTR && errno != ENOBUFS) {
+				perror("ping: sendmmsg");
+				fflush(stdout);
+			}
+			if (n > 0)
+				ntransmitted += n;
+			if (npackets && ntransmitted >= npackets) {
+				signal(SIGALRM, finish);
+				alarm(nreceived ? 1 : MAXWAIT);
+			}
+		}
+		/* wait only when there's nothing more to send */
+		if (poll(&pfd, 1, room > 0 ? 0 : 10) <= 0)
+			continue;
+		for (i = 0; i < BATCH; i++) {
+			in[i].msg_hdr.msg_namelen = sizeof(from[i]);
+			in[i].msg_hdr.msg_control = bulkctl[i];
+			in[i].msg_hdr.msg_controllen = sizeof(bulkctl[i]);
+		}
+		n = recvmmsg(s, in, BATCH, MSG_DONTWAIT, NULL);
+		if (n < 0) {
+			if (errno != EINTR && errno != EAGAIN) {
+				perror("ping: recvmmsg");
+				fflush(stdout);
+			}
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			struct cmsghdr *cm;
+			struct timeval *rcvd = NULL, tv;
+
+			for (cm = CMSG_FIRSTHDR(&in[i].msg_hdr); cm;
+			     cm = CMSG_NXTHDR(&in[i].msg_hdr, cm))
+				if (cm->cmsg_level == SOL_SOCKET &&
+				    cm->cmsg_type == SCM_TIMESTAMPNS) {
+					struct timespec ts;
+
+					memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+					tv.tv_sec = ts.tv_sec;
+					tv.tv_usec = ts.tv_nsec / 1000;
+					rcvd = &tv;
+				}
+			pr_pack( (char *) bulkin[i], in[i].msg_len, &from[i], rcvd );
+			if (npackets && nreceived >= npackets)
+				finish();
+		}
+	}
+}
+
 /*
  * 			M A I N
  */
@@ -395,6 +589,9 @@ main(int argc, char **argv)
 			case 'f':
 				pingflags |= FLOOD;
 				break;
+			case 'F':
+				pingflags |= FLOOD|BULK;
+				break;
 		}
 		argc--, av++;
 	}
@@ -475,6 +672,9 @@ main(int argc, char **argv)
 	for(i=0; i < preload; i++)
 		pinger();
 
+	if(pingflags & BULK)
+		bulk();		/* and never come back */
+
 	if(!(pingflags & FLOOD))
 		catcher();	/* start things going */
 
@@ -499,7 +699,7 @@ main(int argc, char **argv)
 			perror("ping: recvfrom");
 			continue;
 		}
-		pr_pack( packet, cc, &from );
+		pr_pack( packet, cc, &from, NULL );
 		if (npackets && nreceived >= npackets)
 			finish();
 	}
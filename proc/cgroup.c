@@ -0,0 +1,174 @@
+/*
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "procps.h"
+#include "readproc.h"
+#include "prof.h"
+
+/* A task's cgroup is read from /proc/#/cgroup the first time it's asked
+ * for, then kept by pid and start time:  a task is read once in its life
+ * (so one moved to another cgroup goes on showing the first).  The paths
+ * are kept once each and never freed, so that callers rolling tasks up by
+ * cgroup need only compare pointers.
+ *
+ * With cgroup v1 the cpu controller's hierarchy is taken, that being where
+ * containers are accounted;  otherwise the unified one ("0::").
+ *
+ * One lock covers both tables;  the file is read without it.
+ */
+
+#define	TASKHASH	4096			/* power of 2 */
+#define	PATHHASH	256			/* power of 2 */
+
+struct task_cg {
+    struct task_cg *next;
+    pid_t pid;
+    unsigned long long start_time;
+    const char *path;			/* NULL if there was no file */
+};
+
+struct path {
+    struct path *next;
+    unsigned hash;
+    char s[1];
+};
+
+static pthread_mutex_t cglock = PTHREAD_MUTEX_INITIALIZER;
+static struct task_cg *tasks[TASKHASH];
+static struct path *paths[PATHHASH];
+
+static unsigned hash_str(const char *s, int len) {
+    unsigned h = 2166136261u;
+
+    while (len--)
+	h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+/* the one copy of s[0..len), called locked */
+static const char *intern(const char *s, int len) {
+    unsigned h = hash_str(s, len);
+    struct path *p;
+
+    for (p = paths[h & (PATHHASH - 1)]; p; p = p->next)
+	if (p->hash == h && !strncmp(p->s, s, len) && !p->s[len])
+	    return p->s;
+    p = xmalloc(sizeof *p + len);
+    p->hash = h;
+    memcpy(p->s, s, len);
+    p->s[len] = '\0';
+    p->next = paths[h & (PATHHASH - 1)];
+    paths[h & (PATHHASH - 1)] = p;
+    return p->s;
+}
+
+/* is `name' one of the comma separated controllers in c[0..len)? */
+static int has_controller(const char *c, int len, const char *name) {
+    int n = strlen(name);
+    const char *end = c + len, *e;
+
+    for ( ; c < end; c = e + 1) {
+	if (!(e = memchr(c, ',', end - c)))
+	    e = end;
+	if (e - c == n && !strncmp(c, name, n))
+	    return 1;
+    }
+    return 0;
+}
+
+/* the path of the hierarchy we go by, out of "id:controllers:path" lines */
+static const char *pick(char *buf, int *len) {
+    const char *best = NULL, *line, *c, *p, *nl;
+    int rank = 0;
+
+    for (line = buf; *line; line = nl + 1) {
+	if (!(nl = strchr(line, '\n')))
+	    nl = line + strlen(line);
+	c = memchr(line, ':', nl - line);
+	if (c && (p = memchr(c + 1, ':', nl - c - 1))) {
+	    int r = has_controller(c + 1, p - c - 1, "cpu") ? 3
+		  : p == c + 1 && !strncmp(line, "0:", 2) ? 2 : 1;
+	    if (r > rank) {
+		rank = r;
+		best = p + 1;
+		*len = nl - best;
+	    }
+	}
+	if (!*nl)
+	    break;
+    }
+    return best;
+}
+
+static const char *read_cgroup(const char *dir) {
+    char path[PROCPATHLEN + 16], buf[4096];
+    const char *p;
+    int fd, n, len = 0;
+
+    snprintf(path, sizeof path, "%s/cgroup", dir);
+    PROF_COUNT(PROF_SYSCALLS, 3);
+    PROF_COUNT(PROF_OPENS, 1);
+    if ((fd = open(path, O_RDONLY)) == -1)
+	return NULL;
+    n = read(fd, buf, sizeof buf - 1);
+    close(fd);
+    if (n <= 0)
+	return NULL;
+    PROF_COUNT(PROF_BYTES, n);
+    buf[n] = '\0';
+    if (!(p = pick(buf, &len)))
+	return NULL;
+    pthread_mutex_lock(&cglock);
+    p = intern(p, len);
+    pthread_mutex_unlock(&cglock);
+    return p;
+}
+
+const char *cgroup_of(const char *dir, pid_t pid, unsigned long long start_time) {
+    struct task_cg **head = &tasks[(unsigned)pid & (TASKHASH - 1)], *t;
+    const char *path;
+
+    pthread_mutex_lock(&cglock);
+    for (t = *head; t; t = t->next)
+	if (t->pid == pid)
+	    break;
+    if (t && t->start_time == start_time) {
+	path = t->path;
+	pthread_mutex_unlock(&cglock);
+	PROF_COUNT(PROF_CGROUP_HIT, 1);
+	return path;
+    }
+    pthread_mutex_unlock(&cglock);
+
+    PROF_COUNT(PROF_CGROUP_MISS, 1);
+    path = read_cgroup(dir);
+
+    pthread_mutex_lock(&cglock);
+    for (t = *head; t; t = t->next)	/* again:  another thread may have been */
+	if (t->pid == pid)
+	    break;
+    if (!t) {				/* a pid once seen keeps its entry */
+	t = xmalloc(sizeof *t);
+	t->pid = pid;
+	t->next = *head;
+	*head = t;
+    }
+    t->start_time = start_time;
+    t->path = path;
+    pthread_mutex_unlock(&cglock);
+    return path;
+}
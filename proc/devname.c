@@ -17,8 +17,12 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/sysmacros.h>
+#include <pthread.h>
 #include "version.h"
+#include "procps.h"
 #include "devname.h"
+#include "namecache.h"
+#include "prof.h"
 
 //#include <asm/page.h>
 #include <asm/param.h>
@@ -40,7 +44,64 @@ typedef struct tty_map_node {
   char devfs_type;
 } tty_map_node;
 
+/* as kept in the PS_NAMECACHE file */
+typedef struct tty_map_rec {
+  int major_number;
+  int minor_first, minor_last;
+  char name[16];
+  char devfs_type;
+} tty_map_rec;
+
+/* loaded just once, so threads can share it without locking */
 static tty_map_node *tty_map = NULL;
+static pthread_once_t tty_map_once = PTHREAD_ONCE_INIT;
+static nc_stamp tty_map_src;
+
+/* Written in list order; cached_drivers() pushes them back last first. */
+static void flush_drivers(void){
+  tty_map_rec *recs;
+  tty_map_node *tmn;
+  unsigned count = 0;
+  if(tty_map != (tty_map_node *)-1)
+    for(tmn = tty_map; tmn; tmn = tmn->next) count++;
+  recs = calloc(count + 1, sizeof(tty_map_rec));
+  if(!recs) return;
+  count = 0;
+  if(tty_map != (tty_map_node *)-1)
+    for(tmn = tty_map; tmn; tmn = tmn->next, count++){
+      recs[count].major_number = tmn->major_number;
+      recs[count].minor_first  = tmn->minor_first;
+      recs[count].minor_last   = tmn->minor_last;
+      memcpy(recs[count].name, tmn->name, sizeof recs[count].name);
+      recs[count].devfs_type   = tmn->devfs_type;
+    }
+  nc_put(NC_TTY, &tty_map_src, recs, count, count * sizeof(tty_map_rec));
+  free(recs);
+}
+
+/* Use the cache file's copy of /proc/tty/drivers, if it has one.
+ * The stamp of a /proc file only changes when its inode does, so a
+ * driver loaded later may be missed here; the other guesses still work.
+ */
+static int cached_drivers(void){
+  const tty_map_rec *recs;
+  unsigned count, bytes;
+  recs = nc_section(NC_TTY, &tty_map_src, &count, &bytes);
+  if(!recs || bytes < count * sizeof(tty_map_rec)) return 0;
+  while(count--){
+    tty_map_node *tmn = calloc(1, sizeof(tty_map_node));
+    if(!tmn) break;
+    tmn->major_number = recs[count].major_number;
+    tmn->minor_first  = recs[count].minor_first;
+    tmn->minor_last   = recs[count].minor_last;
+    memcpy(tmn->name, recs[count].name, sizeof tmn->name - 1);
+    tmn->devfs_type   = recs[count].devfs_type;
+    tmn->next = tty_map;
+    tty_map = tmn;
+  }
+  if(!tty_map) tty_map = (tty_map_node *)-1;
+  return 1;
+}
 
 /* Load /proc/tty/drivers for device name mapping use. */
 static void load_drivers(void){
@@ -48,6 +109,10 @@ static void load_drivers(void){
   char *p;
   int fd;
   int bytes;
+  if(nc_stamp_file("/proc/tty/drivers", 0, &tty_map_src)){
+    if(cached_drivers()) return;
+    nc_want_flush(NC_TTY, flush_drivers);
+  }
   fd = open("/proc/tty/drivers",O_RDONLY);
   if(fd == -1) goto fail;
   bytes = read(fd, buf, sizeof(buf) - 1);
@@ -99,7 +164,7 @@ fail:
 static int driver_name(char * const buf, int maj, int min){
   struct stat sbuf;
   tty_map_node *tmn;
-  if(!tty_map) load_drivers();
+  pthread_once(&tty_map_once, load_drivers);
   if(tty_map == (tty_map_node *)-1) return 0;
   tmn = tty_map;
   for(;;){
@@ -178,9 +243,9 @@ static int guess_name(char * const buf, int maj, int min){
  */
 static int link_name(char * const buf, int maj, int min, int pid, const char *name){
   struct stat sbuf;
-  char path[32];
+  char path[PROC_ROOT_MAX + 32];
   int count;
-  sprintf(path, "/proc/%d/%s", pid, name);  /* often permission denied */
+  sprintf(path, "%s/%d/%s", proc_root(), pid, name);  /* often permission denied */
   count = readlink(path,buf,PAGE_SIZE-1);
   if(count == -1) return 0;
   buf[count] = '\0';
@@ -190,23 +255,80 @@ static int link_name(char * const buf, int maj, int min, int pid, const char *na
   return 1;
 }
 
+/* Every name found is remembered, so each tty costs the stat() calls
+ * above just once per run rather than once per process.  A tty with no
+ * name of its own is remembered too; then only the per-process links
+ * are worth trying.  Shared by threads the same way as pwcache.c:  nodes
+ * go onto the front of a chain, complete, and are never freed.
+ */
+#define TTY_HASHSIZE 256
+#define TTY_HASH(dev) (((dev) ^ ((dev) >> 8)) & (TTY_HASHSIZE - 1))
+
+typedef struct tty_name_node {
+  struct tty_name_node *next;
+  int dev;
+  char name[1];      /* "" if only a link can tell */
+} tty_name_node;
+
+static tty_name_node *tty_names[TTY_HASHSIZE];
+static pthread_mutex_t tty_names_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const tty_name_node *tty_lookup(int dev){
+  const tty_name_node *tn;
+  tn = __atomic_load_n(&tty_names[TTY_HASH(dev)], __ATOMIC_ACQUIRE);
+  for(; tn; tn = tn->next)
+    if(tn->dev == dev) return tn;
+  return NULL;
+}
+
+static void tty_remember(int dev, const char *name){
+  const tty_name_node *old;
+  tty_name_node *tn;
+  size_t len = strlen(name);
+  if(len > 63) return;  /* some odd link; not worth keeping */
+  pthread_mutex_lock(&tty_names_lock);
+  old = tty_lookup(dev);
+  if(old && (*old->name || !*name)) goto out;  /* nothing new */
+  tn = malloc(sizeof(tty_name_node) + len);
+  if(!tn) goto out;
+  tn->dev = dev;
+  memcpy(tn->name, name, len + 1);
+  tn->next = tty_names[TTY_HASH(dev)];
+  __atomic_store_n(&tty_names[TTY_HASH(dev)], tn, __ATOMIC_RELEASE);
+out:
+  pthread_mutex_unlock(&tty_names_lock);
+}
+
 /* number --> name */
 int dev_to_tty(char *ret, int chop, int dev, int pid, unsigned int flags) {
-  static char buf[PAGE_SIZE];
+  char buf[PAGE_SIZE];
   char *tmp = buf;
+  const tty_name_node *known;
   int i = 0;
   int c;
   if((short)dev == (short)-1) goto fail;
+  known = tty_lookup(dev);
+  if(known && *known->name){
+    PROF_COUNT(PROF_TTY_HIT, 1);
+    strcpy(tmp, known->name);
+    goto abbrev;
+  }
+  PROF_COUNT(PROF_TTY_MISS, 1);  /* a known "no name" is tried again, in part */
   if(linux_version_code > LINUX_VERSION(2, 5, 0)){ /* didn't get done yet */
-    if(link_name(tmp, major(dev), minor(dev), pid, "tty"   )) goto abbrev;
+    if(link_name(tmp, major(dev), minor(dev), pid, "tty"   )) goto found;
   }
-  if(driver_name(tmp, major(dev), minor(dev)               )) goto abbrev;
-  if(  link_name(tmp, major(dev), minor(dev), pid, "fd/2"  )) goto abbrev;
-  if( guess_name(tmp, major(dev), minor(dev)               )) goto abbrev;
-  if(  link_name(tmp, major(dev), minor(dev), pid, "fd/255")) goto abbrev;
+  if(!known &&
+     driver_name(tmp, major(dev), minor(dev)               )) goto found;
+  if(  link_name(tmp, major(dev), minor(dev), pid, "fd/2"  )) goto found;
+  if(!known &&
+      guess_name(tmp, major(dev), minor(dev)               )) goto found;
+  if(  link_name(tmp, major(dev), minor(dev), pid, "fd/255")) goto found;
+  if(!known) tty_remember(dev, "");
 fail:
   strcpy(ret, "?");
   return 1;
+found:
+  tty_remember(dev, tmp);
 abbrev:
   if((flags&ABBREV_DEV) && !strncmp(tmp,"/dev/",5) && tmp[5]) tmp += 5;
   if((flags&ABBREV_TTY) && !strncmp(tmp,"tty",  3) && tmp[3]) tmp += 3;
@@ -232,7 +354,7 @@ abbrev:
 /* name --> number */
 int tty_to_dev(char *name) {
   struct stat sbuf;
-  static char buf[32];
+  char buf[32];
   if(stat(name, &sbuf) >= 0) return sbuf.st_rdev;
   snprintf(buf,32,"/dev/%s",name);
   if(stat(buf, &sbuf) >= 0) return sbuf.st_rdev;
@@ -18,9 +18,12 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/utsname.h>
+#include <pthread.h>
 #include "procps.h"
 #include "version.h"
 #include "sysinfo.h" /* smp_num_cpus */
+#include "namecache.h"
+#include "prof.h"
 
 #define KSYMS_FILENAME "/proc/ksyms"
 
@@ -114,11 +117,32 @@ static const char dash[] = "-";
 
 static symb hashtable[256];
 
+/* All of the above and below, and the reloading of /proc/ksyms, are shared
+ * by wchan() and open_psdb*() under this lock.  A returned name stays good
+ * until /proc/ksyms is next reloaded, which can happen once a second.
+ */
+static pthread_mutex_t ksym_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static char       *sysmap_data;
 static unsigned    sysmap_room;
 static symb       *sysmap_index;
 static unsigned    sysmap_count;
 
+/* Instead of the above, a System.map index from the PS_NAMECACHE file,
+ * made for one kernel build.  The addresses are in Eytzinger order:
+ * keys[1] is the root and keys[2k] and keys[2k+1] are the children of
+ * keys[k], so a search walks one path down and the next few levels of
+ * it are in the same cache lines.  names[k] is where keys[k]'s name
+ * starts in strings.
+ */
+static const unsigned long *sysmap_keys;
+static const unsigned      *sysmap_names;
+static const char          *sysmap_strings;
+static unsigned             sysmap_keys_count;
+static nc_stamp             sysmap_src;
+
+#define EYTZ_BYTES(n) ((((n)+1)*sizeof(long) + ((n)+1)*sizeof(unsigned) + 7) & ~7ul)
+
 static char       *ksyms_data;
 static unsigned    ksyms_room     = 4096;
 static symb       *ksyms_index;
@@ -203,6 +227,23 @@ static const symb *search(unsigned long address, symb *idx, unsigned count){
   return idx+left;
 }
 
+static const symb *search_cache(unsigned long address){
+  static symb found;    /* under ksym_lock, like everything else */
+  const unsigned long *keys = sysmap_keys;
+  unsigned count = sysmap_keys_count;
+  unsigned k = 1;
+  if(!keys) return NULL;
+  while(k <= count){
+    __builtin_prefetch(keys + 16*k);    /* four levels down */
+    k = 2*k + (keys[k] <= address);
+  }
+  k >>= __builtin_ffs(k);   /* back up to where we last went right */
+  if(!k) return NULL;       /* never did:  address is below them all */
+  found.addr = keys[k];
+  found.name = sysmap_strings + sysmap_names[k];
+  return &found;
+}
+
 /*********************************/
 
 /* allocate if needed, read, and return buffer size */
@@ -322,7 +363,7 @@ quiet_goodbye:
 
 #define VCNT 16
 
-static int sysmap_mmap(const char *filename, void (*message)(const char *, ...)) {
+static int sysmap_parse(const char *filename, void (*message)(const char *, ...)) {
   struct stat sbuf;
   char *endp;
   int fd;
@@ -442,6 +483,116 @@ bad_open:
 
 /*********************************/
 
+/* hand out the sorted entries in order, walking the tree in order */
+static unsigned eytzinger(unsigned long *keys, unsigned *names, const symb *sorted,
+                          const unsigned *offs, unsigned n, unsigned i, unsigned k){
+  if(k > n) return i;
+  i = eytzinger(keys, names, sorted, offs, n, i, 2*k);
+  keys[k]  = sorted[i].addr;
+  names[k] = offs[i++];
+  return eytzinger(keys, names, sorted, offs, n, i, 2*k+1);
+}
+
+/* At exit, under the lock so a late wchan() can't see it half done.
+ * Of several names for one address only the last is kept, which is
+ * what search() gives for any address past it.
+ */
+static void flush_sysmap(void){
+  unsigned long *keys = NULL;
+  unsigned *names, *offs = NULL;
+  symb *sorted;
+  char *strings;
+  unsigned long len = 0;
+  unsigned i, n = 0;
+  pthread_mutex_lock(&ksym_lock);
+  sorted = malloc(sysmap_count * sizeof(symb) + 1);
+  if(!sorted) goto out;
+  for(i = 0; i < sysmap_count; i++){
+    if(n && sorted[n-1].addr == sysmap_index[i].addr) n--;
+    sorted[n++] = sysmap_index[i];
+  }
+  for(i = 0; i < n; i++) len += strlen(sorted[i].name) + 1;
+  keys = calloc(1, EYTZ_BYTES(n) + len);
+  offs = malloc(n * sizeof(unsigned) + 1);
+  if(!keys || !offs) goto out;
+  names = (unsigned *)(keys + n + 1);
+  strings = (char *)keys + EYTZ_BYTES(n);
+  len = 0;
+  for(i = 0; i < n; i++){
+    offs[i] = len;
+    strcpy(strings + len, sorted[i].name);
+    len += strlen(strings + len) + 1;
+  }
+  eytzinger(keys, names, sorted, offs, n, 0, 1);
+  nc_put(NC_KSYM, &sysmap_src, keys, n, EYTZ_BYTES(n) + len);
+out:
+  free(offs);
+  free(keys);
+  free(sorted);
+  pthread_mutex_unlock(&ksym_lock);
+}
+
+/* The GNU build ID of the running kernel, hashed, or 0.  The notes are
+ * the usual ELF ones:  namesz, descsz, type, then name and desc, each
+ * padded to four bytes.
+ */
+static unsigned long long kernel_build_id(void){
+  unsigned char buf[1024];
+  unsigned long long hash = 0xcbf29ce484222325ull;  /* FNV-1a */
+  unsigned namesz, descsz, type, pos = 0, i;
+  ssize_t len;
+  int fd;
+  fd = open("/sys/kernel/notes", O_RDONLY|O_NOCTTY);
+  if(fd<0) return 0;
+  len = read(fd, buf, sizeof buf);
+  close(fd);
+  while(len > 0 && pos + 12 <= (unsigned)len){
+    memcpy(&namesz, buf+pos,   4);
+    memcpy(&descsz, buf+pos+4, 4);
+    memcpy(&type,   buf+pos+8, 4);
+    pos += 12;
+    if(namesz > sizeof buf || descsz > sizeof buf) break;
+    if(pos + ((namesz+3)&~3u) + descsz > (unsigned)len) break;
+    if(type == 3 && namesz == 4 && !memcmp(buf+pos, "GNU", 4)){  /* NT_GNU_BUILD_ID */
+      pos += 4;
+      for(i = 0; i < descsz; i++) hash = (hash ^ buf[pos+i]) * 0x100000001b3ull;
+      return hash;
+    }
+    pos += ((namesz+3)&~3u) + ((descsz+3)&~3u);
+  }
+  return 0;
+}
+
+/* Take the cached index of this System.map if it is there, was made for
+ * this kernel build, and looks sane; then there is nothing to parse.
+ * Otherwise parse, and leave the index to be cached at exit.
+ */
+static int sysmap_mmap(const char *filename, void (*message)(const char *, ...)) {
+  const char *sect;
+  unsigned count, bytes, i;
+  unsigned long strbytes;
+  if(!nc_stamp_file(filename, kernel_build_id() ^ linux_version_code, &sysmap_src))
+    return sysmap_parse(filename, message);
+  sect = nc_section(NC_KSYM, &sysmap_src, &count, &bytes);
+  if(sect && count && bytes > EYTZ_BYTES(count)){
+    sysmap_names   = (const unsigned *)(sect + (count+1)*sizeof(long));
+    sysmap_strings = sect + EYTZ_BYTES(count);
+    strbytes = bytes - EYTZ_BYTES(count);
+    if(sysmap_strings[strbytes-1]) goto parse;
+    for(i = 1; i <= count; i++)
+      if(sysmap_names[i] >= strbytes) goto parse;
+    sysmap_keys = (const unsigned long *)sect;
+    sysmap_keys_count = count;
+    return 1;
+  }
+parse:
+  if(!sysmap_parse(filename, message)) return 0;
+  nc_want_flush(NC_KSYM, flush_sysmap);
+  return 1;
+}
+
+/*********************************/
+
 static void read_and_parse(void){
   static time_t stamp;    /* after data gets old, load /proc/ksyms again */
   if(time(NULL) != stamp){
@@ -464,7 +615,7 @@ static void default_message(const char *format, ...) {
 
 /*********************************/
 
-int open_psdb_message(const char *override, void (*message)(const char *, ...)) {
+static int open_psdb_locked(const char *override, void (*message)(const char *, ...)) {
   static const char *sysmap_paths[] = {
     "/boot/System.map-%s",
     "/boot/System.map",
@@ -498,6 +649,14 @@ int open_psdb_message(const char *override, void (*message)(const char *, ...))
   return -1;
 }
 
+int open_psdb_message(const char *override, void (*message)(const char *, ...)) {
+  int ret;
+  pthread_mutex_lock(&ksym_lock);
+  ret = open_psdb_locked(override, message);
+  pthread_mutex_unlock(&ksym_lock);
+  return ret;
+}
+
 /***************************************/
 
 int open_psdb(const char *override) {
@@ -508,8 +667,7 @@ int open_psdb(const char *override) {
 
 #define MAX_OFFSET (0x1000*sizeof(long))  /* past this is generally junk */
 
-/* return pointer to temporary static buffer with function name */
-const char * wchan(unsigned long address) {
+static const char * wchan_locked(unsigned long address) {
   const symb *mod_symb;
   const symb *map_symb;
   const symb *good_symb;
@@ -518,10 +676,15 @@ const char * wchan(unsigned long address) {
   if(!address) return dash;
   read_and_parse();
 
-  if(hashtable[hash].addr == address) return hashtable[hash].name;
+  if(hashtable[hash].addr == address){
+    PROF_COUNT(PROF_WCHAN_HIT, 1);
+    return hashtable[hash].name;
+  }
+  PROF_COUNT(PROF_WCHAN_MISS, 1);
   mod_symb = search(address, ksyms_index,  ksyms_count);
   if(!mod_symb) mod_symb = &fail;
   map_symb = search(address, sysmap_index, sysmap_count);
+  if(!map_symb) map_symb = search_cache(address);
   if(!map_symb) map_symb = &fail;
 
   /* which result is closest? */
@@ -546,3 +709,13 @@ const char * wchan(unsigned long address) {
 
   return ret;
 }
+
+/* return pointer to temporary static buffer with function name */
+const char * wchan(unsigned long address) {
+  const char *ret;
+  if(!address) return dash;
+  pthread_mutex_lock(&ksym_lock);
+  ret = wchan_locked(address);
+  pthread_mutex_unlock(&ksym_lock);
+  return ret;
+}
@@ -39,7 +39,7 @@ DIRS  += proc/
 # -share -fPIC -soname arguments for produce dynamic link lib
 # -soname is a argument for 'ld' linker
 proc/$(SONAME): $(LIBOBJ)
-	$(CC) -shared -Wl,-soname,$(SONAME) -o $@ $^ -lc
+	$(CC) -shared -Wl,-soname,$(SONAME) -o $@ $^ -lpthread -lc
 	cd proc && $(ln_sf) $(SONAME) lib$(NAME).so
 
 
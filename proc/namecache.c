@@ -0,0 +1,201 @@
+/*
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "procps.h"
+#include "namecache.h"
+
+/* Monitoring scripts run ps and friends over and over, and each run would
+ * otherwise ask NSS for the same names, parse /proc/tty/drivers and index
+ * System.map all over again.  With PS_NAMECACHE set, that work is kept in
+ * one file:  it is mapped read-only on first use, and rewritten at exit if
+ * anything new was learned.  The new file is renamed over the old one, so
+ * a reader never sees it half written.  A section whose source file has
+ * changed is ignored and, by the next writer, replaced.
+ *
+ * Whoever can write the file decides what names we print, so it is only
+ * used if it belongs to us (or root) and nobody else may write it, and it
+ * is always written mode 0600.  Each user wants a file of their own.
+ *
+ * The file is in native byte order; it isn't meant to leave the machine.
+ */
+
+#define NC_MAGIC "procnc1"
+#define NC_ALIGN(n) (((n) + 7) & ~7u)
+
+typedef struct nc_sect {
+  nc_stamp src;
+  unsigned off, bytes, count, valid;
+} nc_sect;
+
+typedef struct nc_head {
+  char magic[8];
+  unsigned size;      /* whole file, to catch truncation */
+  unsigned width;     /* sizeof(long), since some records hold them */
+  nc_sect sect[NC_SECTIONS];
+} nc_head;
+
+static const nc_head *map;
+static pthread_once_t map_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t put_lock = PTHREAD_MUTEX_INITIALIZER;
+static void (*flushers[NC_SECTIONS])(void);
+static struct {
+  nc_stamp src;
+  void *data;
+  unsigned count, bytes;
+} fresh[NC_SECTIONS];
+
+/*********************************/
+
+static void map_file(void){
+  const char *path = getenv("PS_NAMECACHE");
+  struct stat sbuf;
+  const nc_head *h;
+  void *vp;
+  int fd, i;
+  if(!path || !*path) return;
+  fd = open(path, O_RDONLY|O_NOCTTY|O_NONBLOCK|O_NOFOLLOW);
+  if(fd<0) return;
+  if(fstat(fd, &sbuf) < 0) goto out;
+  if(!S_ISREG(sbuf.st_mode)) goto out;
+  if(sbuf.st_uid != geteuid() && sbuf.st_uid != 0) goto out;
+  if(sbuf.st_mode & (S_IWGRP|S_IWOTH)) goto out;
+  if(sbuf.st_size < (off_t)sizeof(nc_head) || sbuf.st_size > 1<<30) goto out;
+  vp = mmap(0, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if(vp == MAP_FAILED) goto out;
+  h = vp;
+  if(memcmp(h->magic, NC_MAGIC, sizeof h->magic)) goto bad;
+  if((off_t)h->size != sbuf.st_size || h->width != sizeof(long)) goto bad;
+  for(i = 0; i < NC_SECTIONS; i++){   /* h->size is st_size, checked above */
+    const nc_sect *s = h->sect + i;
+    if(!s->valid) continue;
+    if(s->off & 7 || s->off < sizeof(nc_head)) goto bad;
+    if(s->off > h->size || s->bytes > h->size - s->off) goto bad;
+  }
+  map = h;
+  goto out;
+bad:
+  munmap(vp, sbuf.st_size);
+out:
+  close(fd);
+}
+
+int nc_stamp_file(const char *path, unsigned long long tag, nc_stamp *st){
+  struct stat sbuf;
+  memset(st, 0, sizeof *st);
+  if(stat(path, &sbuf) < 0) return 0;
+  st->dev   = sbuf.st_dev;
+  st->ino   = sbuf.st_ino;
+  st->size  = sbuf.st_size;
+  st->mtime = sbuf.st_mtime;
+  st->tag   = tag;
+  return 1;
+}
+
+const void *nc_section(int which, const nc_stamp *src, unsigned *count, unsigned *bytes){
+  const nc_sect *s;
+  pthread_once(&map_once, map_file);
+  if(!map) return NULL;
+  s = map->sect + which;
+  if(!s->valid || memcmp(&s->src, src, sizeof *src)) return NULL;
+  *count = s->count;
+  *bytes = s->bytes;
+  return (const char *)map + s->off;
+}
+
+/*********************************/
+
+/* at exit:  collect what the flushers have, then write it all out */
+static void write_file(void){
+  const char *path = getenv("PS_NAMECACHE");
+  char tmp[4096];
+  struct stat sbuf;
+  nc_head head;
+  unsigned off;
+  int fd, i;
+
+  if(!path) return;
+  for(i = 0; i < NC_SECTIONS; i++)
+    if(flushers[i]) flushers[i]();
+
+  memset(&head, 0, sizeof head);
+  memcpy(head.magic, NC_MAGIC, sizeof head.magic);
+  head.width = sizeof(long);
+  off = NC_ALIGN(sizeof head);
+  for(i = 0; i < NC_SECTIONS; i++){
+    nc_sect *s = head.sect + i;
+    if(fresh[i].data){
+      s->src   = fresh[i].src;
+      s->count = fresh[i].count;
+      s->bytes = fresh[i].bytes;
+    }else if(map && map->sect[i].valid){
+      *s = map->sect[i];      /* someone else's, still good for all we know */
+    }else continue;
+    s->valid = 1;
+    s->off = off;
+    off = NC_ALIGN(off + s->bytes);
+  }
+  head.size = off;
+
+  /* leave alone anything there that isn't a file of ours */
+  if(lstat(path, &sbuf) == 0 && (!S_ISREG(sbuf.st_mode) || sbuf.st_uid != geteuid()))
+    return;
+  if(snprintf(tmp, sizeof tmp, "%s.XXXXXX", path) >= (int)sizeof tmp) return;
+  fd = mkstemp(tmp);          /* O_EXCL, mode 0600 */
+  if(fd<0) return;
+  if(write(fd, &head, sizeof head) != sizeof head) goto bad;
+  for(i = 0; i < NC_SECTIONS; i++){
+    const nc_sect *s = head.sect + i;
+    const void *data;
+    if(!s->valid) continue;
+    data = fresh[i].data ? fresh[i].data : (const char *)map + map->sect[i].off;
+    if(lseek(fd, s->off, SEEK_SET) != (off_t)s->off) goto bad;
+    if(write(fd, data, s->bytes) != (ssize_t)s->bytes) goto bad;
+  }
+  if(ftruncate(fd, off) < 0) goto bad;
+  if(close(fd) < 0) goto gone;
+  if(rename(tmp, path) < 0) goto gone;
+  return;
+bad:
+  close(fd);
+gone:
+  unlink(tmp);
+}
+
+void nc_want_flush(int which, void (*flush)(void)){
+  static int registered;
+  pthread_once(&map_once, map_file);
+  if(!getenv("PS_NAMECACHE")) return;
+  pthread_mutex_lock(&put_lock);
+  if(!registered) registered = !atexit(write_file);
+  flushers[which] = flush;
+  pthread_mutex_unlock(&put_lock);
+}
+
+void nc_put(int which, const nc_stamp *src, const void *data, unsigned count, unsigned bytes){
+  void *copy = xmalloc(bytes + 1);
+  memcpy(copy, data, bytes);
+  pthread_mutex_lock(&put_lock);
+  free(fresh[which].data);
+  fresh[which].src   = *src;
+  fresh[which].data  = copy;
+  fresh[which].count = count;
+  fresh[which].bytes = bytes;
+  pthread_mutex_unlock(&put_lock);
+}
@@ -0,0 +1,31 @@
+#ifndef PROC_NAMECACHE_H
+#define PROC_NAMECACHE_H
+
+/* The optional cache file named by $PS_NAMECACHE, shared by every run.
+ * Each section remembers where its data came from, and is ignored once
+ * that source has changed.
+ */
+
+#define NC_UID      0     /* user names, pwcache.c      */
+#define NC_GID      1     /* group names, pwcache.c     */
+#define NC_TTY      2     /* /proc/tty/drivers, devname.c */
+#define NC_KSYM     3     /* System.map index, ksym.c   */
+#define NC_SECTIONS 4
+
+typedef struct nc_stamp {
+  unsigned long long dev, ino, size;
+  long long mtime;
+  unsigned long long tag;     /* anything else the data depends on */
+} nc_stamp;
+
+/* fill in from stat(); returns 0 if the file can't be looked at */
+extern int nc_stamp_file(const char *path, unsigned long long tag, nc_stamp *st);
+
+/* the mapped data for a section, if its source is unchanged, else NULL */
+extern const void *nc_section(int which, const nc_stamp *src, unsigned *count, unsigned *bytes);
+
+/* ask for flush() to be called at exit, where it hands nc_put() the new data */
+extern void nc_want_flush(int which, void (*flush)(void));
+extern void nc_put(int which, const nc_stamp *src, const void *data, unsigned count, unsigned bytes);
+
+#endif
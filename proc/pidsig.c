@@ -0,0 +1,174 @@
+/*
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include "procps.h"
+#include "pidsig.h"
+
+/* kill() names a process by a number the kernel hands out again once it
+ * is reaped, so a tool that matches a batch of processes and then signals
+ * them can hit a stranger.  A pidfd names the process itself:  taken while
+ * the process is known to be the one matched, signals sent by it go there
+ * or nowhere.  With many to signal the sends can be split across threads.
+ */
+
+static int sys_pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int sys_pidfd_send_signal(int fd, int sig) {
+#ifdef SYS_pidfd_send_signal
+    return syscall(SYS_pidfd_send_signal, fd, sig, NULL, 0);
+#else
+    (void)fd;
+    (void)sig;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* field 22 of /proc/PID/stat, or 0 if it can't be had */
+static unsigned long long start_time_of(pid_t pid) {
+    char buf[1024], *cp;
+    int fd, n, field;
+
+    snprintf(buf, sizeof buf, "/proc/%d/stat", pid);
+    if ((fd = open(buf, O_RDONLY)) == -1)
+	return 0;
+    n = read(fd, buf, sizeof buf - 1);
+    close(fd);
+    if (n <= 0)
+	return 0;
+    buf[n] = '\0';
+    if (!(cp = strrchr(buf, ')')))
+	return 0;
+    /* ") state" is field 3, so 19 more spaces to the start time */
+    for (field = 2; field < 22 && cp; field++)
+	cp = strchr(cp + 1, ' ');
+    return cp ? strtoull(cp + 1, NULL, 10) : 0;
+}
+
+int pidsig_open(pid_t pid, unsigned long long start_time) {
+    int fd = sys_pidfd_open(pid);
+
+    if (fd == -1 || !start_time)
+	return fd;
+    /* the pidfd came first, so if the pid still has the start time it was
+     * matched with, the pidfd holds that very process */
+    if (start_time_of(pid) != start_time) {
+	close(fd);
+	errno = ESRCH;
+	return -1;
+    }
+    return fd;
+}
+
+void pidsig_add(pidsig_t *ps, pid_t pid, int pidfd) {
+    if (ps->n == ps->room) {
+	ps->room = ps->room * 2 + 64;
+	ps->pid = xrealloc(ps->pid, ps->room * sizeof *ps->pid);
+	ps->fd = xrealloc(ps->fd, ps->room * sizeof *ps->fd);
+	ps->err = xrealloc(ps->err, ps->room * sizeof *ps->err);
+    }
+    ps->pid[ps->n] = pid;
+    ps->fd[ps->n] = pidfd;
+    ps->err[ps->n] = 0;
+    ps->n++;
+}
+
+struct send_job {
+    pidsig_t *ps;
+    int sig, from, to, failed;
+    int started;
+    pthread_t tid;
+};
+
+static void *send_range(void *arg) {
+    struct send_job *job = arg;
+    pidsig_t *ps = job->ps;
+    int i, rc;
+
+    for (i = job->from; i < job->to; i++) {
+	if (ps->fd[i] >= 0)
+	    rc = sys_pidfd_send_signal(ps->fd[i], job->sig);
+	else
+	    rc = kill(ps->pid[i], job->sig);
+	ps->err[i] = rc ? errno : 0;
+	job->failed += rc != 0;
+    }
+    return NULL;
+}
+
+/* fewer than this each, and a thread costs more than it saves */
+#define PER_THREAD 256
+
+int pidsig_send(pidsig_t *ps, int sig) {
+    struct send_job *jobs;
+    struct timespec start, end;
+    int njobs = ps->threads, i, failed = 0;
+
+    if (njobs > ps->n / PER_THREAD)
+	njobs = ps->n / PER_THREAD;
+    if (njobs < 1)
+	njobs = 1;
+    jobs = xmalloc(njobs * sizeof *jobs);
+    for (i = 0; i < njobs; i++) {
+	jobs[i].ps = ps;
+	jobs[i].sig = sig;
+	jobs[i].from = (long long)ps->n * i / njobs;
+	jobs[i].to = (long long)ps->n * (i + 1) / njobs;
+	jobs[i].failed = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 1; i < njobs; i++)
+	jobs[i].started = !pthread_create(&jobs[i].tid, NULL, send_range, &jobs[i]);
+    send_range(&jobs[0]);
+    for (i = 1; i < njobs; i++) {
+	if (jobs[i].started)
+	    pthread_join(jobs[i].tid, NULL);
+	else			/* no thread to be had:  do it here */
+	    send_range(&jobs[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (i = 0; i < njobs; i++)
+	failed += jobs[i].failed;
+    ps->sent += ps->n - failed;
+    ps->failed += failed;
+    ps->nsec += (end.tv_sec - start.tv_sec) * 1000000000ULL
+	      + end.tv_nsec - start.tv_nsec;
+    free(jobs);
+    return failed;
+}
+
+void pidsig_clear(pidsig_t *ps) {
+    int i;
+
+    for (i = 0; i < ps->n; i++)
+	if (ps->fd[i] >= 0)
+	    close(ps->fd[i]);
+    ps->n = 0;
+}
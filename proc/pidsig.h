@@ -0,0 +1,34 @@
+#ifndef PROC_PIDSIG_H
+#define PROC_PIDSIG_H
+
+#include <sys/types.h>
+
+/* A set of processes to signal together.  Each is held by a pidfd where
+ * the kernel has them (5.3 and later), taken while it was being matched,
+ * so a pid reused since then can't be hit by mistake;  otherwise by pid.
+ */
+typedef struct pidsig_t {
+    int n, room;
+    pid_t *pid;
+    int *fd;		/* pidfd, or -1 to go by pid */
+    int *err;		/* after pidsig_send():  0, or the errno */
+    int threads;	/* workers for pidsig_send(), 0 or 1 for none */
+    unsigned long sent, failed;	/* totals over every pidsig_send() */
+    unsigned long long nsec;	/* time spent sending, likewise */
+} pidsig_t;
+
+/* a pidfd for pid, or -1 with errno ESRCH if it is gone (or, given a
+ * nonzero start_time in jiffies, has since been reused), or some other
+ * errno if the kernel has no pidfds */
+extern int pidsig_open(pid_t pid, unsigned long long start_time);
+
+/* queue pid, held by pidfd (which the set then owns) or -1 */
+extern void pidsig_add(pidsig_t *ps, pid_t pid, int pidfd);
+
+/* signal everything queued;  returns how many failed (see err[]) */
+extern int pidsig_send(pidsig_t *ps, int sig);
+
+/* close the pidfds and empty the set, keeping the totals */
+extern void pidsig_clear(pidsig_t *ps);
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <pthread.h>
+#include "procps.h"
+#include "readproc.h"
+#include "pidwatch.h"
+
+/* A monitor which rereads /proc every few seconds spends a good part of
+ * each pass just listing it.  The kernel's proc connector will instead say
+ * whenever a process is forked or exits, so the set of live pids can be
+ * kept from one pass to the next and only the changes applied to it.
+ *
+ * Listening takes a kernel with CONFIG_PROC_EVENTS and, before 6.6,
+ * CAP_NET_ADMIN;  without them pidwatch_open() fails and callers just go
+ * on using /proc.
+ * Only thread group leaders are tracked, being all /proc lists.  An exit
+ * event comes before the task is reaped, and until then it is still in
+ * /proc (as a zombie), so exited pids wait on a list until kill() no longer
+ * finds them.  Should the socket overflow, events were lost and the set is
+ * built afresh from /proc.
+ */
+
+#define WORD_BITS  (8 * sizeof(unsigned long))
+
+static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static int watch_fd = -1;
+static int watch_failed;	/* tried once, and the kernel said no */
+static unsigned long *live;	/* one bit per pid */
+static pid_t live_bits;		/* pids below this fit in `live' */
+static pid_t *gone;		/* exited, perhaps not yet reaped */
+static int ngone, gone_room;
+
+static void live_set(pid_t pid) {
+    if (pid <= 0)
+	return;
+    if (pid >= live_bits) {
+	pid_t bits = live_bits ? live_bits : 32768;
+	while (bits <= pid)
+	    bits *= 2;
+	live = xrealloc(live, bits / 8);
+	memset((char*)live + live_bits / 8, 0, (bits - live_bits) / 8);
+	live_bits = bits;
+    }
+    live[pid / WORD_BITS] |= 1UL << (pid % WORD_BITS);
+}
+
+static void live_clear(pid_t pid) {
+    if (pid > 0 && pid < live_bits)
+	live[pid / WORD_BITS] &= ~(1UL << (pid % WORD_BITS));
+}
+
+/* (re)build the set from what /proc lists */
+static void watch_seed(void) {
+    pidscan_t *ps;
+    pid_t pid;
+
+    if (live_bits)
+	memset(live, 0, live_bits / 8);
+    ngone = 0;
+    if (!(ps = pidscan_open("/proc")))
+	return;
+    while ((pid = pidscan_next(ps)))
+	live_set(pid);
+    pidscan_close(ps);
+}
+
+static void gone_add(pid_t pid) {
+    if (ngone >= gone_room) {
+	gone_room = gone_room * 2 + 64;
+	gone = xrealloc(gone, gone_room * sizeof(pid_t));
+    }
+    gone[ngone++] = pid;
+}
+
+static void gone_drop(pid_t pid) {
+    int i;
+    for (i = 0; i < ngone; i++)
+	if (gone[i] == pid)
+	    gone[i--] = gone[--ngone];
+}
+
+static int watch_send(int fd, enum proc_cn_mcast_op op) {
+    union {
+	struct nlmsghdr nh;
+	char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+    } msg;
+    struct cn_msg *cn = NLMSG_DATA(&msg.nh);
+
+    memset(&msg, 0, sizeof msg);
+    msg.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof op);
+    msg.nh.nlmsg_type = NLMSG_DONE;
+    msg.nh.nlmsg_pid = getpid();
+    cn->id.idx = CN_IDX_PROC;
+    cn->id.val = CN_VAL_PROC;
+    cn->len = sizeof op;
+    memcpy(cn->data, &op, sizeof op);
+    return send(fd, &msg, msg.nh.nlmsg_len, 0) == (ssize_t)msg.nh.nlmsg_len ? 0 : -1;
+}
+
+/* read whatever has arrived;  `acked' (if given) is set once the kernel
+ * has answered our listen request, to 1 if it agreed and -1 if not.
+ * Returns how many tasks came or went.
+ */
+static int watch_drain(int fd, int *acked) {
+    union {
+	struct nlmsghdr nh;
+	char buf[8192];
+    } msg;
+    struct sockaddr_nl from;
+    socklen_t fromlen;
+    struct nlmsghdr *nh;
+    int len, changes = 0;
+
+    for (;;) {
+	fromlen = sizeof from;
+	len = recvfrom(fd, &msg, sizeof msg, MSG_DONTWAIT,
+		       (struct sockaddr*)&from, &fromlen);
+	if (len < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == ENOBUFS) {	/* lost some, so ask /proc again */
+		watch_seed();
+		changes++;
+		continue;
+	    }
+	    break;			/* EAGAIN: that's all for now */
+	}
+	if (from.nl_pid != 0)		/* only the kernel speaks for it */
+	    continue;
+	for (nh = &msg.nh; NLMSG_OK(nh, (unsigned)len); nh = NLMSG_NEXT(nh, len)) {
+	    struct cn_msg *cn;
+	    struct proc_event *ev;
+
+	    if (nh->nlmsg_type != NLMSG_DONE)
+		continue;
+	    cn = NLMSG_DATA(nh);
+	    if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC
+	     || cn->len < sizeof(struct proc_event))
+		continue;
+	    ev = (struct proc_event*)cn->data;
+	    switch (ev->what) {
+	    case PROC_EVENT_NONE:
+		if (acked)
+		    *acked = ev->event_data.ack.err ? -1 : 1;
+		break;
+	    case PROC_EVENT_FORK:
+		if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid)
+		    break;		/* just another thread */
+		live_set(ev->event_data.fork.child_pid);
+		gone_drop(ev->event_data.fork.child_pid);
+		changes++;
+		break;
+	    case PROC_EVENT_EXIT:
+		if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid)
+		    break;
+		gone_add(ev->event_data.exit.process_pid);
+		break;
+	    default:
+		break;
+	    }
+	}
+    }
+    /* a leader outlives its exit until the group is done and reaped */
+    for (len = 0; len < ngone; len++)
+	if (kill(gone[len], 0) == -1 && errno == ESRCH) {
+	    live_clear(gone[len]);
+	    gone[len--] = gone[--ngone];
+	    changes++;
+	}
+    return changes;
+}
+
+int pidwatch_open(void) {
+    struct sockaddr_nl sa;
+    struct pollfd pfd;
+    int fd, acked = 0, size = 1 << 20, tries;
+
+    pthread_mutex_lock(&watch_lock);
+    if (watch_fd >= 0 || watch_failed)
+	goto out;
+    watch_failed = 1;
+    if (strcmp(proc_root(), "/proc"))	/* the events are of the real one */
+	goto out;
+    if ((fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR)) == -1)
+	goto out;
+    /* a burst of forks shouldn't overflow it between two updates */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof size) == -1)
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+    memset(&sa, 0, sizeof sa);
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = CN_IDX_PROC;
+    sa.nl_pid = 0;
+    if (bind(fd, (struct sockaddr*)&sa, sizeof sa) == -1
+     || watch_send(fd, PROC_CN_MCAST_LISTEN) == -1)
+	goto fail;
+    /* the send goes through whether or not the kernel will oblige, so
+     * insist on hearing back before trusting the socket */
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for (tries = 0; !acked && tries < 5; tries++) {
+	if (poll(&pfd, 1, 50) > 0)
+	    watch_drain(fd, &acked);
+    }
+    if (acked != 1)
+	goto fail;
+    /* listening already, so nothing forked from here on is missed */
+    watch_seed();
+    watch_fd = fd;
+    watch_failed = 0;
+    goto out;
+fail:
+    close(fd);
+out:
+    fd = watch_fd >= 0 ? 0 : -1;
+    pthread_mutex_unlock(&watch_lock);
+    return fd;
+}
+
+int pidwatch_update(void) {
+    int n = -1;
+
+    pthread_mutex_lock(&watch_lock);
+    if (watch_fd >= 0)
+	n = watch_drain(watch_fd, NULL);
+    pthread_mutex_unlock(&watch_lock);
+    return n;
+}
+
+int pidwatch_snapshot(pid_t **buf, int *room) {
+    unsigned long bits;
+    pid_t w;
+    int n = 0;
+
+    pthread_mutex_lock(&watch_lock);
+    if (watch_fd < 0) {
+	pthread_mutex_unlock(&watch_lock);
+	return -1;
+    }
+    watch_drain(watch_fd, NULL);
+    for (w = 0; w < live_bits / (pid_t)WORD_BITS; w++) {
+	for (bits = live[w]; bits; bits &= bits - 1) {
+	    if (n + 1 >= *room) {
+		*room = *room * 5 / 4 + 1024;
+		*buf = xrealloc(*buf, *room * sizeof(pid_t));
+	    }
+	    (*buf)[n++] = w * WORD_BITS + __builtin_ctzl(bits);
+	}
+    }
+    if (n + 1 > *room) {
+	*room = 1024;
+	*buf = xrealloc(*buf, *room * sizeof(pid_t));
+    }
+    (*buf)[n] = 0;
+    pthread_mutex_unlock(&watch_lock);
+    return n;
+}
+
+void pidwatch_close(void) {
+    pthread_mutex_lock(&watch_lock);
+    if (watch_fd >= 0) {
+	watch_send(watch_fd, PROC_CN_MCAST_IGNORE);
+	close(watch_fd);
+	watch_fd = -1;
+    }
+    free(live);
+    free(gone);
+    live = NULL;
+    gone = NULL;
+    live_bits = 0;
+    ngone = gone_room = 0;
+    watch_failed = 0;
+    pthread_mutex_unlock(&watch_lock);
+}
@@ -0,0 +1,23 @@
+#ifndef PROC_PIDWATCH_H
+#define PROC_PIDWATCH_H
+
+#include <sys/types.h>
+
+/* The set of live tasks, kept current by the kernel's proc connector.
+ * openproc(PROC_LIVE) walks it in place of /proc when it can be had.
+ */
+
+/* start listening (once per process);  -1 if the kernel won't tell us */
+extern int pidwatch_open(void);
+
+/* apply the events that have come in;  returns how many tasks came or
+ * went, or -1 if there is no watch */
+extern int pidwatch_update(void);
+
+/* bring the set up to date and copy it, in pid order and 0 terminated,
+ * into *buf (grown as needed, *room entries);  returns how many */
+extern int pidwatch_snapshot(pid_t **buf, int *room);
+
+extern void pidwatch_close(void);
+
+#endif
@@ -2,14 +2,23 @@
 #include <stdio.h>
 #include <sys/types.h>
 
-/* The HZ constant from <asm/param.h> is replaced by the Hertz variable
- * available from "proc/sysinfo.h".
+/* The HZ constant from <asm/param.h> is replaced by Hertz, available
+ * (found on first use) from "proc/sysinfo.h".
  */
 
 /* get page info */
 //#include <asm/page.h>
 #include <asm/param.h>
 
+/* The procfs tree that is read:  "/proc", unless PROCPS_ROOT in the
+ * environment or proc_root_set() (before the first read) names another
+ * laid out like it, such as a synthetic one for benchmarks.
+ */
+#define PROC_ROOT_MAX 96
+extern const char *proc_root(void);
+extern int   proc_root_len(void);
+extern int   proc_root_set(const char *path);
+
 extern void *xrealloc(void *oldp, unsigned int size);
 extern void *xmalloc(unsigned int size);
 extern void *xcalloc(void *pointer, int size);
@@ -19,6 +28,10 @@ extern int   mult_lvl_cmp(void* a, void* b);
 extern char *user_from_uid(uid_t uid);
 extern char *group_from_gid(gid_t gid);
 
+/* the cgroup of the task whose /proc directory is `dir', read once for
+ * each pid and start time;  equal pointers are the same cgroup */
+extern const char *cgroup_of(const char *dir, pid_t pid, unsigned long long start_time);
+
 extern const char * wchan(unsigned long address);
 extern int   open_psdb(const char *override);
 extern int   open_psdb_message(const char *override, void (*message)(const char *, ...));
@@ -0,0 +1,58 @@
+/*
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "procps.h"
+
+/* Benchmarks want the same process table every run, which the machine's
+ * own /proc won't give them;  so the tree read for processes (and for
+ * stat, meminfo and the rest) can be a copy somewhere else, made up to
+ * order (see bench/mkproc.c).  A set-id program ignores the environment.
+ */
+
+static char root[PROC_ROOT_MAX + 1] = "/proc";
+static int root_len = 5;
+static pthread_once_t root_once = PTHREAD_ONCE_INIT;
+
+static int root_store(const char *path) {
+    int len;
+
+    if (!path || !*path || (len = strlen(path)) > PROC_ROOT_MAX)
+	return -1;
+    while (len > 1 && path[len - 1] == '/')
+	len--;
+    memcpy(root, path, len);
+    root[len] = '\0';
+    root_len = len;
+    return 0;
+}
+
+static void root_init(void) {
+    if (getuid() == geteuid() && getgid() == getegid())
+	root_store(getenv("PROCPS_ROOT"));
+}
+
+const char *proc_root(void) {
+    pthread_once(&root_once, root_init);
+    return root;
+}
+
+int proc_root_len(void) {
+    pthread_once(&root_once, root_init);
+    return root_len;
+}
+
+int proc_root_set(const char *path) {
+    pthread_once(&root_once, root_init);
+    return root_store(path);
+}
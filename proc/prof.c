@@ -0,0 +1,120 @@
+/*
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "prof.h"
+
+/* The counts are bumped with relaxed atomics, which costs something only
+ * while counting is on;  and a report nobody asked for by name goes out
+ * at exit, so PROCPS_PROF=- ps ax says where ps's time went.
+ */
+
+int prof_enabled;
+
+static prof_t counts;
+static const char *dest;	/* PROCPS_PROF */
+static int reported;
+
+static const char *stage_names[PROF_STAGES] = {
+    "read", "scan", "io", "parse", "names", "refresh", "sort", "frame",
+};
+
+static void report_at_exit(void) {
+    prof_t p;
+
+    if (reported || !prof_enabled)
+	return;
+    prof_take(&p, 0);
+    prof_report(&p, "total");
+}
+
+static void init_prof(void) __attribute__((constructor));
+static void init_prof(void) {
+    if (getuid() != geteuid() || getgid() != getegid())
+	return;			/* no appending to files as someone else */
+    if (!(dest = getenv("PROCPS_PROF")))
+	return;
+    prof_enabled = 1;
+    atexit(report_at_exit);
+}
+
+void prof_enable(int on) {
+    prof_enabled = on;
+}
+
+unsigned long long prof_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void prof_add(int what, unsigned long long n) {
+    __atomic_fetch_add(&counts.count[what], n, __ATOMIC_RELAXED);
+}
+
+void prof_stage(int stage, unsigned long long since) {
+    __atomic_fetch_add(&counts.nsec[stage], prof_clock() - since, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counts.calls[stage], 1, __ATOMIC_RELAXED);
+}
+
+void prof_take(prof_t *p, int reset) {
+    unsigned long long *from = (unsigned long long *)&counts;
+    unsigned long long *to = (unsigned long long *)p;
+    unsigned i;
+
+    for (i = 0; i < sizeof counts / sizeof *from; i++)
+	to[i] = reset ? __atomic_exchange_n(from + i, 0, __ATOMIC_RELAXED)
+		      : __atomic_load_n(from + i, __ATOMIC_RELAXED);
+}
+
+static void hits(FILE *fp, const char *what, unsigned long long hit,
+		 unsigned long long miss) {
+    if (hit || miss)
+	fprintf(fp, "%-8s %10llu hits %8llu misses  %5.1f%%\n", what, hit, miss,
+		100.0 * hit / (hit + miss));
+}
+
+void prof_print(FILE *fp, const prof_t *p, const char *title) {
+    int i;
+
+    fprintf(fp, "== %s ==\n", title);
+    for (i = 0; i < PROF_STAGES; i++)
+	if (p->calls[i])
+	    fprintf(fp, "%-8s %10llu calls %10.3f ms %9.2f us/call\n",
+		    stage_names[i], p->calls[i], p->nsec[i] / 1e6,
+		    p->nsec[i] / 1e3 / p->calls[i]);
+    fprintf(fp, "%-8s %10llu read  %10llu syscalls %8llu opens %12llu bytes\n",
+	    "tasks", p->count[PROF_TASKS], p->count[PROF_SYSCALLS],
+	    p->count[PROF_OPENS], p->count[PROF_BYTES]);
+    hits(fp, "user", p->count[PROF_USER_HIT], p->count[PROF_USER_MISS]);
+    hits(fp, "group", p->count[PROF_GROUP_HIT], p->count[PROF_GROUP_MISS]);
+    hits(fp, "tty", p->count[PROF_TTY_HIT], p->count[PROF_TTY_MISS]);
+    hits(fp, "wchan", p->count[PROF_WCHAN_HIT], p->count[PROF_WCHAN_MISS]);
+    hits(fp, "cgroup", p->count[PROF_CGROUP_HIT], p->count[PROF_CGROUP_MISS]);
+    hits(fp, "sort", p->count[PROF_SORT_HIT], p->count[PROF_SORT_MISS]);
+}
+
+void prof_report(const prof_t *p, const char *title) {
+    FILE *fp = stderr;
+
+    reported = 1;
+    if (dest && strchr(dest, '/') && !(fp = fopen(dest, "a")))
+	return;
+    prof_print(fp, p, title);
+    if (fp != stderr)
+	fclose(fp);
+    else
+	fflush(fp);
+}
@@ -0,0 +1,72 @@
+#ifndef PROC_PROF_H
+#define PROC_PROF_H
+
+#include <stdio.h>
+
+/* Where a pass over /proc spends itself:  system calls and bytes read,
+ * hits and misses in the name caches, and the time of each stage.
+ *
+ * Off unless PROCPS_PROF is in the environment (or prof_enable() is
+ * called), and then each counting point is just the test of one int.
+ * Counts are summed over all threads, so under readproctab_parallel() a
+ * stage's time is the threads' time put together, not the wall clock's.
+ */
+
+enum prof_count {
+    PROF_SYSCALLS,	/* open, read, getdents, stat, close ... */
+    PROF_OPENS,		/* ...of which opens */
+    PROF_BYTES,		/* read from the tasks' files */
+    PROF_TASKS,		/* tasks read */
+    PROF_USER_HIT,  PROF_USER_MISS,	/* user_from_uid() */
+    PROF_GROUP_HIT, PROF_GROUP_MISS,	/* group_from_gid() */
+    PROF_TTY_HIT,   PROF_TTY_MISS,	/* dev_to_tty() */
+    PROF_WCHAN_HIT, PROF_WCHAN_MISS,	/* wchan() */
+    PROF_CGROUP_HIT, PROF_CGROUP_MISS,	/* cgroup_of() */
+    PROF_SORT_HIT,  PROF_SORT_MISS,	/* for callers:  reusing a sorted view */
+    PROF_COUNTS
+};
+
+enum prof_stage {
+    PROF_READ,		/* reading a task, all told (pid2proc) */
+    PROF_SCAN,		/* listing the pids */
+    PROF_IO,		/* opening and reading the task's files */
+    PROF_PARSE,		/* stat2proc(), statm2proc(), status2proc() */
+    PROF_NAMES,		/* uid and gid to names */
+    PROF_REFRESH,	/* for callers:  getting the frame's table */
+    PROF_SORT,		/* ...sorting it */
+    PROF_FRAME,		/* ...and the frame, all told */
+    PROF_STAGES
+};
+
+typedef struct prof_t {
+    unsigned long long count[PROF_COUNTS];
+    unsigned long long nsec[PROF_STAGES];
+    unsigned long long calls[PROF_STAGES];
+} prof_t;
+
+extern int prof_enabled;
+
+/* start (on != 0) or stop counting;  the counts so far are kept */
+extern void prof_enable(int on);
+
+/* copy the counts into *p, and then zero them if `reset' */
+extern void prof_take(prof_t *p, int reset);
+
+/* a breakdown of *p, headed by `title', to where PROCPS_PROF says:  a file
+ * name (appended to), or stderr for "-", "1" or anything else not a path */
+extern void prof_report(const prof_t *p, const char *title);
+extern void prof_print(FILE *fp, const prof_t *p, const char *title);
+
+extern unsigned long long prof_clock(void);	/* monotonic ns */
+extern void prof_add(int what, unsigned long long n);
+extern void prof_stage(int stage, unsigned long long since);
+
+#define PROF_COUNT(what, n) \
+    do { if (prof_enabled) prof_add((what), (n)); } while (0)
+
+/* unsigned long long t;  PROF_BEGIN(t);  ...  PROF_END(PROF_IO, t); */
+#define PROF_BEGIN(t)       ((t) = prof_enabled ? prof_clock() : 0)
+#define PROF_END(stage, t) \
+    do { if (t) prof_stage((stage), (t)); } while (0)
+
+#endif
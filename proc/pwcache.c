@@ -9,68 +9,296 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <pwd.h>
+#include <pthread.h>
 #include "procps.h"
+#include "namecache.h"
+#include "prof.h"
 #include <grp.h>
 
 // might as well fill cache lines... else we waste memory anyway
 
-#define	HASHSIZE	32			/* power of 2 */
+/* Safe for any number of threads:  a cached name is found without locking,
+ * since entries are only ever pushed, complete, onto the front of a chain
+ * and never freed.  A miss asks NSS with the reentrant calls and no lock
+ * held, so parallel readers overlap their LDAP round trips; the lock only
+ * covers publishing and the getpwent() walk.
+ *
+ * Every entry carries an expiry.  Ids NSS doesn't know ("#1234") are cached
+ * too, for less time, so a stale uid doesn't cost a round trip per process.
+ * There is one entry per id:  an expired one is refreshed in place, its name
+ * written first and its expiry last, so whoever sees the new expiry also
+ * sees the new name.  (A name handed out earlier stays valid, though it may
+ * then read as the new one.)
+ *
+ * Before asking NSS we look in the PS_NAMECACHE file, if there is one,
+ * and whatever we learn goes back there at exit, expiry and all.
+ */
+
+#define	HASHSIZE	256			/* power of 2 */
 #define	HASH(x)		((x) & (HASHSIZE - 1))
 
 #define NAMESIZE	20
 #define NAMELENGTH	"19"
 
-static struct pwbuf {
-    struct pwbuf *next;
-    uid_t uid;
+#define	PWCACHE_TTL	600			/* seconds, for a known name */
+#define	PWCACHE_NEGTTL	60			/* seconds, for "#1234" */
+
+#define	LOAD(head)	__atomic_load_n(&(head), __ATOMIC_ACQUIRE)
+#define	PUBLISH(head, p) __atomic_store_n(&(head), (p), __ATOMIC_RELEASE)
+
+static pthread_mutex_t pwlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t pwcache_once = PTHREAD_ONCE_INIT;
+
+struct namebuf {
+    struct namebuf *next;
+    time_t expires;
+    unsigned id;
     char name[NAMESIZE];
-} *pwhash[HASHSIZE];
+};
 
-char *user_from_uid(uid_t uid)
+/* as kept in the cache file, sorted by id */
+struct nc_name {
+    unsigned id;
+    unsigned pad;
+    long long expires;
+    char name[NAMESIZE];
+};
+
+static struct names {
+    struct namebuf *hash[HASHSIZE];
+    const struct nc_name *map;
+    unsigned mapcount;
+    nc_stamp src;
+    int which;				/* NC_UID or NC_GID */
+    void (*flush)(void);
+} users, groups;
+
+static struct namebuf *find(const struct names *n, unsigned id)
 {
-    struct pwbuf **p;
-    struct passwd *pw;
+    struct namebuf *p;
 
-    p = &pwhash[HASH(uid)];
-    while (*p) {
-	if ((*p)->uid == uid)
-	    return((*p)->name);
-	p = &(*p)->next;
-    }
-    *p = (struct pwbuf *) xmalloc(sizeof(struct pwbuf));
-    (*p)->uid = uid;
-    if ((pw = getpwuid(uid)) == NULL)
-	sprintf((*p)->name, "#%d", uid);
+    for (p = LOAD(n->hash[HASH(id)]); p; p = p->next)
+	if (p->id == id)
+	    break;
+    return p;
+}
+
+/* caller holds pwlock */
+static struct namebuf *put(struct names *n, unsigned id, const char *name, time_t expires)
+{
+    struct namebuf *p = find(n, id);
+    char buf[NAMESIZE];
+
+    if (name)
+	sprintf(buf, "%-." NAMELENGTH "s", name);
     else
-	sprintf((*p)->name, "%-." NAMELENGTH "s", pw->pw_name);
-    (*p)->next = NULL;
-    return((*p)->name);
+	sprintf(buf, "#%d", id);
+    if (p) {
+	if (strcmp(p->name, buf))
+	    memcpy(p->name, buf, NAMESIZE);
+	__atomic_store_n(&p->expires, expires, __ATOMIC_RELEASE);
+	return p;
+    }
+    p = (struct namebuf *) xmalloc(sizeof(struct namebuf));
+    p->id = id;
+    p->expires = expires;
+    memcpy(p->name, buf, NAMESIZE);
+    p->next = n->hash[HASH(id)];
+    PUBLISH(n->hash[HASH(id)], p);
+    return p;
 }
 
-static struct grpbuf {
-    struct grpbuf *next;
-    gid_t gid;
-    char name[NAMESIZE];
-} *grphash[HASHSIZE];
+static const struct nc_name *mapped(const struct names *n, unsigned id)
+{
+    unsigned lo = 0, hi = n->mapcount;
 
-char *group_from_gid(gid_t gid)
+    while (lo < hi) {
+	unsigned mid = (lo + hi) / 2;
+	if (n->map[mid].id == id)
+	    return n->map + mid;
+	if (n->map[mid].id < id)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return NULL;
+}
+
+static int by_id_newest(const void *a, const void *b)
+{
+    const struct nc_name *x = a, *y = b;
+
+    if (x->id != y->id)
+	return x->id < y->id ? -1 : 1;
+    return x->expires > y->expires ? -1 : x->expires < y->expires;
+}
+
+/* At exit:  everything still good, from us and from the old file.  Where
+ * both have an id, ours is the newer, since we only ask again once the
+ * file's entry has expired.
+ */
+static void flush_names(struct names *n)
 {
-    struct grpbuf **g;
+    struct nc_name *tab;
+    struct namebuf *p;
+    unsigned i, j, count = 0, room = n->mapcount;
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&pwlock);
+    for (i = 0; i < HASHSIZE; i++)
+	for (p = n->hash[i]; p; p = p->next)
+	    room++;
+    tab = xcalloc(NULL, room * sizeof *tab + 1);
+    for (i = 0; i < HASHSIZE; i++)
+	for (p = n->hash[i]; p; p = p->next)
+	    if (p->expires > now) {
+		tab[count].id = p->id;
+		tab[count].expires = p->expires;
+		memcpy(tab[count++].name, p->name, NAMESIZE);
+	    }
+    pthread_mutex_unlock(&pwlock);
+    for (i = 0; i < n->mapcount; i++)
+	if (n->map[i].expires > now)
+	    tab[count++] = n->map[i];
+    qsort(tab, count, sizeof *tab, by_id_newest);
+    for (i = j = 0; i < count; i++)
+	if (!j || tab[j - 1].id != tab[i].id)
+	    tab[j++] = tab[i];
+    nc_put(n->which, &n->src, tab, j, j * sizeof *tab);
+    free(tab);
+}
+
+static void flush_users(void)
+{
+    flush_names(&users);
+}
+
+static void flush_groups(void)
+{
+    flush_names(&groups);
+}
+
+/* Read all of passwd and group in one go.  With enumeration enabled on
+ * an LDAP or SSSD host this is a single bulk query instead of one round
+ * trip per id; without it the walk only sees local files, and the rest
+ * still comes one at a time.
+ */
+static void warm_names(void)
+{
+    struct passwd *pw;
     struct group *gr;
+    time_t now = time(NULL), expires = now + PWCACHE_TTL;
+    struct namebuf *p;
+
+    pthread_mutex_lock(&pwlock);
+    setpwent();
+    while ((pw = getpwent()) != NULL)
+	if (!(p = find(&users, pw->pw_uid)) || p->expires <= now)
+	    put(&users, pw->pw_uid, pw->pw_name, expires);
+    endpwent();
+    setgrent();
+    while ((gr = getgrent()) != NULL)
+	if (!(p = find(&groups, gr->gr_gid)) || p->expires <= now)
+	    put(&groups, gr->gr_gid, gr->gr_name, expires);
+    endgrent();
+    pthread_mutex_unlock(&pwlock);
+    nc_want_flush(NC_UID, flush_users);
+    nc_want_flush(NC_GID, flush_groups);
+}
+
+static void map_names(struct names *n, int which, const char *file, void (*flush)(void))
+{
+    unsigned bytes;
+
+    n->which = which;
+    n->flush = flush;
+    if (!nc_stamp_file(file, 0, &n->src))
+	return;
+    n->map = nc_section(which, &n->src, &n->mapcount, &bytes);
+    if (n->map && bytes < n->mapcount * sizeof *n->map)
+	n->map = NULL;
+    if (!n->map)
+	n->mapcount = 0;
+}
+
+/* PS_PWENUM in the environment asks for the bulk walk before the first
+ * lookup, unless the cache file already has what it would find.
+ */
+static void pwcache_init(void)
+{
+    map_names(&users, NC_UID, "/etc/passwd", flush_users);
+    map_names(&groups, NC_GID, "/etc/group", flush_groups);
+    if (getenv("PS_PWENUM") && !users.map)
+	warm_names();
+}
+
+static const char *nss_user(unsigned id, char **bufp)
+{
+    struct passwd pwd, *pw;
+    size_t len = 1024;
+    char *buf = xmalloc(len);
+
+    while (getpwuid_r(id, &pwd, buf, len, &pw) == ERANGE && len < 1 << 20)
+	buf = xrealloc(buf, len *= 2);
+    *bufp = buf;
+    return pw ? pw->pw_name : NULL;
+}
 
-    g = &grphash[HASH(gid)];
-    while (*g) {
-       if ((*g)->gid == gid)
-           return((*g)->name);
-       g = &(*g)->next;
+static const char *nss_group(unsigned id, char **bufp)
+{
+    struct group grp, *gr;
+    size_t len = 1024;
+    char *buf = xmalloc(len);		/* member lists can be long */
+
+    while (getgrgid_r(id, &grp, buf, len, &gr) == ERANGE && len < 1 << 20)
+	buf = xrealloc(buf, len *= 2);
+    *bufp = buf;
+    return gr ? gr->gr_name : NULL;
+}
+
+static char *lookup(struct names *n, unsigned id, const char *(*nss)(unsigned, char **))
+{
+    struct namebuf *p;
+    const struct nc_name *m;
+    const char *name;
+    char *buf = NULL;
+    time_t now = time(NULL), expires;
+
+    pthread_once(&pwcache_once, pwcache_init);
+    p = find(n, id);
+    if (p && __atomic_load_n(&p->expires, __ATOMIC_ACQUIRE) > now) {
+	PROF_COUNT(n == &users ? PROF_USER_HIT : PROF_GROUP_HIT, 1);
+	return(p->name);
     }
-    *g = (struct grpbuf *) malloc(sizeof(struct grpbuf));
-    (*g)->gid = gid;
-    if ((gr = getgrgid(gid)) == NULL)
-       sprintf((*g)->name, "#%d", gid);
-    else
-       sprintf((*g)->name, "%-." NAMELENGTH "s", gr->gr_name);
-    (*g)->next = NULL;
-    return((*g)->name);
+    if ((m = mapped(n, id)) && m->expires > now) {	/* the file's a cache too */
+	PROF_COUNT(n == &users ? PROF_USER_HIT : PROF_GROUP_HIT, 1);
+	name = m->name;
+	expires = m->expires;
+    } else {
+	PROF_COUNT(n == &users ? PROF_USER_MISS : PROF_GROUP_MISS, 1);
+	name = nss(id, &buf);
+	expires = now + (name ? PWCACHE_TTL : PWCACHE_NEGTTL);
+	nc_want_flush(n->which, n->flush);
+    }
+    pthread_mutex_lock(&pwlock);
+    p = find(n, id);			/* maybe someone beat us to it */
+    if (!p || p->expires <= now)
+	p = put(n, id, name, expires);
+    pthread_mutex_unlock(&pwlock);
+    free(buf);
+    return(p->name);
+}
+
+char *user_from_uid(uid_t uid)
+{
+    return lookup(&users, uid, nss_user);
+}
+
+char *group_from_gid(gid_t gid)
+{
+    return lookup(&groups, gid, nss_group);
 }
@@ -12,6 +12,9 @@
 #include "readproc.h"
 #include "devname.h"
 #include "procps.h"
+#include "pidwatch.h"
+#include "shmsnap.h"
+#include "prof.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -19,33 +22,394 @@
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
-#include <sys/dir.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <pthread.h>
 
 #ifdef FLASK_LINUX
 #include <fs_secure.h>
 #endif
 
+/* pidscan: glibc's readdir() reads only a few dozen entries per system call
+ * and then the caller still has to turn every name into a number.  With tens
+ * of thousands of tasks it pays to take big bites and parse as we go.
+ */
+#define PIDSCAN_BUFSIZ  (64*1024)
+
+struct linux_dirent64 {		/* what getdents64 hands back */
+    unsigned long long d_ino;
+    long long          d_off;
+    unsigned short     d_reclen;
+    unsigned char      d_type;
+    char               d_name[1];
+};
+
+struct pidscan {
+    int   fd;
+    int   pos, len;		/* unconsumed part of buf */
+    char* buf;
+};
+
+pidscan_t* pidscan_open(const char *dir) {
+    pidscan_t *ps;
+    int fd;
+
+    PROF_COUNT(PROF_SYSCALLS, 1);
+    PROF_COUNT(PROF_OPENS, 1);
+    if ( (fd = open(dir, O_RDONLY | O_DIRECTORY, 0)) == -1 ) return NULL;
+    ps = xmalloc(sizeof *ps);
+    ps->fd = fd;
+    ps->pos = ps->len = 0;
+    ps->buf = xmalloc(PIDSCAN_BUFSIZ);
+    return ps;
+}
+
+pid_t pidscan_next(pidscan_t *ps) {
+    struct linux_dirent64 *de;
+    const char *cp;
+    pid_t pid;
+
+    for (;;) {
+	if (ps->pos >= ps->len) {
+	    unsigned long long t;
+	    PROF_BEGIN(t);
+	    ps->len = syscall(SYS_getdents64, ps->fd, ps->buf, PIDSCAN_BUFSIZ);
+	    PROF_END(PROF_SCAN, t);
+	    PROF_COUNT(PROF_SYSCALLS, 1);
+	    ps->pos = 0;
+	    if (ps->len <= 0) {
+		ps->len = 0;
+		return 0;
+	    }
+	}
+	de = (struct linux_dirent64 *)(ps->buf + ps->pos);
+	ps->pos += de->d_reclen;
+	cp = de->d_name;
+	if (*cp < '1' || *cp > '9')	/* not a task, and no pid 0 either */
+	    continue;
+	pid = 0;
+	do
+	    pid = pid * 10 + (*cp++ - '0');
+	while (*cp >= '0' && *cp <= '9');
+	if (!*cp)
+	    return pid;
+    }
+}
+
+void pidscan_rewind(pidscan_t *ps) {
+    lseek(ps->fd, 0, SEEK_SET);
+    ps->pos = ps->len = 0;
+}
+
+void pidscan_close(pidscan_t *ps) {
+    close(ps->fd);
+    free(ps->buf);
+    free(ps);
+}
+
+/* the digits of `pid' at s, NUL terminated;  returns where the NUL went */
+static char *put_pid(char *s, pid_t pid) {
+    char digits[12], *d = digits + sizeof digits;
+    int n;
+
+    *--d = '\0';
+    do
+	*--d = '0' + pid % 10;
+    while ((pid /= 10));
+    n = digits + sizeof digits - 1 - d;
+    memcpy(s, d, n + 1);
+    return s + n;
+}
+
+/* "/proc/" (or wherever proc_root() says), for the pid to go after */
+static char *put_root(char *path) {
+    int len = proc_root_len();
+
+    memcpy(path, proc_root(), len);
+    path[len] = '/';
+    return path + len + 1;
+}
+
+/* sprintf(path, "/proc/%d", pid) without going through the printf engine
+ */
+static void pid2path(char *path, pid_t pid) {
+    put_pid(put_root(path), pid);
+}
+
+/* PROC_TASKS: "/proc/TGID/task/TID", likewise */
+static void task2path(char *path, pid_t tgid, pid_t tid) {
+    char *s;
+
+    s = put_pid(put_root(path), tgid);
+    memcpy(s, "/task/", 6);
+    put_pid(s + 6, tid);
+}
+
+/* PROC_TASKS: get ready to list the threads of `pid' in *ts, which keeps
+ * its buffer from one process to the next.  Returns 0 when the process has
+ * just the one thread, itself, whose directory is then never opened:  the
+ * task directory links to "." and ".." and each thread.
+ */
+static int tasks_open(pidscan_t **ts, pid_t pid, char *path) {
+    struct stat sb;
+    int fd;
+
+    pid2path(path, pid);
+    strcat(path, "/task");
+    PROF_COUNT(PROF_SYSCALLS, 1);
+    if (stat(path, &sb) == -1 || sb.st_nlink == 3)
+	return 0;			/* (had it gone, so much the better) */
+    PROF_COUNT(PROF_SYSCALLS, 1);
+    PROF_COUNT(PROF_OPENS, 1);
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY, 0)) == -1)
+	return 0;
+    if (!*ts) {
+	*ts = xmalloc(sizeof **ts);
+	(*ts)->buf = xmalloc(PIDSCAN_BUFSIZ);
+    } else if ((*ts)->fd != -1)
+	close((*ts)->fd);
+    (*ts)->fd = fd;
+    (*ts)->pos = (*ts)->len = 0;
+    return 1;
+}
+
+/* ...and the next of them, or 0 (with the directory closed) if no more */
+static pid_t tasks_next(pidscan_t *ts) {
+    pid_t tid = pidscan_next(ts);
+
+    if (!tid) {
+	close(ts->fd);
+	ts->fd = -1;
+    }
+    return tid;
+}
+
+static void tasks_close(pidscan_t *ts) {
+    if (ts->fd != -1)
+	close(ts->fd);
+    free(ts->buf);
+    free(ts);
+}
+
+/* PROC_PERSIST: per-task files which outlive a single readproc() pass.
+ * Entries are chained by pid; `seen' is the pass which last found the task.
+ * With PROC_INCR the task's proc_t is kept here as well.
+ */
+#define PERSIST_HASH  1024
+#define PERSIST_KEY(pid)  ((unsigned)(pid) & (PERSIST_HASH - 1))
+
+#define PF_STAT    0
+#define PF_STATM   1
+#define PF_STATUS  2
+#define PF_FILES   3
+
+struct proc_fds {
+    struct proc_fds *next;
+    pid_t pid;
+    int   seen;
+    int   fd[PF_FILES];	/* -1 if not (yet) open */
+    proc_t *proc;	/* PROC_INCR: what the last pass found */
+};
+
+static const char *persist_names[PF_FILES] = { "stat", "statm", "status" };
+
+static struct proc_fds *persist_get(PROCTAB *PT, pid_t pid) {
+    struct proc_fds **head = &PT->fdhash[PERSIST_KEY(pid)];
+    struct proc_fds *pf;
+
+    for (pf = *head; pf; pf = pf->next)
+	if (pf->pid == pid)
+	    break;
+    if (!pf) {
+	pf = xmalloc(sizeof *pf);
+	pf->pid = pid;
+	pf->fd[PF_STAT] = pf->fd[PF_STATM] = pf->fd[PF_STATUS] = -1;
+	pf->proc = NULL;
+	pf->next = *head;
+	*head = pf;
+    }
+    pf->seen = PT->fdpass;
+    return pf;
+}
+
+static void persist_close(PROCTAB *PT, struct proc_fds *pf, int which) {
+    if (pf->fd[which] == -1)
+	return;
+    close(pf->fd[which]);
+    pf->fd[which] = -1;
+    PT->fdroom++;
+}
+
+/* drop the tasks the last pass did not find, or everything if `all' */
+static void persist_sweep(PROCTAB *PT, int all) {
+    struct proc_fds **link, *pf;
+    int i, which;
+
+    for (i = 0; i < PERSIST_HASH; i++) {
+	link = &PT->fdhash[i];
+	while ((pf = *link)) {
+	    if (!all && pf->seen == PT->fdpass) {
+		link = &pf->next;
+		continue;
+	    }
+	    for (which = 0; which < PF_FILES; which++)
+		persist_close(PT, pf, which);
+	    freeproc(pf->proc);
+	    *link = pf->next;
+	    free(pf);
+	}
+    }
+}
+
+/* PROC_ARENA: chained blocks handed out front to back, all reset at once.
+ * Whatever a single block can't hold gets a block of its own size.
+ */
+#define ARENA_BLOCK  (64*1024)
+#define ARENA_ALIGN  16
+#define ARENA_UP(n)  (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct arena_blk {
+    struct arena_blk *next;
+    unsigned size, used;
+};
+#define ARENA_HDR  ARENA_UP(sizeof(struct arena_blk))
+
+struct proc_arena {
+    struct arena_blk *head, *cur, **tail;
+    char *scratch;		/* where file2strvec_arena() reads to */
+    int   scratchsiz;
+};
+
+static void *arena_alloc(struct proc_arena *a, unsigned size) {
+    struct arena_blk *b;
+
+    size = ARENA_UP(size);
+    for (b = a->cur; b; b = b->next)
+	if (b->size - b->used >= size)
+	    break;
+    if (!b) {
+	unsigned bsize = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+	b = xmalloc(ARENA_HDR + bsize);
+	b->next = NULL;
+	b->size = bsize;
+	b->used = 0;
+	*a->tail = b;
+	a->tail = &b->next;
+    }
+    a->cur = b;
+    b->used += size;
+    return (char *)b + ARENA_HDR + b->used - size;
+}
+
+void resetproc(PROCTAB* PT) {
+    struct arena_blk *b;
+
+    if (!PT->arena)
+	return;
+    for (b = PT->arena->head; b; b = b->next)
+	b->used = 0;
+    PT->arena->cur = PT->arena->head;
+}
+
+static void arena_free(struct proc_arena *a) {
+    struct arena_blk *b, *next;
+
+    for (b = a->head; b; b = next) {
+	next = b->next;
+	free(b);
+    }
+    free(a->scratch);
+    free(a);
+}
+
+/* egid only comes from status, so group names need the ids read too */
+#define FILL_IMPLIED(f) ((f) & PROC_FILLGRP ? (f) | PROC_FILLID : (f))
+
+/* PROCTAB.snapat, when not an index into the snapshot */
+#define SNAP_START  -1		/* a pass yet to begin:  take a snapshot */
+#define SNAP_PROC   -2		/* there was none to take:  read /proc */
+
+/* PROC_UID's list, which a long one (ps -u with many users) is better
+ * searched by halves, if it came in order
+ */
+static void uids_set(PROCTAB* PT, uid_t* uids, int nuid) {
+    int i;
+
+    PT->uids = uids;
+    PT->nuid = nuid;
+    for (i = 1; i < nuid && uids[i-1] < uids[i]; i++)
+	;
+    PT->uidsorted = nuid > 16 && i >= nuid;
+}
+
+static int uid_listed(const PROCTAB* PT, uid_t uid) {
+    int lo = 0, hi = PT->nuid, i;
+
+    if (!PT->uidsorted) {
+	for (i = 0; i < hi; i++)
+	    if (PT->uids[i] == uid)
+		return 1;
+	return 0;
+    }
+    while (lo < hi) {
+	i = (lo + hi) / 2;
+	if (PT->uids[i] == uid)
+	    return 1;
+	if (PT->uids[i] < uid)
+	    lo = i + 1;
+	else
+	    hi = i;
+    }
+    return 0;
+}
+
 /* initiate a process table scan
  */
 PROCTAB* openproc(int flags, ...) {
     va_list ap;
-    PROCTAB* PT = xmalloc(sizeof(PROCTAB));
+    PROCTAB* PT = xcalloc(NULL, sizeof(PROCTAB));
     
-    if (flags & PROC_PID)
+    if (flags & PROC_INCR)	/* its proc_t's live in the persist hash... */
+	flags = (flags | PROC_PERSIST) & ~PROC_ARENA;	/* ...and outlive a pass */
+    if (shmsnap_usable(FILL_IMPLIED(flags)) == 0) {
+      /* /proc is only scanned if a pass finds the snapshot gone stale */
+      PT->snap = xcalloc(NULL, sizeof(shmsnap_copy));
+      PT->snapat = SNAP_START;
+      flags &= ~PROC_LIVE;
+    } else if (flags & PROC_PID || (flags & PROC_LIVE && pidwatch_open() == 0))
       PT->procfs = NULL;
-    else if (!(PT->procfs = opendir("/proc")))
+    else if (!(PT->procfs = pidscan_open(proc_root()))) {
+      free(PT);
       return NULL;
-    PT->flags = flags;
+    }
+    if (flags & PROC_PID || PT->procfs || PT->snap)
+      flags &= ~PROC_LIVE;
+    PT->flags = FILL_IMPLIED(flags);
     va_start(ap, flags);		/*  Init args list */
     if (flags & PROC_PID)
-    	PT->pids = va_arg(ap, pid_t*);
+    	PT->pidhead = PT->pids = va_arg(ap, pid_t*);
     else if (flags & PROC_UID) {
-    	PT->uids = va_arg(ap, uid_t*);
-	PT->nuid = va_arg(ap, int);
+	uid_t *uids = va_arg(ap, uid_t*);
+	uids_set(PT, uids, va_arg(ap, int));
     }
     va_end(ap);				/*  Clean up args list */
+    if (flags & PROC_PERSIST) {
+	struct rlimit rl;
+	/* leave half of our descriptors, and then some, to the caller */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == -1 || rl.rlim_cur == RLIM_INFINITY)
+	    rl.rlim_cur = 1024;
+	/* with no room to keep any, every file is just reopened each pass
+	   (the table still rewinds at the end of one, as callers expect) */
+	if (rl.rlim_cur > 32)
+	    PT->fdroom = (int)rl.rlim_cur / 2 - 16;
+	PT->fdhash = xcalloc(NULL, PERSIST_HASH * sizeof(struct proc_fds*));
+    }
+    if (flags & PROC_ARENA) {
+	PT->arena = xcalloc(NULL, sizeof(struct proc_arena));
+	PT->arena->tail = &PT->arena->head;
+    }
     return PT;
 }
 
@@ -53,169 +417,362 @@ PROCTAB* openproc(int flags, ...) {
  */
 void closeproc(PROCTAB* PT) {
     if (PT){
-        if (PT->procfs) closedir(PT->procfs);
+        if (PT->procfs) pidscan_close(PT->procfs);
+        if (PT->tasks) tasks_close(PT->tasks);
+        if (PT->fdhash) {
+            persist_sweep(PT, 1);
+            free(PT->fdhash);
+        }
+        if (PT->arena) arena_free(PT->arena);
+        shmsnap_free(PT->snap);
+        free(PT->livebuf);
         free(PT);
     }
 }
 
 /* deallocate the space allocated by readproc if the passed rbuf was NULL
  */
+static void freeproc_vecs(proc_t* p) {
+    /* ptrs are after strings to avoid copying memory when building them. */
+    /* so free is called on the address of the address of strvec[0]. */
+    if (!(p->arena & ARENA_VECS)) {
+	if (p->cmdline)
+	    free((void*)*p->cmdline);
+	if (p->environ)
+	    free((void*)*p->environ);
+    }
+}
+
 void freeproc(proc_t* p) {
     if (!p)	/* in case p is NULL */
 	return;
-    /* ptrs are after strings to avoid copying memory when building them. */
-    /* so free is called on the address of the address of strvec[0]. */
-    if (p->cmdline)
-	free((void*)*p->cmdline);
-    if (p->environ)
-	free((void*)*p->environ);
-    free(p);
+    freeproc_vecs(p);
+    if (!(p->arena & ARENA_PROC))
+	free(p);
 }
 
 
 
-static void status2proc (char* S, proc_t* P, int fill) {
-    char* tmp;
-    if (fill == 1) {
-        memset(P->cmd, 0, sizeof P->cmd);
-        sscanf (S, "Name:\t%15c", P->cmd);
-        tmp = strchr(P->cmd,'\n');
-        *tmp='\0';
-        tmp = strstr (S,"State");
-        sscanf (tmp, "State:\t%c", &P->state);
-    }
-
-    tmp = strstr (S,"Pid:");
-    if(tmp) sscanf (tmp,
-        "Pid:\t%d\n"
-        "PPid:\t%d\n",
-        &P->pid,
-        &P->ppid
-    );
-    else fprintf(stderr, "Internal error!\n");
-
-    tmp = strstr (S,"Uid:");
-    if(tmp) sscanf (tmp,
-        "Uid:\t%d\t%d\t%d\t%d",
-        &P->ruid, &P->euid, &P->suid, &P->fuid
-    );
-    else fprintf(stderr, "Internal error!\n");
-
-    tmp = strstr (S,"Gid:");
-    if(tmp) sscanf (tmp,
-        "Gid:\t%d\t%d\t%d\t%d",
-        &P->rgid, &P->egid, &P->sgid, &P->fgid
-    );
-    else fprintf(stderr, "Internal error!\n");
-
-    tmp = strstr (S,"VmSize:");
-    if(tmp) sscanf (tmp,
-        "VmSize: %lu kB\n"
-        "VmLck: %lu kB\n"
-        "VmRSS: %lu kB\n"
-        "VmData: %lu kB\n"
-        "VmStk: %lu kB\n"
-        "VmExe: %lu kB\n"
-        "VmLib: %lu kB\n",
-        &P->vm_size, &P->vm_lock, &P->vm_rss, &P->vm_data,
-        &P->vm_stack, &P->vm_exe, &P->vm_lib
-    );
-    else /* looks like an annoying kernel thread */
-    {
-        P->vm_size  = 0;
-        P->vm_lock  = 0;
-        P->vm_rss   = 0;
-        P->vm_data  = 0;
-        P->vm_stack = 0;
-        P->vm_exe   = 0;
-        P->vm_lib   = 0;
-    }
-
-    tmp = strstr (S,"SigPnd:");
-    if(tmp) sscanf (tmp,
+/* The /proc/#/stat, statm and status parsers make a single pass over the
+ * buffer, by hand:  no scanf, no locale, no rescanning with strstr().  Each
+ * one copes with fields missing off the end, which older kernels omit, and
+ * with fields it doesn't know about, which newer kernels add.
+ */
+
+/* a (maybe negative) decimal number; leaves *S just past its digits */
+static unsigned long long get_num(char **S) {
+    char *s = *S;
+    unsigned long long n = 0;
+    int neg = 0;
+
+    while (*s == ' ' || *s == '\t')
+	s++;
+    if (*s == '-') {
+	neg = 1;
+	s++;
+    }
+    while (*s >= '0' && *s <= '9')
+	n = n * 10 + (*s++ - '0');
+    *S = s;
+    return neg ? -n : n;
+}
+
+/* does the "Key:" at K, LEN bytes before its colon, say NAME? */
+#define KEY_IS(K, LEN, NAME) \
+	((LEN) == sizeof(NAME) - 1 && !memcmp((K), (NAME), sizeof(NAME) - 1))
+
 #ifdef SIGNAL_STRING
-        "SigPnd: %s SigBlk: %s SigIgn: %s %*s %s",
-        P->signal, P->blocked, P->sigignore, P->sigcatch
+/* a signal mask, kept as the kernel's hex string */
+static void get_sig(char *s, char *dst) {
+    int i = 0;
+
+    while (*s == ' ' || *s == '\t')
+	s++;
+    while (i < 17 && *s > ' ')
+	dst[i++] = *s++;
+    dst[i] = '\0';
+}
 #else
-        "SigPnd: %Lx SigBlk: %Lx SigIgn: %Lx %*s %Lx",
-        &P->signal, &P->blocked, &P->sigignore, &P->sigcatch
+static void get_sig(char *s, long long *dst) {
+    unsigned long long n = 0;
+    int c;
+
+    while (*s == ' ' || *s == '\t')
+	s++;
+    for (;;) {
+	c = *s++;
+	if (c >= '0' && c <= '9')	 c -= '0';
+	else if (c >= 'a' && c <= 'f') c -= 'a' - 10;
+	else if (c >= 'A' && c <= 'F') c -= 'A' - 10;
+	else break;
+	n = (n << 4) | c;
+    }
+    *dst = n;
+}
 #endif
-    );
-    else fprintf(stderr, "Internal error!\n");
+
+#define ST_PID	 0x01
+#define ST_UID	 0x02
+#define ST_GID	 0x04
+#define ST_SIG	 0x08
+#define ST_VM	 0x10
+
+/* the keys which must be seen before each part of PROC_FILLSTATUS is done */
+static int status_want(int flags) {
+    int want = ST_PID;
+
+    if (flags & PROC_FILLID)  want |= ST_UID | ST_GID;
+    if (flags & PROC_FILLSIG) want |= ST_SIG;
+    if (flags & PROC_FILLVM)  want |= ST_VM;
+    return want;
+}
+
+/* status2proc: parse status up to the last key `flags' asks for */
+static void status2proc (char* S, proc_t* P, int fill, int flags) {
+    char *key, *s = S;
+    int len, i, found = 0, want = status_want(flags);
+
+    if (fill == 1)
+        memset(P->cmd, 0, sizeof P->cmd);
+    /* stays this way for an annoying kernel thread */
+    P->vm_size  = 0;
+    P->vm_lock  = 0;
+    P->vm_rss   = 0;
+    P->vm_data  = 0;
+    P->vm_stack = 0;
+    P->vm_exe   = 0;
+    P->vm_lib   = 0;
+
+    while (*s && (found & want) != want) {
+	key = s;
+	while (*s && *s != ':' && *s != '\n')
+	    s++;
+	len = s - key;
+	if (*s == ':') {
+	    s++;
+	    switch (*key) {
+	    case 'N':
+		if (fill == 1 && KEY_IS(key, len, "Name")) {
+		    while (*s == '\t' || *s == ' ')
+			s++;
+		    for (i = 0; i < 15 && *s && *s != '\n'; i++)
+			P->cmd[i] = *s++;
+		}
+		break;
+	    case 'S':
+		if (KEY_IS(key, len, "State")) {
+		    if (fill == 1) {
+			while (*s == '\t' || *s == ' ')
+			    s++;
+			P->state = *s;
+		    }
+		} else if (KEY_IS(key, len, "SigPnd"))
+		    get_sig(s, P->signal);
+		else if (KEY_IS(key, len, "SigBlk"))
+		    get_sig(s, P->blocked);
+		else if (KEY_IS(key, len, "SigIgn"))
+		    get_sig(s, P->sigignore);
+		else if (KEY_IS(key, len, "SigCgt")) {
+		    get_sig(s, P->sigcatch);
+		    found |= ST_SIG;		/* the last of the masks */
+		}
+		break;
+	    case 'P':
+		if (KEY_IS(key, len, "Pid")) {
+		    P->pid = get_num(&s);
+		    found |= ST_PID;
+		} else if (KEY_IS(key, len, "PPid"))
+		    P->ppid = get_num(&s);
+		break;
+	    case 'U':
+		if (KEY_IS(key, len, "Uid")) {
+		    P->ruid = get_num(&s);
+		    P->euid = get_num(&s);
+		    P->suid = get_num(&s);
+		    P->fuid = get_num(&s);
+		    found |= ST_UID;
+		}
+		break;
+	    case 'G':
+		if (KEY_IS(key, len, "Gid")) {
+		    P->rgid = get_num(&s);
+		    P->egid = get_num(&s);
+		    P->sgid = get_num(&s);
+		    P->fgid = get_num(&s);
+		    found |= ST_GID;
+		}
+		break;
+	    case 'V':			/* all in kB */
+		if      (KEY_IS(key, len, "VmSize")) P->vm_size  = get_num(&s);
+		else if (KEY_IS(key, len, "VmLck"))  P->vm_lock  = get_num(&s);
+		else if (KEY_IS(key, len, "VmRSS"))  P->vm_rss   = get_num(&s);
+		else if (KEY_IS(key, len, "VmData")) P->vm_data  = get_num(&s);
+		else if (KEY_IS(key, len, "VmStk"))  P->vm_stack = get_num(&s);
+		else if (KEY_IS(key, len, "VmExe"))  P->vm_exe   = get_num(&s);
+		else if (KEY_IS(key, len, "VmLib")) {
+		    P->vm_lib = get_num(&s);
+		    found |= ST_VM;		/* the last of the sizes */
+		}
+		break;
+	    }
+	}
+	while (*s && *s != '\n')	/* on to the next line */
+	    s++;
+	if (*s)
+	    s++;
+    }
+    /* kernel threads have no Vm lines, so those are not missed */
+    if (((found | ST_VM) & want) != want)
+	fprintf(stderr, "Internal error!\n");
 }
 
 
 
 /* stat2proc() makes sure it can handle arbitrary executable file basenames
- * for `cmd', i.e. those with embedded whitespace or embedded ')'s.
- * Such names confuse %s (see scanf(3)), so the string is split and %39c
- * is used instead. (except for embedded ')' "(%[^)]c)" would work.
+ * for `cmd', i.e. those with embedded whitespace or embedded ')'s: the name
+ * runs from the first '(' to the last ')'.  The numbers which follow are
+ * gathered up first, in order, then handed out to their proc_t fields.
  */
+#define STAT_NUMS  38
+
 static void stat2proc(char* S, proc_t* P) {
-    int num;
-    char* tmp = strrchr(S, ')');	/* split into "PID (cmd" and "<rest>" */
-    *tmp = '\0';			/* replace trailing ')' with NUL */
-    /* fill in default values for older kernels */
-    P->exit_signal = SIGCHLD;
-    P->processor = 0;
-    P->rtprio = -1;
-    P->sched = -1;
-    /* parse these two strings separately, skipping the leading "(". */
+    unsigned long long v[STAT_NUMS];
+    char *s, *tmp = strrchr(S, ')');	/* split into "PID (cmd" and "<rest>" */
+    int n;
+
+    if (!tmp || !(s = strchr(S, '(')))
+	return;
+    P->pid = get_num(&S);
+    s++;				/* skip the leading "(" */
+    n = tmp - s;
+    if (n > 15)				/* comm[16] in kernel */
+	n = 15;
     memset(P->cmd, 0, sizeof P->cmd);	/* clear even though *P xcalloc'd ?! */
-    sscanf(S, "%d (%15c", &P->pid, P->cmd);   /* comm[16] in kernel */
-    num = sscanf(tmp + 2,			/* skip space after ')' too */
-       "%c "
-       "%d %d %d %d %d "
-       "%lu %lu %lu %lu %lu "
-       "%Lu %Lu %Lu %Lu "  /* utime stime cutime cstime */
-       "%ld %ld %ld %ld "
-       "%Lu "  /* start_time */
-       "%lu "
-       "%ld "
-       "%lu %lu %lu %lu %lu %lu "
-       "%*s %*s %*s %*s " /* discard, no RT signals & Linux 2.1 used hex */
-       "%lu %lu %lu "
-       "%d %d "
-       "%lu %lu",
-       &P->state,
-       &P->ppid, &P->pgrp, &P->session, &P->tty, &P->tpgid,
-       &P->flags, &P->min_flt, &P->cmin_flt, &P->maj_flt, &P->cmaj_flt,
-       &P->utime, &P->stime, &P->cutime, &P->cstime,
-       &P->priority, &P->nice, &P->timeout, &P->it_real_value,
-       &P->start_time,
-       &P->vsize,
-       &P->rss,
-       &P->rss_rlim, &P->start_code, &P->end_code, &P->start_stack, &P->kstk_esp, &P->kstk_eip,
-/*     P->signal, P->blocked, P->sigignore, P->sigcatch,   */ /* can't use */
-       &P->wchan, &P->nswap, &P->cnswap,
+    memcpy(P->cmd, s, n);
+
+    s = tmp + 1;			/* skip the ')' */
+    while (*s == ' ')
+	s++;
+    P->state = *s ? *s++ : '?';
+
+    memset(v, 0, sizeof v);
+    /* fill in default values for older kernels */
+    v[34] = SIGCHLD;			/* exit_signal */
+    v[35] = 0;				/* processor */
+    v[36] = -1;				/* rtprio */
+    v[37] = -1;				/* sched */
+    for (n = 0; n < STAT_NUMS; n++) {
+	while (*s == ' ')
+	    s++;
+	if (!*s || *s == '\n')
+	    break;
+	v[n] = get_num(&s);
+	while (*s && *s != ' ')		/* Linux 2.1 used hex for signals */
+	    s++;
+    }
+
+    P->ppid          = v[0];
+    P->pgrp          = v[1];
+    P->session       = v[2];
+    P->tty           = v[3];
+    P->tpgid         = v[4];
+    P->flags         = v[5];
+    P->min_flt       = v[6];
+    P->cmin_flt      = v[7];
+    P->maj_flt       = v[8];
+    P->cmaj_flt      = v[9];
+    P->utime         = v[10];
+    P->stime         = v[11];
+    P->cutime        = v[12];
+    P->cstime        = v[13];
+    P->priority      = v[14];
+    P->nice          = v[15];
+    P->timeout       = v[16];
+    P->nlwp          = v[16];		/* 2.6 reused the slot */
+    P->it_real_value = v[17];
+    P->start_time    = v[18];
+    P->vsize         = v[19];
+    P->rss           = v[20];
+    P->rss_rlim      = v[21];
+    P->start_code    = v[22];
+    P->end_code      = v[23];
+    P->start_stack   = v[24];
+    P->kstk_esp      = v[25];
+    P->kstk_eip      = v[26];
+ /* v[27..30] are the signals, but we can't use these (see status2proc) */
+    P->wchan         = v[31];
+    P->nswap         = v[32];
+    P->cnswap        = v[33];
 /* -- Linux 2.0.35 ends here -- */
-       &P->exit_signal, &P->processor,  /* 2.2.1 ends with "exit_signal" */
+    P->exit_signal   = v[34];		/* 2.2.1 ends with "exit_signal" */
+    P->processor     = v[35];
 /* -- Linux 2.2.8 to 2.5.17 end here -- */
-       &P->rtprio, &P->sched  /* both added to 2.5.18 */
-    );
-    
-    /* fprintf(stderr, "stat2proc converted %d fields.\n",num); */
+    P->rtprio        = v[36];		/* both added to 2.5.18 */
+    P->sched         = v[37];
+
     if (P->tty == 0)
 	P->tty = -1;  /* the old notty val, update elsewhere bef. moving to 0 */
 }
 
 static void statm2proc(char* s, proc_t* P) {
-    int num;
-    num = sscanf(s, "%ld %ld %ld %ld %ld %ld %ld",
-	   &P->size, &P->resident, &P->share,
-	   &P->trs, &P->lrs, &P->drs, &P->dt);
-/*    fprintf(stderr, "statm2proc converted %d fields.\n",num); */
+    P->size     = get_num(&s);
+    P->resident = get_num(&s);
+    P->share    = get_num(&s);
+    P->trs      = get_num(&s);
+    P->lrs      = get_num(&s);
+    P->drs      = get_num(&s);
+    P->dt       = get_num(&s);
 }
 
 static int file2str(const char *directory, const char *what, char *ret, int cap) {
-    static char filename[80];
+    char filename[PROCPATHLEN + 16];
     int fd, num_read;
 
     sprintf(filename, "%s/%s", directory, what);
-    if ( (fd       = open(filename, O_RDONLY, 0)) == -1 ) return -1;
+    PROF_COUNT(PROF_OPENS, 1);
+    if ( (fd       = open(filename, O_RDONLY, 0)) == -1 ) {
+	PROF_COUNT(PROF_SYSCALLS, 1);
+	return -1;
+    }
     if ( (num_read = read(fd, ret, cap - 1))      <= 0 ) num_read = -1;
     else ret[num_read] = 0;
     close(fd);
+    PROF_COUNT(PROF_SYSCALLS, 3);
+    PROF_COUNT(PROF_BYTES, num_read > 0 ? num_read : 0);
+    return num_read;
+}
+
+/* file2str() for PROC_PERSIST: reuse (or open) this task's file.  A file
+ * which no longer reads belonged to a task now gone;  its pid may have been
+ * handed out again, so try once more with a fresh open.  Once we are out of
+ * room for more descriptors, fall back to the plain open+read+close.
+ */
+static int persist2str(PROCTAB *PT, struct proc_fds *pf, const char *directory,
+		       int which, char *ret, int cap) {
+    char filename[PROCPATHLEN + 16];
+    int fd, num_read, fresh = 0;
+
+    if ((fd = pf->fd[which]) == -1) {
+	if (PT->fdroom <= 0)
+	    return file2str(directory, persist_names[which], ret, cap);
+	sprintf(filename, "%s/%s", directory, persist_names[which]);
+	PROF_COUNT(PROF_SYSCALLS, 1);
+	PROF_COUNT(PROF_OPENS, 1);
+	if ( (fd = open(filename, O_RDONLY, 0)) == -1 ) return -1;
+	pf->fd[which] = fd;
+	PT->fdroom--;
+	fresh = 1;
+    }
+    num_read = pread(fd, ret, cap - 1, 0);
+    PROF_COUNT(PROF_SYSCALLS, 1);
+    if ( num_read <= 0 ) {
+	persist_close(PT, pf, which);
+	if (!fresh)
+	    return persist2str(PT, pf, directory, which, ret, cap);
+	return -1;
+    }
+    ret[num_read] = 0;
+    PROF_COUNT(PROF_BYTES, num_read);
     return num_read;
 }
 
@@ -226,10 +783,14 @@ static char** file2strvec(const char* directory, const char* what) {
     int align;
 
     sprintf(buf, "%s/%s", directory, what);
+    PROF_COUNT(PROF_SYSCALLS, 1);
+    PROF_COUNT(PROF_OPENS, 1);
     if ( (fd = open(buf, O_RDONLY, 0) ) == -1 ) return NULL;
 
     /* read whole file into a memory buffer, allocating as we go */
     while ((n = read(fd, buf, sizeof buf - 1)) > 0) {
+	PROF_COUNT(PROF_SYSCALLS, 1);
+	PROF_COUNT(PROF_BYTES, n);
 	if (n < (int)(sizeof buf - 1))
 	    end_of_file = 1;
 	if (n == 0 && rbuf == 0)
@@ -248,6 +809,7 @@ static char** file2strvec(const char* directory, const char* what) {
 	    break;
     }
     close(fd);
+    PROF_COUNT(PROF_SYSCALLS, n > 0 ? 1 : 2);	/* the close, and a last read */
     if (n <= 0 && !end_of_file) {
 	if (rbuf) free(rbuf);
 	return NULL;		/* read error */
@@ -273,6 +835,71 @@ static char** file2strvec(const char* directory, const char* what) {
 }
 
 
+/* a strvec of the `tot' bytes at `s', NUL separated and ended:  the strings
+ * with their pointers after them, from the arena (PROC_ARENA) or the heap
+ */
+static char** strvec_copy(PROCTAB* PT, int flags, const char* s, int tot) {
+    const char *e;
+    char *p, *rbuf, *endbuf, **q, **ret;
+    int c, align;
+
+    align = (sizeof(char*)-1) - ((tot + sizeof(char*)-1) & (sizeof(char*)-1));
+    for (c = 0, e = s; e < s + tot; e++)
+	if (!*e)
+	    c += sizeof(char*);
+    c += sizeof(char*);				/* one extra for NULL term */
+
+    if (flags & PROC_ARENA)
+	rbuf = arena_alloc(PT->arena, tot + align + c);
+    else
+	rbuf = xmalloc(tot + align + c);
+    memcpy(rbuf, s, tot);
+    endbuf = rbuf + tot;			/* addr just past data buf */
+    q = ret = (char**) (endbuf+align);		/* pointers AT END, as usual */
+    *q++ = p = rbuf;				/* point ptrs to the strings */
+    endbuf--;					/* do not traverse final NUL */
+    while (++p < endbuf)
+	if (!*p)				/* NUL char implies that */
+	    *q++ = p+1;				/* next string -> next char */
+
+    *q = 0;					/* null ptr list terminator */
+    return ret;
+}
+
+/* file2strvec() for PROC_ARENA: slurp the file into the PROCTAB's reusable
+ * scratch buffer, then copy it, with its pointers, into the arena in one go.
+ */
+static char** file2strvec_arena(PROCTAB* PT, const char* directory, const char* what) {
+    struct proc_arena *a = PT->arena;
+    char path[PROCPATHLEN + 16];
+    int fd, tot = 0, n;
+
+    sprintf(path, "%s/%s", directory, what);
+    PROF_COUNT(PROF_SYSCALLS, 1);
+    PROF_COUNT(PROF_OPENS, 1);
+    if ( (fd = open(path, O_RDONLY, 0) ) == -1 ) return NULL;
+    for (;;) {
+	if (a->scratchsiz - tot < 2048) {
+	    a->scratchsiz = a->scratchsiz * 2 + 4096;
+	    a->scratch = xrealloc(a->scratch, a->scratchsiz);
+	}
+	n = read(fd, a->scratch + tot, a->scratchsiz - tot - 1);
+	PROF_COUNT(PROF_SYSCALLS, 1);
+	if (n <= 0)
+	    break;
+	tot += n;
+    }
+    close(fd);
+    PROF_COUNT(PROF_SYSCALLS, 1);
+    PROF_COUNT(PROF_BYTES, tot);
+    if (n < 0 || !tot)
+	return NULL;		/* read error, or nothing there (anymore) */
+    if (a->scratch[tot-1])			/* last read char not null */
+	a->scratch[tot++] = '\0';		/* so append null-terminator */
+    return strvec_copy(PT, PROC_ARENA, a->scratch, tot);
+}
+
+
 /* These are some nice GNU C expression subscope "inline" functions.
  * The can be used with arbitrary types and evaluate their arguments
  * exactly once.
@@ -293,117 +920,233 @@ static char** file2strvec(const char* directory, const char* what) {
 	    i < n && l[i] == x;			\
 	} )
 
-/* readproc: return a pointer to a proc_t filled with requested info about the
- * next process available matching the restriction set.  If no more such
- * processes are available, return a null pointer (boolean false).  Use the
- * passed buffer instead of allocating space if it is non-NULL.  */
+/* a proc_t to fill:  the caller's, or a new one from the arena or the heap
+ */
+static proc_t* proc_alloc(PROCTAB* PT, int flags, proc_t* p) {
+    if (!p) {
+	if (flags & PROC_ARENA) {
+	    p = memset(arena_alloc(PT->arena, sizeof *p), 0, sizeof *p);
+	    p->arena = ARENA_PROC;
+	} else
+	    p = xcalloc(p, sizeof *p);
+    } else
+	p->arena = 0;
+    if (flags & PROC_ARENA)
+	p->arena |= ARENA_VECS;
+    return p;
+}
 
-/* This is optimized so that if a PID list is given, only those files are
- * searched for in /proc.  If other lists are given in addition to the PID list,
- * the same logic can follow through as for the no-PID list case.  This is
- * fairly complex, but it does try to not to do any unnecessary work.
+static char** pid2strvec(PROCTAB* PT, int flags, const char* path, const char* what) {
+    unsigned long long t;
+    char **v;
+
+    PROF_BEGIN(t);
+    if (flags & PROC_ARENA)
+	v = file2strvec_arena(PT, path, what);
+    else
+	v = file2strvec(path, what);
+    PROF_END(PROF_IO, t);
+    return v;
+}
+
+/* some number->text resolving which is time consuming */
+static void fill_names(proc_t *p, int flags) {
+    unsigned long long t;
+
+    if (!(flags & (PROC_FILLUSR | PROC_FILLGRP)))
+	return;
+    PROF_BEGIN(t);
+    if (flags & PROC_FILLUSR){
+	strncpy(p->euser,   user_from_uid(p->euid), sizeof p->euser);
+        if(flags & PROC_FILLID) {
+            strncpy(p->ruser,   user_from_uid(p->ruid), sizeof p->ruser);
+            strncpy(p->suser,   user_from_uid(p->suid), sizeof p->suser);
+            strncpy(p->fuser,   user_from_uid(p->fuid), sizeof p->fuser);
+        }
+    }
+
+    if (flags & PROC_FILLGRP){
+        strncpy(p->egroup, group_from_gid(p->egid), sizeof p->egroup);
+        if(flags & PROC_FILLID) {
+            strncpy(p->rgroup, group_from_gid(p->rgid), sizeof p->rgroup);
+            strncpy(p->sgroup, group_from_gid(p->sgid), sizeof p->sgroup);
+            strncpy(p->fgroup, group_from_gid(p->fgid), sizeof p->fgroup);
+        }
+    }
+    PROF_END(PROF_NAMES, t);
+}
+
+/* read one of the task's files, through its PROC_PERSIST descriptor if any */
+static int pid2str(PROCTAB* PT, struct proc_fds* pf, const char* path,
+		   int which, char* sbuf, int cap) {
+    unsigned long long t;
+    int n;
+
+    PROF_BEGIN(t);
+    if (pf)
+	n = persist2str(PT, pf, path, which, sbuf, cap);
+    else
+	n = file2str(path, persist_names[which], sbuf, cap);
+    PROF_END(PROF_IO, t);
+    return n;
+}
+
+/* read_task: fill in (or allocate, if p is NULL) one task's proc_t, using the
+ * caller's `path' and `sbuf' as scratch.  Returns NULL if the task has gone
+ * away or is filtered out by PT's uid list or hooks;  nothing is left
+ * allocated then.  It keeps no state of its own, so as long as `flags' leaves
+ * out both PROC_PERSIST and PROC_ARENA (each shares storage kept in PT), any
+ * number of threads may run it at once, even on the same PT.  This is the only reader:  readproc(), ps_readproc() and
+ * readproctab_parallel() all come through here (by way of pid2proc()).
  */
-proc_t* readproc(PROCTAB* PT, proc_t* p) {
-    static struct direct *ent;		/* dirent handle */
-    static struct stat sb;		/* stat buffer */
-    static char path[32], sbuf[1024];	/* bufs for stat,statm */
-    int matched = 0;	/* flags */
+static proc_t* read_task(PROCTAB* PT, int flags, pid_t tgid, pid_t pid,
+			 proc_t* p, char *path, char *sbuf, int cap) {
+    struct stat sb;			/* stat buffer */
+    struct proc_fds *pf = NULL;		/* PROC_PERSIST files, if any */
+    proc_t *old = NULL;			/* PROC_INCR: last pass's proc_t */
+    unsigned long long start_time = 0;	/* ...and what to tell its task by */
+    int euid = 0, keep = 0, alloced = !p;
+    char state = 0, cmd[sizeof old->cmd];
+    unsigned long long t;		/* for prof.h */
 #ifdef FLASK_LINUX
     security_id_t secsid;
 #endif
 
-    /* loop until a proc matching restrictions is found or no more processes */
-    /* I know this could be a while loop -- this way is easier to indent ;-) */
-next_proc:				/* get next PID for consideration */
-
-/*printf("PT->flags is 0x%08x\n", PT->flags);*/
-#define flags (PT->flags)
+    if (flags & PROC_TASKS)
+	task2path(path, tgid, pid);
+    else
+	pid2path(path, pid);
 
-    if (flags & PROC_PID) {
-	if (!*PT->pids)			/* set to next item in pids */
-	    return NULL;
-	sprintf(path, "/proc/%d", *(PT->pids)++);
-	matched = 1;
-    } else {					/* get next numeric /proc ent */
-	while ((ent = readdir(PT->procfs)) &&
-	       (*ent->d_name < '0' || *ent->d_name > '9'))
-	    ;
-	if (!ent || !ent->d_name)
-	    return NULL;
-	sprintf(path, "/proc/%s", ent->d_name);
+    PROF_BEGIN(t);
+    if (flags & PROC_PERSIST) {
+	pf = persist_get(PT, pid);
+	if (persist2str(PT, pf, path, PF_STAT, sbuf, cap) == -1)
+	    return NULL;			/* error reading /proc/#/stat */
     }
+    PROF_COUNT(PROF_SYSCALLS, 1);
 #ifdef FLASK_LINUX
     if ( stat_secure(path, &sb, &secsid) == -1 ) /* no such dirent (anymore) */
 #else
-    if (stat(path, &sb) == -1)		/* no such dirent (anymore) */
+    /* a stat file kept open stands in for the directory, saving a lookup */
+    if (pf && pf->fd[PF_STAT] != -1 ? fstat(pf->fd[PF_STAT], &sb) == -1
+				    : stat(path, &sb) == -1)
 #endif
-	goto next_proc;
+	return NULL;
+
+    if ((flags & PROC_UID) && !uid_listed(PT, sb.st_uid))
+	return NULL;			/* not one of the requested uids */
 
-    if ((flags & PROC_UID) && !XinLN(uid_t, sb.st_uid, PT->uids, PT->nuid))
-	goto next_proc;			/* not one of the requested uids */
+    if (!pf && (file2str(path, "stat", sbuf, cap)) == -1)
+	return NULL;			/* error reading /proc/#/stat */
+    PROF_END(PROF_IO, t);
 
-    if (!p)
-	p = xcalloc(p, sizeof *p); /* passed buf or alloced mem */
+    if (flags & PROC_INCR) {
+	if ((old = pf->proc)) {
+	    start_time = old->start_time;
+	    euid = old->euid;
+	    state = old->state;
+	    memcpy(cmd, old->cmd, sizeof cmd);
+	}
+	p = pf->proc = proc_alloc(PT, flags, old);
+    } else
+	p = proc_alloc(PT, flags, p);		/* passed buf or alloced mem */
     p->euid = sb.st_uid;			/* need a way to get real uid */
 
 #ifdef FLASK_LINUX
     p->secsid = secsid;
 #endif
 
-    if ((file2str(path, "stat", sbuf, sizeof sbuf)) == -1)
-	goto next_proc;			/* error reading /proc/#/stat */
+    PROF_BEGIN(t);
     stat2proc(sbuf, p);				/* parse /proc/#/stat */
+    PROF_END(PROF_PARSE, t);
+    p->tgid = tgid;
 
     if (flags & PROC_FILLMEM) {				/* read, parse /proc/#/statm */
-	if ((file2str(path, "statm", sbuf, sizeof sbuf)) != -1 )
+	if (pid2str(PT, pf, path, PF_STATM, sbuf, cap) != -1) {
+	    PROF_BEGIN(t);
 	    statm2proc(sbuf, p);		/* ignore statm errors here */
+	    PROF_END(PROF_PARSE, t);
+	}
     }						/* statm fields just zero */
 
-    if (flags & PROC_FILLSTATUS) {         /* read, parse /proc/#/status */
-       if ((file2str(path, "status", sbuf, sizeof sbuf)) != -1 ){
-           status2proc(sbuf, p, 0 /*FIXME*/);
-       }
+    /* PROC_INCR: the same task as last pass keeps all the rest;  an exec,
+     * a setuid or dying count as changes, as does a reused pid */
+    keep = old && p->start_time == start_time && p->euid == euid
+	&& (p->state == 'Z' ? state == 'Z'
+			    : state != 'Z' && !strcmp(p->cmd, cmd));
+    if (old && !keep) {
+	freeproc_vecs(old);
+	old->cmdline = old->environ = NULL;
     }
 
-    /* some number->text resolving which is time consuming */
-    if (flags & PROC_FILLUSR){
-	strncpy(p->euser,   user_from_uid(p->euid), sizeof p->euser);
-        if(flags & PROC_FILLSTATUS) {
-            strncpy(p->ruser,   user_from_uid(p->ruid), sizeof p->ruser);
-            strncpy(p->suser,   user_from_uid(p->suid), sizeof p->suser);
-            strncpy(p->fuser,   user_from_uid(p->fuid), sizeof p->fuser);
-        }
-    }
+    if (PT->hooks[PROC_HOOK_STAT] && !PT->hooks[PROC_HOOK_STAT](p))
+	goto drop;
 
-    /* some number->text resolving which is time consuming */
-    if (flags & PROC_FILLGRP){
-        strncpy(p->egroup, group_from_gid(p->egid), sizeof p->egroup);
-        if(flags & PROC_FILLSTATUS) {
-            strncpy(p->rgroup, group_from_gid(p->rgid), sizeof p->rgroup);
-            strncpy(p->sgroup, group_from_gid(p->sgid), sizeof p->sgroup);
-            strncpy(p->fgroup, group_from_gid(p->fgid), sizeof p->fgroup);
-        }
+    if (!keep) {
+	if (flags & PROC_FILLSTATUS) {		/* read, parse /proc/#/status */
+	    if (pid2str(PT, pf, path, PF_STATUS, sbuf, cap) != -1) {
+		PROF_BEGIN(t);
+		status2proc(sbuf, p, 0 /*FIXME*/, flags);
+		PROF_END(PROF_PARSE, t);
+	    }
+	}
+	fill_names(p, flags);
     }
 
-    if ((flags & PROC_FILLCOM) || (flags & PROC_FILLARG))	/* read+parse /proc/#/cmdline */
-	p->cmdline = file2strvec(path, "cmdline");
-    else
-        p->cmdline = NULL;
+    if (PT->hooks[PROC_HOOK_STATUS] && !PT->hooks[PROC_HOOK_STATUS](p))
+	goto drop;
+
+    if (!keep) {
+	if ((flags & PROC_FILLCOM) || (flags & PROC_FILLARG))	/* read+parse /proc/#/cmdline */
+	    p->cmdline = pid2strvec(PT, flags, path, "cmdline");
+	else
+	    p->cmdline = NULL;
+
+	if (flags & PROC_FILLENV)		/* read+parse /proc/#/environ */
+	    p->environ = pid2strvec(PT, flags, path, "environ");
+	else
+	    p->environ = NULL;
+
+	if (flags & PROC_FILLCGROUP)
+	    p->cgroup = cgroup_of(path, pid, p->start_time);
+	else
+	    p->cgroup = NULL;
+    }
 
-    if (flags & PROC_FILLENV)			/* read+parse /proc/#/environ */
-	p->environ = file2strvec(path, "environ");
-    else
-        p->environ = NULL;
-    
     if (p->state == 'Z')		/* fixup cmd for zombies */
-	strncat(p->cmd," <defunct>", sizeof p->cmd);
+	strncat(p->cmd," <defunct>", sizeof p->cmd - strlen(p->cmd) - 1);
 
     return p;
+
+drop:
+    /* a kept PROC_INCR proc_t is still whole;  anything else of ours goes */
+    if (keep)
+	return NULL;
+    if (flags & PROC_INCR) {
+	pf->proc = NULL;
+	alloced = 1;
+    }
+    if (alloced) {
+	p->cmdline = p->environ = NULL;
+	freeproc(p);
+    }
+    return NULL;
 }
-#undef flags
 
-/* ps_readproc: return a pointer to a proc_t filled with requested info about the
- * next process available matching the restriction set.  If no more such
+/* read_task(), timed and counted for prof.h */
+static proc_t* pid2proc(PROCTAB* PT, int flags, pid_t tgid, pid_t pid,
+			proc_t* p, char *path, char *sbuf, int cap) {
+    unsigned long long t;
+
+    PROF_BEGIN(t);
+    p = read_task(PT, flags, tgid, pid, p, path, sbuf, cap);
+    PROF_END(PROF_READ, t);
+    PROF_COUNT(PROF_TASKS, p != NULL);
+    return p;
+}
+
+/* procfs_next: return a pointer to a proc_t filled with requested info about
+ * the next process in /proc matching the restriction set.  If no more such
  * processes are available, return a null pointer (boolean false).  Use the
  * passed buffer instead of allocating space if it is non-NULL.  */
 
@@ -412,13 +1155,9 @@ next_proc:				/* get next PID for consideration */
  * the same logic can follow through as for the no-PID list case.  This is
  * fairly complex, but it does try to not to do any unnecessary work.
  */
-proc_t* ps_readproc(PROCTAB* PT, proc_t* p) {
-    static struct direct *ent;		/* dirent handle */
-    static struct stat sb;		/* stat buffer */
-    static char path[32], sbuf[1024];	/* bufs for stat,statm */
-#ifdef FLASK_LINUX
-    security_id_t secsid;
-#endif
+static proc_t* procfs_next(PROCTAB* PT, proc_t* p) {
+    proc_t *ret;
+    pid_t pid, tgid;
 
     /* loop until a proc matching restrictions is found or no more processes */
     /* I know this could be a while loop -- this way is easier to indent ;-) */
@@ -427,92 +1166,190 @@ next_proc:				/* get next PID for consideration */
 /*printf("PT->flags is 0x%08x\n", PT->flags);*/
 #define flags (PT->flags)
 
-	while ((ent = readdir(PT->procfs)) &&
-	       (*ent->d_name < '0' || *ent->d_name > '9'))
-	    ;
-	if (!ent || !ent->d_name)
+    if (PT->tgid) {			/* PROC_TASKS: more of this process */
+	tgid = PT->tgid;
+	if (!(pid = tasks_next(PT->tasks))) {
+	    PT->tgid = 0;
+	    goto next_proc;
+	}
+	goto next_task;
+    }
+    if (flags & PROC_PID) {
+	if (!*PT->pids) {		/* set to next item in pids */
+	    if (flags & PROC_PERSIST) {
+		persist_sweep(PT, 0);
+		PT->fdpass++;
+		PT->pids = PT->pidhead;
+	    }
 	    return NULL;
-	sprintf(path, "/proc/%s", ent->d_name);
-
-#ifdef FLASK_LINUX
-    if (stat_secure(path, &sb, &secsid) == -1) /* no such dirent (anymore) */
-#else
-    if (stat(path, &sb) == -1)		/* no such dirent (anymore) */
-#endif
+	}
+	pid = *(PT->pids)++;
+    } else if (flags & PROC_LIVE) {		/* next of the watch's pids */
+	if (!PT->pids) {
+	    if (pidwatch_snapshot(&PT->livebuf, &PT->liveroom) < 0)
+		return NULL;
+	    PT->pids = PT->livebuf;
+	}
+	if (!(pid = *(PT->pids)++)) {
+	    if (flags & PROC_PERSIST) {
+		persist_sweep(PT, 0);
+		PT->fdpass++;
+	    }
+	    PT->pids = NULL;		/* the next pass takes a new copy */
+	    return NULL;
+	}
+    } else {					/* get next numeric /proc ent */
+	if (!(pid = pidscan_next(PT->procfs))) {
+	    if (flags & PROC_PERSIST) {
+		persist_sweep(PT, 0);
+		PT->fdpass++;
+		pidscan_rewind(PT->procfs);
+	    }
+	    return NULL;
+	}
+    }
+    tgid = pid;
+    if (flags & PROC_TASKS && tasks_open(&PT->tasks, pid, PT->path)) {
+	PT->tgid = pid;			/* its threads are listed first */
 	goto next_proc;
+    }
+next_task:
+    if (!(ret = pid2proc(PT, flags, tgid, pid, p, PT->path, PT->sbuf, sizeof PT->sbuf)))
+	goto next_proc;
+    return ret;
+}
+#undef flags
 
-    if (!p)
-	p = xcalloc(p, sizeof *p); /* passed buf or alloced mem */
-    p->euid = sb.st_uid;			/* need a way to get real uid */
-#ifdef FLASK_LINUX
-    p->secsid = secsid;
-#endif
-
-    if ((file2str(path, "stat", sbuf, sizeof sbuf)) == -1)
-	goto next_proc;			/* error reading /proc/#/stat */
-    stat2proc(sbuf, p);				/* parse /proc/#/stat */
-
-    if (flags & PROC_FILLMEM) {				/* read, parse /proc/#/statm */
-	if ((file2str(path, "statm", sbuf, sizeof sbuf)) != -1 )
-	    statm2proc(sbuf, p);		/* ignore statm errors here */
-    }						/* statm fields just zero */
-
-  /*  if (flags & PROC_FILLSTATUS) { */        /* read, parse /proc/#/status */
-       if ((file2str(path, "status", sbuf, sizeof sbuf)) != -1 ){
-           status2proc(sbuf, p, 0 /*FIXME*/);
-       }
-/*    }*/
-
-    /* some number->text resolving which is time consuming */
-    if (flags & PROC_FILLUSR){
-	strncpy(p->euser,   user_from_uid(p->euid), sizeof p->euser);
-/*        if(flags & PROC_FILLSTATUS) { */
-            strncpy(p->ruser,   user_from_uid(p->ruid), sizeof p->ruser);
-            strncpy(p->suser,   user_from_uid(p->suid), sizeof p->suser);
-            strncpy(p->fuser,   user_from_uid(p->fuid), sizeof p->fuser);
-/*        }*/
+/* task `at' of the snapshot, as read_task() would have it */
+static proc_t* snap_task(PROCTAB* PT, int flags, int at, proc_t* p) {
+    const proc_t *s;
+    const char *cmd;
+    unsigned len;
+    unsigned char arena;
+    int alloced = !p;
+    unsigned long long t;
+
+    PROF_BEGIN(t);
+    s = shmsnap_task(PT->snap, at, &cmd, &len);
+    if ((flags & PROC_UID) && !uid_listed(PT, s->euid))
+	return NULL;			/* not one of the requested uids */
+    p = proc_alloc(PT, flags, p);
+    arena = p->arena;
+    memcpy(p, s, sizeof *p);		/* cmdline and environ come NULL */
+    p->arena = arena;
+    if (PT->hooks[PROC_HOOK_STAT] && !PT->hooks[PROC_HOOK_STAT](p))
+	goto drop;
+    if (PT->hooks[PROC_HOOK_STATUS] && !PT->hooks[PROC_HOOK_STATUS](p))
+	goto drop;
+    if (flags & (PROC_FILLCOM | PROC_FILLARG) && len)
+	p->cmdline = strvec_copy(PT, flags, cmd, len);
+    if (flags & PROC_FILLCGROUP) {	/* the daemon's pointer meant nothing */
+	pid2path(PT->path, p->pid);
+	p->cgroup = cgroup_of(PT->path, p->pid, p->start_time);
     }
+    PROF_END(PROF_READ, t);
+    PROF_COUNT(PROF_TASKS, 1);
+    return p;
+drop:
+    if (alloced)
+	freeproc(p);
+    return NULL;
+}
 
-    /* some number->text resolving which is time consuming */
-    if (flags & PROC_FILLGRP){
-        strncpy(p->egroup, group_from_gid(p->egid), sizeof p->egroup);
-/*        if(flags & PROC_FILLSTATUS) { */
-            strncpy(p->rgroup, group_from_gid(p->rgid), sizeof p->rgroup);
-            strncpy(p->sgroup, group_from_gid(p->sgid), sizeof p->sgroup);
-            strncpy(p->fgroup, group_from_gid(p->fgid), sizeof p->fgroup);
-/*        }*/
+/* readproc() from a snapshot:  all of it in pid order, or PT's pids */
+static proc_t* snap_next(PROCTAB* PT, proc_t* p) {
+    shmsnap_copy *c = PT->snap;
+    int flags = PT->flags, i;
+    proc_t *ret;
+
+    for (;;) {
+	if (flags & PROC_PID) {
+	    if (!*PT->pids)
+		break;
+	    if ((i = shmsnap_find(c, *PT->pids++)) < 0)
+		continue;		/* no such process */
+	} else {
+	    if (PT->snapat >= c->n)
+		break;
+	    i = PT->snapat++;
+	}
+	if ((ret = snap_task(PT, flags, i, p)))
+	    return ret;
     }
+    if (flags & PROC_PERSIST) {		/* as for /proc, start over */
+	persist_sweep(PT, 0);
+	PT->fdpass++;
+	PT->pids = PT->pidhead;
+	PT->snapat = SNAP_START;
+    }
+    return NULL;
+}
 
-    if ((flags & PROC_FILLCOM) || (flags & PROC_FILLARG))	/* read+parse /proc/#/cmdline */
-	p->cmdline = file2strvec(path, "cmdline");
-    else
-        p->cmdline = NULL;
+/* readproc: return a pointer to a proc_t filled with requested info about the
+ * next process available matching the restriction set, from the snapshot
+ * when openproc() found one (see shmsnap.h) and each pass still does.
+ */
+proc_t* readproc(PROCTAB* PT, proc_t* p) {
+    proc_t *ret;
+
+    if (!PT->snap)
+	return procfs_next(PT, p);
+    if (PT->snapat == SNAP_START)
+	PT->snapat = shmsnap_take(PT->snap, PT->flags) == 0 ? 0 : SNAP_PROC;
+    if (PT->snapat != SNAP_PROC)
+	return snap_next(PT, p);
+    if (!(PT->flags & PROC_PID) && !PT->procfs
+     && !(PT->procfs = pidscan_open(proc_root())))
+	return NULL;
+    if (!(ret = procfs_next(PT, p)) && PT->flags & PROC_PERSIST)
+	PT->snapat = SNAP_START;	/* next pass, try the snapshot again */
+    return ret;
+}
 
-    if (flags & PROC_FILLENV)			/* read+parse /proc/#/environ */
-	p->environ = file2strvec(path, "environ");
-    else
-        p->environ = NULL;
-    
-    if (p->state == 'Z')		/* fixup cmd for zombies */
-	strncat(p->cmd," <defunct>", sizeof p->cmd);
+/* ps_readproc: once ps's own copy of readproc(), and still exported under
+ * its own name so that a ps built against an older library is caught.
+ */
+proc_t* ps_readproc(PROCTAB* PT, proc_t* p) {
+    return readproc(PT, p);
+}
 
-    return p;
+/* have `hook' look at each task once `where' has been read (PROC_HOOK_*),
+ * dropping it before anything more is read if the hook returns 0
+ */
+void prochook(PROCTAB* PT, int where, proc_hook_t hook) {
+    PT->hooks[where] = hook;
 }
-#undef flags
 
 
+/* this comes from the real /proc, whatever proc_root() says */
 void look_up_our_self(proc_t *p) {
-    static char path[32], sbuf[1024];	/* bufs for stat,statm */
+    char path[32], sbuf[1024];		/* bufs for stat,statm */
     sprintf(path, "/proc/%d", getpid());
     file2str(path, "stat", sbuf, sizeof sbuf);
     stat2proc(sbuf, p);				/* parse /proc/#/stat */
+    p->tgid = p->pid;
     file2str(path, "statm", sbuf, sizeof sbuf);
     statm2proc(sbuf, p);		/* ignore statm errors here */
     file2str(path, "status", sbuf, sizeof sbuf);
-    status2proc(sbuf, p, 0 /*FIXME*/);
+    status2proc(sbuf, p, 0 /*FIXME*/, PROC_FILLSTATUS);
 }
 
 
+/* all of PT's tasks, then close it */
+static proc_t** slurp(PROCTAB* PT) {
+    proc_t** tab = NULL;
+    int n = 0;
+
+    if (!PT)
+	return NULL;
+    do {					/* read table: */
+	tab = xrealloc(tab, (n+1)*sizeof(proc_t*));/* realloc as we go, using */
+	tab[n] = readproc(PT, NULL);		  /* final null to terminate */
+    } while (tab[n++]);				  /* stop when NULL reached */
+    closeproc(PT);
+    return tab;
+}
+
 /* Convenient wrapper around openproc and readproc to slurp in the whole process
  * table subset satisfying the constraints of flags and the optional PID list.
  * Free allocated memory with freeproctab().  Access via tab[N]->member.  The
@@ -520,8 +1357,6 @@ void look_up_our_self(proc_t *p) {
  */
 proc_t** readproctab(int flags, ...) {
     PROCTAB* PT = NULL;
-    proc_t** tab = NULL;
-    int n = 0;
     va_list ap;
 
     va_start(ap, flags);		/* pass through args to openproc */
@@ -541,10 +1376,269 @@ proc_t** readproctab(int flags, ...) {
     else
 	PT = openproc(flags);
     va_end(ap);
-    do {					/* read table: */
-	tab = xrealloc(tab, (n+1)*sizeof(proc_t*));/* realloc as we go, using */
-	tab[n] = readproc(PT, NULL);		  /* final null to terminate */
-    } while (tab[n++]);				  /* stop when NULL reached */
-    closeproc(PT);
-    return tab;
+    return slurp(PT);
+}
+
+
+/* readproctab_parallel: readproctab() with the reading of /proc spread over
+ * `nthreads' workers (<= 0 means one per online cpu).  The pids are gathered
+ * up front and handed out in chunks;  each worker resolves its own names.
+ * The table comes back in /proc (or PID list) order, NULL terminated, and is
+ * freed just like that of readproctab().  PROC_PERSIST and PROC_ARENA are
+ * ignored;  PROC_LIVE works as for openproc().
+ */
+#define PARALLEL_CHUNK  64
+#define PARALLEL_MAX    32
+
+struct parallel_job {
+    PROCTAB*	PT;		/* only for its uid list */
+    int		flags;
+    pid_t*	pids;
+    pid_t*	tgids;		/* PROC_TASKS: the process of each of pids[] */
+    proc_t**	tab;		/* tab[i] is for pids[i], NULL if gone */
+    int		n;
+    int		next;		/* first pid not yet handed out */
+    pthread_mutex_t lock;
+};
+
+static void* parallel_worker(void *arg) {
+    struct parallel_job *job = arg;
+    char path[PROCPATHLEN], sbuf[1024];
+    int i, end;
+
+    for (;;) {
+	pthread_mutex_lock(&job->lock);
+	i = job->next;
+	job->next += PARALLEL_CHUNK;
+	pthread_mutex_unlock(&job->lock);
+	if (i >= job->n)
+	    break;
+	if ((end = i + PARALLEL_CHUNK) > job->n)
+	    end = job->n;
+	for ( ; i < end; i++)
+	    job->tab[i] = pid2proc(job->PT, job->flags,
+				   job->tgids ? job->tgids[i] : job->pids[i],
+				   job->pids[i], NULL, path, sbuf, sizeof sbuf);
+    }
+    return NULL;
+}
+
+proc_t** readproctab_parallel(int flags, int nthreads, ...) {
+    PROCTAB PT;
+    struct parallel_job job;
+    pthread_t tid[PARALLEL_MAX];
+    pid_t *list = NULL;
+    int i, j, started, size = 0;
+    va_list ap;
+
+    memset(&PT, 0, sizeof PT);
+    va_start(ap, nthreads);		/* same args as openproc */
+    if (flags & PROC_PID)
+	list = va_arg(ap, pid_t*);
+    else if (flags & PROC_UID) {
+	uid_t *uids = va_arg(ap, uid_t*);
+	uids_set(&PT, uids, va_arg(ap, int));
+    }
+    va_end(ap);
+    PT.flags = flags = FILL_IMPLIED(flags & ~(PROC_PERSIST | PROC_ARENA | PROC_INCR));
+    if (shmsnap_usable(flags) == 0)	/* a copy, with nothing to spread */
+	return slurp(list ? openproc(flags, list)
+		     : flags & PROC_UID ? openproc(flags, PT.uids, PT.nuid)
+		     : openproc(flags));
+
+    job.PT = &PT;
+    job.flags = flags;
+    job.pids = job.tgids = NULL;
+    job.n = job.next = 0;
+    if (list) {
+	while (list[job.n])
+	    job.n++;
+	job.pids = xmalloc((job.n + 1) * sizeof(pid_t));
+	memcpy(job.pids, list, job.n * sizeof(pid_t));
+    } else if (flags & PROC_LIVE && pidwatch_open() == 0) {
+	if ((job.n = pidwatch_snapshot(&job.pids, &size)) < 0)
+	    job.n = 0;
+    } else {
+	pidscan_t *ps;
+	pid_t pid;
+	if (!(ps = pidscan_open(proc_root())))
+	    return NULL;
+	while ((pid = pidscan_next(ps))) {
+	    if (job.n >= size) {
+		size = size * 5 / 4 + 1024;
+		job.pids = xrealloc(job.pids, size * sizeof(pid_t));
+	    }
+	    job.pids[job.n++] = pid;
+	}
+	pidscan_close(ps);
+    }
+    if (flags & PROC_TASKS) {		/* each process stands for its threads */
+	pidscan_t *ts = NULL;
+	pid_t *tids = NULL, tid;
+	char path[PROCPATHLEN];
+	int many, n = 0;
+
+	size = 0;
+	for (i = 0; i < job.n; i++) {
+	    many = tasks_open(&ts, job.pids[i], path);
+	    tid = many ? tasks_next(ts) : job.pids[i];
+	    while (tid) {
+		if (n >= size) {
+		    size = size * 5 / 4 + 1024;
+		    tids = xrealloc(tids, size * sizeof(pid_t));
+		    job.tgids = xrealloc(job.tgids, size * sizeof(pid_t));
+		}
+		tids[n] = tid;
+		job.tgids[n++] = job.pids[i];
+		tid = many ? tasks_next(ts) : 0;
+	    }
+	}
+	if (ts)
+	    tasks_close(ts);
+	free(job.pids);
+	job.pids = tids;
+	job.n = n;
+    }
+    job.tab = xcalloc(NULL, (job.n + 1) * sizeof(proc_t*));
+    pthread_mutex_init(&job.lock, NULL);
+
+    if (nthreads <= 0)
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > (job.n + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK)
+	nthreads = (job.n + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+    if (nthreads > PARALLEL_MAX)
+	nthreads = PARALLEL_MAX;
+    /* we make one of the workers ourselves;  if threads can't be
+     * had, whoever did start (maybe just us) does all of the work */
+    for (started = 0; started < nthreads - 1; started++)
+	if (pthread_create(&tid[started], NULL, parallel_worker, &job))
+	    break;
+    parallel_worker(&job);
+    for (i = 0; i < started; i++)
+	pthread_join(tid[i], NULL);
+    pthread_mutex_destroy(&job.lock);
+
+    /* squeeze out the tasks which vanished */
+    for (i = j = 0; i < job.n; i++)
+	if (job.tab[i])
+	    job.tab[j++] = job.tab[i];
+    job.tab[j] = NULL;
+    free(job.pids);
+    free(job.tgids);
+    return job.tab;
+}
+
+/* The columns are carved, one after another, out of a single block.
+ */
+#define COLS_EACH (2*sizeof(int) + sizeof(char) + sizeof(unsigned) \
+		   + 2*sizeof(unsigned long long) + 2*sizeof(long) + sizeof(proc_t*))
+
+static void cols_carve(proc_cols *c, char *block, int room) {
+    /* widest first, so each column stays aligned */
+    c->utime = (unsigned long long *) block;  block += room * sizeof(unsigned long long);
+    c->stime = (unsigned long long *) block;  block += room * sizeof(unsigned long long);
+    c->rss   = (long *) block;                block += room * sizeof(long);
+    c->nice  = (long *) block;                block += room * sizeof(long);
+    c->cold  = (proc_t **) block;             block += room * sizeof(proc_t*);
+    c->pid   = (int *) block;                 block += room * sizeof(int);
+    c->ppid  = (int *) block;                 block += room * sizeof(int);
+    c->pcpu  = (unsigned *) block;            block += room * sizeof(unsigned);
+    c->state = block;
+}
+
+proc_cols* proccols(proc_cols *c, proc_t **ptab, int n) {
+    int i;
+
+    if (n > c->room) {
+	c->room = n + n / 4 + 64;
+	cols_carve(c, xrealloc(c->utime, c->room * COLS_EACH), c->room);
+    }
+    c->n = n;
+    for (i = 0; i < n; i++) {
+	const proc_t *p = ptab[i];
+	c->pid[i]   = p->pid;
+	c->ppid[i]  = p->ppid;
+	c->state[i] = p->state;
+	c->pcpu[i]  = p->pcpu;
+	c->utime[i] = p->utime;
+	c->stime[i] = p->stime;
+	c->rss[i]   = p->rss;
+	c->nice[i]  = p->nice;
+	c->cold[i]  = ptab[i];
+    }
+    return c;
+}
+
+#define COLS_GATHER(c, col, tmp, ord) do { \
+    for (i = 0; i < (c)->n; i++) \
+	(tmp)[i] = (c)->col[(ord)[i]]; \
+    memcpy((c)->col, (tmp), (c)->n * sizeof *(tmp)); \
+} while (0)
+
+void proccols_order(proc_cols *c, const int *ord) {
+    void *tmp = xmalloc(c->n * sizeof(unsigned long long) + 1);
+    int i;
+
+    COLS_GATHER(c, utime, (unsigned long long *) tmp, ord);
+    COLS_GATHER(c, stime, (unsigned long long *) tmp, ord);
+    COLS_GATHER(c, rss,   (long *) tmp, ord);
+    COLS_GATHER(c, nice,  (long *) tmp, ord);
+    COLS_GATHER(c, cold,  (proc_t **) tmp, ord);
+    COLS_GATHER(c, pid,   (int *) tmp, ord);
+    COLS_GATHER(c, ppid,  (int *) tmp, ord);
+    COLS_GATHER(c, pcpu,  (unsigned *) tmp, ord);
+    COLS_GATHER(c, state, (char *) tmp, ord);
+    free(tmp);
+}
+
+void freeproccols(proc_cols *c) {
+    free(c->utime);
+    memset(c, 0, sizeof *c);
+}
+
+/* The column is taken a block at a time, and each wanted value compared
+ * against the whole block in a loop simple enough for gcc to vectorize.
+ * Lists longer than a few values are sorted and searched instead.
+ */
+#define KEEP_BLOCK  256
+#define KEEP_LINEAR 16
+
+static void keep_block(unsigned char *keep, const int *col, int len,
+		       const int *want, int nwant) {
+    unsigned char hit[KEEP_BLOCK];
+    int i, j;
+
+    memset(hit, 0, sizeof hit);
+    for (j = 0; j < nwant; j++) {
+	const int w = want[j];
+	for (i = 0; i < len; i++)
+	    hit[i] |= col[i] == w;
+    }
+    for (i = 0; i < len; i++)
+	keep[i] &= hit[i];
+}
+
+static int keep_cmp(const void *a, const void *b) {
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+void proccols_keep(unsigned char *keep, const int *col, int n,
+		   const int *want, int nwant) {
+    int i;
+
+    if (nwant > KEEP_LINEAR) {
+	int *sorted = xmalloc(nwant * sizeof *sorted);
+	memcpy(sorted, want, nwant * sizeof *sorted);
+	qsort(sorted, nwant, sizeof *sorted, keep_cmp);
+	for (i = 0; i < n; i++)
+	    if (keep[i] && !bsearch(col + i, sorted, nwant, sizeof *sorted, keep_cmp))
+		keep[i] = 0;
+	free(sorted);
+	return;
+    }
+    for (i = 0; i + KEEP_BLOCK <= n; i += KEEP_BLOCK)
+	keep_block(keep + i, col + i, KEEP_BLOCK, want, nwant);
+    if (i < n)
+	keep_block(keep + i, col + i, n - i, want, nwant);
 }
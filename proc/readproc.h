@@ -108,6 +108,8 @@ typedef struct proc_t {
     char
 	**environ,	/* environment string vector (/proc/#/environ) */
 	**cmdline;	/* command line string vector (/proc/#/cmdline) */
+    const char
+	*cgroup;	/* PROC_FILLCGROUP: the path in /proc/#/cgroup, see cgroup_of() */
     char
 	/* Be compatible: Digital allows 16 and NT allows 14 ??? */
     	ruser[16],	/* real user name */
@@ -129,7 +131,11 @@ typedef struct proc_t {
 	tty,		/* full device number of controlling terminal */
 	tpgid,		/* terminal process group id */
 	exit_signal,	/* might not be SIGCHLD */
-	processor;      /* current (or most recent?) CPU */
+	processor,      /* current (or most recent?) CPU */
+	tgid,		/* thread group (process) id;  pid is the task's own */
+	nlwp;		/* number of threads (2.6 and up;  2.4 had `timeout' there) */
+    unsigned char
+	arena;		/* PROC_ARENA: which parts freeproc() must leave alone */
 #ifdef FLASK_LINUX
     security_id_t sid;
 #endif
@@ -142,18 +148,62 @@ typedef struct proc_t {
 #include <sys/types.h>
 #include <dirent.h>
 #include <unistd.h>
+
+/* pidscan: walk the numeric entries of a /proc directory as pid numbers,
+ * reading the directory in large getdents64 batches.  pidscan_next()
+ * returns 0 once the directory is exhausted;  pidscan_rewind() starts over.
+ */
+typedef struct pidscan pidscan_t;
+extern pidscan_t* pidscan_open(const char *dir);
+extern pid_t pidscan_next(pidscan_t *ps);
+extern void pidscan_rewind(pidscan_t *ps);
+extern void pidscan_close(pidscan_t *ps);
+
+/* room for proc_root() (at most PROC_ROOT_MAX, see procps.h) with a
+ * "/TGID/task/TID/task" after it */
+#define PROCPATHLEN 128
+
+struct proc_fds;
+struct proc_arena;
+struct shmsnap_copy;
+/* A hook sees each task as soon as the given part of it has been read, and
+ * returning 0 drops the task before anything more is read.  Set with
+ * prochook(), which readproctab_parallel() has no use for.
+ */
+typedef int (*proc_hook_t)(proc_t *p);
+#define PROC_HOOK_STAT    0	/* stat, and statm if asked for */
+#define PROC_HOOK_STATUS  1	/* status and the names, if asked for */
+#define PROC_HOOKS        2
+
 typedef struct PROCTAB {
-    DIR*	procfs;
+    pidscan_t*	procfs;
     int		flags;
     pid_t*	pids;	/* pids of the procs */
+    pid_t*	pidhead;	/* where `pids' starts over for the next pass */
     uid_t*	uids;	/* uids of procs */
     int		nuid;	/* cannot really sentinel-terminate unsigned short[] */
+    int		uidsorted;	/* `uids' ascends, so may be searched by halves */
+    struct proc_fds** fdhash;	/* PROC_PERSIST: open files, hashed by pid */
+    int		fdpass;	/* PROC_PERSIST: count of completed passes */
+    int		fdroom;	/* PROC_PERSIST: how many more files we may keep open */
+    struct proc_arena* arena;	/* PROC_ARENA: storage for proc_t's and strvecs */
+    pid_t*	livebuf;	/* PROC_LIVE: this pass's pids, from the watch */
+    int		liveroom;	/* PROC_LIVE: entries `livebuf' has room for */
+    pidscan_t*	tasks;	/* PROC_TASKS: the current process's task directory */
+    pid_t	tgid;	/* PROC_TASKS: ...and its pid, 0 between processes */
+    proc_hook_t	hooks[PROC_HOOKS];	/* see prochook() */
+    struct shmsnap_copy* snap;	/* PROCPS_SNAPSHOT: this pass's table, see shmsnap.h */
+    int		snapat;	/* ...the next task in it, or SNAP_START or SNAP_PROC */
+    char	path[PROCPATHLEN];	/* readproc() scratch: the task's directory */
+    char	sbuf[1024];	/* ...and the file being parsed */
 #ifdef FLASK_LINUX
     security_id_t* sids; /* SIDs of the procs */
 #endif
 } PROCTAB;
 
-/* initialize a PROCTAB structure holding needed call-to-call persistent data
+/* initialize a PROCTAB structure holding needed call-to-call persistent data;
+ * with PROCPS_SNAPSHOT set, passes come from procsnapd's table when they can
+ * (see shmsnap.h)
  */
 extern PROCTAB* openproc(int flags, ... /* pid_t*|uid_t*|dev_t*|char* [, int n] */ );
 
@@ -165,21 +215,64 @@ extern PROCTAB* openproc(int flags, ... /* pid_t*|uid_t*|dev_t*|char* [, int n]
  */
 extern proc_t** readproctab(int flags, ... /* same as openproc */ );
 
+/* Same, but read by `nthreads' worker threads (0: one per online cpu).
+ */
+extern proc_t** readproctab_parallel(int flags, int nthreads, ... /* same as openproc */ );
+
+/* A table's hot fields, one packed array each, so a pass over all tasks
+ * that wants only these reads a few dense arrays instead of a proc_t apiece.
+ * Everything else stays where it was, behind cold[i].
+ */
+typedef struct proc_cols {
+    int         n, room;
+    int        *pid, *ppid;
+    char       *state;
+    unsigned   *pcpu;		/* whatever the caller put in proc_t.pcpu */
+    unsigned long long *utime, *stime;
+    long       *rss, *nice;
+    proc_t    **cold;
+} proc_cols;
+
+/* fill `c' (zeroed the first time) from the first `n' entries of `ptab',
+ * reusing its arrays;  proccols_order() then puts all of them, cold[] too,
+ * into the order old[ord[0]], old[ord[1]] ...
+ */
+extern proc_cols* proccols(proc_cols *c, proc_t **ptab, int n);
+extern void proccols_order(proc_cols *c, const int *ord);
+extern void freeproccols(proc_cols *c);
+
+/* clear keep[i] for each of the `n' entries of `col' (a packed column, not
+ * necessarily one of the above) equal to none of the `nwant' in `want'
+ */
+extern void proccols_keep(unsigned char *keep, const int *col, int n,
+			  const int *want, int nwant);
+
 /* clean-up open files, etc from the openproc()
  */
 extern void closeproc(PROCTAB* PT);
 
 /* retrieve the next process matching the criteria set by the openproc()
+ * (each PROCTAB holds all of its scan's state, so threads may read at once
+ *  as long as each has a PROCTAB of its own;  the name caches are shared)
  */
 extern proc_t* readproc(PROCTAB* PT, proc_t* return_buf);
 extern proc_t* ps_readproc(PROCTAB* PT, proc_t* return_buf);
 
+/* have `hook' look over each task once the PROC_HOOK_* part `where' is in
+ */
+extern void prochook(PROCTAB* PT, int where, proc_hook_t hook);
+
 extern void look_up_our_self(proc_t *p);
 
 /* deallocate space allocated by readproc
  */
 extern void freeproc(proc_t* p);
 
+/* recycle all PROC_ARENA storage handed out by readproc() since openproc()
+ * or the last resetproc();  those proc_t's and strvecs are then invalid
+ */
+extern void resetproc(PROCTAB* PT);
+
 /* openproc/readproctab:
  *   
  * Return PROCTAB* / *proc_t[] or NULL on error ((probably) "/proc" cannot be
@@ -199,10 +292,17 @@ extern void freeproc(proc_t* p);
 #define PROC_FILLENV    0x0004 /* alloc and fill in `environ' */
 #define PROC_FILLUSR    0x0008 /* resolve user id number -> user name */
 #define PROC_FILLGRP    0x0010 /* resolve group id number -> group name */
-#define PROC_FILLSTATUS 0x0020 /* read status -- currently unconditional */
+#define PROC_FILLSTATUS (0x0020|PROC_FILLID|PROC_FILLSIG|PROC_FILLVM) /* read status */
 #define PROC_FILLSTAT   0x0040 /* read stat -- currently unconditional */
 #define PROC_FILLWCHAN  0x0080 /* look up WCHAN name */
 #define PROC_FILLARG    0x0100 /* alloc and fill in `cmdline' */
+#define PROC_FILLID     0x0200 /* status: real, saved and fs uid/gid, egid */
+#define PROC_FILLSIG    0x0400 /* status: signal masks */
+#define PROC_FILLVM     0x0800 /* status: vm_* sizes */
+/* PROC_FILLSTATUS is all three;  asked for alone, each lets the reader stop
+ * parsing status once it has that part, or skip the file altogether.
+ * PROC_FILLGRP implies PROC_FILLID, since egid is only found in status.
+ */
 
 #define PROC_FILLBUG    0x0fff /* No idea what we need */
 #define PROC_FILLANY    0x0000 /* either stat or status will do */
@@ -211,4 +311,55 @@ extern void freeproc(proc_t* p);
 #define PROC_PID     0x1000  /* process id numbers ( 0   terminated) */
 #define PROC_UID     0x4000  /* user id numbers    ( length needed ) */
 
+/* Keep each task's stat, statm and status open between passes, re-reading
+ * them with pread().  When readproc() reaches the end of the table it closes
+ * the files of tasks that were not seen and rewinds, so the same PROCTAB
+ * can simply be read again for the next sample.
+ */
+#define PROC_PERSIST 0x10000
+
+/* Carve the proc_t's which readproc() allocates, and every cmdline/environ
+ * vector, out of big blocks owned by the PROCTAB.  Nothing is freed one at a
+ * time:  resetproc() recycles all of it at once and closeproc() releases it.
+ * freeproc() still works, but only frees what did not come from the arena.
+ * (ignored by readproctab_parallel)
+ */
+#define PROC_ARENA   0x20000
+#define ARENA_PROC   0x01	/* proc_t.arena: the proc_t itself */
+#define ARENA_VECS   0x02	/* proc_t.arena: the cmdline and environ */
+
+/* Keep each task's proc_t in the PROCTAB from one pass to the next.  While
+ * its start_time, command, euid and zombie state stay put, only stat (and
+ * statm) are read again;  status, cmdline, environ and the names are fetched
+ * just for tasks which are new or have changed.  readproc() ignores the
+ * passed buffer and returns the PROCTAB's own proc_t, which lasts until the
+ * end of the next pass (or closeproc) and must not be given to freeproc().
+ * Implies PROC_PERSIST, overrides PROC_ARENA.  (ignored by readproctab_parallel)
+ */
+#define PROC_INCR    0x40000
+
+/* Take the pids from the kernel's fork and exit events (see pidwatch.h)
+ * rather than listing /proc for each pass.  Where those can't be had, as
+ * on older kernels without CAP_NET_ADMIN, the flag is quietly dropped.
+ * Each pass starts from a fresh copy of the set, and the table is read
+ * again after the end of one just as with PROC_PERSIST.
+ * (ignored with PROC_PID)
+ */
+#define PROC_LIVE    0x80000
+
+/* Return each thread as a proc_t of its own, read from /proc/#/task/#, with
+ * `pid' the thread's id and `tgid' that of its process (without the flag the
+ * two are the same).  Every other flag works as before, keyed by thread, and
+ * the pid and uid lists still select whole processes.  A process with just
+ * the one thread is known as such from its task directory's link count, so
+ * that directory is only listed for the others.
+ */
+#define PROC_TASKS   0x100000
+
+/* Fill in `cgroup', which cgroup_of() keeps for the life of each task, so
+ * that /proc/#/cgroup is read just once for it.  The string is the cache's
+ * and is never freed.
+ */
+#define PROC_FILLCGROUP 0x200000
+
 #endif
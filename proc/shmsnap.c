@@ -0,0 +1,393 @@
+/*
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include "procps.h"
+#include "readproc.h"
+#include "shmsnap.h"
+
+/* The file:  a page of header, then the tables wherever the header says.
+ * Each task is its proc_t (pointers cleared) and where its cmdline is in
+ * the text that follows all of them.  A slot that outgrows its room is
+ * moved to the end of the file, which only ever grows (the old place is
+ * punched out), so a reader still mapping less of it is never cut short --
+ * it maps the rest when a table lies beyond what it has.
+ *
+ * Whoever can write the file decides what ps and top show, so readers,
+ * like those of PS_NAMECACHE, only take one that belongs to them or root
+ * and that nobody else may write.  The file is in native byte order.
+ */
+
+#define SHM_MAGIC    "procshm"
+#define SHM_VERSION  1
+#define SHM_HEAD     4096
+
+struct shm_slot {
+    unsigned		seq;		/* odd while being written */
+    int			n, flags;
+    unsigned		pad;
+    unsigned long long	stamp;		/* CLOCK_MONOTONIC ns, when published */
+    unsigned long long	took;		/* ...and since the one before */
+    unsigned long long	off, room;	/* where in the file, and how much */
+    unsigned long long	len;		/* ...of it in use */
+};
+
+struct shm_head {
+    char		magic[8];
+    unsigned		version, proc_size;	/* sizeof(proc_t) */
+    unsigned		interval_ms;	/* 0 once the daemon has gone */
+    unsigned		cur;		/* the slot to read */
+    char		root[PROC_ROOT_MAX + 1];	/* proc_root() as read */
+    struct shm_slot	slot[2];
+};
+
+struct shm_task {
+    proc_t		p;
+    unsigned		cmd, cmdlen;	/* into the text after the tasks */
+};
+
+static unsigned long long mono_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*********************************************************************/
+/* writing */
+
+struct shmsnap_writer {
+    int			fd;
+    struct shm_head	*head;
+    size_t		size;		/* of the file, and what's mapped */
+    unsigned long long	last;		/* when we last published */
+};
+
+static int writer_here;		/* ...so we're not our own reader */
+
+static int grow(shmsnap_writer *w, size_t size) {
+    void *m;
+
+    if (size <= w->size)
+	return 0;
+    if (ftruncate(w->fd, size) == -1)
+	return -1;
+    m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, w->fd, 0);
+    if (m == MAP_FAILED)
+	return -1;
+    if (w->head)
+	munmap(w->head, w->size);
+    w->head = m;
+    w->size = size;
+    return 0;
+}
+
+shmsnap_writer *shmsnap_create(const char *path, unsigned interval_ms) {
+    shmsnap_writer *w;
+    struct stat sb;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (fd == -1)
+	return NULL;
+    if (fstat(fd, &sb) == -1)
+	goto fail;
+    if (!S_ISREG(sb.st_mode) || sb.st_uid != geteuid()
+     || sb.st_mode & (S_IWGRP | S_IWOTH)) {
+	errno = EPERM;			/* someone else's, for us to feed ps? */
+	goto fail;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+	errno = EBUSY;
+	goto fail;
+    }
+    w = xcalloc(NULL, sizeof *w);
+    w->fd = fd;
+    /* start over:  readers mapping the old one see it emptied, not torn */
+    if (ftruncate(fd, 0) == -1 || grow(w, SHM_HEAD) == -1) {
+	free(w);
+	goto fail;
+    }
+    memcpy(w->head->magic, SHM_MAGIC, sizeof w->head->magic);
+    w->head->version = SHM_VERSION;
+    w->head->proc_size = sizeof(proc_t);
+    strncpy(w->head->root, proc_root(), PROC_ROOT_MAX);
+    __atomic_store_n(&w->head->interval_ms, interval_ms, __ATOMIC_RELEASE);
+    writer_here = 1;
+    return w;
+fail:
+    close(fd);
+    return NULL;
+}
+
+static int by_pid(const void *a, const void *b) {
+    pid_t x = (*(proc_t *const *)a)->pid, y = (*(proc_t *const *)b)->pid;
+    return x < y ? -1 : x > y;
+}
+
+int shmsnap_publish(shmsnap_writer *w, proc_t **tab, int n, int flags) {
+    unsigned s = !__atomic_load_n(&w->head->cur, __ATOMIC_RELAXED);
+    struct shm_slot *slot;
+    struct shm_task *t;
+    size_t len, text, off = 0, room = 0;
+    char *out;
+    char **v;
+    int i;
+
+    qsort(tab, n, sizeof *tab, by_pid);
+    len = n * sizeof(struct shm_task);
+    for (i = 0; i < n; i++)
+	for (v = tab[i]->cmdline; v && *v; v++)
+	    len += strlen(*v) + 1;
+
+    if (len > w->head->slot[s].room) {	/* it moves to the end, with room */
+	off = w->size;
+	room = len + len / 4 + 65536;
+	if (grow(w, off + room) == -1)
+	    return -1;
+    }
+    slot = &w->head->slot[s];
+
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (room) {
+	/* anyone still copying from the old place sees seq change, and
+	   tries again, so it can go back to the system now */
+	if (slot->room)
+	    fallocate(w->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		      slot->off, slot->room);
+	slot->off = off;
+	slot->room = room;
+    }
+    out = (char *)w->head + slot->off;
+    t = (struct shm_task *)out;
+    text = n * sizeof *t;
+    for (i = 0; i < n; i++, t++) {
+	t->p = *tab[i];
+	t->p.cmdline = t->p.environ = NULL;
+	t->p.cgroup = NULL;
+	t->p.arena = 0;
+	t->cmd = text;
+	for (v = tab[i]->cmdline; v && *v; v++) {
+	    size_t l = strlen(*v) + 1;
+	    memcpy(out + text, *v, l);
+	    text += l;
+	}
+	t->cmdlen = text - t->cmd;
+    }
+    slot->n = n;
+    slot->flags = flags;
+    slot->len = len;
+    slot->stamp = mono_ns();
+    slot->took = w->last ? slot->stamp - w->last : 0;
+    w->last = slot->stamp;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->head->cur, s, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void shmsnap_close_writer(shmsnap_writer *w) {
+    if (!w)
+	return;
+    __atomic_store_n(&w->head->interval_ms, 0, __ATOMIC_RELEASE);
+    munmap(w->head, w->size);
+    close(w->fd);
+    free(w);
+    writer_here = 0;
+}
+
+/*********************************************************************/
+/* reading */
+
+static const struct shm_head *map;
+static size_t maplen;
+static int mapfd = -1;
+static pthread_once_t map_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void map_file(void) {
+    const char *path = getenv("PROCPS_SNAPSHOT");
+    struct stat sb;
+    void *m;
+    int fd;
+
+    if (!path || getuid() != geteuid() || getgid() != getegid())
+	return;
+    if (!*path || !strcmp(path, "1"))
+	path = SHMSNAP_PATH;
+    fd = open(path, O_RDONLY | O_NOCTTY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1)
+	return;
+    if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode)
+     || (sb.st_uid != geteuid() && sb.st_uid != 0)
+     || sb.st_mode & (S_IWGRP | S_IWOTH) || sb.st_size < SHM_HEAD)
+	goto out;
+    m = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED)
+	goto out;
+    map = m;
+    maplen = sb.st_size;
+    if (memcmp(map->magic, SHM_MAGIC, sizeof map->magic)
+     || map->version != SHM_VERSION || map->proc_size != sizeof(proc_t)
+     || strncmp(map->root, proc_root(), PROC_ROOT_MAX)) {
+	munmap(m, maplen);
+	map = NULL;
+	goto out;
+    }
+    mapfd = fd;				/* kept, to map more of it later */
+    return;
+out:
+    close(fd);
+}
+
+/* map all of the file there is now, since a table lies past our end */
+static int map_more(size_t need) {
+    struct stat sb;
+    void *m;
+    int ret = -1;
+
+    pthread_mutex_lock(&map_lock);
+    if (need <= maplen)
+	ret = 0;			/* another thread got here first */
+    else if (fstat(mapfd, &sb) == 0 && (size_t)sb.st_size >= need
+	  && (m = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, mapfd, 0)) != MAP_FAILED) {
+	/* the old mapping stays:  another thread may still be copying */
+	map = m;
+	maplen = sb.st_size;
+	ret = 0;
+    }
+    pthread_mutex_unlock(&map_lock);
+    return ret;
+}
+
+/* what the table's flags must hold for `flags' */
+static int wanted(int flags) {
+    int want = flags & PROC_FILLBUG & ~PROC_FILLWCHAN;
+
+    if (want & PROC_FILLARG)
+	want = (want & ~PROC_FILLARG) | PROC_FILLCOM;
+    if (want & PROC_FILLGRP)
+	want |= PROC_FILLID;
+    return want;
+}
+
+/* the slot to copy, if it's fresh and has all of `flags' */
+static const struct shm_slot *fresh(int flags, unsigned *seq) {
+    unsigned long long limit;
+    unsigned interval;
+    const struct shm_slot *slot;
+    const struct shm_head *h;
+
+    pthread_once(&map_once, map_file);
+    if (!(h = __atomic_load_n(&map, __ATOMIC_ACQUIRE)) || writer_here
+     || flags & (PROC_FILLENV | PROC_TASKS | PROC_INCR))
+	return NULL;
+    if (!(interval = __atomic_load_n(&h->interval_ms, __ATOMIC_ACQUIRE)))
+	return NULL;
+    slot = &h->slot[__atomic_load_n(&h->cur, __ATOMIC_ACQUIRE) & 1];
+    *seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (*seq & 1 || !*seq)
+	return NULL;			/* being written, or never was */
+    if (wanted(flags) & ~slot->flags)
+	return NULL;
+    /* a big table can take longer to read than the daemon was asked */
+    limit = 1000000ULL * interval;
+    if (slot->took > limit)
+	limit = slot->took;
+    if (mono_ns() - slot->stamp > 2 * limit)
+	return NULL;			/* the daemon's fallen behind, or gone */
+    return slot;
+}
+
+int shmsnap_usable(int flags) {
+    unsigned seq;
+
+    return fresh(flags, &seq) ? 0 : -1;
+}
+
+int shmsnap_take(shmsnap_copy *c, int flags) {
+    const struct shm_slot *slot;
+    unsigned seq, tries;
+    unsigned long long off, len;
+    int n, tflags;
+
+    for (tries = 0; tries < 8; tries++) {
+	if (!(slot = fresh(flags, &seq)))
+	    return -1;
+	n = slot->n;
+	tflags = slot->flags;
+	off = slot->off;
+	len = slot->len;
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+	    continue;			/* torn already */
+	if (n < 0 || len < n * sizeof(struct shm_task) || off < SHM_HEAD
+	 || off + len < off)
+	    return -1;
+	if (off + len > maplen) {
+	    if (map_more(off + len) == -1)
+		return -1;
+	    continue;			/* `slot' was in the old mapping */
+	}
+	if (len > c->room) {
+	    c->room = len + len / 4;
+	    c->buf = xrealloc(c->buf, c->room);
+	}
+	memcpy(c->buf, (const char *)map + off, len);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+	    continue;			/* the daemon came round again */
+	c->n = n;
+	c->flags = tflags;
+	return 0;
+    }
+    return -1;
+}
+
+const proc_t *shmsnap_task(const shmsnap_copy *c, int i,
+			   const char **cmd, unsigned *len) {
+    const struct shm_task *t = (const struct shm_task *)c->buf + i;
+
+    *cmd = c->buf + t->cmd;
+    *len = t->cmdlen;
+    return &t->p;
+}
+
+int shmsnap_find(const shmsnap_copy *c, pid_t pid) {
+    const struct shm_task *t = (const struct shm_task *)c->buf;
+    int lo = 0, hi = c->n;
+
+    while (lo < hi) {
+	int mid = (lo + hi) / 2;
+	if (t[mid].p.pid < pid)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo < c->n && t[lo].p.pid == pid ? lo : -1;
+}
+
+void shmsnap_free(shmsnap_copy *c) {
+    if (!c)
+	return;
+    free(c->buf);
+    free(c);
+}
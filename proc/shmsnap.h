@@ -0,0 +1,62 @@
+#ifndef PROC_SHMSNAP_H
+#define PROC_SHMSNAP_H
+
+#include "readproc.h"
+
+/* One scan of /proc per interval for the whole host:  procsnapd reads the
+ * process table into a shared file, and any openproc() or readproctab()
+ * run with PROCPS_SNAPSHOT in its environment is served from there, with
+ * no system calls, while what's there is fresh and has what was asked for.
+ * Anything else -- no daemon, a stale table, PROC_FILLENV, PROC_TASKS,
+ * PROC_INCR -- quietly reads /proc as before.
+ *
+ * The file holds two tables, each under a seqlock:  the daemon writes the
+ * one not being read, then points readers at it, so a reader copies the
+ * table it found (a memcpy, retried if the daemon got round to it again
+ * meanwhile) and works from its copy.
+ */
+
+#define SHMSNAP_PATH  "/dev/shm/procps-snapshot"
+
+/* what procsnapd fills in:  all there is, but the environment */
+#define SHMSNAP_FLAGS (PROC_FILLSTAT | PROC_FILLMEM | PROC_FILLCOM | \
+		       PROC_FILLSTATUS | PROC_FILLUSR | PROC_FILLGRP)
+
+/* writing, for procsnapd */
+typedef struct shmsnap_writer shmsnap_writer;
+
+/* create or take over `path';  NULL (errno set) if another daemon has it
+ * (EBUSY), or it belongs to someone else or may be written by others (EPERM) */
+extern shmsnap_writer *shmsnap_create(const char *path, unsigned interval_ms);
+
+/* publish the n tasks of tab (in any order), read with `flags';  0 or -1 */
+extern int shmsnap_publish(shmsnap_writer *w, proc_t **tab, int n, int flags);
+
+/* mark the file stale at once, for readers, and let it go */
+extern void shmsnap_close_writer(shmsnap_writer *w);
+
+/* reading, for readproc.c:  a table copied out, in pid order */
+typedef struct shmsnap_copy {
+    char	*buf;
+    unsigned long room;
+    int		n;
+    int		flags;		/* what it was read with */
+} shmsnap_copy;
+
+/* 0 if there's a fresh table with all that `flags' wants, else -1 */
+extern int shmsnap_usable(int flags);
+
+/* copy the latest table into *c, if shmsnap_usable(flags);  0 or -1 */
+extern int shmsnap_take(shmsnap_copy *c, int flags);
+
+/* task i of the copy, and its cmdline (*len bytes, NUL separated and
+ * ended, none if 0) */
+extern const proc_t *shmsnap_task(const shmsnap_copy *c, int i,
+				  const char **cmd, unsigned *len);
+
+/* the index of `pid' in the copy, or -1 */
+extern int shmsnap_find(const shmsnap_copy *c, pid_t pid);
+
+extern void shmsnap_free(shmsnap_copy *c);
+
+#endif
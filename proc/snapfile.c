@@ -0,0 +1,725 @@
+/*
+ * This file may be used subject to the terms and conditions of the
+ * GNU Library General Public License Version 2, or any later version
+ * at your option, as published by the Free Software Foundation.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Library General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "procps.h"
+#include "readproc.h"
+#include "snapfile.h"
+
+/* The file:  a 32 byte header -- "procsnap", then version, hertz, page
+ * size and cpu count as 4 byte little-endian numbers -- and the frames.
+ * A frame is 8 bytes of its own header ("snf", 1 if it is kept whole, and
+ * the length of what follows) and then a run of varints:
+ *
+ *	sec usec uptime(s/100) load(x100 each of 3) users  memory(8, kB)
+ *	cpu tics (5 per cpu, then the sum:  deltas)
+ *	n  pids (in order, each less the one before)
+ *	then for each column of cols[], n deltas;  then for each string,
+ *	n of:  0 for "as before", else its length + 1 and the bytes
+ *
+ * though in both a 0 is followed by how many more 0s come after it, since
+ * most tasks, most of the time, have little or nothing new.
+ *
+ * Deltas, zigzagged so small negative ones stay small, are against the
+ * frame before -- the same task's, found by pid -- or against 0, for a
+ * task that's new and all through a frame kept whole.
+ */
+
+#define SNAP_MAGIC    "procsnap"
+#define SNAP_VERSION  1
+#define HEAD_SIZE     32
+#define FRAME_HEAD    8
+
+typedef unsigned long long u64;
+
+/* where each numeric field is and how wide, and whether it's signed */
+#define SCOL(f)  { offsetof(proc_t, f), sizeof(((proc_t*)0)->f), 1 }
+#define UCOL(f)  { offsetof(proc_t, f), sizeof(((proc_t*)0)->f), 0 }
+
+static const struct col {
+    unsigned short off;
+    unsigned char size, sign;
+} cols[] = {
+    SCOL(ppid), SCOL(tgid), SCOL(pgrp), SCOL(session), SCOL(tty), SCOL(tpgid),
+    SCOL(euid), SCOL(egid), SCOL(state), SCOL(priority), SCOL(nice),
+    SCOL(processor), SCOL(nlwp), UCOL(flags),
+    UCOL(utime), UCOL(stime), UCOL(cutime), UCOL(cstime), UCOL(start_time),
+    SCOL(size), SCOL(resident), SCOL(share), SCOL(trs), SCOL(drs), SCOL(dt),
+    SCOL(rss), UCOL(vsize), UCOL(min_flt), UCOL(maj_flt), UCOL(wchan),
+};
+#define NCOLS  (int)(sizeof cols / sizeof *cols)
+
+enum { S_CMD, S_USER, S_GROUP, S_CMDLINE, NSTRS };
+
+#define NSYS  (3 + 3 + 1 + 1 + 8)	/* the numbers before the cpus */
+
+/* a frame as both ends keep it, to take the next one's deltas against */
+struct row {
+    int pid;
+    u64 v[NCOLS];
+    unsigned str[NSTRS], len[NSTRS];	/* into the frame's heap */
+};
+
+struct frame {
+    struct row *rows;
+    int n, room;
+    char *heap;
+    unsigned used, size;
+    u64 sys[NSYS];
+    u64 *cpus;
+};
+
+static void frame_free(struct frame *f) {
+    free(f->rows);
+    free(f->heap);
+    free(f->cpus);
+}
+
+static void frame_rows(struct frame *f, int n) {
+    if (n > f->room) {
+	f->room = n * 5 / 4 + 64;
+	f->rows = xrealloc(f->rows, f->room * sizeof *f->rows);
+    }
+    f->n = n;
+    f->used = 0;
+}
+
+static unsigned heap_put(struct frame *f, const char *s, unsigned len) {
+    unsigned at;
+
+    if (f->used + len > f->size) {
+	f->size = (f->used + len) * 2 + 4096;
+	f->heap = xrealloc(f->heap, f->size);
+    }
+    at = f->used;
+    memcpy(f->heap + at, s, len);
+    f->used += len;
+    return at;
+}
+
+/* where each of `now's rows was in `was', or -1 -- both are in pid order */
+static void match(const struct frame *now, const struct frame *was, int *at) {
+    int i, j = 0;
+
+    for (i = 0; i < now->n; i++) {
+	while (j < was->n && was->rows[j].pid < now->rows[i].pid)
+	    j++;
+	at[i] = j < was->n && was->rows[j].pid == now->rows[i].pid ? j : -1;
+    }
+}
+
+static u64 zig(u64 d)   { return d << 1 ^ (u64)((long long)d >> 63); }
+static u64 unzig(u64 z) { return z >> 1 ^ -(z & 1); }
+
+static void put32(unsigned char *p, unsigned v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static unsigned get32(const unsigned char *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (unsigned)p[3] << 24;
+}
+
+/*********************************************************************/
+/* writing */
+
+static off_t whole(const char *path, snap_info *info);
+
+struct snap_writer {
+    int fd;
+    unsigned ncpus, count;		/* frames written by us */
+    struct frame f[2];			/* this one and the last */
+    int cur;
+    int *at;
+    int atroom;
+    proc_t **sorted;
+    int sortroom;
+    unsigned char *out;
+    unsigned outlen, outsize;
+};
+
+static void out_room(snap_writer *w, unsigned more) {
+    if (w->outlen + more > w->outsize) {
+	w->outsize = (w->outlen + more) * 2 + 4096;
+	w->out = xrealloc(w->out, w->outsize);
+    }
+}
+
+static void out_num(snap_writer *w, u64 v) {
+    unsigned char *p;
+
+    out_room(w, 10);
+    p = w->out + w->outlen;
+    while (v >= 0x80) {
+	*p++ = v | 0x80;
+	v >>= 7;
+    }
+    *p++ = v;
+    w->outlen = p - w->out;
+}
+
+static void out_bytes(snap_writer *w, const char *s, unsigned len) {
+    out_room(w, len);
+    memcpy(w->out + w->outlen, s, len);
+    w->outlen += len;
+}
+
+static u64 col_get(const proc_t *p, const struct col *c) {
+    const char *f = (const char *)p + c->off;
+
+    switch (c->size) {
+    case 1: return c->sign ? (u64)(long long)*(const signed char *)f : *(const unsigned char *)f;
+    case 2: return c->sign ? (u64)(long long)*(const short *)f : *(const unsigned short *)f;
+    case 4: return c->sign ? (u64)(long long)*(const int *)f : *(const unsigned *)f;
+    default: return *(const u64 *)f;
+    }
+}
+
+static void col_set(proc_t *p, const struct col *c, u64 v) {
+    char *f = (char *)p + c->off;
+
+    switch (c->size) {
+    case 1: *(unsigned char *)f = v;  break;
+    case 2: *(unsigned short *)f = v; break;
+    case 4: *(unsigned *)f = v;       break;
+    default: *(u64 *)f = v;           break;
+    }
+}
+
+static int by_pid(const void *a, const void *b) {
+    int x = (*(proc_t *const *)a)->pid, y = (*(proc_t *const *)b)->pid;
+    return x < y ? -1 : x > y;
+}
+
+/* the strings of a task as stored:  cmdline's NULs and all */
+static unsigned task_str(const proc_t *p, int which, const char **s, char *buf, unsigned room) {
+    unsigned len = 0;
+    char **v;
+
+    switch (which) {
+    case S_CMD:   *s = p->cmd;    return strnlen(p->cmd, sizeof p->cmd);
+    case S_USER:  *s = p->euser;  return strnlen(p->euser, sizeof p->euser);
+    case S_GROUP: *s = p->egroup; return strnlen(p->egroup, sizeof p->egroup);
+    }
+    *s = buf;
+    if (!(v = p->cmdline))
+	return 0;
+    for (; *v && len < room; v++) {
+	unsigned l = strlen(*v) + 1;
+	if (len + l > room)
+	    l = room - len;
+	memcpy(buf + len, *v, l);
+	len += l;
+    }
+    return len;
+}
+
+static int write_all(int fd, const unsigned char *p, unsigned len) {
+    ssize_t n;
+
+    while (len) {
+	if ((n = write(fd, p, len)) == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += n;
+	len -= n;
+    }
+    return 0;
+}
+
+/* row i's column c, as written:  zigzagged, less the row it matched */
+static u64 col_delta(const struct frame *now, const struct frame *was,
+		     const int *at, int i, int c) {
+    return zig(now->rows[i].v[c] - (at[i] < 0 ? 0 : was->rows[at[i]].v[c]));
+}
+
+static int str_same(const struct frame *now, const struct frame *was,
+		    const int *at, int i, int c) {
+    const struct row *r = &now->rows[i], *o;
+
+    if (at[i] < 0)
+	return 0;
+    o = &was->rows[at[i]];
+    return o->len[c] == r->len[c]
+	&& !memcmp(was->heap + o->str[c], now->heap + r->str[c], r->len[c]);
+}
+
+snap_writer *snap_create(const char *path, unsigned hertz, unsigned page_size,
+			 unsigned ncpus) {
+    unsigned char head[HEAD_SIZE];
+    snap_writer *w;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) == -1)
+	return NULL;
+    if (fstat(fd, &st) == -1)
+	goto fail;
+    if (st.st_size) {
+	snap_info info;
+	off_t good = whole(path, &info);
+
+	if (good == -1)
+	    goto fail;
+	if (info.hertz != hertz || info.page_size != page_size || info.ncpus != ncpus) {
+	    errno = EINVAL;		/* some other machine's */
+	    goto fail;
+	}
+	if (good < st.st_size && ftruncate(fd, good) == -1)
+	    goto fail;
+    } else {
+	memset(head, 0, sizeof head);
+	memcpy(head, SNAP_MAGIC, 8);
+	put32(head + 8, SNAP_VERSION);
+	put32(head + 12, hertz);
+	put32(head + 16, page_size);
+	put32(head + 20, ncpus);
+	if (write_all(fd, head, sizeof head) == -1)
+	    goto fail;
+    }
+    w = xcalloc(NULL, sizeof *w);
+    w->fd = fd;
+    w->ncpus = ncpus;
+    return w;
+fail:
+    close(fd);
+    return NULL;
+}
+
+int snap_write(snap_writer *w, const snap_sys *sys, proc_t **tab, int n) {
+    struct frame *now = &w->f[w->cur], *was = &w->f[!w->cur];
+    int key = w->count % SNAP_KEYEVERY == 0, ncpu = 5 * (w->ncpus + 1);
+    char buf[4096];
+    int i, c, run;
+
+    if (n > w->sortroom) {
+	w->sortroom = n * 5 / 4 + 64;
+	w->sorted = xrealloc(w->sorted, w->sortroom * sizeof *w->sorted);
+    }
+    memcpy(w->sorted, tab, n * sizeof *tab);
+    qsort(w->sorted, n, sizeof *w->sorted, by_pid);
+    frame_rows(now, n);
+    for (i = 0; i < n; i++) {
+	struct row *r = &now->rows[i];
+	proc_t *p = w->sorted[i];
+
+	r->pid = p->pid;
+	for (c = 0; c < NCOLS; c++)
+	    r->v[c] = col_get(p, &cols[c]);
+	for (c = 0; c < NSTRS; c++) {
+	    const char *s;
+	    r->len[c] = task_str(p, c, &s, buf, sizeof buf);
+	    r->str[c] = heap_put(now, s, r->len[c]);
+	}
+    }
+    if (key)
+	was->n = 0;			/* so everything's against nothing */
+    if (n > w->atroom) {
+	w->atroom = n * 5 / 4 + 64;
+	w->at = xrealloc(w->at, w->atroom * sizeof *w->at);
+    }
+    match(now, was, w->at);
+
+    now->sys[0] = sys->sec;
+    now->sys[1] = sys->usec;
+    now->sys[2] = sys->uptime * 100 + .5;
+    for (i = 0; i < 3; i++)
+	now->sys[3 + i] = sys->loadavg[i] * 100 + .5;
+    now->sys[6] = sys->users;
+    now->sys[7] = sys->main_total;
+    now->sys[8] = sys->main_used;
+    now->sys[9] = sys->main_free;
+    now->sys[10] = sys->main_buffers;
+    now->sys[11] = sys->main_cached;
+    now->sys[12] = sys->swap_total;
+    now->sys[13] = sys->swap_used;
+    now->sys[14] = sys->swap_free;
+    if (!now->cpus)
+	now->cpus = xmalloc(ncpu * sizeof *now->cpus);
+    memcpy(now->cpus, sys->cpus, ncpu * sizeof *now->cpus);
+
+    w->outlen = 0;
+    out_room(w, FRAME_HEAD);
+    w->outlen = FRAME_HEAD;
+    for (i = 0; i < NSYS; i++)		/* small enough as they are */
+	out_num(w, now->sys[i]);
+    for (i = 0; i < ncpu; i++)
+	out_num(w, zig(now->cpus[i] - (key || !was->cpus ? 0 : was->cpus[i])));
+    out_num(w, n);
+    for (i = 0; i < n; i++)
+	out_num(w, now->rows[i].pid - (i ? now->rows[i - 1].pid : 0));
+    for (c = 0; c < NCOLS; c++)
+	for (i = 0; i < n; i += run) {
+	    u64 d = col_delta(now, was, w->at, i, c);
+	    out_num(w, d);
+	    run = 1;
+	    if (!d) {
+		while (i + run < n && !col_delta(now, was, w->at, i + run, c))
+		    run++;
+		out_num(w, run - 1);
+	    }
+	}
+    for (c = 0; c < NSTRS; c++)
+	for (i = 0; i < n; i += run) {
+	    const struct row *r = &now->rows[i];
+	    run = 1;
+	    if (str_same(now, was, w->at, i, c)) {
+		while (i + run < n && str_same(now, was, w->at, i + run, c))
+		    run++;
+		out_num(w, 0);
+		out_num(w, run - 1);
+		continue;
+	    }
+	    out_num(w, r->len[c] + 1);
+	    out_bytes(w, now->heap + r->str[c], r->len[c]);
+	}
+
+    memcpy(w->out, "snf", 3);
+    w->out[3] = key;
+    put32(w->out + 4, w->outlen - FRAME_HEAD);
+    w->cur = !w->cur;
+    w->count++;
+    return write_all(w->fd, w->out, w->outlen);	/* one go, for O_APPEND */
+}
+
+void snap_close_writer(snap_writer *w) {
+    if (!w)
+	return;
+    close(w->fd);
+    frame_free(&w->f[0]);
+    frame_free(&w->f[1]);
+    free(w->at);
+    free(w->sorted);
+    free(w->out);
+    free(w);
+}
+
+/*********************************************************************/
+/* reading */
+
+struct snap_reader {
+    off_t end;				/* past the last whole frame */
+    int fd;
+    unsigned char *map;
+    size_t maplen;
+    snap_info info;
+    off_t *where;			/* each frame's header */
+    unsigned room;
+    struct frame f[2];
+    int cur;				/* f[cur] holds frame `at' */
+    long long at;			/* -1 for none yet */
+    int *match;
+    int matchroom;
+    proc_t *procs, **tab;
+    int procroom;
+    char *text;				/* the tasks' NUL terminated strings */
+    unsigned textsize;
+};
+
+/* index the whole frames from r->end on */
+static void index_frames(snap_reader *r) {
+    while ((size_t)r->end + FRAME_HEAD <= r->maplen) {
+	const unsigned char *h = r->map + r->end;
+	unsigned len = get32(h + 4);
+
+	if (memcmp(h, "snf", 3) || (size_t)r->end + FRAME_HEAD + len > r->maplen)
+	    break;			/* the rest is yet to come, or junk */
+	if (r->info.frames >= r->room) {
+	    r->room = r->room * 2 + 1024;
+	    r->where = xrealloc(r->where, r->room * sizeof *r->where);
+	}
+	r->where[r->info.frames++] = r->end;
+	r->end += FRAME_HEAD + len;
+    }
+}
+
+static int map_file(snap_reader *r) {
+    struct stat st;
+    void *m;
+
+    if (fstat(r->fd, &st) == -1)
+	return -1;
+    if ((size_t)st.st_size == r->maplen)
+	return 0;
+    m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (m == MAP_FAILED)
+	return -1;
+    if (r->map)
+	munmap(r->map, r->maplen);
+    r->map = m;
+    r->maplen = st.st_size;
+    return 0;
+}
+
+snap_reader *snap_open(const char *path, snap_info *info) {
+    snap_reader *r;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+	return NULL;
+    r = xcalloc(NULL, sizeof *r);
+    r->fd = fd;
+    r->at = -1;
+    if (map_file(r) == -1)
+	goto fail;
+    if (r->maplen < HEAD_SIZE || memcmp(r->map, SNAP_MAGIC, 8)
+     || get32(r->map + 8) != SNAP_VERSION) {
+	errno = EINVAL;
+	goto fail;
+    }
+    r->info.hertz = get32(r->map + 12);
+    r->info.page_size = get32(r->map + 16);
+    r->info.ncpus = get32(r->map + 20);
+    r->end = HEAD_SIZE;
+    index_frames(r);
+    if (info)
+	*info = r->info;
+    return r;
+fail:
+    snap_close(r);
+    return NULL;
+}
+
+/* how much of the file at `path' is whole frames */
+static off_t whole(const char *path, snap_info *info) {
+    snap_reader *r = snap_open(path, info);
+    off_t end;
+
+    if (!r)
+	return -1;
+    end = r->end;
+    snap_close(r);
+    return end;
+}
+
+unsigned snap_reopen(snap_reader *r) {
+    if (map_file(r) == 0)
+	index_frames(r);
+    return r->info.frames;
+}
+
+void snap_close(snap_reader *r) {
+    if (!r)
+	return;
+    if (r->map)
+	munmap(r->map, r->maplen);
+    close(r->fd);
+    frame_free(&r->f[0]);
+    frame_free(&r->f[1]);
+    free(r->where);
+    free(r->match);
+    free(r->procs);
+    free(r->tab);
+    free(r->text);
+    free(r);
+}
+
+static int in_num(const unsigned char **p, const unsigned char *end, u64 *v) {
+    const unsigned char *s = *p;
+    int shift = 0;
+
+    *v = 0;
+    do {
+	if (s >= end || shift > 63)
+	    return -1;
+	*v |= (u64)(*s & 0x7f) << shift;
+	shift += 7;
+    } while (*s++ & 0x80);
+    *p = s;
+    return 0;
+}
+
+/* decode frame `k' into f[!cur], against f[cur] (frame k - 1) */
+static int decode(snap_reader *r, unsigned k) {
+    const unsigned char *h = r->map + r->where[k];
+    const unsigned char *p = h + FRAME_HEAD, *end = p + get32(h + 4);
+    struct frame *now = &r->f[!r->cur], *was = &r->f[r->cur];
+    int key = h[3], ncpu = 5 * (r->info.ncpus + 1);
+    int i, c;
+    u64 v, n, run;
+
+    if (!key && r->at != (long long)k - 1)
+	return -1;
+    if (key)
+	was->n = 0;
+    for (i = 0; i < NSYS; i++)
+	if (in_num(&p, end, &now->sys[i]) == -1)
+	    return -1;
+    if (!now->cpus)
+	now->cpus = xmalloc(ncpu * sizeof *now->cpus);
+    for (i = 0; i < ncpu; i++) {
+	if (in_num(&p, end, &v) == -1)
+	    return -1;
+	now->cpus[i] = unzig(v) + (key || !was->cpus ? 0 : was->cpus[i]);
+    }
+    if (in_num(&p, end, &n) == -1 || n > (u64)(end - p))
+	return -1;			/* (each task takes some bytes) */
+    frame_rows(now, n);
+    for (i = 0; i < (int)n; i++) {
+	if (in_num(&p, end, &v) == -1)
+	    return -1;
+	now->rows[i].pid = v + (i ? now->rows[i - 1].pid : 0);
+    }
+    if ((int)n > r->matchroom) {
+	r->matchroom = n * 5 / 4 + 64;
+	r->match = xrealloc(r->match, r->matchroom * sizeof *r->match);
+    }
+    match(now, was, r->match);
+    for (c = 0; c < NCOLS; c++)
+	for (i = 0; i < (int)n; ) {
+	    if (in_num(&p, end, &v) == -1
+	     || (!v && (in_num(&p, end, &run) == -1 || run >= n - i)))
+		return -1;
+	    for (run = v ? 1 : run + 1; run--; i++)
+		now->rows[i].v[c] = unzig(v)
+		    + (r->match[i] < 0 ? 0 : was->rows[r->match[i]].v[c]);
+	}
+    for (c = 0; c < NSTRS; c++)
+	for (i = 0; i < (int)n; ) {
+	    struct row *row = &now->rows[i];
+	    if (in_num(&p, end, &v) == -1)
+		return -1;
+	    if (!v) {			/* a run of them as before */
+		if (in_num(&p, end, &run) == -1 || run >= n - i)
+		    return -1;
+		for (run++; run--; i++) {
+		    const struct row *o;
+		    if (r->match[i] < 0)
+			return -1;
+		    o = &was->rows[r->match[i]];
+		    now->rows[i].len[c] = o->len[c];
+		    now->rows[i].str[c] = heap_put(now, was->heap + o->str[c], o->len[c]);
+		}
+		continue;
+	    }
+	    if (--v > (u64)(end - p))
+		return -1;
+	    row->len[c] = v;
+	    row->str[c] = heap_put(now, (const char *)p, v);
+	    p += v;
+	    i++;
+	}
+    r->cur = !r->cur;
+    r->at = k;
+    return 0;
+}
+
+/* the current frame, as proc_t's */
+static proc_t **build(snap_reader *r, int *np) {
+    const struct frame *f = &r->f[r->cur];
+    unsigned need = 0, t = 0;
+    int i, c;
+
+    if (f->n + 1 > r->procroom) {
+	r->procroom = f->n * 5 / 4 + 64;
+	r->procs = xrealloc(r->procs, r->procroom * sizeof *r->procs);
+	r->tab = xrealloc(r->tab, r->procroom * sizeof *r->tab);
+    }
+    /* a cmdline's vector then its strings, each string NUL terminated */
+    for (i = 0; i < f->n; i++) {
+	need += f->rows[i].len[S_CMDLINE] + 2 + sizeof(char *);
+	for (c = 0; c < (int)f->rows[i].len[S_CMDLINE]; c++)
+	    need += f->heap[f->rows[i].str[S_CMDLINE] + c] ? 0 : sizeof(char *);
+    }
+    if (need > r->textsize) {
+	r->textsize = need * 5 / 4 + 4096;
+	r->text = xrealloc(r->text, r->textsize);
+    }
+    for (i = 0; i < f->n; i++) {
+	const struct row *row = &f->rows[i];
+	proc_t *p = &r->procs[i];
+	const char *s;
+	unsigned len, j, strs = 0;
+
+	memset(p, 0, sizeof *p);
+	p->pid = row->pid;
+	for (c = 0; c < NCOLS; c++)
+	    col_set(p, &cols[c], row->v[c]);
+	p->arena = ARENA_PROC | ARENA_VECS;	/* none of it is freeproc()'s */
+	memcpy(p->cmd, f->heap + row->str[S_CMD], row->len[S_CMD]);
+	memcpy(p->euser, f->heap + row->str[S_USER], row->len[S_USER]);
+	memcpy(p->egroup, f->heap + row->str[S_GROUP], row->len[S_GROUP]);
+	if ((len = row->len[S_CMDLINE])) {
+	    char **v, *text;
+
+	    s = f->heap + row->str[S_CMDLINE];
+	    for (j = 0; j < len; j++)
+		strs += !s[j];
+	    strs += s[len - 1] != '\0';	/* cut short, unterminated */
+	    t = (t + sizeof(char *) - 1) & ~(sizeof(char *) - 1);
+	    v = (char **)(r->text + t);
+	    text = (char *)(v + strs + 1);
+	    memcpy(text, s, len);
+	    text[len] = '\0';
+	    p->cmdline = v;
+	    for (j = 0; j < strs; j++) {
+		*v++ = text;
+		text += strlen(text) + 1;
+	    }
+	    *v = NULL;
+	    t = text - r->text;
+	}
+	r->tab[i] = p;
+    }
+    r->tab[f->n] = NULL;
+    *np = f->n;
+    return r->tab;
+}
+
+proc_t **snap_read(snap_reader *r, unsigned frame, snap_sys *sys, int *n) {
+    const struct frame *f;
+    long long k;
+    int i;
+
+    if (frame >= r->info.frames)
+	return NULL;
+    if (r->at != (long long)frame) {
+	/* from the last frame kept whole, unless we're already on the way */
+	for (k = frame; k > 0 && !r->map[r->where[k] + 3]; k--)
+	    ;
+	if (r->at >= k && r->at < (long long)frame)
+	    k = r->at + 1;
+	for (; k <= (long long)frame; k++)
+	    if (decode(r, k) == -1) {
+		r->at = -1;
+		return NULL;
+	    }
+    }
+    f = &r->f[r->cur];
+    sys->sec = f->sys[0];
+    sys->usec = f->sys[1];
+    sys->uptime = f->sys[2] / 100.0;
+    for (i = 0; i < 3; i++)
+	sys->loadavg[i] = f->sys[3 + i] / 100.0;
+    sys->users = f->sys[6];
+    sys->main_total = f->sys[7];
+    sys->main_used = f->sys[8];
+    sys->main_free = f->sys[9];
+    sys->main_buffers = f->sys[10];
+    sys->main_cached = f->sys[11];
+    sys->swap_total = f->sys[12];
+    sys->swap_used = f->sys[13];
+    sys->swap_free = f->sys[14];
+    sys->cpus = f->cpus;
+    return build(r, n);
+}
@@ -0,0 +1,64 @@
+#ifndef PROC_SNAPFILE_H
+#define PROC_SNAPFILE_H
+
+#include "readproc.h"
+
+/* A recording of frames -- each a process table along with the cpu tics,
+ * memory and load that went with it -- appended to a file as they come,
+ * for looking at again later:  top -w records, top -R plays back.
+ *
+ * Each frame is stored a column at a time, and every number in it as the
+ * difference from the same task's (or cpu's) in the frame before, so a
+ * second's worth of a quiet machine is mostly zero bytes.  Every
+ * SNAP_KEYEVERY frames one is kept whole, so a reader can start there.
+ *
+ * Only what top shows (and a little more) is kept:  the numbers in
+ * snapfile.c's cols[], the command name, user and group names, and the cmdline.
+ */
+
+#define SNAP_KEYEVERY  60
+
+typedef struct snap_sys {
+    long long sec, usec;		/* when the frame was taken */
+    double uptime;			/* seconds */
+    double loadavg[3];
+    unsigned users;
+    unsigned long main_total, main_used, main_free, main_buffers, main_cached;
+    unsigned long swap_total, swap_used, swap_free;		/* kB */
+    unsigned long long *cpus;		/* u,n,s,i,w for each cpu, then the sum */
+} snap_sys;
+
+typedef struct snap_info {
+    unsigned hertz, page_size, ncpus;	/* of the machine recorded */
+    unsigned frames;			/* whole ones, in the file */
+} snap_info;
+
+typedef struct snap_writer snap_writer;
+typedef struct snap_reader snap_reader;
+
+/* open `path' to add frames to, making it if need be;  NULL (errno set)
+ * if it can't be, or if it holds a recording of some other machine.  A
+ * frame left half written (by a crash, say) is cut off first. */
+extern snap_writer *snap_create(const char *path, unsigned hertz,
+				unsigned page_size, unsigned ncpus);
+
+/* append a frame:  sys->cpus has 5 * (ncpus + 1) tics, and table the n
+ * tasks (in any order);  0, or -1 if the write failed */
+extern int snap_write(snap_writer *w, const snap_sys *sys, proc_t **table, int n);
+extern void snap_close_writer(snap_writer *w);
+
+/* map a recording for reading;  NULL (errno set) if it isn't one */
+extern snap_reader *snap_open(const char *path, snap_info *info);
+
+/* frame `frame' (from 0):  fills in *sys (whose cpus belong to the reader)
+ * and returns its tasks, in pid order, with *n of them -- all kept by the
+ * reader until the next call, and not for freeproc().  Reading the frames
+ * in order is cheapest;  going anywhere else means starting from the
+ * frame kept whole before it.  NULL if there's no such frame. */
+extern proc_t **snap_read(snap_reader *r, unsigned frame, snap_sys *sys, int *n);
+
+/* map whatever has been added to the file since;  returns the frames now */
+extern unsigned snap_reopen(snap_reader *r);
+extern void snap_close(snap_reader *r);
+
+#endif
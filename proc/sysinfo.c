@@ -16,15 +16,16 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/auxv.h>
 #include "version.h"
+#include "procps.h"
 #include "sysinfo.h" /* include self to verify prototypes */
 
 #ifndef HZ
 #include <netinet/in.h>  /* htons */
 #endif
 
-long smp_num_cpus;     /* number of CPUs */
-
 #define BAD_OPEN_MESSAGE					\
 "Error: /proc must be mounted\n"				\
 "  To mount /proc at boot you need an /etc/fstab line like:\n"	\
@@ -32,38 +33,74 @@ long smp_num_cpus;     /* number of CPUs */
 "  In the meantime, mount /proc /proc -t proc\n"
 
 #define STAT_FILE    "/proc/stat"
-static int stat_fd = -1;
 #define UPTIME_FILE  "/proc/uptime"
-static int uptime_fd = -1;
 #define LOADAVG_FILE "/proc/loadavg"
-static int loadavg_fd = -1;
 #define MEMINFO_FILE "/proc/meminfo"
-static int meminfo_fd = -1;
-#define VMINFO_FILE "/proc/vmstat"
-static int vminfo_fd = -1;
+#define VMINFO_FILE  "/proc/vmstat"
 
-#define BUFSIZE 2048
-static char buf[BUFSIZE];
+/* The files are opened on first use and then kept, each pass reading it
+ * again from the top with a single pread() where the kernel formats the
+ * whole file at once.  (/proc/vmstat comes a record at a time, so a short
+ * read doesn't mean the end of it.)  They all share one buffer, grown to
+ * fit the biggest.
+ */
+static struct sysfile {
+    const char *name;
+    int fd;
+    int whole;		/* formatted all at once: a short read is the end */
+} sysfiles[SYSINFO_FILES] = {
+    { STAT_FILE,    -1, 1 },
+    { UPTIME_FILE,  -1, 1 },
+    { LOADAVG_FILE, -1, 1 },
+    { MEMINFO_FILE, -1, 1 },
+    { VMINFO_FILE,  -1, 0 },
+};
+
+static char *buf;
+static int bufsiz;
+
+char *sysinfo_file(int which, int *len) {
+    struct sysfile *f = &sysfiles[which];
+    int n, got = 0;
+
+    if (f->fd == -1) {
+	char path[PROC_ROOT_MAX + 16];
+	/* "/proc/stat" is proc_root() "/stat" */
+	snprintf(path, sizeof path, "%s%s", proc_root(), f->name + 5);
+	f->fd = open(path, O_RDONLY);
+    }
+    if (f->fd == -1) {
+	fprintf(stderr, BAD_OPEN_MESSAGE);
+	fflush(NULL);
+	_exit(102);
+    }
+    for (;;) {
+	if (bufsiz - got < 1024) {
+	    bufsiz = bufsiz ? bufsiz * 2 : 4096;
+	    if (!(buf = realloc(buf, bufsiz))) {
+		perror(f->name);
+		fflush(NULL);
+		_exit(103);
+	    }
+	}
+	if ((n = pread(f->fd, buf + got, bufsiz - 1 - got, got)) < 0) {
+	    perror(f->name);
+	    fflush(NULL);
+	    _exit(103);
+	}
+	got += n;
+	if (!n || (f->whole && got < bufsiz - 1))
+	    break;
+    }
+    buf[got] = '\0';
+    if (len)
+	*len = got;
+    return buf;
+}
 
-/* This macro opens filename only if necessary and seeks to 0 so
- * that successive calls to the functions are more efficient.
- * It also reads the current contents of the file into the global buf.
+/* This macro reads the current contents of the file into the global buf.
  */
-#define FILE_TO_BUF(filename, fd) do{				\
-    static int local_n;						\
-    if (fd == -1 && (fd = open(filename, O_RDONLY)) == -1) {	\
-	fprintf(stderr, BAD_OPEN_MESSAGE);			\
-	fflush(NULL);						\
-	_exit(102);						\
-    }								\
-    lseek(fd, 0L, SEEK_SET);					\
-    if ((local_n = read(fd, buf, sizeof buf - 1)) < 0) {	\
-	perror(filename);					\
-	fflush(NULL);						\
-	_exit(103);						\
-    }								\
-    buf[local_n] = '\0';					\
-}while(0)
+#define FILE_TO_BUF(which) sysinfo_file(which, NULL)
 
 /* evals 'x' twice */
 #define SET_IF_DESIRED(x,y) do{  if(x) *(x) = (y); }while(0)
@@ -74,7 +111,7 @@ int uptime(double *uptime_secs, double *idle_secs) {
     double up=0, idle=0;
     char *savelocale;
 
-    FILE_TO_BUF(UPTIME_FILE,uptime_fd);
+    FILE_TO_BUF(SYSINFO_UPTIME);
     savelocale = setlocale(LC_NUMERIC, NULL);
     setlocale(LC_NUMERIC,"C");
     if (sscanf(buf, "%lf %lf", &up, &idle) < 2) {
@@ -119,7 +156,8 @@ int uptime(double *uptime_secs, double *idle_secs) {
  * architectures there may be a system call or sysctl() that will work.
  */
 
-unsigned long long Hertz;
+static unsigned long long hertz;
+static long cpus;
 
 static void old_Hertz_hack(void){
   unsigned long long user_j, nice_j, sys_j, other_j;  /* jiffies (clock ticks) */
@@ -131,76 +169,97 @@ static void old_Hertz_hack(void){
   savelocale = setlocale(LC_NUMERIC, NULL);
   setlocale(LC_NUMERIC, "C");
   do{
-    FILE_TO_BUF(UPTIME_FILE,uptime_fd);  sscanf(buf, "%lf", &up_1);
+    FILE_TO_BUF(SYSINFO_UPTIME);  sscanf(buf, "%lf", &up_1);
     /* uptime(&up_1, NULL); */
-    FILE_TO_BUF(STAT_FILE,stat_fd);
+    FILE_TO_BUF(SYSINFO_STAT);
     sscanf(buf, "cpu %Lu %Lu %Lu %Lu", &user_j, &nice_j, &sys_j, &other_j);
-    FILE_TO_BUF(UPTIME_FILE,uptime_fd);  sscanf(buf, "%lf", &up_2);
+    FILE_TO_BUF(SYSINFO_UPTIME);  sscanf(buf, "%lf", &up_2);
     /* uptime(&up_2, NULL); */
   } while((long long)( (up_2-up_1)*1000.0/up_1 )); /* want under 0.1% error */
   setlocale(LC_NUMERIC, savelocale);
   jiffies = user_j + nice_j + sys_j + other_j;
   seconds = (up_1 + up_2) / 2;
-  h = (unsigned)( (double)jiffies/seconds/smp_num_cpus );
+  h = (unsigned)( (double)jiffies/seconds/procps_cpus() );
   /* actual values used by 2.4 kernels: 32 64 100 128 1000 1024 1200 */
   switch(h){
-  case    9 ...   11 :  Hertz =   10; break; /* S/390 (sometimes) */
-  case   18 ...   22 :  Hertz =   20; break; /* user-mode Linux */
-  case   30 ...   34 :  Hertz =   32; break; /* ia64 emulator */
-  case   48 ...   52 :  Hertz =   50; break;
-  case   58 ...   61 :  Hertz =   60; break;
-  case   62 ...   65 :  Hertz =   64; break; /* StrongARM /Shark */
-  case   95 ...  105 :  Hertz =  100; break; /* normal Linux */
-  case  124 ...  132 :  Hertz =  128; break; /* MIPS, ARM */
-  case  195 ...  204 :  Hertz =  200; break; /* normal << 1 */
-  case  253 ...  260 :  Hertz =  256; break;
-  case  393 ...  408 :  Hertz =  400; break; /* normal << 2 */
-  case  790 ...  808 :  Hertz =  800; break; /* normal << 3 */
-  case  990 ... 1010 :  Hertz = 1000; break; /* ARM */
-  case 1015 ... 1035 :  Hertz = 1024; break; /* Alpha, ia64 */
-  case 1180 ... 1220 :  Hertz = 1200; break; /* Alpha */
+  case    9 ...   11 :  hertz =   10; break; /* S/390 (sometimes) */
+  case   18 ...   22 :  hertz =   20; break; /* user-mode Linux */
+  case   30 ...   34 :  hertz =   32; break; /* ia64 emulator */
+  case   48 ...   52 :  hertz =   50; break;
+  case   58 ...   61 :  hertz =   60; break;
+  case   62 ...   65 :  hertz =   64; break; /* StrongARM /Shark */
+  case   95 ...  105 :  hertz =  100; break; /* normal Linux */
+  case  124 ...  132 :  hertz =  128; break; /* MIPS, ARM */
+  case  195 ...  204 :  hertz =  200; break; /* normal << 1 */
+  case  253 ...  260 :  hertz =  256; break;
+  case  393 ...  408 :  hertz =  400; break; /* normal << 2 */
+  case  790 ...  808 :  hertz =  800; break; /* normal << 3 */
+  case  990 ... 1010 :  hertz = 1000; break; /* ARM */
+  case 1015 ... 1035 :  hertz = 1024; break; /* Alpha, ia64 */
+  case 1180 ... 1220 :  hertz = 1200; break; /* Alpha */
   default:
 #ifdef HZ
-    Hertz = (unsigned long long)HZ;    /* <asm/param.h> */
+    hertz = (unsigned long long)HZ;    /* <asm/param.h> */
 #else
     /* If 32-bit or big-endian (not Alpha or ia64), assume HZ is 100. */
-    Hertz = (sizeof(long)==sizeof(int) || htons(999)==999) ? 100UL : 1024UL;
+    hertz = (sizeof(long)==sizeof(int) || htons(999)==999) ? 100UL : 1024UL;
 #endif
-    fprintf(stderr, "Unknown HZ value! (%d) Assume %Ld.\n", h, Hertz);
+    fprintf(stderr, "Unknown HZ value! (%d) Assume %Ld.\n", h, hertz);
   }
 }
 
-#ifndef AT_CLKTCK
-#define AT_CLKTCK       17    /* frequency of times() */
-#endif
-
-extern char** environ;
+/* Hertz and the CPU count are only found on first use, and not in a
+ * constructor, so that the likes of kill and uptime, run from health
+ * checks thousands of times a minute, don't pay for what they never ask.
+ */
 
-/* for ELF executables, notes are pushed before environment and args */
-static unsigned long find_elf_note(unsigned long findme){
-  unsigned long *ep = (unsigned long *)environ;
-  while(*ep++);
-  while(*ep){
-    if(ep[0]==findme) return ep[1];
-    ep+=2;
+static void init_hertz(void){
+  if(linux_version_code > LINUX_VERSION(2, 4, 0)){
+    /* the ELF note, but from the auxiliary vector itself:  by now the
+     * program may well have moved environ, which it used to be found past */
+    hertz = getauxval(AT_CLKTCK);
+    if(hertz) return;
+    fprintf(stderr, "2.4 kernel w/o ELF notes? -- report to albert@users.sf.net\n");
   }
-  return 42;
+  old_Hertz_hack();
 }
 
-static void init_libproc(void) __attribute__((constructor));
-static void init_libproc(void){
-  /* ought to count CPUs in /proc/stat instead of relying
-   * on glibc, which foolishly tries to parse /proc/cpuinfo
-   */
-  smp_num_cpus = sysconf(_SC_NPROCESSORS_CONF); // or _SC_NPROCESSORS_ONLN
-  if(smp_num_cpus<1) smp_num_cpus=1; /* SPARC glibc is buggy */
-
-  if(linux_version_code > LINUX_VERSION(2, 4, 0)){ 
-    Hertz = find_elf_note(AT_CLKTCK);
-    if(Hertz!=42) return;
-    fprintf(stderr, "2.4 kernel w/o ELF notes? -- report to albert@users.sf.net\n");
+unsigned long long procps_hertz(void){
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+  pthread_once(&once, init_hertz);
+  return hertz;
+}
+
+/* the CPUs present, from one little sysfs file ("0-3,6,8-11") rather than
+ * glibc's directory listing (or, failing that, parse of /proc/cpuinfo) */
+static void init_cpus(void){
+  char b[256], *p, *e;
+  int fd, n;
+  long lo, hi;
+
+  n = -1;
+  if((fd = open("/sys/devices/system/cpu/present", O_RDONLY)) != -1){
+    n = read(fd, b, sizeof b - 1);
+    close(fd);
   }
-  old_Hertz_hack();
+  if(n > 0){
+    b[n] = '\0';
+    for(p = b; isdigit(*p); p = e + (*e == ',')){
+      lo = hi = strtol(p, &e, 10);
+      if(*e == '-') hi = strtol(e + 1, &e, 10);
+      if(hi >= lo) cpus += hi - lo + 1;
+    }
+  }
+  if(cpus<1) cpus = sysconf(_SC_NPROCESSORS_CONF);
+  if(cpus<1) cpus=1; /* SPARC glibc is buggy */
+}
+
+long procps_cpus(void){
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+  pthread_once(&once, init_cpus);
+  return cpus;
 }
 
 /***********************************************************************
@@ -223,7 +282,7 @@ void five_cpu_numbers(double *uret, double *nret, double *sret, double *iret, do
     tmp_w = 0.0;
     new_w = 0;
  
-    FILE_TO_BUF(STAT_FILE,stat_fd);
+    FILE_TO_BUF(SYSINFO_STAT);
     sscanf(buf, "cpu %Lu %Lu %Lu %Lu %Lu", &new_u, &new_n, &new_s, &new_i, &new_w);
     ticks_past = (new_u+new_n+new_s+new_i+new_w)-(old_u+old_n+old_s+old_i+old_w);
     if(ticks_past){
@@ -258,7 +317,7 @@ void loadavg(double *av1, double *av5, double *av15) {
     double avg_1=0, avg_5=0, avg_15=0;
     char *savelocale;
     
-    FILE_TO_BUF(LOADAVG_FILE,loadavg_fd);
+    FILE_TO_BUF(SYSINFO_LOADAVG);
     savelocale = setlocale(LC_NUMERIC, NULL);
     setlocale(LC_NUMERIC, "C");
     if (sscanf(buf, "%lf %lf %lf", &avg_1, &avg_5, &avg_15) < 3) {
@@ -288,8 +347,58 @@ typedef struct mem_table_struct {
   unsigned *slot; /* slot in return struct */
 } mem_table_struct;
 
-static int compare_mem_table_structs(const void *a, const void *b){
-  return strcmp(((const mem_table_struct*)a)->name,((const mem_table_struct*)b)->name);
+/* Rows of meminfo and vmstat are looked up by name in a small hash, filled
+ * in from the table on the first call.  NAME_MUL was picked so that no two
+ * of the names we know share a slot, making each row one hash over its name
+ * and, for the rows wanted, one memcmp.  (A name added later that happens
+ * to collide just costs a probe.)
+ */
+#define NAME_BITS  7
+#define NAME_SLOTS (1 << NAME_BITS)
+#define NAME_MUL   207
+#define NAME_SLOT(h) (((h) * 2654435761u) >> (32 - NAME_BITS))
+
+typedef struct name_hash {
+  const mem_table_struct *ent[NAME_SLOTS];
+  unsigned char len[NAME_SLOTS];
+  int filled;
+} name_hash;
+
+static void name_hash_fill(name_hash *nh, const mem_table_struct *t, int n){
+  while(n--){
+    const char *s = t[n].name;
+    unsigned h = 0, i;
+    int len;
+    for(len = 0; s[len]; len++) h = h * NAME_MUL + (unsigned char)s[len];
+    for(i = NAME_SLOT(h); nh->ent[i]; i = (i + 1) & (NAME_SLOTS - 1))
+      ;
+    nh->ent[i] = &t[n];
+    nh->len[i] = len;
+  }
+  nh->filled = 1;
+}
+
+/* store the number after each "name<sep>" which the hash knows of */
+static void name_hash_parse(const name_hash *nh, char *head, int sep){
+  char *tail;
+  unsigned h, i;
+
+  for(;;){
+    h = 0;
+    for(tail = head; *tail && *tail != sep && *tail != '\n'; tail++)
+      h = h * NAME_MUL + (unsigned char)*tail;
+    if(*tail == sep){
+      for(i = NAME_SLOT(h); nh->ent[i]; i = (i + 1) & (NAME_SLOTS - 1)){
+        if(nh->len[i] == tail - head && !memcmp(nh->ent[i]->name, head, tail - head)){
+          *(nh->ent[i]->slot) = strtoul(tail + 1, &tail, 10);
+          break;
+        }
+      }
+    }
+    tail = strchr(tail, '\n');
+    if(!tail) break;
+    head = tail+1;
+  }
 }
 
 /* example data, following junk, with comments added:
@@ -353,11 +462,7 @@ unsigned kb_mapped;
 unsigned kb_pagetables;
 
 void meminfo(void){
-  char namebuf[16]; /* big enough to hold any row name */
-  mem_table_struct findme = { namebuf, NULL};
-  mem_table_struct *found;
-  char *head;
-  char *tail;
+  static name_hash mem_hash;
   static const mem_table_struct mem_table[] = {
   {"Active",       &kb_active},
   {"Buffers",      &kb_main_buffers},
@@ -386,31 +491,12 @@ void meminfo(void){
   };
   const int mem_table_count = sizeof(mem_table)/sizeof(mem_table_struct);
 
-  FILE_TO_BUF(MEMINFO_FILE,meminfo_fd);
+  if(!mem_hash.filled) name_hash_fill(&mem_hash, mem_table, mem_table_count);
 
-  kb_inactive = ~0U;
+  FILE_TO_BUF(SYSINFO_MEMINFO);
 
-  head = buf;
-  for(;;){
-    tail = strchr(head, ':');
-    if(!tail) break;
-    *tail = '\0';
-    if(strlen(head) >= sizeof(namebuf)){
-      head = tail+1;
-      goto nextline;
-    }
-    strcpy(namebuf,head);
-    found = bsearch(&findme, mem_table, mem_table_count,
-        sizeof(mem_table_struct), compare_mem_table_structs
-    );
-    head = tail+1;
-    if(!found) goto nextline;
-    *(found->slot) = strtoul(head,&tail,10);
-nextline:
-    tail = strchr(head, '\n');
-    if(!tail) break;
-    head = tail+1;
-  }
+  kb_inactive = ~0U;
+  name_hash_parse(&mem_hash, buf, ':');
   if(!kb_low_total){  /* low==main except with large-memory support */
     kb_low_total = kb_main_total;
     kb_low_free  = kb_main_free;
@@ -426,15 +512,6 @@ nextline:
 
 /* read /proc/vminfo only for 2.5.41 and above */
 
-typedef struct vm_table_struct {
-  const char *name;     /* VM statistic name */
-  unsigned *slot;       /* slot in return struct */
-} vm_table_struct;
-
-static int compare_vm_table_structs(const void *a, const void *b){
-  return strcmp(((const vm_table_struct*)a)->name,((const vm_table_struct*)b)->name);
-}
-
 unsigned vm_nr_dirty;
 unsigned vm_nr_writeback;
 unsigned vm_nr_pagecache;
@@ -460,12 +537,8 @@ unsigned vm_pageoutrun;
 unsigned vm_allocstall;
 
 void vminfo(void){
-  char namebuf[16]; /* big enough to hold any row name */
-  vm_table_struct findme = { namebuf, NULL};
-  vm_table_struct *found;
-  char *head;
-  char *tail;
-  static const vm_table_struct vm_table[] = {
+  static name_hash vm_hash;
+  static const mem_table_struct vm_table[] = {
   {"allocstall",          &vm_allocstall},
   {"kswapd_steal",        &vm_kswapd_steal},
   {"nr_dirty",            &vm_nr_dirty},
@@ -490,34 +563,12 @@ void vminfo(void){
   {"pswpin",              &vm_pswpin},
   {"pswpout",             &vm_pswpout}
   };
-  const int vm_table_count = sizeof(vm_table)/sizeof(vm_table_struct);
+  const int vm_table_count = sizeof(vm_table)/sizeof(mem_table_struct);
 
-  FILE_TO_BUF(VMINFO_FILE,vminfo_fd);
+  if(!vm_hash.filled) name_hash_fill(&vm_hash, vm_table, vm_table_count);
 
-  head = buf;
-  for(;;){
-    tail = strchr(head, ' ');
-    if(!tail) break;
-    *tail = '\0';
-    if(strlen(head) >= sizeof(namebuf)){
-      head = tail+1;
-      goto nextline;
-    }
-    strcpy(namebuf,head);
-    found = bsearch(&findme, vm_table, vm_table_count,
-        sizeof(vm_table_struct), compare_vm_table_structs
-    );
-    head = tail+1;
-    if(!found) goto nextline;
-    *(found->slot) = strtoul(head,&tail,10);
-nextline:
-
-//if(found) fprintf(stderr,"%s=%d\n",found->name,*(found->slot));
-//else      fprintf(stderr,"%s not found\n",findme.name);
+  FILE_TO_BUF(SYSINFO_VMSTAT);
 
-    tail = strchr(head, '\n');
-    if(!tail) break;
-    head = tail+1;
-  }
+  name_hash_parse(&vm_hash, buf, ' ');
 }
 /*****************************************************************/
@@ -1,8 +1,11 @@
 #ifndef SYSINFO_H
 #define SYSINFO_H
 
-extern unsigned long long Hertz;   /* clock tick frequency */
-extern long smp_num_cpus;     /* number of CPUs */
+/* found on first use, so a program that never asks never pays */
+extern unsigned long long procps_hertz(void);
+extern long procps_cpus(void);
+#define Hertz        procps_hertz()	/* clock tick frequency */
+#define smp_num_cpus procps_cpus()	/* number of CPUs */
 
 #define JT double
 extern void five_cpu_numbers(JT *uret, JT *nret, JT *sret, JT *iret, JT *wret);
@@ -11,6 +14,19 @@ extern void five_cpu_numbers(JT *uret, JT *nret, JT *sret, JT *iret, JT *wret);
 extern int        uptime (double *uptime_secs, double *idle_secs);
 extern void       loadavg(double *av1, double *av5, double *av15);
 
+/* The whole of one of these files, NUL terminated (and its length in *len
+ * if len isn't NULL), read through a descriptor that stays open.  The
+ * buffer is shared by all of the calls here and lasts until the next one;
+ * the caller may write on it in the meantime.
+ */
+#define SYSINFO_STAT     0	/* /proc/stat */
+#define SYSINFO_UPTIME   1	/* /proc/uptime */
+#define SYSINFO_LOADAVG  2	/* /proc/loadavg */
+#define SYSINFO_MEMINFO  3	/* /proc/meminfo */
+#define SYSINFO_VMSTAT   4	/* /proc/vmstat */
+#define SYSINFO_FILES    5
+extern char      *sysinfo_file(int which, int *len);
+
 
 /* obsolete */
 extern unsigned kb_main_shared;
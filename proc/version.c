@@ -25,17 +25,15 @@ void display_version(void) {
  * Copyright (c) 1996 Charles Blake <cblake@bbn.com>
  */
 #include <sys/utsname.h>
+#include <pthread.h>
 
-#define LINUX_VERSION(x,y,z)   (0x10000*(x) + 0x100*(y) + z)
+static int version_code;
 
-int linux_version_code = 0;
-
-static void init_Linux_version(void) __attribute__((constructor));
+/* asked for on first use, rather than by a constructor in every program */
 static void init_Linux_version(void) {
     static struct utsname uts;
     int x = 0, y = 0, z = 0;	/* cleared in case sscanf() < 3 */
-    
-    if (linux_version_code) return;
+
     if (uname(&uts) == -1)	/* failure implies impending death */
 	exit(1);
     if (sscanf(uts.release, "%d.%d.%d", &x, &y, &z) < 3)
@@ -43,5 +41,12 @@ static void init_Linux_version(void) {
 		"Non-standard uts for running kernel:\n"
 		"release %s=%d.%d.%d gives version code %d\n",
 		uts.release, x, y, z, LINUX_VERSION(x,y,z));
-    linux_version_code = LINUX_VERSION(x, y, z);
+    version_code = LINUX_VERSION(x, y, z);
+}
+
+int procps_linux_version(void) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    pthread_once(&once, init_Linux_version);
+    return version_code;
 }
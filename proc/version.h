@@ -11,8 +11,10 @@
 extern void display_version(void);	/* display suite version */
 extern const char procps_version[];		/* global buf for suite version */
 
-extern int linux_version_code;		/* runtime version of LINUX_VERSION_CODE
-					   in /usr/include/linux/version.h */
+extern int procps_linux_version(void);	/* runtime version of LINUX_VERSION_CODE
+					   in /usr/include/linux/version.h,
+					   found on first use */
+#define linux_version_code procps_linux_version()
 
 /* Convenience macros for composing/decomposing version codes */
 #define LINUX_VERSION(x,y,z)   (0x10000*(x) + 0x100*(y) + z)
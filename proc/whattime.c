@@ -21,32 +21,60 @@
 #include <time.h>
 #include <utmp.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include "whattime.h"
 #include "sysinfo.h"
 
 static char buf[128];
 static double av[3];
 
-char *sprint_uptime(void) {
+/* Counting the users means reading all of utmp, which top would do every
+ * frame though it seldom changes;  so the count is kept until the file's
+ * identity, size, or modification time says it might be different.
+ */
+static int count_users(void) {
+  static struct stat last;
+  static int numuser, valid;
   struct utmp *utmpstruct;
+  struct stat st;
+
+  if (stat(_PATH_UTMP, &st) == 0) {
+    if (valid && st.st_ino == last.st_ino && st.st_dev == last.st_dev
+     && st.st_size == last.st_size
+     && st.st_mtim.tv_sec == last.st_mtim.tv_sec
+     && st.st_mtim.tv_nsec == last.st_mtim.tv_nsec)
+      return numuser;
+    last = st;
+    valid = 1;
+  } else
+    valid = 0;			/* nothing to go by, so ask every time */
+
+  numuser = 0;
+  setutent();
+  while ((utmpstruct = getutent())) {
+    if ((utmpstruct->ut_type == USER_PROCESS) &&
+       (utmpstruct->ut_name[0] != '\0'))
+      numuser++;
+  }
+  endutent();
+  return numuser;
+}
+
+int uptime_users(void) {
+  return count_users();
+}
+
+/* the line for a moment gone by:  its time, uptime, users and load */
+char *sprint_uptime_at(time_t realseconds, double uptime_secs, int numuser,
+		       const double load[3]) {
   int upminutes, uphours, updays;
   int pos;
   struct tm *realtime;
-  time_t realseconds;
-  int numuser;
-  double uptime_secs, idle_secs;
-
-/* first get the current time */
 
-  time(&realseconds);
   realtime = localtime(&realseconds);
   pos = sprintf(buf, " %02d:%02d:%02d ",
     realtime->tm_hour, realtime->tm_min, realtime->tm_sec);
 
-/* read and calculate the amount of uptime */
-
-  uptime(&uptime_secs, &idle_secs);
-
   updays = (int) uptime_secs / (60*60*24);
   strcat (buf, "up ");
   pos += 3;
@@ -61,27 +89,24 @@ char *sprint_uptime(void) {
   else
     pos += sprintf(buf + pos, "%d min, ", upminutes);
 
-/* count the number of users */
-
-  numuser = 0;
-  setutent();
-  while ((utmpstruct = getutent())) {
-    if ((utmpstruct->ut_type == USER_PROCESS) &&
-       (utmpstruct->ut_name[0] != '\0'))
-      numuser++;
-  }
-  endutent();
-
   pos += sprintf(buf + pos, "%2d user%s, ", numuser, numuser == 1 ? "" : "s");
 
-  loadavg(&av[0], &av[1], &av[2]);
-
   pos += sprintf(buf + pos, " load average: %.2f, %.2f, %.2f",
-		 av[0], av[1], av[2]);
+		 load[0], load[1], load[2]);
 
   return buf;
 }
 
+char *sprint_uptime(void) {
+  time_t realseconds;
+  double uptime_secs, idle_secs;
+
+  time(&realseconds);
+  uptime(&uptime_secs, &idle_secs);
+  loadavg(&av[0], &av[1], &av[2]);
+  return sprint_uptime_at(realseconds, uptime_secs, count_users(), av);
+}
+
 void print_uptime(void)
 {
   printf("%s\n", sprint_uptime());
@@ -3,7 +3,12 @@
 #ifndef __WHATTIME_H
 #define __WHATTIME_H
 
+#include <time.h>
+
 extern void print_uptime(void);
 extern char *sprint_uptime(void);
+extern char *sprint_uptime_at(time_t when, double uptime_secs, int users,
+			      const double load[3]);
+extern int uptime_users(void);
 
 #endif
@@ -0,0 +1,97 @@
+/* procsnapd.c - read /proc once per interval for every ps, top and pgrep */
+
+#include "proc/procps.h"
+#include "proc/readproc.h"
+#include "proc/shmsnap.h"
+#include "proc/version.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+static volatile sig_atomic_t done;
+
+static void stop(int sig) {
+    (void)sig;
+    done = 1;
+}
+
+int main(int argc, char *argv[]){
+    const char *path = SHMSNAP_PATH;
+    double delay = 1.0;
+    long count = -1;
+    shmsnap_writer *w;
+    PROCTAB *PT;
+    proc_t **tab = NULL, *p;
+    struct sigaction sa;
+    struct timespec next;
+    unsigned long long ns;
+    int n, room = 0, i;
+
+    while( (i = getopt(argc, argv, "d:n:V") ) != -1 )
+        switch (i) {
+        case 'd': delay = atof(optarg); break;
+        case 'n': count = atol(optarg); break;
+	case 'V': display_version(); exit(0);
+        default:
+	  fprintf(stderr, "usage: %s [-d delay] [-n count] [-V] [file]\n", argv[0]);
+	  return 1;
+    }
+    if (optind < argc)
+	path = argv[optind];
+    if (delay < 0.01 || delay > 3600) {
+	fprintf(stderr, "%s: delay must be from 0.01 to 3600 seconds\n", argv[0]);
+	return 1;
+    }
+
+    if (!(w = shmsnap_create(path, delay * 1000))) {
+	if (errno == EBUSY)
+	    fprintf(stderr, "%s: %s: another procsnapd has it\n", argv[0], path);
+	else
+	    fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+	return 1;
+    }
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = stop;		/* no SA_RESTART:  the sleep ends too */
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    /* what the readers would do themselves, but just the once */
+    if (!(PT = openproc(SHMSNAP_FLAGS | PROC_PERSIST | PROC_ARENA | PROC_LIVE))) {
+	fprintf(stderr, "%s: can't read %s\n", argv[0], proc_root());
+	shmsnap_close_writer(w);
+	return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!done && count--) {
+	resetproc(PT);
+	for (n = 0; (p = readproc(PT, NULL)); n++) {
+	    if (n >= room) {
+		room = room * 5 / 4 + 1024;
+		tab = xrealloc(tab, room * sizeof *tab);
+	    }
+	    tab[n] = p;
+	}
+	if (shmsnap_publish(w, tab, n, PT->flags) == -1) {
+	    fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+	    break;
+	}
+	if (!count)
+	    break;
+	/* keep to the interval, however long the reading took */
+	ns = next.tv_nsec + (unsigned long long)(delay * 1e9);
+	next.tv_sec += ns / 1000000000;
+	next.tv_nsec = ns % 1000000000;
+	while (!done && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+	    ;
+    }
+    closeproc(PT);
+    free(tab);
+    shmsnap_close_writer(w);
+    return 0;
+}
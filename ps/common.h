@@ -232,6 +232,8 @@ extern int simple_escape_str(char *dst, const char *src, size_t n);
 /********************* UNDECIDED GLOBALS **************/
 
 /* output.c */
+typedef unsigned long long (*sort_key_fn)(const proc_t* P);
+extern sort_key_fn search_sort_key(int (*sr)(const proc_t* P, const proc_t* Q));
 extern void show_one_proc(proc_t* p);
 extern void print_format_specifiers(void);
 extern const aix_struct *search_aix_array(const int findme);
@@ -268,6 +270,7 @@ extern const char     *namelist_file;
 extern int             negate_selection;
 extern unsigned        personality;
 extern int             prefer_bsd_defaults;
+extern int             process_limit;
 extern int             running_only;
 extern int             screen_cols;
 extern int             screen_rows;
@@ -293,6 +296,7 @@ extern void reset_sortformat(void);
 /* select.c */
 extern int want_this_proc(proc_t *buf);
 extern const char *select_bits_setup(void);
+extern int select_pushdown(unsigned needs, pid_t **pids, uid_t **uids, int *nuid);
 
 /* help.c */
 extern const char *help_message;
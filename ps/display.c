@@ -191,7 +191,17 @@ static unsigned needs_for_sort;
 static void check_needs(void){
   format_node *walk_pr = format_list;
   sort_node   *walk_sr = sort_list;
-  /* selection doesn't currently have expensive needs */
+  selection_node *walk_sn = selection_list;
+
+  /* selection only needs the ids that are not in stat */
+  while(walk_sn){
+    switch(walk_sn->typecode){
+    case SEL_RUID: case SEL_SUID: case SEL_FUID:
+    case SEL_RGID: case SEL_EGID: case SEL_SGID: case SEL_FGID:
+      needs_for_sort |= PROC_FILLID;
+    }
+    walk_sn = walk_sn->next;
+  }
 
   while(walk_pr){
     needs_for_format |= walk_pr->need;
@@ -234,22 +244,39 @@ static void compute_needs(void){
   }
 }
 
+/***** open /proc for what the selection lists let it skip */
+static PROCTAB *open_selected(unsigned flags){
+  pid_t *pids;
+  uid_t *uids;
+  int nuid;
+  switch(select_pushdown(flags, &pids, &uids, &nuid)){
+  case PROC_PID: return openproc(flags | PROC_PID, pids);
+  case PROC_UID: return openproc(flags | PROC_UID, uids, nuid);
+  }
+  return openproc(flags);
+}
+
 /***** just display */
 static void simple_spew(void){
   proc_t buf;
   PROCTAB* ptp;
-  ptp = openproc(needs_for_format | needs_for_sort);
+  int left = process_limit;
+  /* the arena lets one process's cmdline & environ recycle the last ones */
+  ptp = open_selected(needs_for_format | needs_for_sort | PROC_ARENA);
   if(!ptp) {
     fprintf(stderr, "Error: can not access /proc.\n");
     exit(1);
   }
+  /* unwanted processes get dropped before their cmdline etc. is read */
+  prochook(ptp, (needs_for_sort & PROC_FILLID) ? PROC_HOOK_STATUS : PROC_HOOK_STAT,
+           want_this_proc);
   memset(&buf, '#', sizeof(proc_t));
   /* use "ps_" prefix to catch library mismatch */
   while(ps_readproc(ptp,&buf)){
-    if(want_this_proc(&buf)) show_one_proc(&buf);
-    if(buf.cmdline) free((void*)*buf.cmdline); // ought to reuse
-    if(buf.environ) free((void*)*buf.environ); // ought to reuse
+    show_one_proc(&buf);
+    resetproc(ptp);
 //    memset(&buf, '#', sizeof(proc_t));
+    if(!--left) break;  /* never, without --limit */
   }
   closeproc(ptp);
 }
@@ -297,9 +324,101 @@ static int compare_two_procs(const void *a, const void *b){
   return 0; /* no conclusion */
 }
 
+/***** sort processes[] by one key, stable, for sort_procs() below */
+typedef struct sort_rec {
+  unsigned long long key;
+  proc_t *p;
+} sort_rec;
+
+static void radix_pass(int n, sort_key_fn ky, int reverse, sort_rec *recs){
+  sort_rec *src = recs;
+  sort_rec *dst = recs + n;
+  unsigned long long flip = reverse ? ~0ULL : 0;
+  int shift;
+  int i;
+  for(i = 0; i < n; i++){
+    recs[i].key = ky(processes[i]) ^ flip;
+    recs[i].p   = processes[i];
+  }
+  for(shift = 0; shift < 64; shift += 8){
+    int count[256];
+    int pos = 0;
+    memset(count, 0, sizeof count);
+    for(i = 0; i < n; i++) count[(src[i].key >> shift) & 0xff]++;
+    if(count[(src[0].key >> shift) & 0xff] == n) continue;  /* all the same */
+    for(i = 0; i < 256; i++){
+      int c = count[i];
+      count[i] = pos;
+      pos += c;
+    }
+    for(i = 0; i < n; i++) dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+    { sort_rec *tmp = src; src = dst; dst = tmp; }
+  }
+  for(i = 0; i < n; i++) processes[i] = src[i].p;
+}
+
+static void merge_pass(int n, const sort_node *node, proc_t **tmp){
+  proc_t **src = processes;
+  proc_t **dst = tmp;
+  int width;
+  for(width = 1; width < n; width *= 2){
+    int lo;
+    for(lo = 0; lo < n; lo += 2*width){
+      int mid = lo + width < n ? lo + width : n;
+      int hi  = lo + 2*width < n ? lo + 2*width : n;
+      int a = lo, b = mid, out = lo;
+      while(a < mid && b < hi){
+        int result = (*node->sr)(src[b], src[a]);
+        if(node->reverse) result = -result;
+        dst[out++] = (result < 0) ? src[b++] : src[a++];  /* ties keep order */
+      }
+      while(a < mid) dst[out++] = src[a++];
+      while(b < hi)  dst[out++] = src[b++];
+    }
+    { proc_t **t = src; src = dst; dst = t; }
+  }
+  if(src != processes) memcpy(processes, src, n * sizeof(proc_t*));
+}
+
+/***** sort processes[] by sort_list
+ * One stable pass per key, last key first, so each earlier key wins.
+ * Integer keys are copied out once into compact records and radix
+ * sorted; only string keys go through their comparator.
+ */
+static void sort_procs(int n){
+  const sort_node *keys[64];
+  const sort_node *walk;
+  sort_rec *recs;
+  proc_t **tmp;
+  int nkeys = 0;
+  for(walk = sort_list; walk; walk = walk->next){
+    if(nkeys == 64) goto plain;
+    keys[nkeys++] = walk;
+  }
+  if(n < 64) goto plain;   /* not worth the trouble */
+  recs = malloc(2 * n * sizeof(sort_rec));
+  tmp  = malloc(n * sizeof(proc_t*));
+  if(!recs || !tmp){
+    free(recs);
+    free(tmp);
+    goto plain;
+  }
+  while(nkeys--){
+    sort_key_fn ky = search_sort_key(keys[nkeys]->sr);
+    if(ky) radix_pass(n, ky, keys[nkeys]->reverse, recs);
+    else   merge_pass(n, keys[nkeys], tmp);
+  }
+  free(recs);
+  free(tmp);
+  return;
+plain:
+  qsort(processes, n, sizeof(proc_t*), compare_two_procs);
+}
+
 /***** show pre-sorted array of process pointers */
 static void show_proc_array(int n){
   proc_t **p = processes;
+  if(process_limit && n > process_limit) n = process_limit;
   while(n--){
     show_one_proc(*p);
     /* no point freeing any of this -- won't need more mem */
@@ -311,11 +430,53 @@ static void show_proc_array(int n){
   }
 }
 
+/***** index the sorted array by pid, for show_tree() and show_forest() */
+/* Sorting by ppid first puts each task's children in one run;  the index
+ * says where that run starts and where the task itself is, so finding
+ * roots and children is a lookup rather than a scan of the whole array. */
+typedef struct tree_slot {
+  int pid;
+  int self;   /* index of the task with this pid, or -1 */
+  int kids;   /* index of the first task with this ppid, or -1 */
+} tree_slot;
+
+static tree_slot *tree_hash;
+static unsigned tree_mask;
+
+static tree_slot *tree_slot_of(int pid){
+  unsigned h = ((unsigned)pid * 2654435761u) & tree_mask;
+  while(tree_hash[h].self != -1 || tree_hash[h].kids != -1){
+    if(tree_hash[h].pid == pid) break;
+    h = (h + 1) & tree_mask;
+  }
+  tree_hash[h].pid = pid;
+  return tree_hash + h;
+}
+
+static void build_tree(const int n){
+  unsigned size = 16;
+  int i;
+  while(size < 4u * n) size <<= 1;  /* up to 2n keys, kept half empty */
+  tree_hash = malloc(size * sizeof *tree_hash);
+  if(!tree_hash){
+    fprintf(stderr, "Error: not enough memory.\n");
+    exit(1);
+  }
+  tree_mask = size - 1;
+  memset(tree_hash, 0xff, size * sizeof *tree_hash);  /* all -1 */
+  for(i = 0; i < n; i++){
+    tree_slot *t = tree_slot_of(processes[i]->ppid);
+    if(t->kids == -1) t->kids = i;
+    tree_slot_of(processes[i]->pid)->self = i;
+  }
+}
+
 /***** show tree */
-/* this needs some optimization work */
 #define ADOPTED(x) 1
 static void show_tree(const int self, const int n, const int level, const int have_sibling){
-  int i = 0;
+  static int shown;
+  int i;
+  if(process_limit && shown++ >= process_limit) return;
   if(level){
     /* add prefix of "+" or "L" */
     if(have_sibling) forest_prefix[level-1] = '+';
@@ -326,11 +487,8 @@ static void show_tree(const int self, const int n, const int level, const int ha
   /* no point freeing any of this -- won't need more mem */
 //  if(processes[self]->cmdline) free((void*)*processes[self]->cmdline);
 //  if(processes[self]->environ) free((void*)*processes[self]->environ);
-  for(;;){  /* look for children */
-    if(i >= n) return; /* no children */
-    if(processes[i]->ppid == processes[self]->pid) break;
-    i++;
-  }
+  i = tree_slot_of(processes[self]->pid)->kids;
+  if(i == -1) return; /* no children */
   if(level){
     /* change our prefix to "|" or " " for the children */
     if(have_sibling) forest_prefix[level-1] = '|';
@@ -360,41 +518,139 @@ static void show_tree(const int self, const int n, const int level, const int ha
 /***** show forest */
 static void show_forest(const int n){
   int i = n;
-  int j;
+  build_tree(n);
   while(i--){   /* cover whole array looking for trees */
-    j = n;
-    while(j--){   /* search for parent: if none, i is a tree! */
-      if(processes[j]->pid == processes[i]->ppid) goto not_root;
-    }
-    show_tree(i,n,0,0);
-not_root:
-    ;
+    /* no parent: i is a tree! */
+    if(tree_slot_of(processes[i]->ppid)->self == -1) show_tree(i,n,0,0);
   }
   /* don't free the array because it takes time and ps will exit anyway */
 }
 
-/***** sorted or forest */
-static void fancy_spew(void){
-  proc_t *retbuf = NULL;
+/***** keep the best process_limit processes in a heap, worst on top */
+static void heap_down(int n, int i){
+  for(;;){
+    proc_t *tmp;
+    int worst = i;
+    int kid = 2*i + 1;
+    if(kid   < n && compare_two_procs(processes+kid,   processes+worst) > 0) worst = kid;
+    if(kid+1 < n && compare_two_procs(processes+kid+1, processes+worst) > 0) worst = kid+1;
+    if(worst == i) return;
+    tmp = processes[i];
+    processes[i] = processes[worst];
+    processes[worst] = tmp;
+    i = worst;
+  }
+}
+
+static void heap_up(int i){
+  while(i){
+    proc_t *tmp;
+    int parent = (i-1)/2;
+    if(compare_two_procs(processes+i, processes+parent) <= 0) return;
+    tmp = processes[i];
+    processes[i] = processes[parent];
+    processes[parent] = tmp;
+    i = parent;
+  }
+}
+
+/* Read cmdline and environ for the survivors only;  nothing sorts on
+ * them, so the losers never needed them.  A task that died or whose pid
+ * got reused since the first pass is left without, and prints [comm]. */
+static void fill_late(int n, int late){
+  static pid_t pids[sizeof processes / sizeof *processes + 1];
   PROCTAB* ptp;
-  int n = 0;  /* number of processes & index into array */
-  ptp = openproc(needs_for_format | needs_for_sort);
+  proc_t *q;
+  int i = 0;
+  while(i < n){
+    pids[i] = processes[i]->pid;
+    i++;
+  }
+  pids[n] = 0;
+  ptp = openproc(late | PROC_PID, pids);
+  if(!ptp) return;
+  i = 0;
+  while((q = readproc(ptp, NULL))){
+    while(i < n && processes[i]->pid != q->pid) i++;  /* same order */
+    if(i < n && processes[i]->start_time == q->start_time){
+      processes[i]->cmdline = q->cmdline;
+      processes[i]->environ = q->environ;
+      q->cmdline = q->environ = NULL;
+    }
+    freeproc(q);
+  }
+  closeproc(ptp);
+}
+
+/***** sorted, with --limit:  read one at a time, hold only what will print */
+static void top_spew(void){
+  proc_t *p;
+  PROCTAB* ptp;
+  int want = process_limit;
+  int n = 0;
+  int late = needs_for_format & ~needs_for_sort
+           & (PROC_FILLCOM|PROC_FILLENV|PROC_FILLARG);
+  if(want > (int)(sizeof processes / sizeof *processes))
+    want = sizeof processes / sizeof *processes;
+  ptp = open_selected((needs_for_format | needs_for_sort) & ~late);
   if(!ptp) {
     fprintf(stderr, "Error: can not access /proc.\n");
     exit(1);
   }
-  while((retbuf = ps_readproc(ptp,retbuf))){
-    if(want_this_proc(retbuf)){
-      fill_pcpu(retbuf); // in case we might sort by %cpu
-      processes[n++] = retbuf;
-      retbuf = NULL;  /* NULL asks ps_readproc to allocate */
+  prochook(ptp, (needs_for_sort & PROC_FILLID) ? PROC_HOOK_STATUS : PROC_HOOK_STAT,
+           want_this_proc);
+  while((p = readproc(ptp, NULL))){
+    fill_pcpu(p); // in case we might sort by %cpu
+    if(n < want){
+      processes[n] = p;
+      heap_up(n++);
+      continue;
+    }
+    if(compare_two_procs(&p, processes) >= 0){  /* no better than the worst */
+      freeproc(p);
+      continue;
     }
+    freeproc(processes[0]);
+    processes[0] = p;
+    heap_down(n, 0);
   }
-  if(retbuf) free(retbuf);
   closeproc(ptp);
   if(!n) return;  /* no processes */
+  if(late) fill_late(n, late);
+  sort_procs(n);
+  show_proc_array(n);
+}
+
+/***** sorted or forest */
+static void fancy_spew(void){
+  proc_t **tab, **walk;
+  unsigned flags = needs_for_format | needs_for_sort;
+  pid_t *pids;
+  uid_t *uids;
+  int nuid;
+  int n = 0;  /* number of processes & index into array */
+  /* everything gets read before any output, so let threads do it */
+  switch(select_pushdown(flags, &pids, &uids, &nuid)){
+  case PROC_PID: tab = readproctab_parallel(flags | PROC_PID, 0, pids); break;
+  case PROC_UID: tab = readproctab_parallel(flags | PROC_UID, 0, uids, nuid); break;
+  default:       tab = readproctab_parallel(flags, 0);
+  }
+  if(!tab) {
+    fprintf(stderr, "Error: can not access /proc.\n");
+    exit(1);
+  }
+  for(walk = tab; *walk; walk++){
+    if(want_this_proc(*walk)){
+      fill_pcpu(*walk); // in case we might sort by %cpu
+      processes[n++] = *walk;
+    }else{
+      freeproc(*walk);
+    }
+  }
+  free(tab);
+  if(!n) return;  /* no processes */
   if(forest_type) prep_forest_sort();
-  qsort(processes, n, sizeof(proc_t*), compare_two_procs);
+  sort_procs(n);
   if(forest_type) show_forest(n);
   else show_proc_array(n);
 }
@@ -426,6 +682,9 @@ int main(int argc, char *argv[]){
   } while (0);
 #endif
 
+  /* a pipe gets only 4 kB per write otherwise */
+  if(!isatty(STDOUT_FILENO)) setvbuf(stdout, NULL, _IOFBF, 64*1024);
+
   reset_global();  /* must be before parser */
   arg_parse(argc,argv);
 
@@ -443,7 +702,8 @@ int main(int argc, char *argv[]){
     if (open_psdb(namelist_file)) wchan_is_number = 1;
   compute_needs();
 
-  if(forest_type || sort_list) fancy_spew(); /* sort or forest */
+  if(process_limit && sort_list && !forest_type) top_spew();
+  else if(forest_type || sort_list) fancy_spew(); /* sort or forest */
   else simple_spew(); /* no sort, no forest */
   show_one_proc((proc_t *)-1); /* no output yet? */
   return 0;
@@ -9,6 +9,40 @@
  * GNU Library General Public License for more details.
  */                                 
 #include <sys/types.h>
+#include <string.h>
+
+/* Word at a time:  long command lines are mostly plain ASCII, so the
+ * byte loops below first skip over (copying) whole words that hold no
+ * byte they would have to look at.  Words are read aligned, and so never
+ * past the page holding the string's NUL. */
+typedef unsigned long word_t;
+#define ONES      (~(word_t)0 / 255)         /* 0x0101... */
+#define HIGHS     (ONES * 0x80)              /* 0x8080... */
+#define ALIGNED(p) (!((unsigned long)(p) & (sizeof(word_t) - 1)))
+/* some byte is below c (for c <= 0x80), or is 0x7f or above */
+#define HAS_LESS(w,c)   (((w) - ONES * (c)) & ~(w) & HIGHS)
+#define HAS_HIGH(w)     (((w) | ((w) + ONES)) & HIGHS)
+/* some byte is c */
+#define HAS_BYTE(w,c)   HAS_LESS((w) ^ (ONES * (c)), 1)
+
+/* copy plain words, " " to "~", while a whole one fits in n-i;  returns i */
+static size_t copy_plain(char **dst, const char **src, size_t i, size_t n, int octal){
+  const char *s = *src;
+  char *d = *dst;
+  word_t w;
+  while(i + sizeof w <= n){
+    memcpy(&w, s, sizeof w);
+    if(HAS_HIGH(w) || HAS_LESS(w, octal ? 0x21 : 0x20)) break;
+    if(octal && HAS_BYTE(w, '\\')) break;
+    memcpy(d, &w, sizeof w);
+    s += sizeof w;
+    d += sizeof w;
+    i += sizeof w;
+  }
+  *src = s;
+  *dst = d;
+  return i;
+}
 
 /* sanitize a string, without the nice BSD library function:     */
 /* strvis(vis_args, k->ki_args, VIS_TAB | VIS_NL | VIS_NOSLASH)  */
@@ -26,6 +60,8 @@ int octal_escape_str(char *dst, const char *src, size_t n){
   "********************************"
   "********************************";
   for(i=0; i<n;){
+    if(ALIGNED(src)) i = copy_plain(&dst, &src, i, n, 1);
+    if(i >= n) break;
     c = (unsigned char) *(src++);
     d = codes[c];
     switch(d){
@@ -70,6 +106,8 @@ int simple_escape_str(char *dst, const char *src, size_t n){
   "********************************"
   "********************************";
   for(i=0; i<n;){
+    if(ALIGNED(src)) i = copy_plain(&dst, &src, i, n, 0);
+    if(i >= n) break;
     c = (unsigned char) *(src++);
     switch(codes[c]){
     case 'Z':
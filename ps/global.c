@@ -61,6 +61,7 @@ int             negate_selection = -1;
 int             running_only = -1;
 unsigned        personality = 0xffffffff;
 int             prefer_bsd_defaults = -1;
+int             process_limit = -1;
 int             screen_cols = -1;
 int             screen_rows = -1;
 unsigned long   seconds_since_boot = -1;
@@ -335,6 +336,7 @@ void reset_global(void){
   lines_to_next_header  = 1;
   namelist_file         = NULL;
   negate_selection      = 0;
+  process_limit         = 0;   /* show them all */
   running_only          = 0;
   seconds_since_boot    = uptime(0,0);
   selection_list        = NULL;
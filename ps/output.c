@@ -120,11 +120,22 @@ static int sr_ ## NAME(const proc_t* P, const proc_t* Q) { \
     return strcmp(P->NAME, Q->NAME); \
 }
 
+/* Integer sorts also get a key function, for a radix sort:  the value
+ * as an unsigned 64-bit number in the same order, so signed ones have
+ * the sign bit flipped after sign extension.
+ */
+#define IS_UNSIGNED(x) ((__typeof__(x))-1 > 0)
+#define KEY_OF(x) (IS_UNSIGNED(x) ? (unsigned long long)(x) \
+                                  : (unsigned long long)(long long)(x) ^ (1ULL<<63))
+
 #define CMP_INT(NAME) \
 static int sr_ ## NAME (const proc_t* P, const proc_t* Q) { \
     if (P->NAME < Q->NAME) return -1; \
     if (P->NAME > Q->NAME) return  1; \
     return 0; \
+} \
+static unsigned long long ky_ ## NAME (const proc_t* P) { \
+    return KEY_OF(P->NAME); \
 }
 
 /* fast version, for values which either:
@@ -134,6 +145,9 @@ static int sr_ ## NAME (const proc_t* P, const proc_t* Q) { \
 #define CMP_SMALL(NAME) \
 static int sr_ ## NAME (const proc_t* P, const proc_t* Q) { \
     return (int)(P->NAME) - (int)(Q->NAME); \
+} \
+static unsigned long long ky_ ## NAME (const proc_t* P) { \
+    return (unsigned)(int)(P->NAME) ^ 0x80000000u; \
 }
 
 CMP_INT(rtprio)
@@ -220,11 +234,85 @@ static int sr_swapable(const proc_t* P, const proc_t* Q) {
   if (p_swapable > q_swapable) return  1;
   return 0;
 }
+static unsigned long long ky_swapable(const proc_t* P) {
+  return P->vm_data + P->vm_stack;
+}
+
+/* which sorts have a key function; the rest (strings) don't */
+typedef struct sort_key_struct {
+  int (*sr)(const proc_t* P, const proc_t* Q);
+  sort_key_fn ky;
+} sort_key_struct;
+
+#define KEY(NAME) { sr_ ## NAME, ky_ ## NAME }
+static const sort_key_struct sort_key_array[] = {
+  KEY(rtprio), KEY(sched), KEY(cutime), KEY(cstime), KEY(priority),
+  KEY(timeout), KEY(nice), KEY(rss), KEY(it_real_value), KEY(size),
+  KEY(resident), KEY(share), KEY(trs), KEY(lrs), KEY(drs), KEY(dt),
+  KEY(vm_size), KEY(vm_lock), KEY(vm_rss), KEY(vm_data), KEY(vm_stack),
+  KEY(vm_exe), KEY(vm_lib), KEY(vsize), KEY(rss_rlim), KEY(flags),
+  KEY(min_flt), KEY(maj_flt), KEY(cmin_flt), KEY(cmaj_flt), KEY(nswap),
+  KEY(cnswap), KEY(utime), KEY(stime), KEY(start_code), KEY(end_code),
+  KEY(start_stack), KEY(kstk_esp), KEY(kstk_eip), KEY(start_time),
+  KEY(wchan), KEY(ruid), KEY(rgid), KEY(euid), KEY(egid), KEY(suid),
+  KEY(sgid), KEY(fuid), KEY(fgid), KEY(pid), KEY(ppid), KEY(pgrp),
+  KEY(session), KEY(tty), KEY(tpgid), KEY(pcpu), KEY(state),
+  KEY(swapable)
+};
+#undef KEY
+
+sort_key_fn search_sort_key(int (*sr)(const proc_t* P, const proc_t* Q)){
+  int i = sizeof(sort_key_array) / sizeof(sort_key_struct);
+  while(i--) if(sort_key_array[i].sr == sr) return sort_key_array[i].ky;
+  return NULL;
+}
 
 
 /***************************************************************************/
 /************ Lots of format functions, starting with the NOP **************/
 
+/* Numbers by hand:  snprintf() parsing a format for each column of each
+ * process was most of what "ps -e" cost.  Each writes a NUL after. */
+static int put_u(char *dst, unsigned long long v){
+  char tmp[24];
+  char *t = tmp + sizeof tmp;
+  int n;
+  do *--t = '0' + v % 10; while(v /= 10);
+  n = tmp + sizeof tmp - t;
+  memcpy(dst, t, n);
+  dst[n] = '\0';
+  return n;
+}
+static int put_d(char *dst, long long v){
+  if(v >= 0) return put_u(dst, v);
+  *dst = '-';
+  return 1 + put_u(dst+1, -(unsigned long long)v);
+}
+/* like "%*llu" */
+static int put_w(char *dst, unsigned long long v, int width){
+  char tmp[24];
+  int n = put_u(tmp, v);
+  int pad = width > n ? width - n : 0;
+  memset(dst, ' ', pad);
+  memcpy(dst+pad, tmp, n+1);
+  return pad + n;
+}
+/* like "%02u", for 0..99 */
+static char *put_02(char *dst, unsigned v){
+  dst[0] = '0' + v / 10;
+  dst[1] = '0' + v % 10;
+  dst[2] = '\0';
+  return dst + 2;
+}
+/* like "%2u.%u" of v/10 and v%10, for 0..999 */
+static int put_tenths(char *dst, unsigned v){
+  int n = put_w(dst, v/10U, 2);
+  dst[n++] = '.';
+  dst[n++] = '0' + v%10U;
+  dst[n] = '\0';
+  return n;
+}
+
 static int pr_nop(void){
   return snprintf(outbuf, COLWID, "%c", '-');
 }
@@ -345,6 +433,16 @@ Modifications to the arguments are not shown.
  */
 
 /* "command" is the same thing: long unless c */
+/* How much of a command line is worth escaping:  show_one_proc() cuts
+ * the column at max_rightward anyway.  Two more, as escape_strlist()
+ * can leave out the space before an argument that only just fits. */
+static size_t room(const char *endp){
+  long n = (long)max_rightward - (endp - outbuf) + 2;
+  if(n < 0) return 0;
+  if(n > (long)OUTBUF_SIZE) return OUTBUF_SIZE;
+  return n;
+}
+
 static int pr_args(void){
   char *endp;
   endp = outbuf + forest_helper();
@@ -353,7 +451,7 @@ static int pr_args(void){
   }else{
     const char **lc = (const char**)pp->cmdline; /* long version */
     if(lc && *lc) {
-      endp += escape_strlist(endp, lc, OUTBUF_SIZE);
+      endp += escape_strlist(endp, lc, room(endp));
     } else {
       char buf[ESC_STRETCH*PAGE_SIZE]; /* TODO: avoid copy */
       escape_str(buf, pp->cmd, ESC_STRETCH*PAGE_SIZE);
@@ -364,7 +462,7 @@ static int pr_args(void){
     const char **env = (const char**)pp->environ;
     if(env && *env){
       *endp++ = ' ';
-      endp += escape_strlist(endp, env, OUTBUF_SIZE);
+      endp += escape_strlist(endp, env, room(endp));
     }
   }
   return endp - outbuf;
@@ -379,7 +477,7 @@ static int pr_comm(void){
   }else{
     const char **lc = (const char**)pp->cmdline; /* long version */
     if(lc && *lc) {
-      endp += escape_strlist(endp, lc, OUTBUF_SIZE);
+      endp += escape_strlist(endp, lc, room(endp));
     } else {
       char buf[ESC_STRETCH*PAGE_SIZE]; /* TODO: avoid copy */
       escape_str(buf, pp->cmd, ESC_STRETCH*PAGE_SIZE);
@@ -390,7 +488,7 @@ static int pr_comm(void){
     const char **env = (const char**)pp->environ;
     if(env && *env){
       *endp++ = ' ';
-      endp += escape_strlist(endp, env, OUTBUF_SIZE);
+      endp += escape_strlist(endp, env, room(endp));
     }
   }
   return endp - outbuf;
@@ -416,13 +514,14 @@ static int pr_etime(void){
   hh = t%24;
   t /= 24;
   dd = t;
-  cp +=(     dd      ?  snprintf(cp, COLWID, "%u-", dd)           :  0 );
-  cp +=( (dd || hh)  ?  snprintf(cp, COLWID, "%02u:", hh)         :  0 );
-  cp +=                 snprintf(cp, COLWID, "%02u:%02u", mm, ss)       ;
+  if(dd){ cp += put_u(cp, dd); *cp++ = '-'; }
+  if(dd || hh){ cp = put_02(cp, hh); *cp++ = ':'; }
+  cp = put_02(cp, mm); *cp++ = ':';
+  cp = put_02(cp, ss);
   return (int)(cp-outbuf);
 }
 static int pr_nice(void){
-  return snprintf(outbuf, COLWID, "%ld", pp->nice);
+  return put_d(outbuf, pp->nice);
 }
 
 /* "Processor utilisation for scheduling."  --- we use %cpu w/o fraction */
@@ -435,7 +534,7 @@ static int pr_c(void){
   seconds = seconds_since_boot - pp->start_time / Hertz;
   if(seconds) pcpu = (total_time * 100ULL / Hertz) / seconds;
   if (pcpu > 99U) pcpu = 99U;
-  return snprintf(outbuf, COLWID, "%2u", pcpu);
+  return put_w(outbuf, pcpu, 2);
 }
 /* normal %CPU in ##.# format. */
 static int pr_pcpu(void){
@@ -447,7 +546,7 @@ static int pr_pcpu(void){
   seconds = seconds_since_boot - pp->start_time / Hertz;
   if(seconds) pcpu = (total_time * 1000ULL / Hertz) / seconds;
   if (pcpu > 999U) pcpu = 999U;
-  return snprintf(outbuf, COLWID, "%2u.%u", pcpu/10U, pcpu%10U);
+  return put_tenths(outbuf, pcpu);
 }
 /* this is a "per-mill" format, like %cpu with no decimal point */
 static int pr_cp(void){
@@ -459,17 +558,17 @@ static int pr_cp(void){
   seconds = seconds_since_boot - pp->start_time / Hertz ;
   if(seconds) pcpu = (total_time * 1000ULL / Hertz) / seconds;
   if (pcpu > 999U) pcpu = 999U;
-  return snprintf(outbuf, COLWID, "%3u", pcpu);
+  return put_w(outbuf, pcpu, 3);
 }
 
 static int pr_pgid(void){
-  return snprintf(outbuf, COLWID, "%u", pp->pgrp);
+  return put_u(outbuf, (unsigned)pp->pgrp);
 }
 static int pr_pid(void){
-  return snprintf(outbuf, COLWID, "%u", pp->pid);
+  return put_u(outbuf, (unsigned)pp->pid);
 }
 static int pr_ppid(void){
-  return snprintf(outbuf, COLWID, "%u", pp->ppid);
+  return put_u(outbuf, (unsigned)pp->ppid);
 }
 
 
@@ -477,7 +576,7 @@ static int pr_ppid(void){
 static int pr_time(void){
   unsigned long t;
   unsigned dd,hh,mm,ss;
-  int c;
+  char *cp = outbuf;
   t = (pp->utime + pp->stime) / Hertz;
   ss = t%60;
   t /= 60;
@@ -486,9 +585,11 @@ static int pr_time(void){
   hh = t%24;
   t /= 24;
   dd = t;
-  c  =( dd ? snprintf(outbuf, COLWID, "%u-", dd) : 0              );
-  c +=( snprintf(outbuf+c, COLWID, "%02u:%02u:%02u", hh, mm, ss)    );
-  return c;
+  if(dd){ cp += put_u(cp, dd); *cp++ = '-'; }
+  cp = put_02(cp, hh); *cp++ = ':';
+  cp = put_02(cp, mm); *cp++ = ':';
+  cp = put_02(cp, ss);
+  return (int)(cp-outbuf);
 }
 
 /* HP-UX puts this (I forget, vsz or vsize?) in kB and uses "sz" for pages.
@@ -500,7 +601,7 @@ static int pr_time(void){
  * TODO: add flag for "1.23M" behavior, on this and other columns.
  */
 static int pr_vsz(void){
-  return snprintf(outbuf, COLWID, "%lu", pp->vm_size);
+  return put_u(outbuf, pp->vm_size);
 }
 
 /*
@@ -513,23 +614,23 @@ static int pr_ruser(void){
     int width = COLWID;
 
     if(user_is_number)
-        return snprintf(outbuf, COLWID, "%d", pp->ruid);
+        return put_d(outbuf, (int)pp->ruid);
     if (strlen(pp->ruser)>max_rightward)
         width = max_rightward;
     return snprintf(outbuf, width, "%s", pp->ruser);
 }
 static int pr_egroup(void){
-  if(strlen(pp->egroup)>max_rightward) return snprintf(outbuf, COLWID, "%d", pp->egid);
+  if(strlen(pp->egroup)>max_rightward) return put_d(outbuf, (int)pp->egid);
   return snprintf(outbuf, COLWID, "%s", pp->egroup);
 }
 static int pr_rgroup(void){
-  if(strlen(pp->rgroup)>max_rightward) return snprintf(outbuf, COLWID, "%d", pp->rgid);
+  if(strlen(pp->rgroup)>max_rightward) return put_d(outbuf, (int)pp->rgid);
   return snprintf(outbuf, COLWID, "%s", pp->rgroup);
 }
 static int pr_euser(void){
     int width = COLWID;
     if(user_is_number)
-        return snprintf(outbuf, COLWID, "%d", pp->euid);
+        return put_d(outbuf, (int)pp->euid);
     if (strlen(pp->euser)>max_rightward)
         width = max_rightward;
     return snprintf(outbuf, width, "%s", pp->euser);
@@ -546,13 +647,13 @@ static int pr_euser(void){
  * Linux may use "priority" for historical purposes.
  */
 static int pr_priority(void){    /* -20..20 */
-    return snprintf(outbuf, COLWID, "%ld", pp->priority);
+    return put_d(outbuf, pp->priority);
 }
 static int pr_pri(void){         /* 20..60 */
-    return snprintf(outbuf, COLWID, "%ld", 39 - pp->priority);
+    return put_d(outbuf, 39 - pp->priority);
 }
 static int pr_opri(void){        /* 39..79 */
-    return snprintf(outbuf, COLWID, "%ld", 60 + pp->priority);
+    return put_d(outbuf, 60 + pp->priority);
 }
 
 static int pr_wchan(void){
@@ -619,7 +720,7 @@ static int pr_flag(void){
 }
 
 static int pr_euid(void){
-  return snprintf(outbuf, COLWID, "%d", pp->euid);
+  return put_d(outbuf, (int)pp->euid);
 }
 
 /*********** non-standard ***********/
@@ -660,10 +761,13 @@ static int old_time_helper(char *dst, unsigned long long t, unsigned long long r
 static int pr_bsdtime(void){
     unsigned long long t;
     unsigned u;
+    int n;
     t = pp->utime + pp->stime;
     if(include_dead_children) t += (pp->cutime + pp->cstime);
     u = t / Hertz;
-    return snprintf(outbuf, COLWID, "%3u:%02u", u/60U, u%60U);
+    n = put_w(outbuf, u/60U, 3);
+    outbuf[n++] = ':';
+    return (int)(put_02(outbuf+n, u%60U) - outbuf);
 }
 
 static int pr_bsdstart(void){
@@ -688,7 +792,7 @@ static int pr_alarm(void){
 
 /* HP-UX puts this in pages and uses "vsz" for kB */
 static int pr_sz(void){
-  return snprintf(outbuf, COLWID, "%lu", (pp->vm_size)/(PAGE_SIZE/1024));
+  return put_u(outbuf, (pp->vm_size)/(PAGE_SIZE/1024));
 }
 
 
@@ -711,51 +815,51 @@ static int pr_sz(void){
 static int pr_dsiz(void){
     long dsiz = 0;
     if(pp->vsize) dsiz += (pp->vsize - pp->end_code + pp->start_code) >> 10;
-    return snprintf(outbuf, COLWID, "%ld", dsiz);
+    return put_d(outbuf, dsiz);
 }
 
 /* kB text (code) size. See trs, dsiz & drs. */
 static int pr_tsiz(void){
     long tsiz = 0;
     if(pp->vsize) tsiz += (pp->end_code - pp->start_code) >> 10;
-    return snprintf(outbuf, COLWID, "%ld", tsiz);
+    return put_d(outbuf, tsiz);
 }
 
 /* kB _resident_ data size. See dsiz, tsiz & trs. */
 static int pr_drs(void){
     long drs = 0;
     if(pp->vsize) drs += (pp->vsize - pp->end_code + pp->start_code) >> 10;
-    return snprintf(outbuf, COLWID, "%ld", drs);
+    return put_d(outbuf, drs);
 }
 
 /* kB text _resident_ (code) size. See tsiz, dsiz & drs. */
 static int pr_trs(void){
     long trs = 0;
     if(pp->vsize) trs += (pp->end_code - pp->start_code) >> 10;
-    return snprintf(outbuf, COLWID, "%ld", trs);
+    return put_d(outbuf, trs);
 }
 
 /* approximation to: kB of address space that could end up in swap */
 static int pr_swapable(void) {
-  return snprintf(outbuf, COLWID, "%ld", pp->vm_data + pp->vm_stack);
+  return put_d(outbuf, pp->vm_data + pp->vm_stack);
 }
 
 /* nasty old Debian thing */
 static int pr_size(void) {
-  return snprintf(outbuf, COLWID, "%ld", pp->size);
+  return put_d(outbuf, pp->size);
 }
 
 
 static int pr_minflt(void){
     long flt = pp->min_flt;
     if(include_dead_children) flt += pp->cmin_flt;
-    return snprintf(outbuf, COLWID, "%ld", flt);
+    return put_d(outbuf, flt);
 }
 
 static int pr_majflt(void){
     long flt = pp->maj_flt;
     if(include_dead_children) flt += pp->cmaj_flt;
-    return snprintf(outbuf, COLWID, "%ld", flt);
+    return put_d(outbuf, flt);
 }
 
 static int pr_lim(void){
@@ -765,7 +869,7 @@ static int pr_lim(void){
 
 /* should print leading tilde ('~') if process is bound to the CPU */
 static int pr_psr(void){
-  return snprintf(outbuf, COLWID, "%d", pp->processor);
+  return put_d(outbuf, (int)pp->processor);
 }
 
 static int pr_wname(void){
@@ -785,7 +889,7 @@ static int pr_nwchan(void){
 }
 
 static int pr_rss(void){
-  return snprintf(outbuf, COLWID, "%lu", pp->vm_rss);
+  return put_u(outbuf, pp->vm_rss);
 }
 
 /* pp->vm_rss * 1000 would overflow on 32-bit systems with 64 GB memory */
@@ -793,7 +897,7 @@ static int pr_pmem(void){
   unsigned long pmem = 0;
   pmem = pp->vm_rss * 1000ULL / kb_main_total;
   if (pmem > 999) pmem = 999;
-  return snprintf(outbuf, COLWID, "%2u.%u", (unsigned)(pmem/10), (unsigned)(pmem%10));
+  return put_tenths(outbuf, pmem);
 }
 
 static int pr_class(void){
@@ -807,11 +911,11 @@ static int pr_class(void){
 }
 static int pr_rtprio(void){
   if(pp->sched==0 || pp->sched==-1) return snprintf(outbuf, COLWID, "-");
-  return snprintf(outbuf, COLWID, "%ld", pp->rtprio);
+  return put_d(outbuf, (long)pp->rtprio);
 }
 static int pr_sched(void){
   if(pp->sched==-1) return snprintf(outbuf, COLWID, "-");
-  return snprintf(outbuf, COLWID, "%ld", pp->sched);
+  return put_d(outbuf, (long)pp->sched);
 }
 
 static int pr_lstart(void){
@@ -895,41 +999,41 @@ static int pr_sigcatch(void){
 
 
 static int pr_egid(void){
-  return snprintf(outbuf, COLWID, "%d", pp->egid);
+  return put_d(outbuf, (int)pp->egid);
 }
 static int pr_rgid(void){
-  return snprintf(outbuf, COLWID, "%d", pp->rgid);
+  return put_d(outbuf, (int)pp->rgid);
 }
 static int pr_sgid(void){
-  return snprintf(outbuf, COLWID, "%d", pp->sgid);
+  return put_d(outbuf, (int)pp->sgid);
 }
 static int pr_fgid(void){
-  return snprintf(outbuf, COLWID, "%d", pp->fgid);
+  return put_d(outbuf, (int)pp->fgid);
 }
 static int pr_ruid(void){
-  return snprintf(outbuf, COLWID, "%d", pp->ruid);
+  return put_d(outbuf, (int)pp->ruid);
 }
 static int pr_suid(void){
-  return snprintf(outbuf, COLWID, "%d", pp->suid);
+  return put_d(outbuf, (int)pp->suid);
 }
 static int pr_fuid(void){
-  return snprintf(outbuf, COLWID, "%d", pp->fuid);
+  return put_d(outbuf, (int)pp->fuid);
 }
 
 
 static int pr_fgroup(void){
-  if(strlen(pp->fgroup)>max_rightward) return snprintf(outbuf, COLWID, "%d", pp->fgid);
+  if(strlen(pp->fgroup)>max_rightward) return put_d(outbuf, (int)pp->fgid);
   return snprintf(outbuf, COLWID, "%s", pp->fgroup);
 }
 static int pr_sgroup(void){
-  if(strlen(pp->sgroup)>max_rightward) return snprintf(outbuf, COLWID, "%d", pp->sgid);
+  if(strlen(pp->sgroup)>max_rightward) return put_d(outbuf, (int)pp->sgid);
   return snprintf(outbuf, COLWID, "%s", pp->sgroup);
 }
 static int pr_fuser(void){
     int width = COLWID;
 
     if(user_is_number)
-        return snprintf(outbuf, COLWID, "%d", pp->fuid);
+        return put_d(outbuf, (int)pp->fuid);
     if (strlen(pp->fuser)>max_rightward)
         width = max_rightward;
     return snprintf(outbuf, width, "%s", pp->fuser);
@@ -938,7 +1042,7 @@ static int pr_suser(void){
     int width = COLWID;
 
     if(user_is_number)
-        return snprintf(outbuf, COLWID, "%d", pp->suid);
+        return put_d(outbuf, (int)pp->suid);
     if (strlen(pp->suser)>max_rightward)
         width = max_rightward;
     return snprintf(outbuf, width, "%s", pp->suser);
@@ -953,16 +1057,16 @@ static int pr_nlwp(void){  /* THCNT thcount NLWP nlwp */
 }
 
 static int pr_sess(void){
-  return snprintf(outbuf, COLWID, "%u", pp->session);
+  return put_u(outbuf, (unsigned)pp->session);
 }
 static int pr_tpgid(void){
-  return snprintf(outbuf, COLWID, "%d", pp->tpgid);
+  return put_d(outbuf, (int)pp->tpgid);
 }
 
 
 /* SGI uses "cpu" to print the processor ID with header "P" */
 static int pr_sgi_p(void){          /* FIXME */
-  if(pp->state == 'R') return snprintf(outbuf, COLWID, "%d", pp->processor);
+  if(pp->state == 'R') return put_d(outbuf, (int)pp->processor);
   return snprintf(outbuf, COLWID, "*");
 }
 
@@ -1137,6 +1241,9 @@ static int sr_context ( const proc_t* P, const proc_t* Q ) {
 #define USR PROC_FILLUSR     /* uid_t -> user names */
 #define GRP PROC_FILLGRP     /* gid_t -> group names */
 #define WCH PROC_FILLWCHAN   /* do WCHAN lookup */
+#define ID  PROC_FILLID      /* read status, up to the uid/gid lines */
+#define SIG PROC_FILLSIG     /* read status, up to the signal masks */
+#define VM  PROC_FILLVM      /* read status, up to the vm_* sizes */
 
 /* TODO
  *      pull out annoying BSD aliases into another table (to macro table?)
@@ -1152,7 +1259,7 @@ static int sr_context ( const proc_t* P, const proc_t* Q ) {
 static const format_struct format_array[] = {
 /* code       header     print()      sort()    width need vendor flags  */
 {"%cpu",      "%CPU",    pr_pcpu,     sr_pcpu,    4,   0,    BSD, RIGHT}, /*pcpu*/
-{"%mem",      "%MEM",    pr_pmem,     sr_nop,     4,   0,    BSD, RIGHT}, /*pmem*/
+{"%mem",      "%MEM",    pr_pmem,     sr_nop,     4,  VM,    BSD, RIGHT}, /*pmem*/
 {"acflag",    "ACFLG",   pr_nop,      sr_nop,     5,   0,    XXX, RIGHT}, /*acflg*/
 {"acflg",     "ACFLG",   pr_nop,      sr_nop,     5,   0,    BSD, RIGHT}, /*acflag*/
 {"addr",      "ADDR",    pr_nop,      sr_nop,     4,   0,    XXX, RIGHT},
@@ -1161,12 +1268,12 @@ static const format_struct format_array[] = {
 {"argc",      "ARGC",    pr_nop,      sr_nop,     4,   0,    LNX, RIGHT},
 {"args",      "COMMAND", pr_args,     sr_nop,    16, ARG,    U98, UNLIMITED}, /*command*/
 {"atime",     "TIME",    pr_time,     sr_nop,     8,   0,    SOE, CUMUL|RIGHT}, /*cputime*/ /* was 6 wide */
-{"blocked",   "BLOCKED", pr_sigmask,  sr_nop,     9,   0,    BSD, SIGNAL}, /*sigmask*/
+{"blocked",   "BLOCKED", pr_sigmask,  sr_nop,     9, SIG,    BSD, SIGNAL}, /*sigmask*/
 {"bnd",       "BND",     pr_nop,      sr_nop,     1,   0,    AIX, RIGHT},
 {"bsdstart",  "START",   pr_bsdstart, sr_nop,     6,   0,    LNX, RIGHT},
 {"bsdtime",   "TIME",    pr_bsdtime,  sr_nop,     6,   0,    LNX, RIGHT},
 {"c",         "C",       pr_c,        sr_pcpu,    2,   0,    SUN, RIGHT},
-{"caught",    "CAUGHT",  pr_sigcatch, sr_nop,     9,   0,    BSD, SIGNAL}, /*sigcatch*/
+{"caught",    "CAUGHT",  pr_sigcatch, sr_nop,     9, SIG,    BSD, SIGNAL}, /*sigcatch*/
 {"class",     "CLS",     pr_class,    sr_sched,   3,   0,    XXX, LEFT},
 {"cls",       "-",       pr_nop,      sr_nop,     1,   0,    HPU, RIGHT},
 {"cmaj_flt",  "-",       pr_nop,      sr_cmaj_flt, 1,  0,    LNX, RIGHT},
@@ -1185,7 +1292,7 @@ static const format_struct format_array[] = {
 {"cwd",       "CWD",     pr_nop,      sr_nop,     3,   0,    LNX, LEFT},
 {"drs",       "DRS",     pr_drs,      sr_drs,     4, MEM,    LNX, RIGHT},
 {"dsiz",      "DSIZ",    pr_dsiz,     sr_nop,     4,   0,    LNX, RIGHT},
-{"egid",      "EGID",    pr_egid,     sr_egid,    5,   0,    LNX, RIGHT},
+{"egid",      "EGID",    pr_egid,     sr_egid,    5,  ID,    LNX, RIGHT},
 {"egroup",    "EGROUP",  pr_egroup,   sr_egroup,  8, GRP,    LNX, USER},
 {"eip",       "EIP",     pr_eip,      sr_kstk_eip, 8,  0,    LNX, RIGHT},
 {"end_code",  "E_CODE",  pr_nop,      sr_end_code, 8,  0,    LNx, RIGHT},
@@ -1195,20 +1302,20 @@ static const format_struct format_array[] = {
 {"euid",      "EUID",    pr_euid,     sr_euid,    5,   0,    LNX, RIGHT},
 {"euser",     "EUSER",   pr_euser,    sr_euser,   8, USR,    LNX, USER},
 {"f",         "F",       pr_flag,     sr_nop,     1,   0,    XXX, RIGHT}, /*flags*/
-{"fgid",      "FGID",    pr_fgid,     sr_fgid,    5,   0,    LNX, RIGHT},
+{"fgid",      "FGID",    pr_fgid,     sr_fgid,    5,  ID,    LNX, RIGHT},
 {"fgroup",    "FGROUP",  pr_fgroup,   sr_fgroup,  8, GRP,    LNX, USER},
 {"flag",      "F",       pr_flag,     sr_flags,   1,   0,    DEC, RIGHT},
 {"flags",     "F",       pr_flag,     sr_flags,   1,   0,    BSD, RIGHT}, /*f*/ /* was FLAGS, 8 wide */
 {"fname",     "COMMAND", pr_fname,    sr_nop,     8,   0,    SUN, LEFT},
-{"fsgid",     "FSGID",   pr_fgid,     sr_fgid,    5,   0,    LNX, RIGHT},
+{"fsgid",     "FSGID",   pr_fgid,     sr_fgid,    5,  ID,    LNX, RIGHT},
 {"fsgroup",   "FSGROUP", pr_fgroup,   sr_fgroup,  8, GRP,    LNX, USER},
-{"fsuid",     "FSUID",   pr_fuid,     sr_fuid,    5,   0,    LNX, RIGHT},
-{"fsuser",    "FSUSER",  pr_fuser,    sr_fuser,   8, USR,    LNX, USER},
-{"fuid",      "FUID",    pr_fuid,     sr_fuid,    5,   0,    LNX, RIGHT},
-{"fuser",     "FUSER",   pr_fuser,    sr_fuser,   8, USR,    LNX, USER},
-{"gid",       "GID",     pr_egid,     sr_egid,    5,   0,    SUN, RIGHT},
+{"fsuid",     "FSUID",   pr_fuid,     sr_fuid,    5,  ID,    LNX, RIGHT},
+{"fsuser",    "FSUSER",  pr_fuser,    sr_fuser,   8, USR|ID, LNX, USER},
+{"fuid",      "FUID",    pr_fuid,     sr_fuid,    5,  ID,    LNX, RIGHT},
+{"fuser",     "FUSER",   pr_fuser,    sr_fuser,   8, USR|ID, LNX, USER},
+{"gid",       "GID",     pr_egid,     sr_egid,    5,  ID,    SUN, RIGHT},
 {"group",     "GROUP",   pr_egroup,   sr_egroup,  5, GRP,    U98, USER}, /* was 8 wide */
-{"ignored",   "IGNORED", pr_sigignore,sr_nop,     9,   0,    BSD, SIGNAL}, /*sigignore*/
+{"ignored",   "IGNORED", pr_sigignore,sr_nop,     9, SIG,    BSD, SIGNAL}, /*sigignore*/
 {"inblk",     "INBLK",   pr_nop,      sr_nop,     5,   0,    BSD, RIGHT}, /*inblock*/
 {"inblock",   "INBLK",   pr_nop,      sr_nop,     5,   0,    DEC, RIGHT}, /*inblk*/
 {"intpri",    "PRI",     pr_opri,     sr_priority, 3,  0,    HPU, RIGHT},
@@ -1255,11 +1362,11 @@ static const format_struct format_array[] = {
 {"paddr",     "PADDR",   pr_nop,      sr_nop,     6,   0,    BSD, RIGHT},
 {"pagein",    "PAGEIN",  pr_majflt,   sr_nop,     6,   0,    XXX, RIGHT},
 {"pcpu",      "%CPU",    pr_pcpu,     sr_pcpu,    4,   0,    U98, RIGHT}, /*%cpu*/
-{"pending",   "PENDING", pr_sig,      sr_nop,     9,   0,    BSD, SIGNAL}, /*sig*/
+{"pending",   "PENDING", pr_sig,      sr_nop,     9, SIG,    BSD, SIGNAL}, /*sig*/
 {"pgid",      "PGID",    pr_pgid,     sr_pgrp,    5,   0,    U98, RIGHT},
 {"pgrp",      "PGRP",    pr_pgid,     sr_pgrp,    5,   0,    LNX, RIGHT},
 {"pid",       "PID",     pr_pid,      sr_pid,     5,   0,    U98, RIGHT},
-{"pmem",      "%MEM",    pr_pmem,     sr_nop,     4,   0,    XXX, RIGHT}, /*%mem*/
+{"pmem",      "%MEM",    pr_pmem,     sr_nop,     4,  VM,    XXX, RIGHT}, /*%mem*/
 {"poip",      "-",       pr_nop,      sr_nop,     1,   0,    BSD, RIGHT},
 {"policy",    "POL",     pr_class,    sr_sched,   3,   0,    DEC, LEFT},
 {"ppid",      "PPID",    pr_ppid,     sr_ppid,    5,   0,    U98, RIGHT},
@@ -1272,15 +1379,15 @@ static const format_struct format_array[] = {
 {"psxpri",    "PPR",     pr_nop,      sr_nop,     3,   0,    DEC, RIGHT},
 {"re",        "RE",      pr_nop,      sr_nop,     3,   0,    BSD, RIGHT},
 {"resident",  "RES",     pr_nop,      sr_resident, 5,MEM,    LNX, RIGHT},
-{"rgid",      "RGID",    pr_rgid,     sr_rgid,    5,   0,    XXX, RIGHT},
+{"rgid",      "RGID",    pr_rgid,     sr_rgid,    5,  ID,    XXX, RIGHT},
 {"rgroup",    "RGROUP",  pr_rgroup,   sr_rgroup,  8, GRP,    U98, USER}, /* was 8 wide */
 {"rlink",     "RLINK",   pr_nop,      sr_nop,     8,   0,    BSD, RIGHT},
-{"rss",       "RSS",     pr_rss,      sr_rss,     4,   0,    XXX, RIGHT}, /* was 5 wide */
-{"rssize",    "RSS",     pr_rss,      sr_vm_rss,  4,   0,    DEC, RIGHT}, /*rsz*/
-{"rsz",       "RSZ",     pr_rss,      sr_vm_rss,  4,   0,    BSD, RIGHT}, /*rssize*/
+{"rss",       "RSS",     pr_rss,      sr_rss,     4,  VM,    XXX, RIGHT}, /* was 5 wide */
+{"rssize",    "RSS",     pr_rss,      sr_vm_rss,  4,  VM,    DEC, RIGHT}, /*rsz*/
+{"rsz",       "RSZ",     pr_rss,      sr_vm_rss,  4,  VM,    BSD, RIGHT}, /*rssize*/
 {"rtprio",    "RTPRIO",  pr_rtprio,   sr_rtprio,  6,   0,    BSD, RIGHT},
-{"ruid",      "RUID",    pr_ruid,     sr_ruid,    5,   0,    XXX, RIGHT},
-{"ruser",     "RUSER",   pr_ruser,    sr_ruser,   8, USR,    U98, USER},
+{"ruid",      "RUID",    pr_ruid,     sr_ruid,    5,  ID,    XXX, RIGHT},
+{"ruser",     "RUSER",   pr_ruser,    sr_ruser,   8, USR|ID, U98, USER},
 {"s",         "S",       pr_s,        sr_state,   1,   0,    SUN, LEFT}, /*stat,state*/
 {"sched",     "SCH",     pr_sched,    sr_sched,   3,   0,    AIX, RIGHT},
 {"scnt",      "SCNT",    pr_nop,      sr_nop,     4,   0,    DEC, RIGHT},  /* man page misspelling of scount? */
@@ -1289,20 +1396,20 @@ static const format_struct format_array[] = {
 {"sess",      "SESS",    pr_sess,     sr_session, 5,   0,    XXX, RIGHT},
 {"session",   "SESS",    pr_sess,     sr_session, 5,   0,    LNX, RIGHT},
 {"sgi_p",     "P",       pr_sgi_p,    sr_nop,     1,   0,    LNX, RIGHT}, /* "cpu" number */
-{"sgi_rss",   "RSS",     pr_rss,      sr_nop,     4,   0,    LNX, LEFT}, /* SZ:RSS */
-{"sgid",      "SGID",    pr_sgid,     sr_sgid,    5,   0,    LNX, RIGHT},
+{"sgi_rss",   "RSS",     pr_rss,      sr_nop,     4,  VM,    LNX, LEFT}, /* SZ:RSS */
+{"sgid",      "SGID",    pr_sgid,     sr_sgid,    5,  ID,    LNX, RIGHT},
 {"sgroup",    "SGROUP",  pr_sgroup,   sr_sgroup,  8, GRP,    LNX, USER},
 {"share",     "-",       pr_nop,      sr_share,   1, MEM,    LNX, RIGHT},
 {"sid",       "SID",     pr_sess,     sr_session, 5,   0,    XXX, RIGHT}, /* Sun & HP */
-{"sig",       "PENDING", pr_sig,      sr_nop,     9,   0,    XXX, SIGNAL}, /*pending*/
-{"sig_block", "BLOCKED",  pr_sigmask, sr_nop,     9,   0,    LNX, SIGNAL},
-{"sig_catch", "CATCHED", pr_sigcatch, sr_nop,     9,   0,    LNX, SIGNAL},
-{"sig_ignore", "IGNORED",pr_sigignore, sr_nop,    9,   0,    LNX, SIGNAL},
-{"sig_pend",  "SIGNAL",   pr_sig,     sr_nop,     9,   0,    LNX, SIGNAL},
-{"sigcatch",  "CAUGHT",  pr_sigcatch, sr_nop,     9,   0,    XXX, SIGNAL}, /*caught*/
-{"sigignore", "IGNORED", pr_sigignore,sr_nop,     9,   0,    XXX, SIGNAL}, /*ignored*/
-{"sigmask",   "BLOCKED", pr_sigmask,  sr_nop,     9,   0,    XXX, SIGNAL}, /*blocked*/
-{"size",      "SZ",      pr_swapable, sr_swapable, 1,  0,    SCO, RIGHT},
+{"sig",       "PENDING", pr_sig,      sr_nop,     9, SIG,    XXX, SIGNAL}, /*pending*/
+{"sig_block", "BLOCKED",  pr_sigmask, sr_nop,     9, SIG,    LNX, SIGNAL},
+{"sig_catch", "CATCHED", pr_sigcatch, sr_nop,     9, SIG,    LNX, SIGNAL},
+{"sig_ignore", "IGNORED",pr_sigignore, sr_nop,    9, SIG,    LNX, SIGNAL},
+{"sig_pend",  "SIGNAL",   pr_sig,     sr_nop,     9, SIG,    LNX, SIGNAL},
+{"sigcatch",  "CAUGHT",  pr_sigcatch, sr_nop,     9, SIG,    XXX, SIGNAL}, /*caught*/
+{"sigignore", "IGNORED", pr_sigignore,sr_nop,     9, SIG,    XXX, SIGNAL}, /*ignored*/
+{"sigmask",   "BLOCKED", pr_sigmask,  sr_nop,     9, SIG,    XXX, SIGNAL}, /*blocked*/
+{"size",      "SZ",      pr_swapable, sr_swapable, 1, VM,    SCO, RIGHT},
 {"sl",        "SL",      pr_nop,      sr_nop,     3,   0,    XXX, RIGHT},
 {"spid",      "SPID",    pr_thread,   sr_nop,     5,   0,    SGI, RIGHT},
 {"stackp",    "STACKP",  pr_stackp,   sr_nop,     8,   0,    LNX, RIGHT}, /*start_stack*/
@@ -1310,18 +1417,18 @@ static const format_struct format_array[] = {
 {"start_code", "S_CODE",  pr_nop,     sr_start_code, 8, 0,   LNx, RIGHT},
 {"start_stack", "STACKP", pr_stackp,  sr_start_stack, 8, 0,  LNX, RIGHT}, /*stackp*/
 {"start_time", "START",  pr_stime,    sr_start_time, 5, 0,   LNx, RIGHT},
-{"stat",      "STAT",    pr_stat,     sr_state,   4,   0,    BSD, LEFT}, /*state,s*/
+{"stat",      "STAT",    pr_stat,     sr_state,   4,  VM,    BSD, LEFT}, /*state,s*/
 {"state",     "S",       pr_s,        sr_state,   1,   0,    XXX, LEFT}, /*stat,s*/ /* was STAT */
 {"status",    "STATUS",  pr_nop,      sr_nop,     6,   0,    DEC, RIGHT},
 {"stime",     "STIME",   pr_stime,    sr_stime,   5,   0,    XXX, /* CUMUL| */RIGHT}, /* was 6 wide */
-{"suid",      "SUID",    pr_suid,     sr_suid,    5,   0,    LNx, RIGHT},
-{"suser",     "SUSER",   pr_suser,    sr_suser,   8, USR,    LNx, USER},
-{"svgid",     "SVGID",   pr_sgid,     sr_sgid,    5,   0,    XXX, RIGHT},
+{"suid",      "SUID",    pr_suid,     sr_suid,    5,  ID,    LNx, RIGHT},
+{"suser",     "SUSER",   pr_suser,    sr_suser,   8, USR|ID, LNx, USER},
+{"svgid",     "SVGID",   pr_sgid,     sr_sgid,    5,  ID,    XXX, RIGHT},
 {"svgroup",   "SVGROUP", pr_sgroup,   sr_sgroup,  8, GRP,    LNX, USER},
-{"svuid",     "SVUID",   pr_suid,     sr_suid,    5,   0,    XXX, RIGHT},
-{"svuser",    "SVUSER",  pr_suser,    sr_suser,   8, USR,    LNX, USER},
+{"svuid",     "SVUID",   pr_suid,     sr_suid,    5,  ID,    XXX, RIGHT},
+{"svuser",    "SVUSER",  pr_suser,    sr_suser,   8, USR|ID, LNX, USER},
 {"systime",   "SYSTEM",  pr_nop,      sr_nop,     6,   0,    DEC, RIGHT},
-{"sz",        "SZ",      pr_sz,       sr_nop,     5,   0,    HPU, RIGHT},
+{"sz",        "SZ",      pr_sz,       sr_nop,     5,  VM,    HPU, RIGHT},
 {"tdev",      "TDEV",    pr_nop,      sr_nop,     4,   0,    XXX, RIGHT},
 {"thcount",   "THCNT",   pr_nlwp,     sr_nop,     5,   0,    AIX, RIGHT},
 {"tid",       "TID",     pr_thread,   sr_nop,     5,   0,    AIX, RIGHT},
@@ -1352,13 +1459,13 @@ static const format_struct format_array[] = {
 {"usertime",  "USER",    pr_nop,      sr_nop,     4,   0,    DEC, RIGHT},
 {"usrpri",    "UPR",     pr_nop,      sr_nop,     3,   0,    DEC, RIGHT}, /*upr*/
 {"utime",     "UTIME",   pr_nop,      sr_utime,   6,   0,    LNx, CUMUL|RIGHT},
-{"vm_data",   "DATA",    pr_nop,      sr_vm_data, 5,   0,    LNx, RIGHT},
-{"vm_exe",    "EXE",     pr_nop,      sr_vm_exe,  5,   0,    LNx, RIGHT},
-{"vm_lib",    "LIB",     pr_nop,      sr_vm_lib,  5,   0,    LNx, RIGHT},
-{"vm_lock",   "LCK",     pr_nop,      sr_vm_lock, 3,   0,    LNx, RIGHT},
-{"vm_stack",  "STACK",   pr_nop,      sr_vm_stack, 5,  0,    LNx, RIGHT},
-{"vsize",     "VSZ",     pr_vsz,      sr_vsize,   5,   0,    DEC, RIGHT}, /*vsz*/
-{"vsz",       "VSZ",     pr_vsz,      sr_vm_size, 5,   0,    U98, RIGHT}, /*vsize*/
+{"vm_data",   "DATA",    pr_nop,      sr_vm_data, 5,  VM,    LNx, RIGHT},
+{"vm_exe",    "EXE",     pr_nop,      sr_vm_exe,  5,  VM,    LNx, RIGHT},
+{"vm_lib",    "LIB",     pr_nop,      sr_vm_lib,  5,  VM,    LNx, RIGHT},
+{"vm_lock",   "LCK",     pr_nop,      sr_vm_lock, 3,  VM,    LNx, RIGHT},
+{"vm_stack",  "STACK",   pr_nop,      sr_vm_stack, 5, VM,    LNx, RIGHT},
+{"vsize",     "VSZ",     pr_vsz,      sr_vsize,   5,  VM,    DEC, RIGHT}, /*vsz*/
+{"vsz",       "VSZ",     pr_vsz,      sr_vm_size, 5,  VM,    U98, RIGHT}, /*vsize*/
 {"wchan",     "WCHAN",   pr_wchan,    sr_wchan,   6, WCH,    XXX, WCHAN}, /* BSD n forces this to nwchan */ /* was 10 wide */
 {"wname",     "WCHAN",   pr_wname,    sr_nop,     6, WCH,    SGI, WCHAN}, /* opposite of nwchan */
 {"xstat",     "XSTAT",   pr_nop,      sr_nop,     5,   0,    BSD, RIGHT},
@@ -1604,6 +1711,92 @@ static void check_header_width(void){
 }
 
 
+/********** the format list, compiled for show_one_proc() **********/
+/* What the justification switch used to decide for every column of every
+ * row depends only on the options, which are settled by the time anything
+ * prints, so it is decided once, the first time through. */
+#define PAD_NONE  0  /* as it comes */
+#define PAD_RIGHT 1  /* right justified in "width" */
+#define PAD_CHOP  2  /* cut at "width", or the screen if last */
+
+typedef struct plan_step {
+  int (*pr)(void);
+  const char *name;
+  int width;
+  int pad;
+  int padto;    /* where PAD_RIGHT justifies to */
+  int legit;    /* extra space a wide SIGNAL column may steal */
+  int gap;      /* a space is owed between this column and the next */
+} plan_step;
+
+static plan_step *plan;
+static int plan_len;
+
+static void compile_plan(void){
+  format_node *fmt;
+  plan_step *ps;
+  int n = 0;
+  for(fmt = format_list; fmt; fmt = fmt->next) n++;
+  plan = ps = malloc(n * sizeof *plan);
+  plan_len = n;
+  for(fmt = format_list; fmt; fmt = fmt->next, ps++){
+    ps->pr    = fmt->pr;
+    ps->name  = fmt->name;
+    ps->width = fmt->width;
+    ps->pad   = PAD_NONE;
+    ps->padto = fmt->width;
+    ps->legit = 0;
+    ps->gap   = fmt->next && fmt->pr && fmt->next->pr; /* neither is AIX filler */
+    switch((fmt->flags) & JUST_MASK){
+    case 0:  /* for AIX, assigned outside this file */
+    case LEFT:          /* bad */
+      break;
+    case RIGHT:     /* OK */
+      ps->pad = PAD_RIGHT;
+      break;
+    case SIGNAL:
+      /* if the screen is wide enough, use full 16-character output */
+      ps->pad = PAD_RIGHT;
+      ps->padto = wide_signals ? 16 : 9;
+      if(wide_signals) ps->legit = 7;
+      break;
+    case USER:       /* bad */
+      if(user_is_number) ps->pad = PAD_RIGHT;
+      break;
+    case WCHAN:       /* bad */
+      ps->pad = wchan_is_number ? PAD_RIGHT : PAD_CHOP;
+      break;
+    case UNLIMITED:
+      ps->pad = PAD_CHOP;
+      break;
+    default:
+      fprintf(stderr, "bad alignment code\n");
+      break;
+    }
+  }
+}
+
+/********** rows go out in big writes, not a few bytes per column **********/
+static char  rows[64*1024];
+static int   rows_used;
+
+static void rows_flush(void){
+  if(rows_used) fwrite(rows, rows_used, 1, stdout);
+  rows_used = 0;
+}
+
+static void rows_put(const char *s, int n){
+  if(n > (int)sizeof rows - rows_used){
+    rows_flush();
+    if(n > (int)sizeof rows){
+      fwrite(s, n, 1, stdout);
+      return;
+    }
+  }
+  memcpy(rows + rows_used, s, n);
+  rows_used += n;
+}
+
 /********** show one process (NULL proc prints header) **********/
 void show_one_proc(proc_t* p){
   /* unknown: maybe set correct & actual to 1, remove +/- 1 below */
@@ -1613,17 +1806,20 @@ void show_one_proc(proc_t* p){
   int leftpad  = 0;  /* amount of space this column _could_ need */
   int space    = 0;  /* amount of space we actually need to print */
   int dospace  = 0;  /* previous column determined that we need a space */
-  int legit    = 0;  /* legitimately stolen extra space */
-  format_node *fmt = format_list;
+  const plan_step *ps, *last;
   static int did_stuff = 0;  /* have we ever printed anything? */
 
   if(-1==(long)p){    /* true only once, at the end */
     check_header_width();  /* temporary test code */
-    if(did_stuff) return;
+    if(did_stuff){
+      rows_flush();
+      return;
+    }
     /* have _never_ printed anything, but might need a header */
     if(!--lines_to_next_header){
       lines_to_next_header = header_gap;
       show_one_proc(NULL);
+      rows_flush();
     }
     /* fprintf(stderr, "No processes available.\n"); */  /* legal? */
     exit(1);
@@ -1636,67 +1832,30 @@ void show_one_proc(proc_t* p){
   }
   did_stuff = 1;
   pp = p;                 /* global, the proc_t struct */
-  if(active_cols>(int)OUTBUF_SIZE) fprintf(stderr,"Fix bigness error.\n");
+  if(!plan){
+    if(active_cols>(int)OUTBUF_SIZE) fprintf(stderr,"Fix bigness error.\n");
+    compile_plan();
+  }
+  last = plan + plan_len - 1;
 
   /* print row start sequence */
-  for(;;){
-    legit = 0;
+  for(ps = plan; ; ps++){
     /* set width suggestion which might be ignored */
-    if(fmt->next) max_rightward = fmt->width;
+    if(ps != last) max_rightward = ps->width;
     else max_rightward = active_cols-((correct>actual) ? correct : actual);
-    max_leftward  = fmt->width + actual - correct; /* TODO check this */
+    max_leftward  = ps->width + actual - correct; /* TODO check this */
     /* prepare data and calculate leftpad */
-    if(p && fmt->pr) amount = (*fmt->pr)();
-    else amount = strlen(strcpy(outbuf, fmt->name)); /* AIX or headers */
-    switch((fmt->flags) & JUST_MASK){
-    case 0:  /* for AIX, assigned outside this file */
-      leftpad = 0;
-      break;
-    case LEFT:          /* bad */
-      leftpad = 0;
-      break;
-    case RIGHT:     /* OK */
-      leftpad = fmt->width - amount;
+    if(p && ps->pr) amount = (*ps->pr)();
+    else amount = strlen(strcpy(outbuf, ps->name)); /* AIX or headers */
+    leftpad = 0;
+    switch(ps->pad){
+    case PAD_RIGHT:
+      leftpad = ps->padto - amount;
       if(leftpad < 0) leftpad = 0;
       break;
-    case SIGNAL:
-      /* if the screen is wide enough, use full 16-character output */
-      if(wide_signals){
-        leftpad = 16 - amount;
-        legit = 7;
-      }else{
-        leftpad =  9 - amount;
-      }
-      if(leftpad < 0) leftpad = 0;
-      break;
-    case USER:       /* bad */
-      leftpad = fmt->width - amount;
-      if(leftpad < 0) leftpad = 0;
-      if(!user_is_number) leftpad = 0;
-      break;
-    case WCHAN:       /* bad */
-      if(wchan_is_number){
-        leftpad = fmt->width - amount;
-        if(leftpad < 0) leftpad = 0;
-        break;
-      }else{
-        if(fmt->next){
-          outbuf[fmt->width] = '\0';  /* Must chop, more columns! */
-        }else{
-          int chopspot;  /* place to chop */
-          int tmpspace;  /* need "space" before it is calculated below */
-          tmpspace = correct - actual;
-          if(tmpspace<1) tmpspace = dospace;
-          chopspot = active_cols-actual-tmpspace;
-          if(chopspot<1) chopspot=1;  /* oops, we (mostly) lose this column... */
-          outbuf[chopspot] = '\0';    /* chop at screen/buffer limit */
-        }
-        leftpad = 0;
-        break;
-      }
-    case UNLIMITED:
-      if(fmt->next){
-        outbuf[fmt->width] = '\0';  /* Must chop, more columns! */
+    case PAD_CHOP:
+      if(ps != last){
+        outbuf[ps->width] = '\0';  /* Must chop, more columns! */
       }else{
         int chopspot;  /* place to chop */
         int tmpspace;  /* need "space" before it is calculated below */
@@ -1706,10 +1865,6 @@ void show_one_proc(proc_t* p){
         if(chopspot<1) chopspot=1;  /* oops, we (mostly) lose this column... */
         outbuf[chopspot] = '\0';    /* chop at screen/buffer limit */
       }
-      leftpad = 0;
-      break;
-    default:
-      fprintf(stderr, "bad alignment code\n");
       break;
     }
     /* At this point:
@@ -1720,7 +1875,6 @@ void show_one_proc(proc_t* p){
      * leftpad   left padding for this column alone (not make-up or gap)
      * space     not needed (will recalculate now)
      * dospace   if we require space between this and the prior column
-     * legit     space we were allowed to steal, and thus did steal
      */
     space = correct - actual + leftpad;
     if(space<1) space=dospace;
@@ -1728,24 +1882,19 @@ void show_one_proc(proc_t* p){
 
     /* print data, set x position stuff */
     amount = strlen(outbuf);  /* post-chop data width */
-    if(!fmt->next){
+    if(ps == last){
       /* Last column. Write padding + data + newline all together. */
       outbuf[amount] = '\n';
-      fwrite(outbuf-space, space+amount+1, 1, stdout);
+      rows_put(outbuf-space, space+amount+1);
       break;
     }
     /* Not the last column. Write padding + data together. */
-    fwrite(outbuf-space, space+amount, 1, stdout);
+    rows_put(outbuf-space, space+amount);
     actual  += space+amount;
-    correct += fmt->width;
-    correct += legit;        /* adjust for SIGNAL expansion */
-    if(fmt->pr && fmt->next->pr){ /* neither is AIX filler */
-      correct++;
-      dospace = 1;
-    }else{
-      dospace = 0;
-    }
-    fmt = fmt->next;
+    correct += ps->width;
+    correct += ps->legit;        /* adjust for SIGNAL expansion */
+    if(ps->gap) correct++;
+    dospace = ps->gap;
     /* At this point:
      *
      * correct   screen position we should be at
@@ -1754,7 +1903,6 @@ void show_one_proc(proc_t* p){
      * leftpad   not needed
      * space     not needed
      * dospace   if have determined that we need a space next time
-     * legit     not needed
      */
   }
 }
@@ -743,6 +743,7 @@ static const char *parse_gnu_option(void){
   {"headings",      &&case_headings},
   {"help",          &&case_help},
   {"info",          &&case_info},
+  {"limit",         &&case_limit},
   {"lines",         &&case_lines},
   {"no-header",     &&case_no_header},
   {"no-headers",    &&case_no_headers},
@@ -881,6 +882,19 @@ static const char *parse_gnu_option(void){
     if(err) return err;
     selection_list->typecode = SEL_PID;
     return NULL;
+  case_limit:
+    trace("--limit\n");
+    arg = grab_gnu_arg();
+    if(arg && *arg){
+      long t;
+      char *endptr;
+      t = strtol(arg, &endptr, 0);
+      if(!*endptr && (t>0) && (t<2000000000)){
+        process_limit = (int)t;
+        return NULL;
+      }
+    }
+    return "Number of processes must follow --limit.";
   case_rows:
   case_lines:
     trace("--rows\n");
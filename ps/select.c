@@ -75,50 +75,167 @@ static int table_accept(proc_t *buf){
   return (select_bits & (1<<proc_index));
 }
 
-/***** selected by some kind of list? */
-static int proc_was_listed(proc_t *buf){
-  selection_node *sn = selection_list;
-  int i;
-  if(!sn) return 0;
-  while(sn){
-    switch(sn->typecode){
-    default:
-      printf("Internal error in ps! Please report this bug.\n");
+/***** the lists, each compiled into a hash of its values */
+/* A process then costs a probe or two per list, however long the lists
+ * are.  Values are compared whole -- not cut to 16 bits as once, when
+ * uid 65536 passed for root and pts/256 for pts/0 -- and a command is
+ * its first 8 characters, padded with NULs, as strncmp() would see it. */
+typedef struct sel_set {
+  struct sel_set *next;
+  int typecode;
+  unsigned shift;               /* 64 - log2(buckets) */
+  unsigned long long *key;
+  unsigned char *used;
+} sel_set;
 
-#define return_if_match(foo,bar) \
-        i=sn->n; while(i--) \
-        if((unsigned short )(buf->foo) == (unsigned short)(*(sn->u+i)).bar) \
-        return 1
+static sel_set *sel_sets;
+static int sel_compiled;
 
-    break; case SEL_RUID: return_if_match(ruid,uid);
-    break; case SEL_EUID: return_if_match(euid,uid);
-    break; case SEL_SUID: return_if_match(suid,uid);
-    break; case SEL_FUID: return_if_match(fuid,uid);
+static unsigned long long sel_key(int typecode, const sel_union *u){
+  unsigned long long k = 0;
+  switch(typecode){
+  case SEL_RUID: case SEL_EUID: case SEL_SUID: case SEL_FUID:
+    return (unsigned)u->uid;
+  case SEL_RGID: case SEL_EGID: case SEL_SGID: case SEL_FGID:
+    return (unsigned)u->gid;
+  case SEL_PGRP: case SEL_PID: case SEL_SESS:
+    return (unsigned)u->pid;
+  case SEL_TTY:
+    return (unsigned)u->tty;
+  case SEL_COMM:
+    memcpy(&k, u->cmd, strnlen(u->cmd, 8));
+    return k;
+  }
+  return 0;
+}
 
-    break; case SEL_RGID: return_if_match(rgid,gid);
-    break; case SEL_EGID: return_if_match(egid,gid);
-    break; case SEL_SGID: return_if_match(sgid,gid);
-    break; case SEL_FGID: return_if_match(fgid,gid);
+static unsigned sel_bucket(const sel_set *set, unsigned long long k){
+  return (unsigned)((k * 0x9e3779b97f4a7c15ULL) >> set->shift);
+}
 
-    break; case SEL_PGRP: return_if_match(pgrp,pid);
-    break; case SEL_PID : return_if_match(pid,pid);
-    break; case SEL_TTY : return_if_match(tty,tty);
-    break; case SEL_SESS: return_if_match(session,pid);
+static int sel_has(const sel_set *set, unsigned long long k){
+  unsigned mask = (1u << (64 - set->shift)) - 1;
+  unsigned i = sel_bucket(set, k);
+  while(set->used[i]){
+    if(set->key[i] == k) return 1;
+    i = (i + 1) & mask;
+  }
+  return 0;
+}
 
-    /* TODO Should use a long long cast for performance */
-    break; case SEL_COMM: i=sn->n; while(i--)
-    if(!strncmp( buf->cmd, (*(sn->u+i)).cmd, 8 )) return 1;
+static void compile_lists(void){
+  selection_node *sn;
+  sel_set *set;
+  unsigned size, mask, b;
+  int i;
+  sel_compiled = 1;
+  for(sn = selection_list; sn; sn = sn->next){
+    set = malloc(sizeof *set);
+    set->typecode = sn->typecode;
+    for(size = 8, set->shift = 61; size < 2u * sn->n; size *= 2) set->shift--;
+    set->key = malloc(size * sizeof *set->key);
+    set->used = calloc(size, 1);
+    mask = size - 1;
+    for(i = 0; i < sn->n; i++){
+      unsigned long long k = sel_key(sn->typecode, sn->u + i);
+      if(sel_has(set, k)) continue;
+      for(b = sel_bucket(set, k); set->used[b]; b = (b + 1) & mask) ;
+      set->key[b] = k;
+      set->used[b] = 1;
+    }
+    set->next = sel_sets;
+    sel_sets = set;
+  }
+}
 
+/***** selected by some kind of list? */
+static int proc_was_listed(proc_t *buf){
+  const sel_set *set;
+  unsigned long long k;
+  if(!sel_compiled) compile_lists();
+  for(set = sel_sets; set; set = set->next){
+    switch(set->typecode){
+    default:
+      printf("Internal error in ps! Please report this bug.\n");
+      continue;
+    case SEL_RUID: k = (unsigned)buf->ruid; break;
+    case SEL_EUID: k = (unsigned)buf->euid; break;
+    case SEL_SUID: k = (unsigned)buf->suid; break;
+    case SEL_FUID: k = (unsigned)buf->fuid; break;
 
+    case SEL_RGID: k = (unsigned)buf->rgid; break;
+    case SEL_EGID: k = (unsigned)buf->egid; break;
+    case SEL_SGID: k = (unsigned)buf->sgid; break;
+    case SEL_FGID: k = (unsigned)buf->fgid; break;
 
-#undef return_if_match
+    case SEL_PGRP: k = (unsigned)buf->pgrp; break;
+    case SEL_PID : k = (unsigned)buf->pid; break;
+    case SEL_TTY : k = (unsigned)buf->tty; break;
+    case SEL_SESS: k = (unsigned)buf->session; break;
 
+    case SEL_COMM: k = 0; memcpy(&k, buf->cmd, strnlen(buf->cmd, 8)); break;
     }
-    sn = sn->next;
+    if(sel_has(set, k)) return 1;
   }
   return 0;
 }
 
+static int cmp_pid(const void *a, const void *b){
+  pid_t x = *(const pid_t *)a, y = *(const pid_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_uid(const void *a, const void *b){
+  uid_t x = *(const uid_t *)a, y = *(const uid_t *)b;
+  return (x > y) - (x < y);
+}
+
+/***** what openproc() can check for itself, before reading stat */
+/* When the lists alone decide and they're all of PIDs, the reader need
+ * never look at another process (PROC_PID, with a sorted 0 terminated
+ * list of them, as /proc would have them);  when they're all of
+ * effective uids, it skips the others by their directory's owner
+ * (PROC_UID, with a sorted list and its length) -- unless status is to
+ * be read, whose euid is what ps goes by then, and which for a task
+ * that can't dump core isn't its directory's.  want_this_proc() still
+ * gets to see what's left.  Otherwise 0, and the lists are only ever
+ * checked by want_this_proc(). */
+int select_pushdown(unsigned needs, pid_t **pids, uid_t **uids, int *nuid){
+  static pid_t *plist;
+  static uid_t *ulist;
+  selection_node *sn;
+  int type, n, i, j;
+  if(all_processes || negate_selection || simple_select || !selection_list)
+    return 0;
+  type = selection_list->typecode;
+  for(n = 0, sn = selection_list; sn; n += sn->n, sn = sn->next)
+    if(sn->typecode != type) return 0;
+  switch(type){
+  case SEL_PID:
+    plist = realloc(plist, (n + 1) * sizeof *plist);
+    for(j = 0, sn = selection_list; sn; sn = sn->next)
+      for(i = 0; i < sn->n; i++)
+        if(sn->u[i].pid > 0) plist[j++] = sn->u[i].pid;  /* no 0 in /proc */
+    qsort(plist, j, sizeof *plist, cmp_pid);
+    for(n = i = 0; i < j; i++)               /* once each */
+      if(!n || plist[n-1] != plist[i]) plist[n++] = plist[i];
+    plist[n] = 0;
+    *pids = plist;
+    return PROC_PID;
+  case SEL_EUID:
+    if(needs & PROC_FILLSTATUS) return 0;
+    ulist = realloc(ulist, (n + 1) * sizeof *ulist);
+    for(j = 0, sn = selection_list; sn; sn = sn->next)
+      for(i = 0; i < sn->n; i++) ulist[j++] = sn->u[i].uid;
+    qsort(ulist, j, sizeof *ulist, cmp_uid);
+    for(n = i = 0; i < j; i++)
+      if(!n || ulist[n-1] != ulist[i]) ulist[n++] = ulist[i];
+    *uids = ulist;
+    *nuid = n;
+    return PROC_UID;
+  }
+  return 0;
+}
 
 /***** This must satisfy Unix98 and as much BSD as possible */
 int want_this_proc(proc_t *buf){
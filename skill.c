@@ -24,6 +24,8 @@
 #include "proc/sig.h"
 #include "proc/devname.h"
 #include "proc/procps.h"  /* char *user_from_uid(uid_t uid) */
+#include "proc/readproc.h" /* pidscan_open() and friends */
+#include "proc/pidsig.h"
 #include "proc/version.h" /* procps_version */
 
 static int f_flag, i_flag, v_flag, w_flag, n_flag;
@@ -74,32 +76,15 @@ static void display_kill_version(){
   }
 }
 
-/***** kill or nice a process */
-static void hurt_proc(int tty, int uid, int pid, char *cmd){
-  int failed;
-  int saved_errno;
+/***** say what became of a process */
+static void report_proc(int tty, int uid, int pid, const char *cmd, int err){
   char dn_buf[1000];
   dev_to_tty(dn_buf, 999, tty, pid, ABBREV_DEV);
-  if(i_flag){
-    char buf[8];
-    fprintf(stderr, "%-8.8s %-8.8s %5d %-16.16s   ? ",
-      (char*)dn_buf,user_from_uid(uid),pid,cmd
-    );
-    if(!fgets(buf,7,stdin)){
-      printf("\n");
-      exit(0);
-    }
-    if(*buf!='y' && *buf!='Y') return;
-  }
-  /* do the actual work */
-  if(program==PROG_SKILL) failed=kill(pid,sig_or_pri);
-  else                    failed=setpriority(PRIO_PROCESS,pid,sig_or_pri);
-  saved_errno = errno;
-  if(w_flag && failed){
+  if(w_flag && err){
     fprintf(stderr, "%-8.8s %-8.8s %5d %-16.16s   ",
       (char*)dn_buf,user_from_uid(uid),pid,cmd
     );
-    errno = saved_errno;
+    errno = err;
     perror("");
     return;
   }
@@ -117,14 +102,154 @@ static void hurt_proc(int tty, int uid, int pid, char *cmd){
 }
 
 
-/***** check one process */
+/***** signals, a set at a time */
+/* Each process to signal is held by a pidfd taken while its stat file was
+ * still open (see check_proc), so the signal can't reach a later owner of
+ * the PID.  They go out when a batch is done;  with -f they are saved up
+ * for as long as there are descriptors to hold them, and sent from several
+ * threads.  What hurt_proc() will say about each waits alongside it.
+ */
+static pidsig_t sigs;
+static struct pending {
+  int tty;
+  int uid;
+  char cmd[17];
+} *pending;
+static int pending_room;
+static int pending_max;               /* with -f, pidfds to hold before sending */
+static int pending_bypid;             /* no pidfd: send before the batch closes */
+
+static void send_signals(void){
+  int i;
+  if(!sigs.n) return;
+  pidsig_send(&sigs, sig_or_pri);
+  for(i=0; i<sigs.n; i++)
+    report_proc(pending[i].tty, pending[i].uid, sigs.pid[i], pending[i].cmd, sigs.err[i]);
+  pidsig_clear(&sigs);
+  pending_bypid = 0;
+}
+
+static void queue_signal(int tty, int uid, int pid, const char *cmd, int pidfd){
+  struct pending *p;
+  if(sigs.n == pending_room){
+    pending_room = pending_room*2 + 64;
+    pending = realloc(pending, pending_room*sizeof(*pending));
+    if(!pending) fprintf(stderr,"No memory.\n"),exit(2);
+  }
+  p = &pending[sigs.n];
+  p->tty = tty;
+  p->uid = uid;
+  strncpy(p->cmd, cmd, sizeof(p->cmd)-1);
+  p->cmd[sizeof(p->cmd)-1] = '\0';
+  if(pidfd < 0) pending_bypid++;
+  pidsig_add(&sigs, pid, pidfd);
+}
+
+
+/***** kill or nice a process */
+static void hurt_proc(int tty, int uid, int pid, char *cmd, int pidfd){
+  int failed;
+  if(i_flag){
+    char buf[8];
+    char dn_buf[1000];
+    dev_to_tty(dn_buf, 999, tty, pid, ABBREV_DEV);
+    fprintf(stderr, "%-8.8s %-8.8s %5d %-16.16s   ? ",
+      (char*)dn_buf,user_from_uid(uid),pid,cmd
+    );
+    if(!fgets(buf,7,stdin)){
+      printf("\n");
+      exit(0);
+    }
+    if(*buf!='y' && *buf!='Y'){
+      if(pidfd >= 0) close(pidfd);
+      return;
+    }
+  }
+  /* do the actual work */
+  if(program==PROG_SKILL){
+    queue_signal(tty, uid, pid, cmd, pidfd);
+    if(i_flag) send_signals();  /* as soon as it's approved */
+    return;
+  }
+  failed=setpriority(PRIO_PROCESS,pid,sig_or_pri);
+  report_proc(tty, uid, pid, cmd, failed ? errno : 0);
+}
+
+
+/***** check a batch of processes */
+/* Tasks are opened a batch at a time, then the UID list is checked against
+ * the whole batch (see proccols_keep), only the survivors have their stat
+ * read, then the same for the TTY list, and the names last of all.  Every
+ * file stays open until the batch is done, as check_proc() always held its
+ * own, to kill/nice before the PID can be reused.
+ */
+#define BATCH 64
+static struct {
+  int count;
+  int fd[BATCH];
+  int pidfd[BATCH];
+  int pid[BATCH];
+  int tty[BATCH];
+  uid_t uid[BATCH];
+  char *cmd[BATCH];
+  unsigned char keep[BATCH];
+  char buf[BATCH][128];
+} batch;
+
+static void check_batch(void){
+  int n = batch.count;
+  char *tmp;
+  int i, j;
+  if(uids) proccols_keep(batch.keep, (const int*)batch.uid, n, (const int*)uids, uid_count);
+  for(i=0; i<n; i++){
+    char *buf = batch.buf[i];
+    ssize_t num;
+    if(!batch.keep[i]) continue;
+    num = read(batch.fd[i],buf,127);
+    buf[num>0 ? num : 0] = '\0';
+    tmp = strrchr(buf, ')');
+    if(tmp) *tmp++ = '\0';
+    batch.cmd[i] = strchr(buf, '(');
+    if(!tmp || !batch.cmd[i]){  /* process exited maybe */
+      batch.keep[i] = 0;
+      continue;
+    }
+    batch.cmd[i]++;
+    j = 5; while(j-- && *tmp) while(*tmp && *tmp++!=' '); /* scan to find tty */
+    if(!*tmp){  /* cut short */
+      batch.keep[i] = 0;
+      continue;
+    }
+    batch.tty[i] = atoi(tmp);
+  }
+  if(ttys) proccols_keep(batch.keep, batch.tty, n, ttys, tty_count);
+  for(i=0; i<n; i++){
+    if(!batch.keep[i]) continue;
+    tmp = batch.cmd[i];
+    if(cmds){
+      j=cmd_count;
+      /* fast comparison trick -- useful? */
+      while(j--) if(cmds[j][0]==*tmp && !strcmp(cmds[j],tmp)) break;
+      if(j==-1) continue;
+    }
+    /* This is where we kill/nice something. */
+    hurt_proc(batch.tty[i], batch.uid[i], batch.pid[i], tmp, batch.pidfd[i]);
+    batch.pidfd[i] = -1;  /* hurt_proc() has it now */
+  }
+  if(!f_flag || pending_bypid || sigs.n >= pending_max) send_signals();
+  for(i=0; i<n; i++){
+    close(batch.fd[i]); /* kill/nice _first_ to avoid PID reuse */
+    if(batch.pidfd[i] >= 0) close(batch.pidfd[i]);
+  }
+  batch.count = 0;
+}
+
+/***** add one process to the batch */
 static void check_proc(int pid){
   char buf[128];
   struct stat statbuf;
-  char *tmp;
-  int tty;
   int fd;
-  int i;
+  int i = batch.count;
   if(pid==my_pid) return;
   sprintf(buf, "/proc/%d/stat", pid); /* pid (cmd) state ppid pgrp session tty */
   fd = open(buf,O_RDONLY);
@@ -132,38 +257,23 @@ static void check_proc(int pid){
     if(pids && w_flag) printf("WARNING: process %d could not be found.",pid);
     return;
   }
-  fstat(fd, &statbuf);
-  if(uids){  /* check the EUID */
-    i=uid_count;
-    while(i--) if(uids[i]==statbuf.st_uid) break;
-    if(i==-1) goto closure;
-  }
-  read(fd,buf,128);
-  buf[127] = '\0';
-  tmp = strrchr(buf, ')');
-  *tmp++ = '\0';
-  i = 5; while(i--) while(*tmp++!=' '); /* scan to find tty */
-  tty = atoi(tmp);
-  if(ttys){
-    i=tty_count;
-    while(i--) if(ttys[i]==tty) break;
-    if(i==-1) goto closure;
-  }
-  tmp = strchr(buf, '(') + 1;
-  if(cmds){
-    i=cmd_count;
-    /* fast comparison trick -- useful? */
-    while(i--) if(cmds[i][0]==*tmp && !strcmp(cmds[i],tmp)) break;
-    if(i==-1) goto closure;
+  batch.pidfd[i] = -1;
+  if(program==PROG_SKILL){
+    /* taken while the stat file is open:  if that still reads, this is
+       the same process */
+    batch.pidfd[i] = pidsig_open(pid, 0);
+    if(batch.pidfd[i]==-1 && errno==ESRCH){
+      close(fd);
+      if(pids && w_flag) printf("WARNING: process %d could not be found.",pid);
+      return;
+    }
   }
-  /* This is where we kill/nice something. */
-/*  fprintf(stderr, "PID %d, UID %d, TTY %d,%d, COMM %s\n",
-    pid, statbuf.st_uid, tty>>8, tty&0xf, tmp
-  );
-*/
-  hurt_proc(tty, statbuf.st_uid, pid, tmp);
-closure:
-  close(fd); /* kill/nice _first_ to avoid PID reuse */
+  fstat(fd, &statbuf);
+  batch.fd[i] = fd;
+  batch.pid[i] = pid;
+  batch.uid[i] = statbuf.st_uid; /* the EUID */
+  batch.keep[i] = 1;
+  if(++batch.count == BATCH) check_batch();
 }
 
 
@@ -204,11 +314,12 @@ static void show_lists(void){
 /***** iterate over all PIDs */
 static void iterate(void){
   int pid;
-  DIR *d;
-  struct dirent *de;
+  pidscan_t *d;
   if(pids){
     pid = pid_count;
     while(pid--) check_proc(pids[pid]);
+    check_batch();
+    send_signals();
     return;
   }
 #if 0
@@ -216,18 +327,38 @@ static void iterate(void){
   if(!ttys && !cmds && !pids && !i_flag){
   }
 #endif
-  d = opendir("/proc");
+  d = pidscan_open("/proc");
   if(!d){
     perror("/proc");
     exit(1);
   }
-  while(( de = readdir(d) )){
-    if(de->d_name[0] > '9') continue;
-    if(de->d_name[0] < '1') continue;
-    pid = atoi(de->d_name);
-    if(pid) check_proc(pid);
+  while(( pid = pidscan_next(d) )) check_proc(pid);
+  check_batch();
+  send_signals();
+  pidscan_close(d);
+}
+
+/***** -f: saved-up signals, from several threads */
+static void fast_setup(void){
+  struct rlimit rl;
+  long cpus;
+  if(!f_flag || program!=PROG_SKILL) return;
+  pending_max = 1024 - BATCH*2 - 32;
+  if(getrlimit(RLIMIT_NOFILE, &rl)==0){
+    rl.rlim_cur = rl.rlim_max;   /* as many pidfds as we may hold */
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if(rl.rlim_cur > (rlim_t)BATCH*2 + 32)
+      pending_max = rl.rlim_cur > 1<<20 ? 1<<20 : (int)(rl.rlim_cur - BATCH*2 - 32);
   }
-  closedir (d);
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  sigs.threads = cpus < 1 ? 1 : cpus > 16 ? 16 : cpus;
+}
+
+static void fast_report(void){
+  if(!f_flag || program!=PROG_SKILL) return;
+  fprintf(stderr, "%lu signalled, %lu failed, in %.3f ms\n",
+    sigs.sent, sigs.failed, sigs.nsec / 1e6);
 }
 
 /***** kill help */
@@ -340,7 +471,8 @@ static void skillsnice_usage(void){
   fprintf(stderr,
     "\n"
     "General options:\n"
-    "-f  fast mode            This is not currently useful.\n"
+    "-f  fast mode            Signal all at once from several threads, then\n"
+    "                         report how many and how long it took.\n"
     "-i  interactive use      You will be asked to approve each action.\n"
     "-v  verbose output       Display information about selected processes.\n"
     "-w  warnings enabled     This is not currently useful.\n"
@@ -561,7 +693,9 @@ int main(int argc, char *argv[]){
   case PROG_SKILL:
     skillsnice_parse(argc, argv);
 /*    show_lists(); */
+    fast_setup();
     iterate(); /* this is it, go get them */
+    fast_report();
     break;
   case PROG_KILL:
     kill_main(argc, argv);
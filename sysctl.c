@@ -21,11 +21,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 /*
  *    Additional types we might need.
@@ -44,6 +47,8 @@ static void Preload(const char *filename);
 static int WriteSetting(const char *setting);
 static int ReadSetting(const char *setting);
 static int DisplayAll(const char *path, bool ShowTableUtil);
+static int ShowValue(int fd, const char *outname);
+static int SysOpen(const char *name, int flags);
 
 
 /*
@@ -54,6 +59,18 @@ static const char PROC_PATH[] = "/proc/sys/";
 static const char DEFAULT_PRELOAD[] = "/etc/sysctl.conf";
 static bool PrintName;
 static bool PrintNewline;
+static bool ReportTiming;
+
+/*
+ *    The keys are opened relative to /proc/sys, opened once, and -a walks
+ *    the tree by directory descriptor;  so nothing is looked up from the
+ *    root more than once.  The names and values are built in these.
+ */
+static int SysFd = -1;
+static char KeyPath[PATH_MAX];       /* PROC_PATH, then the key as a path */
+static char OutName[PATH_MAX];       /* the key, as displayed */
+static char *ValueBuf;
+static size_t ValueSize;
 
 /* error messages */
 static const char ERR_UNKNOWN_PARAMETER[] = "error: Unknown parameter '%s'\n";
@@ -61,6 +78,7 @@ static const char ERR_MALFORMED_SETTING[] = "error: Malformed setting '%s'\n";
 static const char ERR_NO_EQUALS[] = "error: '%s' must be of the form name=value\n";
 static const char ERR_INVALID_KEY[] = "error: '%s' is an unknown key\n";
 static const char ERR_UNKNOWN_WRITING[] = "error: unknown error %d setting key '%s'\n";
+static const char ERR_WRITING[] = "error: %s setting key '%s'\n";
 static const char ERR_UNKNOWN_READING[] = "error: unknown error %d reading key '%s'\n";
 static const char ERR_PERMISSION_DENIED[] = "error: permission denied on key '%s'\n";
 static const char ERR_OPENING_DIR[] = "error: unable to open directory '%s'\n";
@@ -93,6 +111,7 @@ int main(int argc, char **argv) {
 
    PrintName = true;
    PrintNewline = true;
+   ReportTiming = false;
 
    if (argc < 2) {
        return Usage(me);
@@ -114,6 +133,9 @@ int main(int argc, char **argv) {
               SwitchesAllowed = false;
               WriteMode = true;
            break;
+         case 't':
+              ReportTiming = true;
+           break;
          case 'p':
               argv++;
               if (argv && *argv && **argv) {
@@ -158,7 +180,7 @@ static int Usage(const char *name) {
    printf("usage:  %s [-n] variable ... \n"
           "        %s [-n] -w variable=value ... \n" 
           "        %s [-n] -a \n" 
-          "        %s [-n] -p <file>   (default /etc/sysctl.conf) \n"
+          "        %s [-n] [-t] -p <file>   (default /etc/sysctl.conf) \n"
           "        %s [-n] -A\n", name, name, name, name, name);
    return -1;
 }  /* end Usage() */
@@ -200,9 +222,11 @@ static void Preload(const char *filename) {
    char oneline[257];
    char buffer[257];
    char *t;
-   int n = 0;
+   int n = 0, keys = 0, failed = 0;
    char *name, *value;
+   struct timespec start, end;
 
+   clock_gettime(CLOCK_MONOTONIC, &start);
    if (!filename || ((fp = fopen(filename, "r")) == NULL)) {
       fprintf(stderr, ERR_PRELOAD_FILE, filename);
       return;
@@ -237,10 +261,18 @@ static void Preload(const char *filename) {
          value++;
 
       sprintf(buffer, "%s=%s", name, value);
-      WriteSetting(buffer);
+      keys++;
+      if (WriteSetting(buffer))
+         failed++;
    } /* endwhile */
 
    fclose(fp);
+   if (ReportTiming) {
+      fflush(stdout);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      fprintf(stderr, "%s: %d keys (%d failed) in %.3f ms\n", filename, keys, failed,
+              (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+   } /* endif */
 } /* end Preload() */
 
 
@@ -255,8 +287,9 @@ static int WriteSetting(const char *setting) {
    const char *value;
    const char *equals;
    char *tmpname;
-   FILE *fp;
    char *outname;
+   size_t len;
+   int fd;
 
    if (!name) {        /* probably don't want to display this err */
       return 0;
@@ -276,22 +309,25 @@ static int WriteSetting(const char *setting) {
       return -2;
    } /* end if */
 
+   len = equals - name;
+   if (len >= sizeof OutName - strlen(PROC_PATH))
+      len = sizeof OutName - strlen(PROC_PATH) - 1;
+
    /* used to open the file */
-   tmpname = malloc(equals-name+1+strlen(PROC_PATH));
-   strcpy(tmpname, PROC_PATH);
-   strncat(tmpname, name, (int)(equals-name)); 
-   tmpname[equals-name+strlen(PROC_PATH)] = 0;
-   slashdot(tmpname+strlen(PROC_PATH),'.','/'); /* change . to / */
+   tmpname = KeyPath + strlen(PROC_PATH);
+   memcpy(tmpname, name, len);
+   tmpname[len] = 0;
+   slashdot(tmpname,'.','/'); /* change . to / */
 
    /* used to display the output */
-   outname = malloc(equals-name+1);                       
-   strncpy(outname, name, (int)(equals-name)); 
-   outname[equals-name] = 0;
+   outname = OutName;
+   memcpy(outname, name, len);
+   outname[len] = 0;
    slashdot(outname,'/','.'); /* change / to . */
  
-   fp = fopen(tmpname, "w");
+   fd = SysOpen(tmpname, O_WRONLY | O_TRUNC);
 
-   if (!fp) {
+   if (fd < 0) {
       switch(errno) {
       case ENOENT:
          fprintf(stderr, ERR_INVALID_KEY, outname);
@@ -305,9 +341,22 @@ static int WriteSetting(const char *setting) {
       } /* end switch */
       rc = -1;
    } else {
-      fprintf(fp, "%s\n", value);
-      fclose(fp);
+      /* the whole value in one write, as the kernel wants it */
+      len = strlen(value);
+      if (len + 2 > ValueSize) {
+         ValueSize = len + 1024;
+         ValueBuf = realloc(ValueBuf, ValueSize);
+      } /* endif */
+      memcpy(ValueBuf, value, len);
+      ValueBuf[len++] = '\n';
+      if (write(fd, ValueBuf, len) < 0) {
+         fprintf(stderr, ERR_WRITING, strerror(errno), outname);
+         rc = -1;
+      } /* endif */
+      close(fd);
+   } /* endif */
 
+   if (rc == 0) {
       if (PrintName) {
          fprintf(stdout, "%s = %s\n", outname, value);
       } else {
@@ -318,41 +367,72 @@ static int WriteSetting(const char *setting) {
       }
    } /* endif */
 
-   free(tmpname);
-   free(outname);
    return rc;
 } /* end WriteSetting() */
 
 
 
+/*
+ *     Open a key, by its path under /proc/sys (built in KeyPath)
+ *
+ */
+static int SysOpen(const char *name, int flags) {
+   static bool tried;
+
+   if (!tried) {
+      tried = true;
+      SysFd = open(PROC_PATH, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   } /* endif */
+   if (SysFd >= 0)
+      return openat(SysFd, name, flags | O_CLOEXEC);
+
+   /* no /proc/sys to hand: the full path, for the error it gets */
+   memcpy(KeyPath, PROC_PATH, strlen(PROC_PATH));
+   return open(KeyPath, flags | O_CLOEXEC);
+} /* end SysOpen() */
+
+
+
 /*
  *     Read a sysctl setting 
  *
  */
 static int ReadSetting(const char *setting) {
-   int rc = 0;
    char *tmpname, *outname;
-   char inbuf[1025];
    const char *name = setting;
-   FILE *fp;
+   int fd;
 
    if (!setting || !*setting) {
       fprintf(stderr, ERR_INVALID_KEY, setting);
    } /* endif */
 
    /* used to open the file */
-   tmpname = malloc(strlen(name)+strlen(PROC_PATH)+1);
-   strcpy(tmpname, PROC_PATH);
-   strcat(tmpname, name); 
-   slashdot(tmpname+strlen(PROC_PATH),'.','/'); /* change . to / */
+   tmpname = KeyPath + strlen(PROC_PATH);
+   strncpy(tmpname, name, sizeof KeyPath - strlen(PROC_PATH) - 1);
+   KeyPath[sizeof KeyPath - 1] = 0;
+   slashdot(tmpname,'.','/'); /* change . to / */
 
    /* used to display the output */
-   outname = strdup(name);
+   outname = OutName;
+   strncpy(outname, name, sizeof OutName - 1);
+   OutName[sizeof OutName - 1] = 0;
    slashdot(outname,'/','.'); /* change / to . */
 
-   fp = fopen(tmpname, "r");
+   fd = SysOpen(tmpname, O_RDONLY);
+   return ShowValue(fd, outname);
+} /* end ReadSetting() */
+
+
+
+/*
+ *     Print a key's value from its opened file (or, -1, say why it wasn't)
+ *
+ */
+static int ShowValue(int fd, const char *outname) {
+   size_t got = 0, at, end;
+   ssize_t n;
 
-   if (!fp) {
+   if (fd < 0) {
       switch(errno) {
       case ENOENT:
          fprintf(stderr, ERR_INVALID_KEY, outname);
@@ -364,68 +444,111 @@ static int ReadSetting(const char *setting) {
          fprintf(stderr, ERR_UNKNOWN_READING, errno, outname);
         break;
       } /* end switch */
-      rc = -1;
-   } else {
-      while(fgets(inbuf, 1024, fp)) {
-         /* already has the \n in it */
-         if (PrintName) {
-            fprintf(stdout, "%s = %s", outname, inbuf);
-         } else {
-            if (!PrintNewline) {
-              char *nlptr = strchr(inbuf,'\n');
-              if(nlptr) *nlptr='\0';
-            }
-            fprintf(stdout, "%s", inbuf);
-         }
-      } /* endwhile */
-      fclose(fp);
+      return -1;
    } /* endif */
 
-   free(tmpname);
-   free(outname);
-   return rc;
-} /* end ReadSetting() */
+   for (;;) {
+      if (ValueSize - got < 1024) {
+         ValueSize = ValueSize ? ValueSize * 2 : 4096;
+         ValueBuf = realloc(ValueBuf, ValueSize);
+      } /* endif */
+      n = read(fd, ValueBuf + got, ValueSize - got);
+      if (n <= 0)
+         break;      /* a read error just ends it, as it always has */
+      got += n;
+   } /* endfor */
+   close(fd);
+
+   /* in pieces, as fgets() into a 1024 byte buffer would give them */
+   for (at = 0; at < got; at = end) {
+      char *nl = memchr(ValueBuf + at, '\n', got - at);
+      end = nl ? (size_t)(nl - ValueBuf) + 1 : got;
+      if (end - at > 1023)
+         end = at + 1023;
+      if (PrintName) {
+         fprintf(stdout, "%s = ", outname);
+         fwrite(ValueBuf + at, 1, end - at, stdout);
+      } else {
+         size_t len = end - at;
+         if (!PrintNewline && ValueBuf[end - 1] == '\n')
+            len--;
+         fwrite(ValueBuf + at, 1, len, stdout);
+      } /* endif */
+   } /* endfor */
+   return 0;
+} /* end ShowValue() */
 
 
 
 /*
- *     Display all the sysctl settings 
+ *     Walk the directory at `dfd', whose path under /proc/sys is `key'
+ *     (of length `len', without the trailing slash)
  *
  */
-static int DisplayAll(const char *path, bool ShowTableUtil) {
-   int rc = 0;
-   int rc2;
+static void DisplayDir(int dfd, char *key, size_t len, bool ShowTableUtil) {
    DIR *dp;
    struct dirent *de;
-   char *tmpdir;
    struct stat ts;
+   size_t namelen;
+   int isdir, sub;
 
-   dp = opendir(path);
+   if (!(dp = fdopendir(dfd))) {
+      close(dfd);
+      return;
+   } /* endif */
+   while (( de = readdir(dp) )) {
+      if (de->d_name[0] == '.' && (!de->d_name[1]
+       || (de->d_name[1] == '.' && !de->d_name[2])))
+         continue;                       /* skip . and .. */
+      namelen = strlen(de->d_name);
+      if (len + namelen + 2 >= sizeof OutName - strlen(PROC_PATH))
+         continue;
+      memcpy(key + len, de->d_name, namelen + 1);
 
-   if (!dp) {
-      fprintf(stderr, ERR_OPENING_DIR, path);
-      rc = -1;
-   } else {
-      readdir(dp); readdir(dp);   /* skip . and .. */
-      while (( de = readdir(dp) )) {
-         tmpdir = (char *)malloc(strlen(path)+strlen(de->d_name)+2);
-         sprintf(tmpdir, "%s%s", path, de->d_name);
-         rc2 = stat(tmpdir, &ts);       /* should check this return code */
-         if (rc2 != 0) {
-            perror(tmpdir);
-         } else {
-            if (S_ISDIR(ts.st_mode)) {
-               strcat(tmpdir, "/");
-               DisplayAll(tmpdir, ShowTableUtil);
-            } else {
-               rc |= ReadSetting(tmpdir+strlen(PROC_PATH));
-            } /* endif */
+      isdir = de->d_type == DT_DIR;
+      if (de->d_type == DT_UNKNOWN || de->d_type == DT_LNK) {
+         if (fstatat(dfd, de->d_name, &ts, 0) != 0) {
+            perror(KeyPath);
+            continue;
          } /* endif */
-         free(tmpdir);
-      } /* end while */
-      closedir(dp);
+         isdir = S_ISDIR(ts.st_mode);
+      } /* endif */
+
+      if (isdir) {
+         sub = openat(dfd, de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+         key[len + namelen] = '/';
+         key[len + namelen + 1] = 0;
+         if (sub < 0)
+            fprintf(stderr, ERR_OPENING_DIR, KeyPath);
+         else
+            DisplayDir(sub, key, len + namelen + 1, ShowTableUtil);
+      } else {
+         memcpy(OutName, key, len + namelen + 1);
+         slashdot(OutName,'/','.'); /* change / to . */
+         ShowValue(openat(dfd, de->d_name, O_RDONLY | O_CLOEXEC), OutName);
+      } /* endif */
+   } /* end while */
+   closedir(dp);
+} /* end DisplayDir() */
+
+
+
+/*
+ *     Display all the sysctl settings 
+ *
+ */
+static int DisplayAll(const char *path, bool ShowTableUtil) {
+   size_t len = strlen(path);
+   int dfd;
+
+   dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+   if (dfd < 0) {
+      fprintf(stderr, ERR_OPENING_DIR, path);
+      return -1;
    } /* endif */
 
-   return rc;
+   memcpy(KeyPath, path, len + 1);
+   DisplayDir(dfd, KeyPath + len, 0, ShowTableUtil);
+   return 0;
 } /* end DisplayAll() */
-
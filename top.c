@@ -46,6 +46,8 @@
 #include "proc/devname.h"
         /* need: (ksym.c) open_psdb_message, wchan, close_psdb (redhat only) */
 #include "proc/procps.h"
+        /* need: prof_take, prof_report + the PROF_ macros */
+#include "proc/prof.h"
         /* need: 2 types + openproc, readproc, closeproc */
 #include "proc/readproc.h"
         /* need: signal_name_to_number */
@@ -60,6 +62,8 @@
 #include "proc/version.h"
         /* need: sprint_uptime */
 #include "proc/whattime.h"
+        /* need: snap_create, snap_write, snap_open, snap_read */
+#include "proc/snapfile.h"
 
 #include "top.h"
 
@@ -77,6 +81,9 @@ static char *Myname;
 static char  RCfile [OURPATHSZ];
         /* The run-time acquired page size */
 static int  Page_size;
+        /* ...and clock tick rate -- our own, so a replay can have its own */
+#undef  Hertz
+static unsigned long long Hertz;
 
         /* SMP, Irix/Solaris mode, Linux 2.5.xx support */
 static int   Cpu_tot,
@@ -88,6 +95,17 @@ static const char *States_fmts = STATES_line2x4;
 static pid_t  Monpids [MONPIDMAX] = { 0 };
 static int    Monpidsidx = 0;
 
+        /* Recording (-w) and replay (-R) -- a replay's frames come from
+           its file, and Snap_frame holds what it says of the machine */
+static snap_writer *Snap_out;
+static snap_reader *Snap_in;
+static snap_sys     Snap_frame;
+static proc_t     **Snap_tab;
+static int          Snap_n,
+                    Snap_at,            /* the frame to show next...    */
+                    Snap_shown = -2,    /* ...and the one shown last    */
+                    Snap_frames;
+
         /* A postponed error message */
 static char  Msg_delayed [SMLBUFSIZ];
 static int   Msg_awaiting = 0;
@@ -116,7 +134,11 @@ static float  Delay_time = DEF_DELAY;  /* how long to sleep between updates  */
 static int  No_ksyms = -1,      /* set to '0' if ksym avail, '1' otherwise   */
             PSDBopen = 0,       /* set to '1' if psdb opened (now postponed) */
             Batch = 0,          /* batch mode, collect no input, dumb output */
+            Batch_fmt = 0,      /* batch records ('c'sv or 'j'son), not text */
             Loops = -1,         /* number of iterations, -1 loops forever    */
+            Incr_mode = 0,      /* set if unchanged tasks are only re-stat'd */
+            Thread_mode = 0,    /* 'H' - set if each thread shows as a task  */
+            Cgroup_mode = 0,    /* 'C' - set if each cgroup shows as a task  */
             Secure_mode = 0;    /* set if some functionality restricted      */
 
         /* Some cap's stuff to reduce runtime calls --
@@ -151,6 +173,22 @@ static float  Frame_tscale;     /* so we can '*' vs. '/' WHEN 'pcpu' */
 static int    Frame_srtflg,     /* the subject window sort direction */
               Frame_ctimes,     /* the subject window's ctimes flag  */
               Frame_cmdlin;     /* the subject window's cmdlin flag  */
+static proc_cols Frame_cols;    /* the hot fields, in proc table order */
+static QSORT_t Frame_sort;      /* for sort_col_cold, the real thing */
+
+        /* The windows' sorted views, of which GROUPSMAX will do, and the
+           frame they're good for -- bumped whenever Frame_cols is packed */
+static SORTV_t Sort_views [GROUPSMAX];
+static int     Sort_gen;
+
+        /* The cgroup rollups, which outlive a frame (so Roll_frame tells
+           a new one from an old), and their hash -- see roll_begin */
+static ROLL_t  *Roll_tab;       /* Roll_n used, of Roll_siz            */
+static int      Roll_n, Roll_siz;
+static int     *Roll_hash;      /* chain heads into Roll_tab, by key   */
+static int      Roll_hsiz;      /* number of buckets, a power of 2     */
+static int      Roll_frame;     /* the pass now being rolled up        */
+static proc_t **Roll_ppt;       /* what Frame_cols is packed from      */
         /* ////////////////////////////////////////////////////////////// */
 
 
@@ -218,6 +256,31 @@ static int sort_P_CMD (const proc_t **P, const proc_t **Q)
 _SC_NUM1(P_WCH, wchan)
 _SC_NUM1(P_FLG, flags)
 
+        /*
+         * The packed column versions, for sort_frame -- each must give
+         * exactly the results of its namesake above. */
+_SC_COLx(P_PID, pid)
+_SC_COLx(P_PPD, ppid)
+_SC_COLx(P_NCE, nice)
+_SC_COL1(P_CPU, pcpu)
+_SC_COLx(P_STA, state)
+
+                                        /* no ctimes, and so no proc_t */
+static int sort_col_P_TME (const int *P, const int *Q)
+{
+   if ( (Frame_cols.utime[*P] + Frame_cols.stime[*P])
+      < (Frame_cols.utime[*Q] + Frame_cols.stime[*Q]) ) return SORT_lt;
+   if ( (Frame_cols.utime[*P] + Frame_cols.stime[*P])
+      > (Frame_cols.utime[*Q] + Frame_cols.stime[*Q]) ) return SORT_gt;
+   return SORT_eq;
+}
+
+                                        /* any other field... */
+static int sort_col_cold (const int *P, const int *Q)
+{
+   return Frame_sort(&Frame_cols.cold[*P], &Frame_cols.cold[*Q]);
+}
+
 
 /*######  Tiny useful routine(s)  ########################################*/
 
@@ -285,6 +348,307 @@ static const char *tg2 (int x, int y)
 }
 
 
+/*######  Screen Output routines  ########################################*/
+
+        /* A frame isn't sent as it's drawn.  All that so_lets_see_em puts
+           out gets caught here, row by row, and at frame's end just those
+           spans of a row that differ from the last frame go out -- cursor
+           addressed, and all in one write.  Whoever else writes to the
+           screen must zap Scr_valid, so the next frame gets sent whole. */
+static SROW_t *Scr_now, *Scr_was;       /* this frame's rows, last frame's */
+static int     Scr_nrows;               /* how many of each                */
+static int     Scr_row = -1;            /* row being caught, -1 when not   */
+static int     Scr_valid;               /* Scr_was is what's on the screen */
+static char   *Scr_buf;                 /* what we'll send at frame's end  */
+static int     Scr_len, Scr_siz;
+
+static void *alloc_r (void *q, unsigned numb);  /* it's further down */
+
+
+        /*
+         * Add to what goes out at frame's end */
+static void scr_add (const char *str, int len)
+{
+   if (Scr_len + len > Scr_siz) {
+      Scr_siz = (Scr_len + len) * 2;
+      Scr_buf = alloc_r(Scr_buf, Scr_siz);
+   }
+   memcpy(Scr_buf + Scr_len, str, len);
+   Scr_len += len;
+}
+
+
+        /*
+         * Send what's been added, in one write (if the tty allows) */
+static void scr_flush (void)
+{
+   int i, len;
+
+   fflush(stdout);
+   for (i = 0; i < Scr_len; ) {
+      len = write(STDOUT_FILENO, Scr_buf + i, Scr_len - i);
+      if (0 > len) {
+         if (EINTR == errno) continue;
+         break;
+      }
+      i += len;
+   }
+   Scr_len = 0;
+}
+
+
+        /*
+         * tputs wants a function, for anything it would send */
+static int scr_outb (int c)
+{
+   char ch = c;
+
+   scr_add(&ch, 1);
+   return c;
+}
+
+
+        /*
+         * Send a terminfo string at frame's end, delays 'n all */
+static void scr_send (const char *str)
+{
+   tputs(str, 1, scr_outb);
+}
+
+
+        /*
+         * tputs wants a function -- and this one catches the frame */
+static int scr_outc (int c)
+{
+   SROW_t *r;
+
+   if (Scr_row < Scr_nrows) {
+      if ('\n' == c) ++Scr_row;
+      else {
+         r = &Scr_now[Scr_row];
+         if (r->len >= r->siz) {
+            r->siz = r->siz * 2 + ROWBUFSIZ;
+            r->txt = alloc_r(r->txt, r->siz);
+         }
+         r->txt[r->len++] = c;
+      }
+   }
+   return c;
+}
+
+
+        /*
+         * Everybody's putp -- headed for the screen, or for Scr_now */
+static void scr_putp (const char *str)
+{
+   if (0 > Scr_row) putp(str);
+   else tputs(str, 1, scr_outc);
+}
+
+
+        /*
+         * How long is the escape sequence at str? (never more than max) */
+static int scr_esclen (const char *str, int max)
+{
+   int i;
+
+   if (2 < max && '[' == str[1]) {
+      for (i = 2; i < max; i++)
+         if (0x40 <= str[i] && 0x7e >= str[i]) return i + 1;
+      return max;
+   }
+   if (2 < max && strchr("()*+", str[1])) return 3;
+   return 2 < max ? 2 : max;
+}
+
+
+        /*
+         * Split a row into the characters it shows, each with a hash of
+         * every escape sequence before it -- so two cells alike really do
+         * look alike.  Returns -1 if the row's columns can't be known. */
+static int scr_cells (const SROW_t *r, SCEL_t *cel)
+{
+   unsigned hue = 0;
+   int i = 0, n = 0;
+
+   while (i < r->len) {
+      unsigned char c = r->txt[i];
+
+      if ('\033' == c) {
+         int len = scr_esclen(r->txt + i, r->len - i);
+         while (len--) hue = hue * 31 + (unsigned char)r->txt[i++];
+         continue;
+      }
+      if (' ' > c || '~' < c) return -1;
+      cel[n].ch = c;
+      cel[n].hue = hue;
+      cel[n].off = i++;
+      ++n;
+   }
+   return n;
+}
+
+
+        /*
+         * Send cells x (included) thru end (excluded) of row y */
+static void scr_span (const SROW_t *r, const SCEL_t *cel, int n, int x, int end, int y)
+{
+   int i = 0, stop;
+
+   scr_send(tg2(x, y));
+   scr_send(Caps_off);
+      /* replay whatever escapes came ahead of x, so x looks as it should */
+   while (i < cel[x].off) {
+      if ('\033' == r->txt[i]) {
+         int len = scr_esclen(r->txt + i, r->len - i);
+         scr_add(r->txt + i, len);
+         i += len;
+      } else
+         ++i;
+   }
+   stop = end < n ? cel[end].off : r->len;
+   scr_add(r->txt + cel[x].off, stop - cel[x].off);
+}
+
+
+        /*
+         * Send what's changed in row y -- maybe all of it */
+static void scr_diff (int y)
+{
+#define SCR_GAP  8                      /* alike cells cheaper to resend */
+   static SCEL_t *now, *was;
+   static int     siz;
+   SROW_t *n = &Scr_now[y], *w = &Scr_was[y];
+   int nn, nw, x, end, alike, i;
+
+   if (n->len >= siz || w->len >= siz) {
+      siz = (n->len > w->len ? n->len : w->len) + ROWBUFSIZ;
+      now = alloc_r(now, sizeof(SCEL_t) * siz);
+      was = alloc_r(was, sizeof(SCEL_t) * siz);
+   }
+   nn = scr_cells(n, now);
+   nw = Scr_valid ? scr_cells(w, was) : -1;
+   if (0 > nn || 0 > nw) {
+      scr_send(tg2(0, y));
+      scr_add(n->txt, n->len);
+      scr_send(Cap_clr_eol);
+      return;
+   }
+#define ALIKE(i) ((i) < nw && now[i].ch == was[i].ch && now[i].hue == was[i].hue)
+   x = 0;
+   while (x < nn) {
+      if (ALIKE(x)) {
+         ++x;
+         continue;
+      }
+         /* a change: it runs 'til SCR_GAP cells in a row haven't */
+      for (end = x + 1, alike = 0, i = x + 1; i < nn && SCR_GAP > alike; i++) {
+         if (ALIKE(i)) ++alike;
+         else {
+            alike = 0;
+            end = i + 1;
+         }
+      }
+      scr_span(n, now, nn, x, end, y);
+      x = end;
+   }
+   if (nw > nn) {                       /* the old row's leftovers must go */
+      scr_send(tg2(nn, y));
+      scr_send(Caps_off);
+      scr_send(Cap_clr_eol);
+   }
+#undef ALIKE
+#undef SCR_GAP
+}
+
+
+        /*
+         * Drop a row's clr_eol's, we'll be the judge of that */
+static void scr_unclr (SROW_t *r)
+{
+   int len = strlen(Cap_clr_eol), i, j;
+
+   if (!len) return;
+   for (i = j = 0; i < r->len; ) {
+      if (i + len <= r->len && !memcmp(r->txt + i, Cap_clr_eol, len))
+         i += len;
+      else
+         r->txt[j++] = r->txt[i++];
+   }
+   r->len = j;
+}
+
+
+        /*
+         * Start catching a frame (if we can) in place of homing the cursor */
+static void scr_begin (void)
+{
+   int i;
+
+   if (Batch || !Cap_can_goto) {
+      putp(Batch ? "\n\n" : Cap_home);
+      return;
+   }
+   if (Scr_nrows != Screen_rows) {
+      for (i = 0; i < Scr_nrows; i++) {
+         free(Scr_now[i].txt);
+         free(Scr_was[i].txt);
+      }
+      Scr_nrows = Screen_rows;
+      Scr_now = alloc_r(Scr_now, sizeof(SROW_t) * Scr_nrows);
+      Scr_was = alloc_r(Scr_was, sizeof(SROW_t) * Scr_nrows);
+      memset(Scr_now, 0, sizeof(SROW_t) * Scr_nrows);
+      memset(Scr_was, 0, sizeof(SROW_t) * Scr_nrows);
+      Scr_valid = 0;
+   }
+   for (i = 0; i < Scr_nrows; i++)
+      Scr_now[i].len = 0;
+   Scr_row = 0;
+}
+
+
+        /*
+         * Put the cursor at the start of row y */
+static void scr_goto (int y)
+{
+   if (0 > Scr_row) putp(tg2(0, y));
+   else Scr_row = y;
+}
+
+
+        /*
+         * The frame's done:  clear what's below it, leave the cursor at
+         * the start of row y and send what's changed */
+static void scr_end (int y)
+{
+   SROW_t *tmp;
+   int i;
+
+   if (0 > Scr_row) {
+      PUTP("%s%s%s", Cap_clr_eos, tg2(0, y), Cap_clr_eol);
+      fflush(stdout);
+      return;
+   }
+   Scr_row = -1;
+   Scr_len = 0;
+   for (i = 0; i < Scr_nrows; i++) {
+      scr_unclr(&Scr_now[i]);
+      if (Scr_valid
+      && Scr_now[i].len == Scr_was[i].len
+      && !memcmp(Scr_now[i].txt, Scr_was[i].txt, Scr_now[i].len))
+         continue;
+      scr_diff(i);
+   }
+   scr_send(Caps_off);
+   scr_send(tg2(0, y));
+   scr_flush();
+   tmp = Scr_was;
+   Scr_was = Scr_now;
+   Scr_now = tmp;
+   Scr_valid = 1;
+}
+
+
 /*######  Exit/Interrput routines  #######################################*/
 
         /*
@@ -294,9 +658,11 @@ static void bye_bye (int eno, const char *str)
 {
    if (!Batch)
       tcsetattr(STDIN_FILENO, TCSAFLUSH, &Savedtty);
-   putp(tg2(0, Screen_rows));
-   putp(Cap_curs_norm);
-   putp("\n");
+   if (!Batch_fmt) {                    /* records end with their own '\n' */
+      putp(tg2(0, Screen_rows));
+      putp(Cap_curs_norm);
+      putp("\n");
+   }
 
 #ifdef ATEOJ_REPORT
    fprintf(stderr,
@@ -406,6 +772,7 @@ static void suspend (int dont_care_sig)
    putp(tg2(0, Screen_rows));
    putp(Cap_curs_norm);
    fflush(stdout);
+   Scr_valid = 0;
    raise(SIGSTOP);
       /* later, after SIGCONT... */
    if (!Batch)
@@ -507,6 +874,7 @@ static void show_msg (const char *str)
       , Caps_off
       , Cap_clr_eol);
    fflush(stdout);
+   Scr_valid = 0;
    sleep(MSG_SLEEP);
    Msg_awaiting = 0;
 }
@@ -759,7 +1127,11 @@ static void time_elapsed (void)
     struct timezone timez;
     float et;
 
-    gettimeofday(&timev, &timez);
+    if (Snap_in) {
+       timev.tv_sec = Snap_frame.sec;
+       timev.tv_usec = Snap_frame.usec;
+    } else
+       gettimeofday(&timev, &timez);
     et = (timev.tv_sec - oldtimev.tv_sec)
        + (float)(timev.tv_usec - oldtimev.tv_usec) / 1000000.0;
     oldtimev.tv_sec = timev.tv_sec;
@@ -805,39 +1177,45 @@ static void *alloc_r (void *q, unsigned numb)
          *    cpus[Cpu_tot]        == tics from the 1st /proc/stat line */
 static CPUS_t *refreshcpus (CPUS_t *cpus)
 {
-   static FILE *fp = NULL;
+   char *line, *eol;
    int i;
-      /* enough for a /proc/stat CPU line (not the intr line) */
-   char buf[SMLBUFSIZ];
-
-      /* by opening this file once, we'll avoid the hit on minor page faults
-         (sorry Linux, but you'll have to close it for us) */
-   if (!fp) {
-      if (!(fp = fopen("/proc/stat", "r")))
-         std_err(fmtmk("Failed /proc/stat open: %s", strerror(errno)));
+
+      /* the library keeps /proc/stat open for us (along with the other
+         files it parses), and hands it back whole from a single pread */
+   if (!cpus) {
       /* note: we allocate one more CPUS_t than Cpu_tot so that the last slot
                can hold tics representing the /proc/stat cpu summary (the first
                line read) -- that slot supports our View_CPUSUM toggle */
       cpus = alloc_c((1 + Cpu_tot) * sizeof(CPUS_t));
    }
-   rewind(fp);
-   fflush(fp);
+      /* a replay's tics are laid out just as ours (the sum last) */
+   if (Snap_in) {
+      for (i = 0; i <= Cpu_tot; i++) {
+         const unsigned long long *t = &Snap_frame.cpus[5 * i];
+         cpus[i].u = t[0]; cpus[i].n = t[1]; cpus[i].s = t[2];
+         cpus[i].i = t[3]; cpus[i].w = t[4];
+      }
+      return cpus;
+   }
+   line = sysinfo_file(SYSINFO_STAT, NULL);
 
       /* first value the last slot with the cpu summary line */
-   if (!fgets(buf, sizeof(buf), fp)) std_err("failed /proc/stat read");
-   if (4 > sscanf(buf, CPU_FMTS_JUST1
+   if ((eol = strchr(line, '\n'))) *eol = '\0';
+   if (4 > sscanf(line, CPU_FMTS_JUST1
       , &cpus[Cpu_tot].u, &cpus[Cpu_tot].n, &cpus[Cpu_tot].s, &cpus[Cpu_tot].i, &cpus[Cpu_tot].w))
          std_err("failed /proc/stat read");
       /* and just in case we're 2.2.xx compiled without SMP support... */
    if (1 == Cpu_tot) memcpy(cpus, &cpus[1], sizeof(CPUS_t));
 
-      /* and now value each separate cpu's tics */
+      /* and now value each separate cpu's tics -- a line at a time, cut
+         off at its end so sscanf needn't measure all of the rest */
    for (i = 0; 1 < Cpu_tot && i < Cpu_tot; i++) {
-#ifdef PRETEND4CPUS
-      rewind(fp);
+#ifndef PRETEND4CPUS
+      if (!eol) std_err("failed /proc/stat read");
+      line = eol + 1;
+      if ((eol = strchr(line, '\n'))) *eol = '\0';
 #endif
-      if (!fgets(buf, sizeof(buf), fp)) std_err("failed /proc/stat read");
-      if (4 > sscanf(buf, CPU_FMTS_MULTI
+      if (4 > sscanf(line, CPU_FMTS_MULTI
          , &cpus[i].u, &cpus[i].n, &cpus[i].s, &cpus[i].i, &cpus[i].w))
             std_err("failed /proc/stat read");
    }
@@ -849,26 +1227,110 @@ static CPUS_t *refreshcpus (CPUS_t *cpus)
         /*
          * This guy's modeled on libproc's 'readproctab' function except
          * we reuse and extend any prior proc_t's.  He's been customized
-         * for our specific needs and to avoid the use of <stdarg.h> */
+         * for our specific needs and to avoid the use of <stdarg.h>
+         * The PROCTAB itself persists (along with the /proc files it
+         * holds open) for as long as we keep asking for the same flags. */
 static proc_t **refreshprocs (proc_t **table, int flags)
 {
 #define PTRsz  sizeof(proc_t *)         /* eyeball candy */
 #define ENTsz  sizeof(proc_t)
    static unsigned savmax = 0;          /* first time, Bypass: (i)  */
+   static PROCTAB *PT = NULL;
+   static int PT_flags;
+   static unsigned incsiz = 0;          /* (o) table's room, incr mode */
+   static proc_t eot;                   /* (o) likewise, its 'eot'  */
    proc_t *ptsk = (proc_t *)-1;         /* first time, Force: (ii)  */
    unsigned curmax = 0;                 /* every time  (jeeze)      */
-   PROCTAB* PT;
 
-   if (Monpidsidx) {
-      PT = openproc(flags | PROC_PID, Monpids);
-         /* work around a previous bug in openproc (now corrected) */
-      PT->procfs = NULL;
-   } else
-      PT = openproc(flags);
+   if (Thread_mode) flags |= PROC_TASKS;
+   if (Cgroup_mode) flags |= PROC_FILLCGROUP;
+
+      /* o) Replays:  the tasks are the reader's, we just point at them
+            (while 'savmax' stays 0, so there's nothing of ours to free) */
+   if (Snap_in) {
+      static proc_t reot;
+      int i;
+
+      table = alloc_r(table, (Snap_n + 1) * PTRsz);
+      for (i = 0; i < Snap_n; i++) {
+         if (Monpidsidx) {
+            int j;
+            for (j = 0; j < Monpidsidx && Monpids[j] != Snap_tab[i]->pid; j++)
+               ;
+            if (j == Monpidsidx) continue;
+         }
+         table[curmax++] = Snap_tab[i];
+      }
+      reot.pid = -1;
+      table[curmax] = &reot;
+      return table;
+   }
+
+      /* o) Big smp frames:  toss the *Existing* table, read a new one
+            with threads (the last frame's size being our best guess) */
+   if (!Incr_mode && Cpu_tot > 1 && Frame_maxtask >= THREADMIN) {
+         /* the serial table's open files would just sit there -- should
+            we come back, it's simply reopened */
+      if (PT) {
+         closeproc(PT);
+         PT = NULL;
+      }
+      while (curmax < savmax) freeproc(table[curmax++]);
+      free(table);
+      if (Monpidsidx)
+         table = readproctab_parallel(flags | PROC_PID, Cpu_tot, Monpids);
+      else
+         table = readproctab_parallel(flags | PROC_LIVE, Cpu_tot);
+      if (!table) std_err("failed /proc read");
+      for (curmax = 0; table[curmax]; curmax++)
+         ;
+      savmax = 0;                       /* force: (iii)             */
+      goto eot_entry;
+   }
+
+   if (PT && flags != PT_flags) {
+      closeproc(PT);
+      PT = NULL;
+   }
+   if (!PT) {
+      int o_flags = flags | PROC_PERSIST | PROC_LIVE
+                  | (Incr_mode ? PROC_INCR : PROC_ARENA);
+
+      PT_flags = flags;
+      if (Monpidsidx)
+         PT = openproc(o_flags | PROC_PID, Monpids);
+      else
+         PT = openproc(o_flags);
+      if (!PT) std_err("failed /proc open");
+   }
+
+      /* o) Incremental frames:  the proc_t's now belong to the PROCTAB, which
+            keeps them by pid and re-reads just stat/statm for the tasks that
+            haven't changed -- so any we owned are tossed, then we merely
+            collect pointers (and 'incsiz' tracks the room for them) */
+   if (Incr_mode) {
+      if (savmax) {
+         while (curmax < savmax) freeproc(table[curmax++]);
+         savmax = incsiz = curmax = 0;
+      }
+      while ((ptsk = readproc(PT, NULL))) {
+         if (curmax + 1 >= incsiz) {
+            incsiz = incsiz * 2 + 256;
+            table = alloc_r(table, incsiz * PTRsz);
+         }
+         table[curmax++] = ptsk;
+      }
+      if (!table) table = alloc_r(NULL, (incsiz = 1) * PTRsz);
+      eot.pid = -1;
+      table[curmax] = &eot;
+      return table;
+   }
+      /* last frame's cmdlines (at least those in the arena) are history */
+   resetproc(PT);
 
       /* i) Allocated Chunks:  *Existing* table;  refresh + reuse */
    while (curmax < savmax) {
-      if (table[curmax]->cmdline) {
+      if (table[curmax]->cmdline && !(table[curmax]->arena & ARENA_VECS)) {
          free(*table[curmax]->cmdline);
          table[curmax]->cmdline = NULL;
       }
@@ -876,16 +1338,20 @@ static proc_t **refreshprocs (proc_t **table, int flags)
       ++curmax;
    }
 
-      /* ii) Unallocated Chunks:  *New* or *Existing* table;  extend + fill */
+      /* ii) Unallocated Chunks:  *New* or *Existing* table;  extend + fill
+             (the proc_t's are ours, since they outlive the arena's frame) */
    while (ptsk) {
-         /* realloc as we go, keeping 'table' ahead of 'currmax++' */
-      table = alloc_r(table, (curmax + 1) * PTRsz);
-         /* here, readproc will allocate the underlying proc_t stg */
-      if ((ptsk = readproc(PT, NULL)))
-         table[curmax++] = ptsk;
+      if (curmax >= savmax) {
+            /* realloc as we go, keeping 'table' ahead of 'currmax++' */
+         table = alloc_r(table, (curmax + 1) * PTRsz);
+         table[curmax] = alloc_c(ENTsz);
+         savmax = curmax + 1;
+      }
+      if ((ptsk = readproc(PT, table[curmax])))
+         ++curmax;
    }
-   closeproc(PT);
 
+eot_entry:
       /* iii) Chunkless:  make 'eot' entry, after possible extension */
    if (curmax >= savmax) {
       table = alloc_r(table, (curmax + 1) * PTRsz);
@@ -902,6 +1368,167 @@ static proc_t **refreshprocs (proc_t **table, int flags)
 }
 
 
+/*######  Record/Replay routines  ########################################*/
+
+        /*
+         * Start recording to 'path' (-w), adding to what it holds already */
+static void record_open (const char *path)
+{
+   if (!(Snap_out = snap_create(path, (unsigned)Hertz, (unsigned)Page_size, (unsigned)Cpu_tot)))
+      std_err(fmtmk("can't record to '%s': %s", path
+         , EINVAL == errno ? "another machine's recording" : strerror(errno)));
+}
+
+
+        /*
+         * Replay 'path' (-R) -- the machine is then the one recorded, as far
+         * as Hertz, the page size and the cpus go */
+static void replay_open (const char *path)
+{
+   snap_info info;
+   int i;
+
+   if (!(Snap_in = snap_open(path, &info)))
+      std_err(fmtmk("can't replay '%s': %s", path
+         , EINVAL == errno ? "not a recording" : strerror(errno)));
+   if (!info.frames)
+      std_err(fmtmk("nothing recorded in '%s'", path));
+   Snap_frames = (int)info.frames;
+   Hertz = info.hertz;
+   Page_size = (int)info.page_size;
+   Cpu_tot = (int)info.ncpus;
+   Cpu_map = alloc_r(Cpu_map, sizeof(int) * Cpu_tot);
+   for (i = 0; i < Cpu_tot; i++)
+      Cpu_map[i] = i;
+}
+
+
+        /*
+         * Make frame 'frame' of a replay the one the next refreshprocs,
+         * refreshcpus and the like see -- 0, or -1 if there's no such frame. */
+static int replay_load (int frame)
+{
+   if (0 > frame || frame >= Snap_frames) return -1;
+   if (!(Snap_tab = snap_read(Snap_in, (unsigned)frame, &Snap_frame, &Snap_n)))
+      std_err(fmtmk("failed replay, frame %d", frame));
+   return 0;
+}
+
+
+        /*
+         * Move a replay along:  a frame on, unless there's none yet (a file
+         * still being written gets looked at again) -- which in Batch mode,
+         * with nothing more to come, is the end of it. */
+static void replay_next (void)
+{
+   if (Snap_at != Snap_shown) return;   /* they've asked for some other */
+   if (Snap_at + 1 >= Snap_frames)
+      Snap_frames = (int)snap_reopen(Snap_in);
+   if (Snap_at + 1 < Snap_frames)
+      ++Snap_at;
+   else if (Batch)
+      stop(0);
+}
+
+
+        /*
+         * Seek a replay by 'by' frames from the one being shown, as
+         * the '[', ']', '{' and '}' keys do. */
+static void replay_seek (int by)
+{
+   if (!Snap_in) {
+      show_msg("\aOnly when replaying (-R)");
+      return;
+   }
+   Snap_at = Snap_shown + by;
+   if (0 > Snap_at) Snap_at = 0;
+   if (Snap_at >= Snap_frames) Snap_at = Snap_frames - 1;
+   show_msg(fmtmk("Frame %d of %d", Snap_at + 1, Snap_frames));
+}
+
+
+        /*
+         * Append this frame to the recording -- the tasks as they came from
+         * refreshprocs, the cpus' tics, memory, and the uptime line's parts
+         * (all but the tasks read afresh, since a frame needn't show them) */
+static void record_frame (proc_t **ppt)
+{
+   static CPUS_t *cpus;
+   static unsigned long long *tics;
+   struct timeval tv;
+   double idle;
+   snap_sys sys;
+   int i;
+
+   cpus = refreshcpus(cpus);
+   if (!tics) tics = alloc_c(5 * (1 + Cpu_tot) * sizeof(*tics));
+   for (i = 0; i <= Cpu_tot; i++) {
+      tics[5 * i]     = cpus[i].u; tics[5 * i + 1] = cpus[i].n;
+      tics[5 * i + 2] = cpus[i].s; tics[5 * i + 3] = cpus[i].i;
+      tics[5 * i + 4] = cpus[i].w;
+   }
+   meminfo();
+   gettimeofday(&tv, NULL);
+   sys.sec = tv.tv_sec;
+   sys.usec = tv.tv_usec;
+   uptime(&sys.uptime, &idle);
+   loadavg(&sys.loadavg[0], &sys.loadavg[1], &sys.loadavg[2]);
+   sys.users = uptime_users();
+   sys.main_total = kb_main_total;  sys.main_used = kb_main_used;
+   sys.main_free = kb_main_free;    sys.main_buffers = kb_main_buffers;
+   sys.main_cached = kb_main_cached;
+   sys.swap_total = kb_swap_total;  sys.swap_used = kb_swap_used;
+   sys.swap_free = kb_swap_free;
+   sys.cpus = tics;
+   if (-1 == snap_write(Snap_out, &sys, ppt, Frame_maxtask))
+      std_err(fmtmk("failed recording: %s", strerror(errno)));
+}
+
+
+static void frame_states (proc_t **ppt, int show);  /* it's further down */
+
+        /*
+         * Ready the replay's next frame -- after a jump (or at the start),
+         * first putting the one before through frame_states unseen, since
+         * %CPU and the cpu states are measured from there. */
+static void replay_prime (proc_t ***p_table, int flags)
+{
+   if (Snap_at != Snap_shown + 1 && !replay_load(Snap_at - 1)) {
+      *p_table = refreshprocs(*p_table, flags);
+      frame_states(*p_table, 0);
+   }
+   replay_load(Snap_at);
+   Snap_shown = Snap_at;
+}
+
+
+        /*
+         * Refresh the memory numbers -- from /proc, or the replay's frame */
+static void refreshmem (void)
+{
+   if (!Snap_in) {
+      meminfo();
+      return;
+   }
+   kb_main_total = Snap_frame.main_total;  kb_main_used = Snap_frame.main_used;
+   kb_main_free = Snap_frame.main_free;    kb_main_buffers = Snap_frame.main_buffers;
+   kb_main_cached = Snap_frame.main_cached;
+   kb_swap_total = Snap_frame.swap_total;  kb_swap_used = Snap_frame.swap_used;
+   kb_swap_free = Snap_frame.swap_free;
+}
+
+
+        /*
+         * The uptime line's text, now or as a replay's frame had it */
+static const char *uptime_line (void)
+{
+   if (Snap_in)
+      return sprint_uptime_at((time_t)Snap_frame.sec, Snap_frame.uptime
+         , (int)Snap_frame.users, Snap_frame.loadavg);
+   return sprint_uptime();
+}
+
+
 /*######  Startup routines  ##############################################*/
 
         /*
@@ -929,6 +1556,7 @@ static void before (char *me)
 
       /* get virtual page size -- nearing huge! */
    Page_size = getpagesize();
+   Hertz = procps_hertz();
 }
 
 
@@ -1024,7 +1652,7 @@ static void parse_args (char **args)
       .  bunched args are actually handled properly and none are ignored
       .  we tolerate NO whitespace and NO switches -- maybe too tolerant? */
    static const char usage[] =
-      " -h?v | -bcisS -d delay -n iterations -p pid [,pid ...]";
+      " -h?v | -bcirsS -d delay -n iterations -p pid [,pid ...]";
    float tmp_delay = MAXFLOAT;
    char *p;
 
@@ -1084,6 +1712,9 @@ static void parse_args (char **args)
                   cp = p;
                } while (*cp);
                break;
+            case 'r':
+               Incr_mode = 1;
+               break;
             case 's':
                Secure_mode = 1;
                break;
@@ -1124,7 +1755,8 @@ process_command_line_arguments(int *argc, char **argv)
 	float tmp_delay = MAXFLOAT;
 	char *p;
 	static const char usage[] =
-      " -h?v | -bcisS -d delay -n iterations -p pid [,pid ...]";
+      " -h?v | -bcCirsS -d delay -n iterations -p pid [,pid ...] -F csv|json"
+      " -w file | -R file";
 
 	(*argc)--, av++;
 	while((*argc > 0) && ('-' == *av[0])) {
@@ -1151,6 +1783,9 @@ process_command_line_arguments(int *argc, char **argv)
 			case 'c':
 				TOGw(Curwin, Show_CMDLIN);
 				break;
+			case 'C':
+				Cgroup_mode = 1;
+				break;
 			case 'd':
 				if(*(av[0]+1)) av[0]++;
 				else if(av[1]) { 
@@ -1159,6 +1794,18 @@ process_command_line_arguments(int *argc, char **argv)
 					std_err("-d requires argument");
 				if(1 != sscanf(av[0], "%f", &tmp_delay))
 					std_err(fmtmk("bad delay '%s'", av[0]));
+				av[0] += strspn(av[0], "+- ,.1234567890") - 1;	/* past it */
+				break;
+			case 'F':
+				if (*(av[0]+1)) av[0]++;
+				else if (av[1]) {
+					av++; (*argc)--;
+				} else std_err("-F requires argument");
+				if (!strcmp(av[0], "csv")) Batch_fmt = 'c';
+				else if (!strcmp(av[0], "json")) Batch_fmt = 'j';
+				else std_err(fmtmk("bad format '%s'", av[0]));
+				Batch = 1;
+				av[0] += strlen(av[0]) - 1;
 				break;
 			case '?':
 			case 'h': case 'H':
@@ -1176,6 +1823,7 @@ process_command_line_arguments(int *argc, char **argv)
 				} else std_err("-n requires argument");
 				if(1 != sscanf(av[0], "%d", &Loops) || 1 > Loops)
 					std_err(fmtmk("bad iteration arg '%s'", av[0]));
+				av[0] += strspn(av[0], "+- ,.1234567890") - 1;
 				break;
 			case 'p':
 				do {
@@ -1195,6 +1843,23 @@ process_command_line_arguments(int *argc, char **argv)
 						break;
 					av[0] = p;
 				} while (*av[0]);
+				av[0] += strspn(av[0], "+- ,.1234567890") - 1;
+				break;
+			case 'r':
+				Incr_mode = 1;
+				break;
+			case 'R':
+			case 'w':
+				p = av[0];
+				if (*(av[0]+1)) av[0]++;
+				else if (av[1]) {
+					av++; (*argc)--;
+				} else std_err(fmtmk("-%c requires argument", *p));
+				if (Snap_in || Snap_out)
+					std_err("only one of -w and -R");
+				if ('w' == *p) record_open(av[0]);
+				else replay_open(av[0]);
+				av[0] += strlen(av[0]) - 1;
 				break;
 			case 's':
 				Secure_mode = 1;
@@ -1460,6 +2125,8 @@ static void win_colsheads (WIN_t *q)
    if (Mode_altscr) strcpy(q->columnhdr, " "); else q->columnhdr[0] = '\0';
    for (i = 0; i < q->maxpflgs; i++) {
       h = Fieldstab[q->procflags[i]].head;
+         /* a cgroup's 'pid' is the number of its tasks */
+      if (Cgroup_mode && P_PID == q->procflags[i]) h = " TSKS ";
          /* oops, won't fit -- we're outta here... */
       if (Screen_cols < (int)(strlen(q->columnhdr) + strlen(h))) break;
       strcat(q->columnhdr, h);
@@ -1479,6 +2146,8 @@ static void win_colsheads (WIN_t *q)
       , Mode_altscr ? fmtmk("%d", q->winnum) : "");
    for (i = 0; i < q->maxpflgs; i++) {
       h = Fieldstab[q->procflags[i]].head;
+         /* a cgroup's 'pid' is the number of its tasks */
+      if (Cgroup_mode && P_PID == q->procflags[i]) h = " TSKS ";
          /* are we gonna' need the kernel symbol table? */
       if (P_WCH == q->procflags[i]) needpsdb = 1;
       if (P_CMD == q->procflags[i])
@@ -1514,6 +2183,14 @@ static inline int win_fldviz (WIN_t *q, PFLG_t flg)
 }
 
 
+        /*
+         * Tell caller if a pflag is shown or sorted on, thus must be read */
+static inline int win_fldneed (WIN_t *q, PFLG_t flg)
+{
+   return q->sortindx == flg || win_fldviz(q, flg);
+}
+
+
         /*
          * Value a window's name and make the associated group name. */
 static void win_names (WIN_t *q, const char *name)
@@ -1699,6 +2376,7 @@ static void wins_resize (int dont_care_sig)
    WIN_t *w;
 
    (void)dont_care_sig;
+   Scr_valid = 0;
    Screen_cols = columns;
    Screen_rows = lines;
    if (-1 != (ioctl(STDOUT_FILENO, TIOCGWINSZ, &wz))) {
@@ -1794,6 +2472,172 @@ static void windows_stage2 (void)
 }
 
 
+/*######  Cgroup Rollup routines  #######################################*/
+
+        /*
+         * Start a pass of frame_states:  each rollup's per-frame sums go
+         * back to zero, but not its time, since that's only ever grown by
+         * the tics its tasks used since the last pass (a task that's gone
+         * took its time with it, but the cgroup still used it). */
+static void roll_begin (void)
+{
+   int i;
+
+   ++Roll_frame;
+   for (i = 0; i < Roll_n; i++) {
+      proc_t *p = &Roll_tab[i].p;
+
+      p->pid = p->pcpu = 0;
+      p->size = p->resident = p->share = p->trs = p->drs = p->dt = 0;
+      p->rss = 0;
+      p->maj_flt = 0;
+      p->cutime = p->cstime = 0;
+      p->state = 'S';
+   }
+}
+
+
+        /*
+         * Make a new rollup's hash chains -- for all Roll_n of them, since
+         * a new size (or losing some) means every key hashes anew. */
+static void roll_rehash (void)
+{
+   int i;
+
+   if (!Roll_hsiz) Roll_hsiz = 64;
+   while (Roll_n * 2 > Roll_hsiz) Roll_hsiz *= 2;
+   Roll_hash = alloc_r(Roll_hash, sizeof(int) * Roll_hsiz);
+   memset(Roll_hash, -1, sizeof(int) * Roll_hsiz);
+   for (i = 0; i < Roll_n; i++) {
+      int k = RHASH_key(Roll_tab[i].key, Roll_hsiz);
+      Roll_tab[i].lnk = Roll_hash[k];
+      Roll_hash[k] = i;
+   }
+}
+
+
+        /*
+         * Forget every rollup, for a fresh start. */
+static void roll_reset (void)
+{
+   while (Roll_n) free(Roll_tab[--Roll_n].argv[0]);
+   roll_rehash();
+}
+
+
+        /*
+         * Add a task to its cgroup's rollup, given the tics it used since
+         * the previous pass -- which is all its time for a rollup that's
+         * new, since that has none of its past yet. */
+static void roll_task (const proc_t *t, TICS_t tics)
+{
+   static const char none[] = "-";
+   const char *key = t->cgroup ? t->cgroup : none;
+   ROLL_t *r;
+   int i, k;
+
+   k = RHASH_key(key, Roll_hsiz);
+   for (i = Roll_hsiz ? Roll_hash[k] : -1; -1 != i; i = Roll_tab[i].lnk)
+      if (key == Roll_tab[i].key) break;
+
+   if (-1 == i) {
+      const char *b = strrchr(key, '/'), *e;
+
+      if (Roll_n >= Roll_siz) {
+         Roll_siz = Roll_siz * 5 / 4 + 32;
+         Roll_tab = alloc_r(Roll_tab, sizeof(ROLL_t) * Roll_siz);
+      }
+      r = &Roll_tab[i = Roll_n++];
+      memset(r, 0, sizeof(*r));
+      r->key = key;
+      r->argv[0] = strcpy(alloc_c(strlen(key) + 1), key);
+      r->born = Roll_frame;
+      r->p.state = 'S';
+         /* the name's the last of the path, less any '.scope' and such --
+            and if that's too long, what's after its last '-' (for the
+            likes of 'cri-containerd-<id>', that's what tells them apart) */
+      b = (b && b[1]) ? b + 1 : key;
+      if (!(e = strrchr(b, '.')) || e == b) e = b + strlen(b);
+      if (e - b >= (int)sizeof(r->p.cmd)) {
+         const char *d = memrchr(b, '-', e - b);
+         if (d && d + 1 < e) b = d + 1;
+      }
+      snprintf(r->p.cmd, sizeof(r->p.cmd), "%.*s", (int)(e - b), b);
+      if (Roll_n * 2 > Roll_hsiz) roll_rehash();
+      else {
+         r->lnk = Roll_hash[k];
+         Roll_hash[k] = i;
+      }
+   }
+   r = &Roll_tab[i];
+
+      /* the first task of the pass lends the rollup its user and such */
+   if (Roll_frame != r->seen) {
+      r->seen = Roll_frame;
+      r->p.ruid = t->ruid;
+      r->p.euid = t->euid;
+      memcpy(r->p.euser, t->euser, sizeof(r->p.euser));
+      memcpy(r->p.ruser, t->ruser, sizeof(r->p.ruser));
+      memcpy(r->p.egroup, t->egroup, sizeof(r->p.egroup));
+      r->p.priority = t->priority;
+      r->p.nice = t->nice;
+      r->p.processor = t->processor;
+   } else if (r->p.euid != t->euid)
+      strcpy(r->p.euser, "*");
+
+   r->p.pid++;
+   r->p.pcpu += tics;
+   r->p.utime += (Roll_frame == r->born) ? t->utime + t->stime : tics;
+   r->p.cutime += t->cutime;
+   r->p.cstime += t->cstime;
+   r->p.maj_flt += t->maj_flt;
+      /* threads share their process's memory, so it's counted just once */
+   if (!Thread_mode || t->pid == t->tgid) {
+      r->p.size += t->size;
+      r->p.resident += t->resident;
+      r->p.share += t->share;
+      r->p.trs += t->trs;
+      r->p.drs += t->drs;
+      r->p.dt += t->dt;
+      r->p.rss += t->rss;
+   }
+   if ('R' == t->state) r->p.state = 'R';
+}
+
+
+        /*
+         * End a pass:  rollups that had no tasks this time are dropped, and
+         * the rest become the 'tasks' the windows sort and show (with the
+         * hot fields packed anew, for sort_frame). */
+static void roll_end (void)
+{
+   static proc_t eot;
+   int i, n;
+
+   for (i = n = 0; i < Roll_n; i++)
+      if (Roll_frame != Roll_tab[i].seen)
+         free(Roll_tab[i].argv[0]);
+      else {
+         if (i != n) Roll_tab[n] = Roll_tab[i];
+         n++;
+      }
+   if (n != Roll_n) {
+      Roll_n = n;
+      roll_rehash();
+   }
+   Roll_ppt = alloc_r(Roll_ppt, sizeof(proc_t *) * (Roll_n + 1));
+   for (i = 0; i < Roll_n; i++) {
+         /* set here, since growing Roll_tab may have moved it */
+      Roll_tab[i].p.cmdline = Roll_tab[i].argv;
+      Roll_ppt[i] = &Roll_tab[i].p;
+   }
+   eot.pid = -1;
+   Roll_ppt[Roll_n] = &eot;
+   proccols(&Frame_cols, Roll_ppt, Roll_n);
+   ++Sort_gen;
+}
+
+
 /*######  Per-Frame Display support  #####################################*/
 
         /*
@@ -1853,24 +2697,65 @@ static void frame_states (proc_t **ppt, int show)
    static HIST_t   *hist_sav;
    static HIST_t   *hist_new;
    static unsigned  hist_siz; // number of structs
+   static int      *hash_sav; // chain heads into hist_sav, by pid
+   static int      *hash_new; // chain heads into hist_new, by pid
+   static unsigned  hash_siz; // number of buckets, always a power of 2
    unsigned         total, running, sleeping, stopped, zombie;
    HIST_t          *hist_tmp;
+   int             *hash_tmp;
+   int              roll = Cgroup_mode && !Batch_fmt; // records are per task
+   static CPUS_t   *smpcpu;
 
    // reuse memory each time around
    hist_tmp = hist_sav;
    hist_sav = hist_new;
    hist_new = hist_tmp;
+   hash_tmp = hash_sav;
+   hash_sav = hash_new;
+   hash_new = hash_tmp;
+
+      /* size everything for this frame up front, so the history and its
+         hash can't be moved out from under us in the middle of a pass */
+   for (total = 0; -1 != ppt[total]->pid; total++)
+      ;
+   if (total >= hist_siz) {
+      hist_siz = total * 5 / 4 + 100;  // grow by at least 25%
+      hist_sav = alloc_r(hist_sav, sizeof(HIST_t) * hist_siz);
+      hist_new = alloc_r(hist_new, sizeof(HIST_t) * hist_siz);
+   }
+   if (total * 2 > hash_siz) {
+      unsigned i;
+         /* keep the chains short (load <= .5), then rebuild the previous
+            frame's chains since a new size means every pid hashes anew */
+      if (!hash_siz) hash_siz = HHASH_MIN;
+      while (total * 2 > hash_siz) hash_siz *= 2;
+      hash_sav = alloc_r(hash_sav, sizeof(int) * hash_siz);
+      hash_new = alloc_r(hash_new, sizeof(int) * hash_siz);
+      memset(hash_sav, -1, sizeof(int) * hash_siz);
+      for (i = 0; i < (unsigned)Frame_maxtask; i++) {
+         int k = HHASH_key(hist_sav[i].pid, hash_siz);
+         hist_sav[i].lnk = hash_sav[k];
+         hash_sav[k] = i;
+      }
+   }
+   memset(hash_new, -1, sizeof(int) * hash_siz);
+
+      /* pack the fields the passes below (and sort_frame) live on; the
+         rest of each task stays put, behind Frame_cols.cold */
+   proccols(&Frame_cols, ppt, (int)total);
+   ++Sort_gen;
+   if (roll) roll_begin();
 
    total = running = sleeping = stopped = zombie = 0;
    time_elapsed();
 
       /* make a pass through the data to get stats */
-   while (-1 != ppt[total]->pid) {                      /* calculations //// */
+   while (total < (unsigned)Frame_cols.n) {             /* calculations //// */
       TICS_t tics;
-      proc_t *this = ppt[total];
-      int i;
+      int pid = Frame_cols.pid[total];
+      int i, k;
 
-      switch (this->state) {
+      switch (Frame_cols.state[total]) {
          case 'S':
          case 'D':
             sleeping++;
@@ -1884,28 +2769,27 @@ static void frame_states (proc_t **ppt, int show)
          case 'R':
             running++;
             break;
-      }
-      if (total+1 >= hist_siz) {
-         hist_siz = hist_siz * 5 / 4 + 100;  // grow by at least 25%
-         hist_sav = alloc_r(hist_sav, sizeof(HIST_t) * hist_siz);
-         hist_new = alloc_r(hist_new, sizeof(HIST_t) * hist_siz);
       }
          /* calculate time in this process; the sum of user time (utime)
             + system time (stime) -- but PLEASE dont waste time and effort on
             calcs and saves that go unused, like the old top! */
-      hist_new[total].pid  = this->pid;
-      hist_new[total].tics = tics = (this->utime + this->stime);
+      hist_new[total].pid  = pid;
+      hist_new[total].tics = tics = (Frame_cols.utime[total] + Frame_cols.stime[total]);
+      k = HHASH_key(pid, hash_siz);
+      hist_new[total].lnk = hash_new[k];
+      hash_new[k] = total;
 
          /* find matching entry from previous pass and make ticks elapsed */
-      for (i = 0; i < Frame_maxtask; i++) {
-         if (this->pid == hist_sav[i].pid) {
+      for (i = hash_sav[k]; -1 != i; i = hist_sav[i].lnk) {
+         if (pid == hist_sav[i].pid) {
             tics -= hist_sav[i].tics;
             break;
          }
       }
          /* we're just saving elapsed tics, to be converted into %cpu if
             this task wins it's displayable screen row lottery... */
-      this->pcpu = tics;
+      Frame_cols.pcpu[total] = Frame_cols.cold[total]->pcpu = tics;
+      if (roll) roll_task(Frame_cols.cold[total], tics);
 
       total++;
    } /* end: while 'pids' */
@@ -1914,11 +2798,9 @@ static void frame_states (proc_t **ppt, int show)
    Frame_maxtask = total;
 
    if (show) {                                          /* display ///////// */
-      static CPUS_t *smpcpu = NULL;
-
          /* display Task states */
       show_special(fmtmk(STATES_line1
-         , total, running, sleeping, stopped, zombie));
+         , Thread_mode ? "Threads" : "Tasks", total, running, sleeping, stopped, zombie));
       Msg_row += 1;
 
          /* refresh our /proc/stat data... */
@@ -1937,6 +2819,18 @@ static void frame_states (proc_t **ppt, int show)
          }
       }
    } /* end: if 'show' */
+   else if (Snap_in) {
+      int i;
+         /* a replay's jump:  the next frame's cpu states start here too */
+      smpcpu = refreshcpus(smpcpu);
+      for (i = 0; i <= Cpu_tot; i++) {
+         smpcpu[i].u_sav = smpcpu[i].u;
+         smpcpu[i].s_sav = smpcpu[i].s;
+         smpcpu[i].n_sav = smpcpu[i].n;
+         smpcpu[i].i_sav = smpcpu[i].i;
+         smpcpu[i].w_sav = smpcpu[i].w;
+      }
+   }
 }
 
 
@@ -1944,7 +2838,7 @@ static void frame_states (proc_t **ppt, int show)
          * Obtain memory information and display it. */
 static void frame_storage (void)
 {
-   meminfo();
+   refreshmem();
    if (CHKw(Curwin, View_MEMORY)) {
       show_special(fmtmk(MEMORY_line1
          , kb_main_total, kb_main_used, kb_main_free, kb_main_buffers));
@@ -2052,6 +2946,8 @@ static void show_a_task (WIN_t *q, proc_t *task)
          case P_CPU:
          {  float u = (float)task->pcpu * Frame_tscale;
 
+               /* a cgroup's share is of them all, even in Irix mode */
+            if (Cgroup_mode && Mode_irixps) u /= Cpu_tot;
             if (99.9 < u) u = 99.9;
             MKCOL(q, i, a, &pad, cbuf, u);
          }
@@ -2166,7 +3062,338 @@ static void show_a_task (WIN_t *q, proc_t *task)
 #undef MKCOL
 }
 
-
+
+        /*
+         * Sift ord[i] down the heap of the best n seen, worst on top */
+static void sift_frame (int *ord, int n, int i, QSORT_t how)
+{
+   for (;;) {
+      int kid = 2 * i + 1, tmp;
+
+      if (kid >= n) return;
+      if (kid + 1 < n && how(&ord[kid + 1], &ord[kid]) > 0) ++kid;
+      if (how(&ord[kid], &ord[i]) <= 0) return;
+      tmp = ord[i];
+      ord[i] = ord[kid];
+      ord[kid] = tmp;
+      i = kid;
+   }
+}
+
+
+        /*
+         * Sort the frame's tasks for a window by way of an index into
+         * Frame_cols -- so only the fields not packed there cost us a
+         * trip out to each proc_t.  Tasks the window won't show (idle or
+         * not the user's) are left out, and when there's room for only
+         * 'rows' of the rest only the best 'rows' get sorted:  a heap of
+         * them is kept as the others go by.  The order is kept as one of
+         * Sort_views, and any window wanting the same one this frame (as
+         * many or fewer of it) is simply handed that.  Returns how many
+         * tasks lead the view, and sets 'view'. */
+static int sort_frame (WIN_t *q, int rows, const int **view)
+{
+   SORTV_t *v;
+   QSORT_t how;
+   int i, n, idleps = CHKw(q, Show_IDLEPS) ? 1 : 0;
+   unsigned long long t;
+
+   if (rows < 0) rows = 0;
+      /* o) made already this frame, and with enough of it sorted */
+   for (i = 0; i < GROUPSMAX; i++) {
+      v = &Sort_views[i];
+      if (v->frame == Sort_gen
+      && v->sortindx == q->sortindx
+      && v->srtflg == Frame_srtflg
+      && v->ctimes == Frame_ctimes
+      && v->cmdlin == Frame_cmdlin
+      && v->idleps == idleps
+      && !strcmp(v->usrnam, q->colusrnam)
+      && (v->n < v->rows || rows <= v->n)) {
+         PROF_COUNT(PROF_SORT_HIT, 1);
+         *view = v->ord;
+         return rows < v->n ? rows : v->n;
+      }
+   }
+
+   PROF_COUNT(PROF_SORT_MISS, 1);
+   PROF_BEGIN(t);
+      /* o) else the window's own view gets made over */
+   v = &Sort_views[q->winnum - 1];
+   if ((unsigned)Frame_cols.n > v->siz) {
+      v->siz = Frame_cols.n * 5 / 4 + 100;
+      v->ord = alloc_r(v->ord, sizeof(int) * v->siz);
+   }
+   n = 0;
+   for (i = 0; i < Frame_cols.n; i++) {
+      if ((idleps
+      || ('S' != Frame_cols.state[i] && 'Z' != Frame_cols.state[i]))
+      && ((!q->colusrnam[0])
+      || (!strcmp(q->colusrnam, Frame_cols.cold[i]->euser)) ) )
+         v->ord[n++] = i;
+   }
+
+   switch (q->sortindx) {
+      case P_PID: how = (QSORT_t)sort_col_P_PID; break;
+      case P_PPD: how = (QSORT_t)sort_col_P_PPD; break;
+      case P_NCE: how = (QSORT_t)sort_col_P_NCE; break;
+      case P_CPU: how = (QSORT_t)sort_col_P_CPU; break;
+      case P_STA: how = (QSORT_t)sort_col_P_STA; break;
+      case P_TME:
+      case P_TM2:
+         if (!Frame_ctimes) {
+            how = (QSORT_t)sort_col_P_TME;
+            break;
+         }
+         /* fall through - the children's times weren't packed */
+      default:
+         Frame_sort = Fieldstab[q->sortindx].sort;
+         how = (QSORT_t)sort_col_cold;
+         break;
+   }
+   if (rows < n) {
+      for (i = rows / 2; i-- > 0; )
+         sift_frame(v->ord, rows, i, how);
+      for (i = rows; rows && i < n; i++) {
+         if (how(&v->ord[i], &v->ord[0]) < 0) {
+            int tmp = v->ord[0];
+            v->ord[0] = v->ord[i];
+            v->ord[i] = tmp;
+            sift_frame(v->ord, rows, 0, how);
+         }
+      }
+      n = rows;
+   }
+   qsort(v->ord, (unsigned)n, sizeof(int), how);
+
+   v->frame = Sort_gen;
+   v->sortindx = q->sortindx;
+   v->srtflg = Frame_srtflg;
+   v->ctimes = Frame_ctimes;
+   v->cmdlin = Frame_cmdlin;
+   v->idleps = idleps;
+   strcpy(v->usrnam, q->colusrnam);
+   v->rows = rows;
+   v->n = n;
+   PROF_END(PROF_SORT, t);
+   *view = v->ord;
+   return n;
+}
+
+
+/*######  Batch Record routines  #########################################*/
+
+        /*
+         * Add a number -- never padded or scaled, and no printf either */
+static void rec_num (TICS_t num)
+{
+   char buf[32], *p = buf + sizeof(buf);
+
+   do *--p = '0' + num % 10; while (num /= 10);
+   scr_add(p, buf + sizeof(buf) - p);
+}
+
+
+        /*
+         * Add a signed number */
+static void rec_int (long long num)
+{
+   if (0 > num) {
+      scr_add("-", 1);
+      rec_num(-(TICS_t)num);
+   } else
+      rec_num((TICS_t)num);
+}
+
+
+        /*
+         * Add a string:  JSON escaped, or a CSV quoted field */
+static void rec_str (const char *str)
+{
+   char buf[8];
+
+   scr_add("\"", 1);
+   for (; *str; str++) {
+      unsigned char c = *str;
+
+      if ('c' == Batch_fmt) {
+         scr_add(str, 1);
+         if ('"' == c) scr_add("\"", 1);
+      } else if ('"' == c || '\\' == c) {
+         buf[0] = '\\';
+         buf[1] = c;
+         scr_add(buf, 2);
+      } else if (' ' > c || 0x7f == c) {
+         snprintf(buf, sizeof(buf), "\\u%04x", c);
+         scr_add(buf, 6);
+      } else
+         scr_add(str, 1);
+   }
+   scr_add("\"", 1);
+}
+
+
+        /*
+         * Start the next field:  its JSON key, or a CSV comma */
+static void rec_key (const char *key, int first)
+{
+   if (!first) scr_add(",", 1);
+   if ('j' == Batch_fmt) {
+      scr_add("\"", 1);
+      scr_add(key, strlen(key));
+      scr_add("\":", 2);
+   }
+}
+
+
+        /*
+         * One task, straight from its proc_t -- pcpu holds the tics it
+         * used since the last frame (since it began, the first time) */
+static void rec_task (const proc_t *p, const char *stamp)
+{
+   char cmd[BIGBUFSIZ];
+   int i;
+
+   if ('j' == Batch_fmt) scr_add("{", 1);
+   else {
+      scr_add(stamp, strlen(stamp));
+      scr_add(",", 1);
+   }
+   rec_key("pid", 1);         rec_int(p->pid);
+   rec_key("ppid", 0);        rec_int(p->ppid);
+   rec_key("pgrp", 0);        rec_int(p->pgrp);
+   rec_key("tty", 0);         rec_int(p->tty);
+   rec_key("euid", 0);        rec_int(p->euid);
+   rec_key("user", 0);        rec_str(p->euser);
+   cmd[0] = p->state;
+   cmd[1] = '\0';
+   rec_key("state", 0);       rec_str(cmd);
+   rec_key("pri", 0);         rec_int(p->priority);
+   rec_key("ni", 0);          rec_int(p->nice);
+   rec_key("processor", 0);   rec_int(p->processor);
+   rec_key("utime", 0);       rec_num(p->utime);
+   rec_key("stime", 0);       rec_num(p->stime);
+   rec_key("cutime", 0);      rec_num(p->cutime);
+   rec_key("cstime", 0);      rec_num(p->cstime);
+   rec_key("start_time", 0);  rec_num(p->start_time);
+   rec_key("tics", 0);        rec_num(p->pcpu);
+   rec_key("vsize", 0);       rec_num(p->vsize);
+   rec_key("rss", 0);         rec_int(p->rss);
+   rec_key("size", 0);        rec_int(p->size);
+   rec_key("resident", 0);    rec_int(p->resident);
+   rec_key("share", 0);       rec_int(p->share);
+   rec_key("trs", 0);         rec_int(p->trs);
+   rec_key("drs", 0);         rec_int(p->drs);
+   rec_key("dt", 0);          rec_int(p->dt);
+   rec_key("min_flt", 0);     rec_num(p->min_flt);
+   rec_key("maj_flt", 0);     rec_num(p->maj_flt);
+   if (p->cmdline && p->cmdline[0]) {
+      int len = 0;
+      for (i = 0; p->cmdline[i] && len < (int)sizeof(cmd) - 1; i++)
+         len += snprintf(cmd + len, sizeof(cmd) - len, "%s%s"
+            , i ? " " : "", p->cmdline[i]);
+   } else
+      snprintf(cmd, sizeof(cmd), "%s", p->cmd);
+   rec_key("cmd", 0);         rec_str(cmd);
+   if ('j' == Batch_fmt) scr_add("}", 1);
+   else scr_add("\n", 1);
+}
+
+
+        /*
+         * One cpu's (or all cpus') tics so far, as a JSON array */
+static void rec_cpu (const CPUS_t *cpu)
+{
+   scr_add("[", 1);
+   rec_num(cpu->u);  scr_add(",", 1);
+   rec_num(cpu->n);  scr_add(",", 1);
+   rec_num(cpu->s);  scr_add(",", 1);
+   rec_num(cpu->i);  scr_add(",", 1);
+   rec_num(cpu->w);
+   scr_add("]", 1);
+}
+
+
+        /*
+         * In place of a Batch mode frame, write records for collectors
+         * to read -- CSV, a row per task (and a header, to begin with),
+         * or JSON, a line per frame.  No scaling, no padding, it's all
+         * the raw counts, and each frame goes out in a single write. */
+static void do_records (void)
+{
+   static proc_t **p_table = NULL;
+   static CPUS_t  *smpcpu = NULL;
+   static int      heads = 0;
+   int p_flags = PROC_FILLSTAT | PROC_FILLMEM | PROC_FILLUSR;
+   struct timeval tv;
+   char stamp[SMLBUFSIZ];
+   double up, idle, av[3];
+   unsigned long long t;
+   int i;
+
+   if (CHKw(Curwin, Show_CMDLIN) || Snap_out) p_flags |= PROC_FILLCOM;
+   if (Snap_in) replay_prime(&p_table, p_flags);
+   PROF_BEGIN(t);
+   p_table = refreshprocs(p_table, p_flags);
+   PROF_END(PROF_REFRESH, t);
+   frame_states(p_table, 0);
+   if (Snap_out) record_frame(p_table);
+   if (Snap_in) {
+      tv.tv_sec = Snap_frame.sec;
+      tv.tv_usec = Snap_frame.usec;
+   } else
+      gettimeofday(&tv, NULL);
+   snprintf(stamp, sizeof(stamp), "%ld.%06ld", (long)tv.tv_sec, (long)tv.tv_usec);
+
+   Scr_len = 0;
+   if ('j' == Batch_fmt) {
+      smpcpu = refreshcpus(smpcpu);
+      refreshmem();
+      if (Snap_in) {
+         up = Snap_frame.uptime;
+         for (i = 0; i < 3; i++) av[i] = Snap_frame.loadavg[i];
+      } else {
+         uptime(&up, &idle);
+         loadavg(&av[0], &av[1], &av[2]);
+      }
+      scr_add("{\"time\":", 8);
+      scr_add(stamp, strlen(stamp));
+      snprintf(stamp, sizeof(stamp), ",\"uptime\":%.2f,\"load\":[%.2f,%.2f,%.2f]"
+         , up, av[0], av[1], av[2]);
+      scr_add(stamp, strlen(stamp));
+      scr_add(",\"cpu\":", 7);
+      rec_cpu(&smpcpu[Cpu_tot]);
+      scr_add(",\"cpus\":[", 9);
+      for (i = 0; i < Cpu_tot; i++) {
+         if (i) scr_add(",", 1);
+         rec_cpu(&smpcpu[i]);
+      }
+      scr_add("],\"mem\":{", 9);
+      rec_key("total", 1);       rec_num(kb_main_total);
+      rec_key("used", 0);        rec_num(kb_main_used);
+      rec_key("free", 0);        rec_num(kb_main_free);
+      rec_key("buffers", 0);     rec_num(kb_main_buffers);
+      rec_key("cached", 0);      rec_num(kb_main_cached);
+      rec_key("swap_total", 0);  rec_num(kb_swap_total);
+      rec_key("swap_used", 0);   rec_num(kb_swap_used);
+      rec_key("swap_free", 0);   rec_num(kb_swap_free);
+      scr_add("},\"tasks\":[", 11);
+   } else if (!heads++) {
+      static const char head[] = "time,pid,ppid,pgrp,tty,euid,user,state"
+         ",pri,ni,processor,utime,stime,cutime,cstime,start_time,tics"
+         ",vsize,rss,size,resident,share,trs,drs,dt,min_flt,maj_flt,cmd\n";
+      scr_add(head, sizeof(head) - 1);
+   }
+   for (i = 0; i < Frame_maxtask; i++) {
+      if (i && 'j' == Batch_fmt) scr_add(",", 1);
+      rec_task(p_table[i], stamp);
+   }
+   if ('j' == Batch_fmt) scr_add("]}\n", 3);
+
+   scr_flush();
+}
+
+
 /*######  Main Screen routines  ##########################################*/
 
         /*
@@ -2287,6 +3514,19 @@ static void do_key (unsigned c)
       }
          break;
 
+      case 'H':
+         Thread_mode = !Thread_mode;
+         show_msg(fmtmk("Show threads %s", Thread_mode ? "On" : "Off"));
+         break;
+
+      case 'C':
+         Cgroup_mode = !Cgroup_mode;
+            /* rollups start afresh, and 'PID' heads one way or the other */
+         roll_reset();
+         wins_resize(0);
+         show_msg(fmtmk("Show cgroups %s", Cgroup_mode ? "On" : "Off"));
+         break;
+
       case 'i':
          VIZTOGc(Show_IDLEPS);
          break;
@@ -2487,6 +3727,13 @@ static void do_key (unsigned c)
          }
          break;
 
+      case '[':           /* a replay's frames, one or 60 at a time */
+      case ']':
+      case '{':
+      case '}':
+         replay_seek(('[' == c || '{' == c ? -1 : 1) * ('[' == c || ']' == c ? 1 : 60));
+         break;
+
       case '\n':          /* just ignore these, they'll have the effect */
       case ' ':           /* of refreshing display after waking us up ! */
          break;
@@ -2497,62 +3744,97 @@ static void do_key (unsigned c)
 }
 
 
+        /*
+         * With PROCPS_PROF set, say where the frame just shown spent its
+         * time -- the first one includes priming the pump and its nap. */
+static void frame_prof (unsigned long long began)
+{
+   static unsigned long frames;
+   prof_t p;
+
+   if (!prof_enabled) return;
+   PROF_END(PROF_FRAME, began);
+   prof_take(&p, 1);
+   prof_report(&p, fmtmk("frame %lu", ++frames));
+}
+
+
         /*
          * Begin a new frame by:
          *    1) Refreshing the all important proc table
          *    2) Displaying uptime and load average (maybe)
          *    3) Arranging for task/cpu states to be displayed
          *    4) Arranging for memory & swap usage to be displayed
-         * and then, returning a pointer to the pointers to the proc_t's! */
-static proc_t **do_summary (void)
+         * and then, leaving Frame_cols packed with what the windows show! */
+static void do_summary (void)
 {
+   static const PFLG_t memflgs[] = {
+      P_COD, P_DAT, P_DRT, P_MEM, P_RES, P_SHR, P_SWP, P_VRT };
    static proc_t **p_table = NULL;
-   int p_flags = PROC_FILLMEM | PROC_FILLSTAT | PROC_FILLSTATUS;
+   int p_flags = PROC_FILLSTAT;
+   unsigned long long t;
    WIN_t *w;
+   int i;
 
-      /* first try to minimize the cost of this frame (cross your fingers) */
+      /* first try to minimize the cost of this frame (cross your fingers) --
+         only statm and status cost extra, and then just for shown/sorted
+         fields (status is wanted only for the egid behind a group name) */
    w = Curwin;
    do {
       if (!Mode_altscr || CHKw(w, VISIBLE_tsk)) {
          p_flags |= (CHKw(w, Show_CMDLIN) && win_fldviz(w, P_CMD)) ? PROC_FILLCOM : 0;
-         p_flags |= win_fldviz(w, P_USR) ? PROC_FILLUSR : 0;
-         p_flags |= win_fldviz(w, P_GRP) ? PROC_FILLGRP : 0;
+         p_flags |= win_fldneed(w, P_USR) ? PROC_FILLUSR : 0;
+         p_flags |= win_fldneed(w, P_GRP) ? PROC_FILLGRP : 0;
+         for (i = 0; i < MAXTBL(memflgs); i++)
+            if (win_fldneed(w, memflgs[i])) p_flags |= PROC_FILLMEM;
       }
       if (Mode_altscr) w = w->next;
    } while (w != Curwin);
+      /* a recording has it all, for whatever the replay may want shown */
+   if (Snap_out) p_flags |= PROC_FILLCOM | PROC_FILLMEM | PROC_FILLUSR;
 
-   if (!p_table) {
+   if (Snap_in) {
+      if (!p_table) {
+         putp(Cap_clr_scr);
+         Scr_valid = 0;
+      }
+      replay_prime(&p_table, p_flags);
+   } else if (!p_table) {
          /* whoa first time, gotta' prime the pump... */
       p_table = refreshprocs(NULL, p_flags);
       frame_states(p_table, 0);
       putp(Cap_clr_scr);
       sleep(1);
-   } else
-      putp(Batch ? "\n\n" : Cap_home);
+      Scr_valid = 0;
+   }
+   scr_begin();
 
 
       /*
        ** Display Load averages */
    if (CHKw(Curwin, View_LOADAV)) {
       if (!Mode_altscr)
-         show_special(fmtmk(LOADAV_line, Myname, sprint_uptime()));
+         show_special(fmtmk(LOADAV_line, Myname, uptime_line()));
       else
          show_special(fmtmk(CHKw(Curwin, VISIBLE_tsk)
             ? LOADAV_line_alt
             : LOADAV_line
-            , Curwin->grpname, sprint_uptime()));
+            , Curwin->grpname, uptime_line()));
       Msg_row += 1;
    }
 
       /*
        ** Display Tasks and Cpu(s) states and also prime for potential 'pcpu',
        ** but NO table sort yet -- that's done on a per window basis! */
+   PROF_BEGIN(t);
    p_table = refreshprocs(p_table, p_flags);
+   PROF_END(PROF_REFRESH, t);
    frame_states(p_table, CHKw(Curwin, View_STATES));
 
       /*
        ** Display Memory and Swap space usage */
    frame_storage();
+   if (Snap_out) record_frame(p_table);
 
 #ifndef YIELDCPU_OFF
    /* jeeze pucker up, it's time to kiss the scheduler's butt...
@@ -2566,7 +3848,8 @@ static proc_t **do_summary (void)
    sched_yield();
 #endif
    SETw(Curwin, NEWFRAM_cwo);
-   return p_table;
+      /* the windows get the cgroups, having rolled up the tasks */
+   if (Cgroup_mode) roll_end();
 
 #undef myCMD
 #undef myGRP
@@ -2575,64 +3858,42 @@ static proc_t **do_summary (void)
 
         /*
          * Squeeze as many tasks as we can into a single window,
-         * after sorting the passed proc table. */
-static void do_window (proc_t **ppt, WIN_t *q, int *lscr)
-{
-#ifdef SORT_SUPRESS
-   /* the 1 flag that DOES and 2 flags that MAY impact our proc table qsort */
-#define srtMASK  ~( Qsrt_NORMAL | Show_CMDLIN | Show_CTIMES )
-   static PFLG_t sav_indx = 0;
-   static int    sav_flgs = -1;
-#endif
-   int i, lwin;
+         * in the order sort_frame gives it. */
+static void do_window (WIN_t *q, int *lscr)
+{
+   const int *view;
+   int i, lwin, rows, shown;
 
       /*
        ** Display Column Headings -- and distract 'em while we sort (maybe) */
    PUTP("\n%s%s%s%s", q->capclr_hdr, q->columnhdr, Caps_off, Cap_clr_eol);
-
-#ifdef SORT_SUPRESS
-   if (CHKw(Curwin, NEWFRAM_cwo)
-   || sav_indx != q->sortindx
-   || sav_flgs != (q->winflags & srtMASK)) {
-      sav_indx = q->sortindx;
-      sav_flgs = (q->winflags & srtMASK);
-#endif
-                                                /* this one's always needed! */
-      if (CHKw(q, Qsrt_NORMAL)) Frame_srtflg = 1;
-         else Frame_srtflg = -1;
-      Frame_ctimes = CHKw(q, Show_CTIMES);      /* this and next, only maybe */
-      Frame_cmdlin = CHKw(q, Show_CMDLIN);
-      qsort(ppt, (unsigned)Frame_maxtask, sizeof(proc_t *)
-         , Fieldstab[q->sortindx].sort);
-#ifdef SORT_SUPRESS
-   }
-#endif
       /* account for column headings */
    if (!Batch) (*lscr)++;
+
+      /* how many rows our loop below can possibly fill */
+   rows = Batch ? Frame_cols.n : Max_lines - *lscr;
+   if (q->winlines && q->winlines < rows) rows = q->winlines;
+
+   if (CHKw(q, Qsrt_NORMAL)) Frame_srtflg = 1;
+      else Frame_srtflg = -1;
+   Frame_ctimes = CHKw(q, Show_CTIMES);         /* this and next, only maybe */
+   Frame_cmdlin = CHKw(q, Show_CMDLIN);
+   shown = sort_frame(q, rows, &view);
    lwin = 1;
    i = 0;
 
-   while ( -1 != ppt[i]->pid && *lscr < Max_lines
+   while ( i < shown && *lscr < Max_lines
    &&  (!q->winlines || (lwin <= q->winlines)) ) {
-      if ((CHKw(q, Show_IDLEPS)
-      || ('S' != ppt[i]->state && 'Z' != ppt[i]->state))
-      && ((!q->colusrnam[0])
-      || (!strcmp(q->colusrnam, ppt[i]->euser)) ) ) {
-            /*
-             ** Display a process Row */
-         show_a_task(q, ppt[i]);
-         if (!Batch) (*lscr)++;
-         ++lwin;
-      }
+         /*
+          ** Display a process Row */
+      show_a_task(q, Frame_cols.cold[view[i]]);
+      if (!Batch) (*lscr)++;
+      ++lwin;
       ++i;
    }
       /* for this frame that window's toast, cleanup for next time */
    q->winlines = 0;
    OFFw(Curwin, FLGSOFF_cwo);
-
-#ifdef SORT_SUPRESS
-#undef srtMASK
-#endif
 }
 
 
@@ -2692,29 +3953,35 @@ static void sohelpme (int wix, int max)
          */
 static void so_lets_see_em (void)
 {
-   proc_t **ppt;
    int i, scrlins;
+   unsigned long long t;
 
+   PROF_BEGIN(t);
    Msg_row = scrlins = 0;
-   ppt = do_summary();
+   if (Batch_fmt) {
+      do_records();
+      frame_prof(t);
+      return;
+   }
+   do_summary();
    Max_lines = (Screen_rows - Msg_row) - 1;
 
    if (CHKw(Curwin, EQUWINS_cwo))
       wins_reflag(Flags_OFF, EQUWINS_cwo);
 
       /* sure hope each window's columns header begins with a newline... */
-   putp(tg2(0, Msg_row));
+   scr_goto(Msg_row);
 
    if (!Mode_altscr) {
          /* only 1 window to show so, piece o' cake */
       Curwin->winlines = Curwin->maxtasks;
-      do_window(ppt, Curwin, &scrlins);
+      do_window(Curwin, &scrlins);
    } else {
          /* maybe NO window is visible but assume, pieces o' cakes */
       for (i = 0 ; i < GROUPSMAX; i++) {
          if (CHKw(Winstk[i], VISIBLE_tsk)) {
             sohelpme(i, Max_lines - scrlins);
-            do_window(ppt, Winstk[i], &scrlins);
+            do_window(Winstk[i], &scrlins);
          }
          if (Max_lines <= scrlins) break;
       }
@@ -2722,8 +3989,8 @@ static void so_lets_see_em (void)
    /* clear to end-of-screen (critical if last window is 'idleps off'),
       then put the cursor in-its-place, and rid us of any prior frame's msg
       (main loop must iterate such that we're always called before sleep) */
-   PUTP("%s%s%s", Cap_clr_eos, tg2(0, Msg_row), Cap_clr_eol);
-   fflush(stdout);
+   scr_end(Msg_row);
+   frame_prof(t);
 }
 
 
@@ -2783,17 +4050,21 @@ int main (int dont_care_argc, char **argv)
       if (Msg_awaiting) show_msg(Msg_delayed);
       if (0 < Loops) --Loops;
       if (!Loops) stop(0);
+      if (Snap_in) replay_next();
 
-      if (Batch)
-         sleep((unsigned)Delay_time);
+      if (Batch) {
+         if (!Snap_in) sleep((unsigned)Delay_time);
+      }
       else {                             /*  Linux reports time not slept, */
          tv.tv_sec = Delay_time;         /*  so we must reinit every time. */
          tv.tv_usec = (Delay_time - (int)Delay_time) * 1000000;
          FD_ZERO(&fs);
          FD_SET(STDIN_FILENO, &fs);
          if (0 < select(STDIN_FILENO+1, &fs, NULL, NULL, &tv)
-         &&  0 < chin(0, &c, 1))
+         &&  0 < chin(0, &c, 1)) {
             do_key((unsigned)c);
+            Scr_valid = 0;                /* who knows what it wrote */
+         }
       }
    }
 
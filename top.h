@@ -25,7 +25,6 @@
 //#define CASEUP_SCALE            /* show scaled time/num suffix upper case  */
 //#define CASEUP_SUMMK            /* show memory summary kilobytes with 'K'  */
 //#define POSIX_CMDLIN            /* use '[ ]' for kernel threads, not '( )' */
-//#define SORT_SUPRESS            /* *attempt* to reduce qsort overhead      */
 //#define USE_LIB_STA3            /* use lib status (3 ch) vs. proc_t (1 ch) */
 //#define WARN_NOT_SMP            /* restrict '1' & 'I' commands to true smp */
 
@@ -37,6 +36,7 @@
 //#define YIELDCPU_OFF            /* hang on tight, DON'T issue sched_yield  */
 
 #ifdef PRETEND2_5_X
+#undef linux_version_code
 #define linux_version_code LINUX_VERSION(2,5,43)
 #endif
 
@@ -54,6 +54,14 @@
         /* Specific process id monitoring support (command line only) */
 #define MONPIDMAX  20
 
+        /* With smp, frames of at least this many tasks are read by
+           libproc worker threads instead of our persistent PROCTAB */
+#define THREADMIN  2000
+
+        /* Starting number of buckets for the frame_states pid hash,
+           which then doubles as needed (it must be a power of 2) */
+#define HHASH_MIN  1024
+
         /* Miscellaneous buffer sizes with liberal values
            -- mostly just to pinpoint source code usage/dependancies */
 #define SCREENMAX   512
@@ -76,13 +84,19 @@
 
 /*######  Some Miscellaneous Macro definitions  ##########################*/
 
+        /* Yield a pid's bucket in a hash of (power of 2) 'sz' buckets */
+#define HHASH_key(pid,sz)  (int)((unsigned)(pid) & ((sz) - 1))
+        /* ...and of cgroups, by the address of the string they're known by */
+#define RHASH_key(key,sz)  (int)((unsigned)((unsigned long)(key) >> 4) * 2654435761u & ((sz) - 1))
+
         /* Yield table size as 'int' */
 #define MAXTBL(t)  (int)(sizeof(t) / sizeof(t[0]))
 
         /* Convert some proc stuff into vaules we can actually use */
 #define BYTES_2K(n)  (unsigned)( (n) >> 10 )
 #define PAGES_2B(n)  (unsigned)( (n) * Page_size )
-#define PAGES_2K(n)  BYTES_2K(PAGES_2B(n))
+        /* (not by way of bytes, which a cgroup's sums can run past 4g of) */
+#define PAGES_2K(n)  (unsigned)( (unsigned long long)(n) * Page_size >> 10 )
 #define PAGE_CNT(n)  (unsigned)( (n) / Page_size )
 
         /* Used as return arguments in *some* of the sort callbacks */
@@ -111,13 +125,24 @@
    static int sort_ ## f (const proc_t **P, const proc_t **Q) { \
       return Frame_srtflg * strcmp((*Q)->s, (*P)->s); }
 
+        /* And the same for those fields kept in the frame's packed columns,
+           where what gets sorted is an index into them -- no proc_t's! */
+#define _SC_COL1(f,c) \
+   static int sort_col_ ## f (const int *P, const int *Q) { \
+      if ( Frame_cols.c[*P] < Frame_cols.c[*Q] ) return SORT_lt; \
+      if ( Frame_cols.c[*P] > Frame_cols.c[*Q] ) return SORT_gt; \
+      return SORT_eq; }
+#define _SC_COLx(f,c) \
+   static int sort_col_ ## f (const int *P, const int *Q) { \
+      return Frame_srtflg * ( Frame_cols.c[*Q] - Frame_cols.c[*P] ); }
+
         /* Used to 'inline' those portions of the display requiring formatting
            while ensuring we won't be blindsided by some whacko terminal's
            '$<..>' (millesecond delay) lurking in a terminfo string.  */
 #define PUTP(fmt,arg...) do { \
            char _str[ROWBUFSIZ]; \
            snprintf(_str, sizeof(_str), fmt, ## arg); \
-           putp(_str); \
+           scr_putp(_str); \
         } while (0);
 
 /*------  Special Macros (debug and/or informative)  ---------------------*/
@@ -161,9 +186,40 @@ typedef struct {
            and save data that goes unused like the old top! */
 typedef struct {
    int    pid;
+   int    lnk;  /* next HIST_t in this pid's hash chain, or -1 */
    TICS_t tics;
 } HIST_t;
 
+        /* This structure is one cgroup's 'task', its tasks rolled up --
+           kept from one frame to the next, so its time can simply grow
+           by each frame's elapsed tics (see roll_task) */
+typedef struct {
+   proc_t      p;       /* what a window shows and sorts, pid = tasks */
+   const char *key;     /* the cgroup, as cgroup_of handed it out     */
+   char       *argv[2]; /* p.cmdline: a copy of key, for 'c' to show  */
+   int         lnk;     /* next ROLL_t in this key's hash chain, or -1 */
+   int         born;    /* the pass it first had tasks in             */
+   int         seen;    /* ...and the last                            */
+} ROLL_t;
+
+        /* This structure is one window's sorted view of a frame -- the
+           order, as indexes into Frame_cols, of what that window shows.
+           A window wanting the same order in the same frame just takes
+           another's (see sort_frame) */
+typedef struct {
+   int         frame;   /* Sort_gen when made, else it's stale        */
+   PFLG_t      sortindx;
+   int         srtflg,  /* the rest of the key: direction, ctimes &   */
+               ctimes,  /*    cmdlin (which the sort may look at)     */
+               cmdlin,
+               idleps;  /* ...and what picked the tasks to sort       */
+   char        usrnam [USRNAMSIZ];
+   int         rows,    /* how many it meant to sort...               */
+               n;       /* ...and did, fewer meaning that's all shown */
+   int        *ord;     /* room for siz of them                       */
+   unsigned    siz;
+} SORTV_t;
+
         /* This structure stores a frame's cpu tics used in history
            calculations.  It exists primarily for SMP support but serves
            all environments. */
@@ -174,6 +230,20 @@ typedef struct {
    TICS_t u_sav, s_sav, n_sav, i_sav, w_sav;
 } CPUS_t;
 
+        /* These structures hold one screen row, as a frame left it (or
+           will leave it), and then each character it shows -- so only
+           what changes between frames need be sent. */
+typedef struct {
+   char *txt;   /* the row's bytes, less its clr_eol */
+   int   len, siz;
+} SROW_t;
+
+typedef struct {
+   unsigned char ch;
+   unsigned      hue;   /* hash of all the escape seqs ahead of ch */
+   int           off;   /* where ch is in its row's bytes */
+} SCEL_t;
+
         /* The scaling 'type' used with scale_num() -- this is how
            the passed number is interpreted should scaling be necessary */
 enum scale_num {
@@ -324,7 +394,7 @@ typedef struct win {
            see 'show_special' for syntax details + other cautions. */
 #define LOADAV_line  "%s -%s\n"
 #define LOADAV_line_alt  "%s\06 -%s\n"
-#define STATES_line1  "Tasks:\03" \
+#define STATES_line1  "%s:\03" \
    " %3u \02total,\03 %3u \02running,\03 %3u \02sleeping,\03 %3u \02stopped,\03 %3u \02zombie\03\n"
 #define STATES_line2x4  "%s\03" \
    " %#5.1f%% \02user,\03 %#5.1f%% \02system,\03 %#5.1f%% \02nice,\03 %#5.1f%% \02idle\03\n"
@@ -350,6 +420,9 @@ typedef struct win {
    "\n" \
    "  l,t,m     Toggle Summary: '\01l\02' load avg; '\01t\02' task/cpu stats; '\01m\02' mem info\n" \
    "  1,I       Toggle SMP view: '\0011\02' single/separate states; '\01I\02' Irix/Solaris mode\n" \
+   "  H         Toggle threads: each thread shown as a task of its own\n" \
+   "  C         Toggle cgroups: a row for each, its tasks rolled up\n" \
+   "  [,],{,}   Replay (-R): '\01[\02' '\01]\02' back/on a frame; '\01{\02' '\01}\02' sixty frames\n" \
    "  Z\05         Change color mappings\n" \
    "\n" \
    "  f,o     . Fields/Columns: '\01f\02' add or remove; '\01o\02' change display order\n" \
@@ -502,11 +575,29 @@ typedef struct win {
 /*------  Sort callbacks  ------------------------------------------------*/
 /*        for each possible field, in the form of:                        */
 /*atic int         sort_P_XXX (const proc_t **P, const proc_t **Q);       */
+/*        and for those fields kept in Frame_cols:                        */
+/*atic int         sort_col_P_XXX (const int *P, const int *Q);           */
+//atic int         sort_col_cold (const int *P, const int *Q);
 /*------  Tiny useful routine(s)  ----------------------------------------*/
 //atic int         chin (int ech, char *buf, unsigned cnt);
 //atic const char *fmtmk (const char *fmts, ...);
 //atic char       *strim (int sp, char *str);
 //atic const char *tg2 (int x, int y);
+/*------  Screen Output routines  ----------------------------------------*/
+//atic void        scr_add (const char *str, int len);
+//atic int         scr_outb (int c);
+//atic void        scr_flush (void);
+//atic void        scr_send (const char *str);
+//atic int         scr_outc (int c);
+//atic void        scr_putp (const char *str);
+//atic int         scr_esclen (const char *str, int max);
+//atic int         scr_cells (const SROW_t *r, SCEL_t *cel);
+//atic void        scr_span (const SROW_t *r, const SCEL_t *cel, int n, int x, int end, int y);
+//atic void        scr_diff (int y);
+//atic void        scr_unclr (SROW_t *r);
+//atic void        scr_begin (void);
+//atic void        scr_goto (int y);
+//atic void        scr_end (int y);
 /*------  Exit/Interrput routines  ---------------------------------------*/
 //atic void        bye_bye (int eno, const char *str);
 //atic void        stop (int dont_care_sig);
@@ -530,6 +621,16 @@ typedef struct win {
 //atic void       *alloc_r (void *q, unsigned numb);
 //atic CPUS_t     *refreshcpus (CPUS_t *cpus);
 //atic proc_t    **refreshprocs (proc_t **table, int flags);
+/*------  Record/Replay routines  ----------------------------------------*/
+//atic void        record_open (const char *path);
+//atic void        replay_open (const char *path);
+//atic int         replay_load (int frame);
+//atic void        replay_next (void);
+//atic void        replay_seek (int by);
+//atic void        record_frame (proc_t **ppt);
+//atic void        replay_prime (proc_t ***p_table, int flags);
+//atic void        refreshmem (void);
+//atic const char *uptime_line (void);
 /*------  Startup routines  ----------------------------------------------*/
 //atic void        before (char *me);
 //atic void        configs_read (void);
@@ -544,6 +645,7 @@ typedef struct win {
 /*------  Windows/Field Groups support  ----------------------------------*/
 //atic void        win_colsheads (WIN_t *q);
 //atic inline int  win_fldviz (WIN_t *q, int flg);
+//atic inline int  win_fldneed (WIN_t *q, int flg);
 //atic void        win_names (WIN_t *q, const char *name);
 //atic void        win_select (char ch);
 //atic int         win_warn (void);
@@ -553,16 +655,32 @@ typedef struct win {
 //atic void        wins_resize (int dont_care_sig);
 //atic void        windows_stage1 (void);
 //atic void        windows_stage2 (void);
+/*------  Cgroup Rollup routines  ----------------------------------------*/
+//atic void        roll_begin (void);
+//atic void        roll_rehash (void);
+//atic void        roll_reset (void);
+//atic void        roll_task (const proc_t *t, TICS_t tics);
+//atic void        roll_end (void);
 /*------  Per-Frame Display support  -------------------------------------*/
 //atic void        cpudo (CPUS_t *cpu, const char *pfx);
 //atic void        frame_states (proc_t **ppt, int show);
 //atic void        frame_storage (void);
 //atic void        mkcol (WIN_t *q, PFLG_t idx, int sta, int *pad, char *buf, ...);
 //atic void        show_a_task (WIN_t *q, proc_t *task);
+//atic void        sift_frame (int *ord, int n, int i, QSORT_t how);
+//atic int         sort_frame (WIN_t *q, int rows, const int **view);
+/*------  Batch Record routines  -----------------------------------------*/
+//atic void        rec_num (TICS_t num);
+//atic void        rec_int (long long num);
+//atic void        rec_str (const char *str);
+//atic void        rec_key (const char *key, int first);
+//atic void        rec_task (const proc_t *p, const char *stamp);
+//atic void        rec_cpu (const CPUS_t *cpu);
+//atic void        do_records (void);
 /*------  Main Screen routines  ------------------------------------------*/
 //atic void        do_key (unsigned c);
-//atic proc_t    **do_summary (void);
-//atic void        do_window (proc_t **ppt, WIN_t *q, int *lscr);
+//atic void        do_summary (void);
+//atic void        do_window (WIN_t *q, int *lscr);
 //atic void        sohelpme (int wix, int max);
 //atic void        so_lets_see_em (void);
 /*------  Entry point  ---------------------------------------------------*/
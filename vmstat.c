@@ -26,6 +26,8 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <time.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
@@ -44,6 +46,10 @@ typedef unsigned long long jiff;
 
 static int a_option; /* "-a" means "show active/inactive" */
 
+/* procs_running and procs_blocked, when /proc/stat has them (2.5.45+) */
+static int have_procs;
+static unsigned procs_running, procs_blocked;
+
 /****************************************************************/
 
 
@@ -52,7 +58,7 @@ static void usage(void) {
   fprintf(stderr,"              -V prints version.\n");
   fprintf(stderr,"              -n causes the headers not to be reprinted regularly.\n");
   fprintf(stderr,"              -a print inactive/active page stats.\n");
-  fprintf(stderr,"              delay is the delay between updates in seconds. \n");
+  fprintf(stderr,"              delay is the delay between updates in seconds (0.01 and up). \n");
   fprintf(stderr,"              count is the number of updates.\n");
   exit(EXIT_FAILURE);
 }
@@ -86,39 +92,37 @@ static void showheader(void){
 static void getstat(jiff *cuse, jiff *cice, jiff *csys, jiff *cide, jiff *ciow,
 	     unsigned *pin, unsigned *pout, unsigned *s_in, unsigned *sout,
 	     unsigned *itot, unsigned *i1, unsigned *ct) {
-  static int Stat;
   int need_extra_file = 0;
+  char* sbuf = sysinfo_file(SYSINFO_STAT, NULL);
   char* b;
-  buff[BUFFSIZE-1] = 0;  /* ensure null termination in buffer */
 
-  if(Stat){
-    lseek(Stat, 0L, SEEK_SET);
-  }else{
-    Stat = open("/proc/stat", O_RDONLY, 0);
-    if(Stat == -1) crash("/proc/stat");
-  }
-  read(Stat,buff,BUFFSIZE-1);
   *itot = 0; 
   *i1 = 1;   /* ensure assert below will fail if the sscanf bombs */
   *ciow = 0;  /* not separated out until the 2.5.41 kernel */
 
-  b = strstr(buff, "cpu ");
+  b = strstr(sbuf, "cpu ");
   if(b) sscanf(b,  "cpu  %Lu %Lu %Lu %Lu %Lu", cuse, cice, csys, cide, ciow);
 
-  b = strstr(buff, "page ");
+  b = strstr(sbuf, "page ");
   if(b) sscanf(b,  "page %u %u", pin, pout);
   else need_extra_file = 1;
 
-  b = strstr(buff, "swap ");
+  b = strstr(sbuf, "swap ");
   if(b) sscanf(b,  "swap %u %u", s_in, sout);
   else need_extra_file = 1;
 
-  b = strstr(buff, "intr ");
+  b = strstr(sbuf, "intr ");
   if(b) sscanf(b,  "intr %u %u", itot, i1);
 
-  b = strstr(buff, "ctxt ");
+  b = strstr(sbuf, "ctxt ");
   if(b) sscanf(b,  "ctxt %u", ct);
 
+  /* the kernel counts these for us, sparing getrunners() a walk of /proc */
+  b = strstr(sbuf, "procs_running ");
+  have_procs = b && sscanf(b, "procs_running %u", &procs_running) == 1;
+  b = strstr(sbuf, "procs_blocked ");
+  have_procs = have_procs && b && sscanf(b, "procs_blocked %u", &procs_blocked) == 1;
+
   if(need_extra_file){  /* 2.5.40-bk4 and above */
     vminfo();
     *pin  = vm_pgpgin;
@@ -141,6 +145,12 @@ static void getrunners(unsigned int *running, unsigned int *blocked,
   *blocked=0;
   *swapped=0;
 
+  if (have_procs) {  /* from getstat(), which must come first */
+    *running = procs_running;
+    *blocked = procs_blocked;
+    goto self;
+  }
+
   if ((proc=opendir("/proc"))==NULL) crash("/proc");
 
   while((ent=readdir(proc))) {
@@ -172,6 +182,7 @@ static void getrunners(unsigned int *running, unsigned int *blocked,
   }
   closedir(proc);
 
+self:
 #if 1
   /* is this next line a good idea?  It removes this thing which
      uses (hopefully) little time, from the count of running processes */
@@ -179,6 +190,29 @@ static void getrunners(unsigned int *running, unsigned int *blocked,
 #endif
 }
 
+/* Sleep until the next multiple of `period' since the first sample, so
+ * the time a sample takes doesn't push back all those after it.  Running
+ * late (stopped, or a slow terminal) just starts the schedule over.
+ */
+static void tick(struct timespec *next, const struct timespec *period) {
+  struct timespec now;
+
+  next->tv_sec += period->tv_sec;
+  next->tv_nsec += period->tv_nsec;
+  if (next->tv_nsec >= 1000000000L) {
+    next->tv_nsec -= 1000000000L;
+    next->tv_sec++;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (now.tv_sec > next->tv_sec
+   || (now.tv_sec == next->tv_sec && now.tv_nsec >= next->tv_nsec)) {
+    *next = now;
+    return;
+  }
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL) == EINTR)
+    ;
+}
+
 
 
 
@@ -197,13 +231,14 @@ int main(int argc, char *argv[]) {
   jiff duse,dsys,didl,Div,divo2;
   unsigned int pgpgin[2], pgpgout[2], pswpin[2], pswpout[2];
   unsigned int inter[2],ticks[2],ctxt[2];
-  unsigned int per=0, pero2; 
+  double per=1.0;  /* seconds, maybe a fraction of one */
+  struct timespec period, next;
+  char *end;
   unsigned long num=0;
   unsigned int kb_per_page = sysconf(_SC_PAGESIZE) / 1024;
 
   setlinebuf(stdout);
   argc=0; /* redefined as number of integer arguments */
-  per=1;
   num=0;
   for (argv++;*argv;argv++) {
     if ('-' ==(**argv)) {
@@ -227,7 +262,8 @@ int main(int argc, char *argv[]) {
       argc++;
       switch (argc) {
       case 1:
-        if ((per = atoi(*argv)) == 0)
+        per = strtod(*argv, &end);
+        if (end == *argv || !(per >= 0.01))
          usage();
        num = ULONG_MAX;
        break;
@@ -245,14 +281,16 @@ int main(int argc, char *argv[]) {
       height=((tmp>0)?tmp:22);
   }    
 
-  pero2=(per/2);
+  period.tv_sec = (time_t)per;
+  period.tv_nsec = (long)((per - period.tv_sec) * 1e9);
   showheader();
 
-  getrunners(&running,&blocked,&swapped);
   meminfo();
   getstat(cpu_use,cpu_nic,cpu_sys,cpu_idl,cpu_iow,
 	  pgpgin,pgpgout,pswpin,pswpout,
 	  inter,ticks,ctxt);
+  getrunners(&running,&blocked,&swapped);
+  clock_gettime(CLOCK_MONOTONIC, &next);
   duse= *cpu_use + *cpu_nic; 
   dsys= *cpu_sys + *cpu_iow;  /* ADC -- add IO-wait here? */
   didl= *cpu_idl;
@@ -276,33 +314,35 @@ int main(int argc, char *argv[]) {
   );
 
   for(i=1;i<num;i++) { /* \\\\\\\\\\\\\\\\\\\\ main loop ////////////////// */
-    sleep(per);
+    tick(&next, &period);
     if (moreheaders && ((i%height)==0)) showheader();
     tog= !tog;
 
-    getrunners(&running,&blocked,&swapped);
     meminfo();
     getstat(cpu_use+tog,cpu_nic+tog,cpu_sys+tog,cpu_idl+tog,cpu_iow+tog,
 	  pgpgin+tog,pgpgout+tog,pswpin+tog,pswpout+tog,
 	  inter+tog,ticks+tog,ctxt+tog);
+    getrunners(&running,&blocked,&swapped);
     duse= cpu_use[tog]-cpu_use[!tog] + cpu_nic[tog]-cpu_nic[!tog];
     dsys= cpu_sys[tog]-cpu_sys[!tog] + cpu_iow[tog]-cpu_iow[!tog];
     didl= cpu_idl[tog]-cpu_idl[!tog];
     /* idle can run backwards for a moment -- kernel "feature" */
     if(cpu_idl[tog]<cpu_idl[!tog]) didl=0;
     Div= duse+dsys+didl;
+    /* a short enough delay can pass without a single clock tick */
+    if(!Div) Div=1;
     divo2= Div/2UL;
     printf(format,
 	   running,blocked,swapped,
 	   kb_swap_used,kb_main_free,
 	   a_option?kb_inactive:kb_main_buffers,
 	   a_option?kb_inactive:kb_main_cached,
-	   (unsigned)( ( (pswpin [tog] - pswpin [!tog])*kb_per_page+pero2 )/per ),
-	   (unsigned)( ( (pswpout[tog] - pswpout[!tog])*kb_per_page+pero2 )/per ),
-	   (unsigned)( (  pgpgin [tog] - pgpgin [!tog]             +pero2 )/per ),
-	   (unsigned)( (  pgpgout[tog] - pgpgout[!tog]             +pero2 )/per ),
-	   (unsigned)( (  inter  [tog] - inter  [!tog]             +pero2 )/per ),
-	   (unsigned)( (  ctxt   [tog] - ctxt   [!tog]             +pero2 )/per ),
+	   (unsigned)( (pswpin [tog] - pswpin [!tog])*kb_per_page / per + 0.5 ),
+	   (unsigned)( (pswpout[tog] - pswpout[!tog])*kb_per_page / per + 0.5 ),
+	   (unsigned)( (pgpgin [tog] - pgpgin [!tog])             / per + 0.5 ),
+	   (unsigned)( (pgpgout[tog] - pgpgout[!tog])             / per + 0.5 ),
+	   (unsigned)( (inter  [tog] - inter  [!tog])             / per + 0.5 ),
+	   (unsigned)( (ctxt   [tog] - ctxt   [!tog])             / per + 0.5 ),
 	   (unsigned)( (100*duse+divo2)/Div ),
 	   (unsigned)( (100*dsys+divo2)/Div ),
 	   (unsigned)( (100*didl+divo2)/Div )
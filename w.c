@@ -123,44 +123,130 @@ static void print_logintime(time_t logt, FILE* fout) {
 }
 
 
+/* The process table, indexed once by pid and by tty so that each utmp
+ * entry looks at only its own processes.  A tty's chain runs in table
+ * order, which is the order getproc() used to meet them in on its scan
+ * of the whole table:  that order still decides the ties.
+ */
+static struct slot { int key, pos; } *pid_slots, *tty_slots;  /* pos -1: empty */
+static unsigned slot_mask;
+static int *tty_next;		/* table position of the next on that tty, or -1 */
+
+static struct slot *slot_find(struct slot *t, int key) {
+    unsigned h = ((unsigned)key * 2654435761u) & slot_mask;
+
+    while (t[h].pos != -1 && t[h].key != key)
+	h = (h + 1) & slot_mask;
+    return &t[h];
+}
+
+static void index_procs(void) {
+    struct slot *s;
+    unsigned size;
+    int i, n;
+
+    for (n = 0; procs[n]; n++)
+	;
+    for (size = 64; size < 2U * n; size *= 2)
+	;
+    slot_mask = size - 1;
+    pid_slots = xmalloc(size * sizeof *pid_slots);
+    tty_slots = xmalloc(size * sizeof *tty_slots);
+    for (i = 0; i < (int)size; i++)
+	pid_slots[i].pos = tty_slots[i].pos = -1;
+    tty_next = xmalloc((n + 1) * sizeof *tty_next);
+    for (i = n - 1; i >= 0; i--) {	/* backwards, to push each on the front */
+	s = slot_find(pid_slots, procs[i]->pid);
+	s->key = procs[i]->pid;
+	s->pos = i;
+	s = slot_find(tty_slots, procs[i]->tty);
+	tty_next[i] = s->pos;
+	s->key = procs[i]->tty;
+	s->pos = i;
+    }
+}
+
+/* getpwnam() for a utmp user name, remembered:  a busy host has many
+ * sessions apiece for rather fewer users.  Returns 0 if there's no such user.
+ */
+static int user_uid(const char *name, unsigned *uid) {
+    static struct uname {
+	struct uname *next;
+	unsigned uid;
+	int known;
+	char name[UT_NAMESIZE+1];
+    } *hash[64];
+    struct uname *e;
+    struct passwd *passwd_data;   /* pointer to static data */
+    unsigned h = 0;
+    const char *cp;
+
+    for (cp = name; *cp; cp++)
+	h = h * 31 + (unsigned char)*cp;
+    for (e = hash[h % 64]; e; e = e->next)
+	if (!strcmp(e->name, name))
+	    break;
+    if (!e) {
+	e = xmalloc(sizeof *e);
+	strcpy(e->name, name);
+	passwd_data = getpwnam(name);
+	e->known = passwd_data != NULL;
+	e->uid = e->known ? passwd_data->pw_uid : ~0U;
+	e->next = hash[h % 64];
+	hash[h % 64] = e;
+    }
+    *uid = e->uid;
+    return e->known;
+}
+
+
 /* This function scans the process table accumulating total cpu times for
  * any processes "associated" with this login session.  It also searches
  * for the "best" process to report as "(w)hat" the user for that login
  * session is doing currently.  This the essential core of 'w'.
  */
 static proc_t *getproc(utmp_t *u, char *tty, unsigned long long *jcpu, int *found_utpid) {
-    int line;
-    proc_t **p, *best = NULL, *secondbest = NULL;
+    int line, i, utpid, at;
+    proc_t *p, *best = NULL, *secondbest = NULL;
     unsigned uid = ~0U;
 
     if(!ignoreuser){
       char buf[UT_NAMESIZE+1];
-      struct passwd *passwd_data;   /* pointer to static data */
       strncpy(buf,u->ut_user,UT_NAMESIZE);
       buf[UT_NAMESIZE] = '\0';
-      passwd_data = getpwnam(buf);
-      if(!passwd_data) return NULL;
-      uid = passwd_data->pw_uid;
-      /* OK to have passwd_data go out of scope here */
+      if(!user_uid(buf, &uid)) return NULL;
     }
     line = tty_to_dev(tty);
     *jcpu = *found_utpid = 0;
-    for(p = procs; *p; p++) {
-	if((**p).pid == u->ut_pid) {
+    /* the tty's processes, with the login process merged in where the
+       scan would have come to it */
+    utpid = slot_find(pid_slots, u->ut_pid)->pos;
+    i = slot_find(tty_slots, line)->pos;
+    while (i != -1 || utpid != -1) {
+	if (utpid != -1 && (i == -1 || utpid <= i)) {
+	    if ((at = utpid) == i)
+		i = tty_next[i];
+	    utpid = -1;
+	} else {
+	    at = i;
+	    i = tty_next[i];
+	}
+	p = procs[at];
+	if(p->pid == u->ut_pid) {
         *found_utpid = 1;
-        best = *p;
+        best = p;
     }
-	if((**p).tty != line) continue;
-        (*jcpu) += (**p).utime + (**p).stime;
-        secondbest = *p;
+	if(p->tty != line) continue;
+        (*jcpu) += p->utime + p->stime;
+        secondbest = p;
         /* same time-logic here as for "best" below */
-        if(!  (secondbest && (**p).start_time <= secondbest->start_time)  ){
-          secondbest = *p;
+        if(!  (secondbest && p->start_time <= secondbest->start_time)  ){
+          secondbest = p;
         }
-        if(!ignoreuser && uid != (**p).euid && uid != (**p).ruid) continue;
-        if((**p).pid != (**p).tpgid) continue;
-        if(best && (**p).start_time <= best->start_time) continue;
-    	best = *p;
+        if(!ignoreuser && uid != p->euid && uid != p->ruid) continue;
+        if(p->pid != p->tpgid) continue;
+        if(best && p->start_time <= best->start_time) continue;
+    	best = p;
     }
     return best ? best : secondbest;
 }
@@ -271,7 +357,8 @@ int main(int argc, char **argv) {
     if (maxcmd < 3)
 	fprintf(stderr, "warning: screen width %d suboptimal.\n", win.ws_col);
 
-    procs = readproctab(PROC_FILLCOM | PROC_FILLUSR);
+    procs = readproctab_parallel(PROC_FILLCOM | PROC_FILLUSR, 0);
+    index_procs();
 
     if (header) {				/* print uptime and headers */
 	print_uptime();
@@ -12,6 +12,8 @@
 #define VERSION "0.2.0"
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <signal.h>
 #include <ncurses.h>
@@ -19,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <locale.h>
@@ -42,6 +45,17 @@ static int height=24, width=80;
 static int screen_size_changed=0;
 static int first_screen=1;
 
+/* what each cell of the output area last showed, and whether it was then
+ * highlighted;  only the cells which differ are handed to curses */
+static unsigned char *shown;
+static unsigned char *shown_attr;
+static int shown_cells;
+
+/* the command's output, read off its pipe a bufferful at a time */
+static int out_fd = -1, out_eof;
+static char out_buf[65536];
+static int out_pos, out_len;
+
 
 #define min(x,y) ((x) > (y) ? (y) : (x))
 
@@ -79,6 +93,91 @@ winch_handler(int notused)
 }
 
 
+static int
+out_getc(void)
+{
+  if (out_pos == out_len)
+    {
+      if (out_eof)
+	return EOF;
+      do
+	out_len = read(out_fd, out_buf, sizeof out_buf);
+      while (out_len < 0 && errno == EINTR);
+      out_pos = 0;
+      if (out_len <= 0)
+	{
+	  out_len = 0;
+	  out_eof = 1;
+	  return EOF;
+	}
+    }
+  return (unsigned char)out_buf[out_pos++];
+}
+
+
+/* like popen(command, "r"), but we do the reading ourselves */
+static pid_t
+start_command(const char *command)
+{
+  int fds[2];
+  pid_t pid;
+
+  if (pipe(fds) == -1)
+    {
+      perror("pipe");
+      do_exit(2);
+    }
+  if ((pid = fork()) == -1)
+    {
+      perror("fork");
+      do_exit(2);
+    }
+  if (pid == 0)
+    {
+      close(fds[0]);
+      if (fds[1] != 1)
+	{
+	  dup2(fds[1], 1);
+	  close(fds[1]);
+	}
+      execl("/bin/sh", "sh", "-c", command, (char *) 0);
+      _exit(127);
+    }
+  close(fds[1]);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  out_fd = fds[0];
+  out_eof = out_pos = out_len = 0;
+  return pid;
+}
+
+
+/* an interval is timed from the start of one run to that of the next, not
+ * from the end of the last; should a run take longer than the interval,
+ * the next simply starts at once */
+static void
+wait_interval(struct timespec *next, double interval)
+{
+  struct timespec now;
+  long ns;
+
+  next->tv_sec += (time_t) interval;
+  ns = next->tv_nsec + (long) ((interval - (time_t) interval) * 1e9);
+  next->tv_sec += ns / 1000000000L;
+  next->tv_nsec = ns % 1000000000L;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (now.tv_sec > next->tv_sec
+      || (now.tv_sec == next->tv_sec && now.tv_nsec >= next->tv_nsec))
+    {
+      *next = now;
+      return;
+    }
+  /* a resize cuts the wait short, as sleep() used to */
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL) == EINTR
+	 && !screen_size_changed)
+    ;
+}
+
+
 static void
 get_terminal_size(void)
 {
@@ -101,7 +200,8 @@ main(int argc, char *argv[])
     option_differences_cumulative=0,
     option_help=0,
     option_version=0;
-  int interval=2;
+  double interval=2;
+  struct timespec next;
   char *command;
   int command_length=0;		/* not including final \0 */
 
@@ -124,8 +224,8 @@ main(int argc, char *argv[])
 	case 'n':
 	  {
 	    char *str;
-	    interval = strtol(optarg, &str, 10);
-	    if (!*optarg || *str)
+	    interval = strtod(optarg, &str);
+	    if (!*optarg || *str || !(interval >= 0.1))
 	      do_usage();
 	  }
 	  break;
@@ -151,7 +251,7 @@ main(int argc, char *argv[])
       fputs("  -d, --differences[=cumulative]\thighlight changes between updates\n", stderr);
       fputs("\t\t(cumulative means highlighting is cumulative)\n", stderr);
       fputs("  -h, --help\t\t\t\tprint a summary of the options\n", stderr);
-      fputs("  -n, --interval=<seconds>\t\tseconds to wait between updates\n", stderr);
+      fputs("  -n, --interval=<seconds>\t\tseconds to wait between updates (0.1 and up)\n", stderr);
       fputs("  -v, --version\t\t\t\tprint the version number\n", stderr);
       exit(0);
     }
@@ -187,6 +287,7 @@ main(int argc, char *argv[])
   nonl();
   noecho();
   cbreak();
+  clock_gettime(CLOCK_MONOTONIC, &next);
 
   for(;;)
     {
@@ -194,8 +295,8 @@ main(int argc, char *argv[])
       char *ts = ctime(&t);
       int tsl = strlen(ts);
       char *header;
-      FILE *p;
-      int x, y;
+      pid_t pid;
+      int x, y, i;
 
       if (screen_size_changed)
 	{
@@ -206,10 +307,21 @@ main(int argc, char *argv[])
 	  screen_size_changed = 0;
 	  first_screen = 1;
 	}
+      if (shown_cells != height * width)
+	{
+	  shown_cells = height * width;
+	  shown = realloc(shown, shown_cells);
+	  shown_attr = realloc(shown_attr, shown_cells);
+	  if (!shown || !shown_attr)
+	    {
+	      perror("realloc");
+	      do_exit(2);
+	    }
+	}
 
       /* left justify interval and command, right justify time, clipping all
 	 to fit window width */
-      asprintf(&header, "Every %ds: %.*s",
+      asprintf(&header, "Every %gs: %.*s",
 	       interval, min(width-1, command_length), command);
       mvaddstr(0, 0, header);
       if (strlen(header) > (size_t)(width - tsl - 1))
@@ -217,11 +329,7 @@ main(int argc, char *argv[])
       mvaddstr(0, width - tsl + 1, ts);
       free(header);
 
-      if (!(p = popen(command, "r")))
-	{
-	  perror("popen");
-	  do_exit(2);
-	}
+      pid = start_command(command);
 
       for (y=2; y<height; y++)
 	{
@@ -237,7 +345,7 @@ main(int argc, char *argv[])
 		     next stop instead of reading characters */
 		  if (!tabpending)
 		    do
-		      c = getc(p);
+		      c = out_getc();
 		    while (c != EOF && !isprint(c) && c != '\n' && c != '\t');
 		  if (c == '\n')
 		    if (x == 0) {
@@ -252,16 +360,16 @@ main(int argc, char *argv[])
 		  if (tabpending && (((x + 1) % 8) == 0))
 		    tabpending = 0;
 		}
-	      move(y, x);
+	      i = y * width + x;
 	      if (option_differences)
-		{
-		  int oldch = inch();
-		  char oldc = oldch & A_CHARTEXT;
-		  attr = !first_screen
-		    && (c != oldc
-			|| (option_differences_cumulative
-			    && (oldch & A_ATTRIBUTES)));
-		}
+		attr = !first_screen
+		  && (c != shown[i]
+		      || (option_differences_cumulative && shown_attr[i]));
+	      if (!first_screen && c == shown[i] && attr == shown_attr[i])
+		continue;
+	      shown[i] = c;
+	      shown_attr[i] = attr;
+	      move(y, x);
 	      if (attr)
 		standout();
 	      addch(c);
@@ -270,11 +378,13 @@ main(int argc, char *argv[])
 	    }
 	}
 
-      pclose(p);
+      close(out_fd);
+      while (waitpid(pid, NULL, 0) == -1 && errno == EINTR)
+	;
 
       first_screen = 0;
       refresh();
-      sleep(interval);
+      wait_interval(&next, interval);
     }
 
   endwin();